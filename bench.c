@@ -0,0 +1,591 @@
+// 채팅 서버 부하 생성 및 지연 시간 측정 도구
+//
+// 로컬 서버에 가상 클라이언트를 여러 개 접속시키고, 그중 일부가 정해진 속도로 메시지를 보내면
+// 나머지가 받은 메시지의 payload에 들어 있는 보낸 시각으로 종단 간 브로드캐스트 지연 시간을 잰다.
+// 부하 생성기가 먼저 한계에 닿지 않도록 클라이언트를 여러 스레드(-j)에 나눠 각자 epoll로 처리한다.
+// 결과는 사람이 읽을 요약을 표준 에러로, 비교하기 쉬운 JSON 한 줄을 표준 출력으로 낸다.
+// -A로 서버 관리 소켓을 주면 측정 전후의 서버 통계를 비교해 받은 메시지 하나당 서버가 사용자 공간에서 복사한
+// 바이트와 보낸 메시지 하나당 malloc으로 새로 할당한 버퍼 수도 낸다.
+//
+//  예) ./server -m epoll && ./bench -c 2000 -s 20 -r 50 -b 128 -d 10 -j 4 -p $(pgrep -n server) -l epoll 127.0.0.1
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "protocol.h"
+
+#define MAX_EVENTS 256
+#define HIST_SUB 64         // 지연 시간 히스토그램에서 2의 거듭제곱 구간마다 나누는 칸 수 (오차 약 1.5%)
+#define HIST_BUCKETS (HIST_SUB * 60)
+#define PAYLOAD_TAG "BENCH"
+#define LOGIN_TIMEOUT_MS 60000  // 모든 클라이언트가 로그인할 때까지 기다리는 시간
+#define DRAIN_MS 2000       // 보내기를 멈춘 뒤 남은 메시지를 기다리는 시간
+#define ADMIN_TEXT_MAX (64 * 1024)  // 관리 소켓에서 읽는 통계 텍스트 최대 크기
+
+enum BenchProto {
+    BENCH_LEGACY,           // struct LoginInfo / struct Message
+    BENCH_FRAME             // 가변 길이 프레임
+};
+
+// 가상 클라이언트 하나
+struct BenchConn {
+    int fd;
+    int logged_in;
+    uint64_t next_send;     // 다음 메시지를 보낼 시각 (나노초)
+    struct FrameReader reader;
+    char *out;              // 소켓이 가득 차서 아직 보내지 못한 데이터
+    size_t out_off, out_len;
+};
+
+// 부하 생성 스레드 하나 (클라이언트 i % n_workers == index를 맡음)
+struct Worker {
+    int index;
+    int epfd;
+    int n_conns;            // 맡은 클라이언트 수
+    int logins;             // 로그인을 마친 클라이언트 수
+    int failed;
+    uint64_t sent, delivered, foreign, send_blocked;
+    uint64_t lat_sum, lat_max;
+    uint64_t hist[HIST_BUCKETS];    // 지연 시간 히스토그램 (마이크로초)
+    pthread_t thread;
+};
+
+// 설정
+static int n_clients = 1000;
+static int n_senders = 10;
+static int n_workers = 1;
+static double rate = 10.0;      // 보내는 클라이언트 하나가 초당 보내는 메시지 수
+static size_t msg_size = 64;    // 메시지 내용 크기
+static double duration = 10.0;  // 측정 시간 (초)
+static int proto = BENCH_LEGACY;
+static int port = TCP_PORT;
+static pid_t server_pid = 0;    // RSS와 CPU 사용량을 잴 서버 프로세스 (0이면 재지 않음)
+static const char *admin_path = NULL;   // 복사한 바이트와 할당 횟수를 읽을 서버 관리 소켓 (NULL이면 읽지 않음)
+static const char *label = "";
+static struct sockaddr_in server_addr;
+
+// 스레드 사이에서 단계를 맞추는 데 쓰는 값 (장벽 사이에서 main 스레드만 씀)
+static struct BenchConn *conns;
+static struct Worker *workers;
+static pthread_barrier_t barrier;
+static uint64_t start_ns;       // 측정 시작 시각
+static uint64_t total_sent;     // 모든 스레드가 보낸 메시지 수 (남은 메시지를 기다릴 때 사용)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 마이크로초 값이 들어갈 히스토그램 칸
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);    // v는 [2^e, 2^(e+1)) 구간
+    int idx = HIST_SUB + (e - 6) * HIST_SUB + (int)((v >> (e - 6)) - HIST_SUB);
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+// 히스토그램 칸의 대표값 (칸의 가장 작은 값)
+static uint64_t hist_value(int idx) {
+    if (idx < HIST_SUB) return idx;
+    int e = (idx - HIST_SUB) / HIST_SUB + 6;
+    return (uint64_t)(HIST_SUB + (idx - HIST_SUB) % HIST_SUB) << (e - 6);
+}
+
+static uint64_t percentile(const struct Worker *w, double p) {
+    uint64_t total = 0, seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) total += w->hist[i];
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(p * total);
+    if (rank >= total) rank = total - 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += w->hist[i];
+        if (seen > rank) return hist_value(i);
+    }
+    return w->lat_max;
+}
+
+// 서버 프로세스와 그 자식 프로세스(fork 모드)의 CPU 시간과 RSS 합계
+struct ProcStats {
+    double cpu_sec;
+    long rss_kb;
+    int procs;
+};
+
+static int read_proc_stat(pid_t pid, pid_t *ppid, double *cpu_sec, long *rss_kb) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    char *p = strrchr(buf, ')');    // 프로세스 이름에 공백이 있을 수 있으므로 마지막 ')' 뒤부터 읽음
+    if (p == NULL) return -1;
+    int parent;
+    unsigned long utime, stime;
+    long rss;
+    if (sscanf(p + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+               &parent, &utime, &stime, &rss) != 4) {
+        return -1;
+    }
+    *ppid = parent;
+    *cpu_sec = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+    *rss_kb = rss * (sysconf(_SC_PAGESIZE) / 1024);
+    return 0;
+}
+
+static struct ProcStats server_stats(void) {
+    struct ProcStats st = { 0 };
+    if (server_pid <= 0) return st;
+    DIR *dir = opendir("/proc");
+    if (dir == NULL) return st;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        pid_t pid = atoi(de->d_name);
+        pid_t ppid;
+        double cpu;
+        long rss;
+        if (pid <= 0 || read_proc_stat(pid, &ppid, &cpu, &rss) < 0) continue;
+        if (pid == server_pid || ppid == server_pid) {
+            st.cpu_sec += cpu;
+            st.rss_kb += rss;
+            st.procs++;
+        }
+    }
+    closedir(dir);
+    return st;
+}
+
+// 서버 관리 소켓에서 읽은 버퍼 관련 통계
+struct ServerCounters {
+    int ok;
+    uint64_t copied;        // chat_bytes_copied_total
+    uint64_t allocs;        // chat_buffer_heap_allocs_total
+};
+
+// 통계 텍스트에서 "이름 값" 줄을 찾아 값을 반환 (없으면 0)
+static uint64_t counter_value(const char *text, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = text; p != NULL; p = strchr(p, '\n')) {
+        if (*p == '\n') p++;
+        if (strncmp(p, name, len) == 0 && p[len] == ' ') return strtoull(p + len + 1, NULL, 10);
+    }
+    return 0;
+}
+
+// 관리 소켓에서 통계 스냅샷 하나를 읽음 (관리 소켓이 없거나 읽지 못하면 ok가 0)
+static struct ServerCounters server_counters(void) {
+    static char text[ADMIN_TEXT_MAX];
+    struct ServerCounters sc = { 0 };
+    if (admin_path == NULL) return sc;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, admin_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return sc;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return sc;
+    }
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(text) - 1 && (n = read(fd, text + len, sizeof(text) - 1 - len)) > 0) len += n;
+    close(fd);
+    text[len] = '\0';
+
+    sc.ok = (strstr(text, "chat_bytes_copied_total ") != NULL);
+    sc.copied = counter_value(text, "chat_bytes_copied_total");
+    sc.allocs = counter_value(text, "chat_buffer_heap_allocs_total");
+    return sc;
+}
+
+static void set_events(struct Worker *w, struct BenchConn *c, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// 데이터를 보내고 남은 것은 쌓아 두었다가 EPOLLOUT 때 보냄 (1: 보냄, 0: 앞서 보내지 못한 데이터가 있어 건너뜀)
+static int conn_send(struct Worker *w, struct BenchConn *c, const char *data, size_t len) {
+    if (c->out_off < c->out_len) {
+        w->send_blocked++;
+        return 0;
+    }
+    ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        n = 0;
+    }
+    if ((size_t)n < len) {
+        memcpy(c->out, data + n, len - n);
+        c->out_off = 0;
+        c->out_len = len - n;
+        set_events(w, c, EPOLLIN | EPOLLOUT);
+    }
+    return 1;
+}
+
+static int conn_flush(struct Worker *w, struct BenchConn *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        c->out_off += n;
+    }
+    c->out_off = c->out_len = 0;
+    set_events(w, c, EPOLLIN);
+    return 0;
+}
+
+// 보낸 시각을 payload 앞부분에 넣은 메시지를 보냄
+static int send_message(struct Worker *w, struct BenchConn *c) {
+    char text[BUFSIZ];
+    char wire[sizeof(struct Message) + FRAME_HEADER_LEN];
+    int head = snprintf(text, sizeof(text), PAYLOAD_TAG " %llu ", (unsigned long long)now_ns());
+    size_t len = msg_size > (size_t)head ? msg_size : (size_t)head;
+    memset(text + head, 'x', len - head);
+
+    size_t wire_len;
+    if (proto == BENCH_LEGACY) {
+        struct Message *msg = (struct Message *)wire;
+        memset(msg, 0, sizeof(*msg));
+        memcpy(msg->content, text, len);
+        wire_len = sizeof(struct Message);
+    } else {
+        wire_len = frame_encode(wire, FRAME_CHAT, NULL, 0, text, len);
+    }
+    int ret = conn_send(w, c, wire, wire_len);
+    if (ret > 0) w->sent++;
+    return ret < 0 ? -1 : 0;
+}
+
+// 받은 메시지의 payload에서 보낸 시각을 읽어 지연 시간을 기록
+static void record_message(struct Worker *w, const char *text, size_t len) {
+    size_t tag = sizeof(PAYLOAD_TAG);   // 태그와 공백
+    uint64_t ts = 0;
+    size_t i;
+    if (len <= tag || memcmp(text, PAYLOAD_TAG " ", tag) != 0) {  // 안내 메시지나 다시 보내 준 이전 메시지
+        w->foreign++;
+        return;
+    }
+    for (i = tag; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+        ts = ts * 10 + (text[i] - '0');
+    }
+    uint64_t now = now_ns();
+    uint64_t lat = now > ts ? (now - ts) / 1000 : 0;
+    w->hist[hist_index(lat)]++;
+    w->lat_sum += lat;
+    if (lat > w->lat_max) w->lat_max = lat;
+    w->delivered++;
+}
+
+// 받은 데이터를 처리 (-1: 연결 종료나 프로토콜 오류)
+static int conn_recv(struct Worker *w, struct BenchConn *c) {
+    while (1) {
+        size_t avail;
+        char *space = frame_reader_space(&c->reader, &avail);
+        if (space == NULL) return -1;
+        ssize_t n = recv(c->fd, space, avail, 0);
+        if (n == 0) return -1;
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        frame_reader_commit(&c->reader, n);
+
+        while (1) {
+            if (proto == BENCH_LEGACY) {
+                if (!c->logged_in) {    // 로그인 결과는 null 종료 문자열
+                    const char *reply = frame_reader_take(&c->reader, strlen("로그인 성공") + 1);
+                    if (reply == NULL) break;
+                    c->logged_in = 1;
+                    w->logins++;
+                    continue;
+                }
+                const struct Message *msg = (const void *)frame_reader_take(&c->reader, sizeof(struct Message));
+                if (msg == NULL) break;
+                record_message(w, msg->content, strnlen(msg->content, BUFSIZ));
+            } else {
+                struct Frame f;
+                int ret = frame_reader_next(&c->reader, &f);
+                if (ret < 0) return -1;
+                if (ret == 0) break;
+                if (f.type == FRAME_LOGIN_OK) {
+                    c->logged_in = 1;
+                    w->logins++;
+                } else if (f.type == FRAME_CHAT) {
+                    record_message(w, f.payload, f.len);
+                } else {
+                    return -1;
+                }
+            }
+        }
+    }
+}
+
+// 서버에 접속하고 로그인 정보를 보냄
+static int conn_open(struct Worker *w, struct BenchConn *c, int i) {
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0) return -1;
+    if (connect(c->fd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) return -1;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+
+    c->out = malloc(sizeof(struct Message) + FRAME_HEADER_LEN);
+    if (c->out == NULL || frame_reader_init(&c->reader, 2 * sizeof(struct Message)) < 0) return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) return -1;
+
+    char id[MAX_ID_LEN];
+    char wire[sizeof(struct LoginInfo) + FRAME_HEADER_LEN + MAX_ID_LEN];
+    size_t len;
+    snprintf(id, sizeof(id), "bench%d", i);
+    if (proto == BENCH_LEGACY) {
+        struct LoginInfo *login = (struct LoginInfo *)wire;
+        memset(login, 0, sizeof(*login));
+        strcpy(login->id, id);
+        len = sizeof(struct LoginInfo);
+    } else {
+        len = frame_encode(wire, FRAME_LOGIN, id, strlen(id), "bench", 5);
+    }
+    return conn_send(w, c, wire, len) < 0 ? -1 : 0;
+}
+
+// 이벤트를 처리하며 until까지 실행 (sending이면 맡은 클라이언트 중 보내는 클라이언트가 일정에 맞춰 보냄)
+// done이 0이 아니면 조건을 만족할 때 일찍 끝냄
+static int run_until(struct Worker *w, uint64_t until, int sending, int (*done)(struct Worker *)) {
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        uint64_t now = now_ns();
+        if (now >= until || (done && done(w))) return 0;
+
+        uint64_t wake = until;
+        if (sending) {
+            for (int i = w->index; i < n_senders; i += n_workers) {
+                struct BenchConn *c = &conns[i];
+                while (c->next_send <= now) {
+                    if (send_message(w, c) < 0) return -1;
+                    c->next_send += (uint64_t)(1e9 / rate);
+                }
+                if (c->next_send < wake) wake = c->next_send;
+            }
+        }
+
+        int timeout = (int)((wake - now + 999999) / 1000000);
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < n; i++) {
+            struct BenchConn *c = events[i].data.ptr;
+            if ((events[i].events & EPOLLOUT) && conn_flush(w, c) < 0) {
+                fprintf(stderr, "send(): %s\n", strerror(errno));
+                return -1;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && conn_recv(w, c) < 0) {
+                fprintf(stderr, "서버가 연결을 끊었습니다. (클라이언트 %d)\n", (int)(c - conns));
+                return -1;
+            }
+        }
+    }
+}
+
+static int all_logged_in(struct Worker *w) {
+    return w->logins >= w->n_conns;
+}
+
+// 맡은 수신자에게 와야 할 메시지를 모두 받았는지 (보낸 사람에게는 돌아오지 않음)
+static int all_delivered(struct Worker *w) {
+    return w->delivered >= total_sent * w->n_conns - w->sent;
+}
+
+// 부하 생성 스레드: 접속과 로그인, 측정, 남은 메시지 수신을 main 스레드와 장벽으로 맞춰 진행
+static void *worker_main(void *arg) {
+    struct Worker *w = arg;
+    for (int i = w->index; i < n_clients && !w->failed; i += n_workers) {
+        if (conn_open(w, &conns[i], i) < 0) {
+            fprintf(stderr, "connect(%d): %s\n", i, strerror(errno));
+            w->failed = 1;
+        }
+        w->n_conns++;
+        if (w->n_conns % 64 == 0 && run_until(w, now_ns(), 0, NULL) < 0) w->failed = 1;  // 로그인 응답을 틈틈이 받음
+    }
+    if (!w->failed && run_until(w, now_ns() + LOGIN_TIMEOUT_MS * 1000000ULL, 0, all_logged_in) < 0) w->failed = 1;
+    pthread_barrier_wait(&barrier);     // 모두 로그인함
+
+    pthread_barrier_wait(&barrier);     // main 스레드가 측정 시작 시각을 정함
+    memset(w->hist, 0, sizeof(w->hist));
+    w->delivered = w->foreign = w->lat_sum = w->lat_max = 0;
+    if (!w->failed && run_until(w, start_ns + (uint64_t)(duration * 1e9), 1, NULL) < 0) w->failed = 1;
+    pthread_barrier_wait(&barrier);     // 모두 보내기를 멈춤
+
+    pthread_barrier_wait(&barrier);     // main 스레드가 전체 보낸 수를 셈
+    if (!w->failed && run_until(w, now_ns() + DRAIN_MS * 1000000ULL, 0, all_delivered) < 0) w->failed = 1;
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage : %s [-c clients] [-s senders] [-r msgs/sec/sender] [-b bytes] [-d seconds] [-j threads]\n"
+                    "          [-P legacy|frame] [-t port] [-p server_pid] [-A admin_socket] [-l label] IP_ADDRESS\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:r:b:d:j:P:t:p:A:l:")) != -1) {
+        switch (opt) {
+        case 'c': n_clients = atoi(optarg); break;
+        case 's': n_senders = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'b': msg_size = strtoul(optarg, NULL, 10); break;
+        case 'd': duration = atof(optarg); break;
+        case 'j': n_workers = atoi(optarg); break;
+        case 'P':
+            if (strcmp(optarg, "legacy") == 0) {
+                proto = BENCH_LEGACY;
+            } else if (strcmp(optarg, "frame") == 0) {
+                proto = BENCH_FRAME;
+            } else {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 't': port = atoi(optarg); break;
+        case 'p': server_pid = atoi(optarg); break;
+        case 'A': admin_path = optarg; break;
+        case 'l': label = optarg; break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind >= argc || n_clients < 2 || n_senders < 1 || n_senders > n_clients || rate <= 0 ||
+        msg_size >= BUFSIZ || duration <= 0 || n_workers < 1 || n_workers > n_clients) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    // 클라이언트 수만큼 파일 디스크립터를 열 수 있도록 한도를 올림
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)n_clients + 64) {
+        rl.rlim_cur = (rlim_t)n_clients + 64 < rl.rlim_max ? (rlim_t)n_clients + 64 : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, argv[optind], &server_addr.sin_addr) != 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    conns = calloc(n_clients, sizeof(struct BenchConn));
+    workers = calloc(n_workers, sizeof(struct Worker));
+    if (conns == NULL || workers == NULL) {
+        perror("calloc()");
+        return -1;
+    }
+    pthread_barrier_init(&barrier, NULL, n_workers + 1);
+
+    // 접속과 로그인 (앞쪽 n_senders개가 메시지를 보냄)
+    uint64_t t0 = now_ns();
+    for (int k = 0; k < n_workers; k++) {
+        workers[k].index = k;
+        workers[k].epfd = epoll_create1(0);
+        if (workers[k].epfd < 0 || pthread_create(&workers[k].thread, NULL, worker_main, &workers[k]) != 0) {
+            perror("worker");
+            return -1;
+        }
+    }
+    pthread_barrier_wait(&barrier);
+    int logins = 0, failed = 0;
+    for (int k = 0; k < n_workers; k++) {
+        logins += workers[k].logins;
+        failed |= workers[k].failed;
+    }
+    if (failed || logins < n_clients) {
+        fprintf(stderr, "로그인 실패: %d/%d\n", logins, n_clients);
+        return -1;
+    }
+    double login_sec = (now_ns() - t0) / 1e9;
+
+    // 측정 (보내는 시각을 고르게 흩어 놓음)
+    struct ProcStats before = server_stats();
+    struct ServerCounters counters_before = server_counters();
+    start_ns = now_ns();
+    for (int i = 0; i < n_senders; i++) {
+        conns[i].next_send = start_ns + (uint64_t)(1e9 / rate) * i / n_senders;
+    }
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+    struct ProcStats after = server_stats();
+    double elapsed = (now_ns() - start_ns) / 1e9;
+
+    // 보내기를 멈추고 아직 도착하지 않은 메시지를 받음
+    total_sent = 0;
+    for (int k = 0; k < n_workers; k++) total_sent += workers[k].sent;
+    pthread_barrier_wait(&barrier);
+
+    // 스레드별 결과를 합침
+    struct Worker *sum = calloc(1, sizeof(struct Worker));
+    for (int k = 0; k < n_workers; k++) {
+        struct Worker *w = &workers[k];
+        pthread_join(w->thread, NULL);
+        failed |= w->failed;
+        sum->sent += w->sent;
+        sum->delivered += w->delivered;
+        sum->foreign += w->foreign;
+        sum->send_blocked += w->send_blocked;
+        sum->lat_sum += w->lat_sum;
+        if (w->lat_max > sum->lat_max) sum->lat_max = w->lat_max;
+        for (int i = 0; i < HIST_BUCKETS; i++) sum->hist[i] += w->hist[i];
+    }
+    if (failed) return -1;
+    struct ServerCounters counters_after = server_counters();    // 남은 메시지까지 다 받은 뒤 (전달에 든 복사를 모두 포함)
+
+    uint64_t expected = sum->sent * (n_clients - 1);    // 보낸 사람에게는 돌아오지 않음
+    double cpu_pct = (elapsed > 0 && after.procs > 0) ? (after.cpu_sec - before.cpu_sec) / elapsed * 100.0 : 0;
+    uint64_t p50 = percentile(sum, 0.50), p99 = percentile(sum, 0.99), p999 = percentile(sum, 0.999);
+    double mean = sum->delivered ? (double)sum->lat_sum / sum->delivered : 0;
+    unsigned long long sent = sum->sent, delivered = sum->delivered;
+    int have_counters = counters_before.ok && counters_after.ok;
+    double copied_per_msg = (have_counters && delivered) ? (double)(counters_after.copied - counters_before.copied) / delivered : 0;
+    double allocs_per_msg = (have_counters && sent) ? (double)(counters_after.allocs - counters_before.allocs) / sent : 0;
+
+    fprintf(stderr,
+            "[%s] %s 클라이언트 %d명 (보내는 클라이언트 %d명, %.1f msg/s, %zu바이트, 스레드 %d개), 로그인 %.2f초\n"
+            "  보냄 %llu (%.0f msg/s), 받음 %llu/%llu (%.0f msg/s), 소켓이 가득 차서 건너뜀 %llu\n"
+            "  지연 시간 p50 %lluus p99 %lluus p999 %lluus 최대 %lluus 평균 %.0fus\n"
+            "  서버 CPU %.1f%% RSS %ldKB (프로세스 %d개)\n",
+            label, proto == BENCH_LEGACY ? "legacy" : "frame", n_clients, n_senders, rate, msg_size, n_workers,
+            login_sec, sent, sent / elapsed, delivered, (unsigned long long)expected, delivered / elapsed,
+            (unsigned long long)sum->send_blocked, (unsigned long long)p50, (unsigned long long)p99,
+            (unsigned long long)p999, (unsigned long long)sum->lat_max, mean, cpu_pct, after.rss_kb, after.procs);
+    if (have_counters) {
+        fprintf(stderr, "  서버 복사 %.1f바이트/받은 메시지, 힙 할당 %.3f회/보낸 메시지\n", copied_per_msg, allocs_per_msg);
+    }
+
+    printf("{\"label\":\"%s\",\"proto\":\"%s\",\"clients\":%d,\"senders\":%d,\"threads\":%d,\"rate\":%.2f,"
+           "\"size\":%zu,\"duration_s\":%.3f,\"login_s\":%.3f,\"sent\":%llu,\"delivered\":%llu,\"expected\":%llu,"
+           "\"send_blocked\":%llu,\"send_rate\":%.1f,\"deliver_rate\":%.1f,"
+           "\"latency_us\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"mean\":%.1f},"
+           "\"server\":{\"pid\":%d,\"procs\":%d,\"cpu_pct\":%.1f,\"rss_kb\":%ld,"
+           "\"copied_per_delivered\":%.1f,\"heap_allocs_per_sent\":%.3f}}\n",
+           label, proto == BENCH_LEGACY ? "legacy" : "frame", n_clients, n_senders, n_workers, rate, msg_size,
+           elapsed, login_sec, sent, delivered, (unsigned long long)expected,
+           (unsigned long long)sum->send_blocked, sent / elapsed, delivered / elapsed,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+           (unsigned long long)sum->lat_max, mean, (int)server_pid, after.procs, cpu_pct, after.rss_kb,
+           copied_per_msg, allocs_per_msg);
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "buffer.h"
+#include "metrics.h"
+
+// 크기 등급별 블록 풀 (메시지마다 만들고 버리는 버퍼를 malloc/free 없이 재사용)
+// 스레드마다 등급별 캐시를 두어 잠금 없이 꺼내고 넣으며, 캐시가 비거나 넘치면 공용 저장소와 묶음 단위로 주고받는다.
+// 다른 스레드가 해제한 블록(다른 샤드로 넘긴 버퍼)은 해제한 스레드의 캐시로 들어가 공용 저장소를 거쳐 돌아온다.
+static const struct {
+    size_t size;            // 블록에 담을 수 있는 크기 (헤더 제외)
+    unsigned cache_max;     // 스레드 캐시가 붙잡아 두는 최대 블록 수 (넘으면 절반을 공용 저장소로)
+    unsigned depot_max;     // 공용 저장소가 보관하는 최대 블록 수 (넘으면 free)
+} pool_class[POOL_CLASSES] = {
+    { 64, 256, 16384 },             // 샤드 사이 메시지
+    { 256, 256, 16384 },            // 짧은 채팅 프레임
+    { 1024, 128, 4096 },
+    { 4096, 64, 1024 },             // io_uring 송신 요청
+    { 16 * 1024, 16, 256 },         // 구 버전 struct Message
+    { 80 * 1024, 4, 32 },           // 가장 큰 프레임 (payload 64KB + 헤더)
+};
+
+// 블록 앞에 붙는 헤더 (할당된 동안은 등급, 풀에 있는 동안은 다음 블록)
+union PoolHeader {
+    int cls;                // 크기 등급 (-1이면 풀을 거치지 않은 큰 블록)
+    union PoolHeader *next;
+    max_align_t align;      // 데이터가 어떤 형식이든 담을 수 있도록 정렬
+};
+
+struct PoolList {
+    union PoolHeader *head;
+    unsigned count;
+};
+
+static __thread struct PoolList pool_cache[POOL_CLASSES];
+static struct PoolList pool_depot[POOL_CLASSES];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;   // pool_depot을 보호
+
+static int pool_class_of(size_t size) {
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        if (size <= pool_class[i].size) return i;
+    }
+    return -1;
+}
+
+// 목록 앞에서 최대 n개를 떼어 다른 목록 앞에 붙임 (옮긴 개수 반환)
+static unsigned pool_move(struct PoolList *from, struct PoolList *to, unsigned n) {
+    unsigned moved = 0;
+    while (moved < n && from->head != NULL) {
+        union PoolHeader *h = from->head;
+        from->head = h->next;
+        h->next = to->head;
+        to->head = h;
+        moved++;
+    }
+    from->count -= moved;
+    to->count += moved;
+    return moved;
+}
+
+// size 바이트를 담을 블록 할당 (내용은 초기화하지 않음)
+void *pool_alloc(size_t size) {
+    int cls = pool_class_of(size);
+    union PoolHeader *h;
+    if (cls >= 0) {
+        struct PoolList *cache = &pool_cache[cls];
+        if (cache->head == NULL) {    // 캐시가 비었으면 공용 저장소에서 절반만큼 가져옴
+            pthread_mutex_lock(&pool_lock);
+            pool_move(&pool_depot[cls], cache, pool_class[cls].cache_max / 2);
+            pthread_mutex_unlock(&pool_lock);
+        }
+        if ((h = cache->head) != NULL) {
+            cache->head = h->next;
+            cache->count--;
+            h->cls = cls;
+            return h + 1;
+        }
+    }
+    h = malloc(sizeof(union PoolHeader) + (cls >= 0 ? pool_class[cls].size : size));
+    if (h == NULL) return NULL;
+    metric_add(MC_BUF_ALLOCS, 1);
+    h->cls = cls;
+    return h + 1;
+}
+
+// 블록을 현재 스레드의 캐시에 반납 (캐시가 가득 차면 절반을 공용 저장소로, 공용 저장소도 가득 차면 free)
+void pool_free(void *p) {
+    if (p == NULL) return;
+    union PoolHeader *h = (union PoolHeader *)p - 1;
+    int cls = h->cls;
+    if (cls < 0) {
+        free(h);
+        return;
+    }
+    struct PoolList *cache = &pool_cache[cls];
+    if (cache->count == pool_class[cls].cache_max) {
+        struct PoolList spill = { NULL, 0 };
+        pool_move(cache, &spill, cache->count / 2);
+        pthread_mutex_lock(&pool_lock);
+        unsigned room = pool_class[cls].depot_max - pool_depot[cls].count;
+        pool_move(&spill, &pool_depot[cls], room);
+        pthread_mutex_unlock(&pool_lock);
+        while (spill.head != NULL) {
+            union PoolHeader *next = spill.head->next;
+            free(spill.head);
+            spill.head = next;
+        }
+    }
+    h->next = cache->head;
+    cache->head = h;
+    cache->count++;
+}
+
+// len 바이트 데이터를 담을 버퍼 생성 (참조 수 1, 풀에서 할당)
+struct SharedBuf *sbuf_new(size_t len) {
+    struct SharedBuf *b = pool_alloc(sizeof(struct SharedBuf) + len);
+    if (b == NULL) return NULL;
+    atomic_init(&b->refs, 1);
+    b->len = len;
+    return b;
+}
+
+// 데이터를 복사해 버퍼 생성
+struct SharedBuf *sbuf_from(const void *data, size_t len) {
+    struct SharedBuf *b = sbuf_new(len);
+    if (b == NULL) return NULL;
+    memcpy(b->data, data, len);
+    metric_add(MC_BYTES_COPIED, len);
+    return b;
+}
+
+struct SharedBuf *sbuf_ref(struct SharedBuf *b) {
+    atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+    return b;
+}
+
+void sbuf_unref(struct SharedBuf *b) {
+    if (b != NULL && atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) {
+        pool_free(b);
+    }
+}
+
+// 대기열 끝에 버퍼 참조를 추가 (참조 하나를 대기열이 가져감)
+int outq_push(struct OutQueue *q, struct SharedBuf *b) {
+    if (q->count == q->cap) {    // 가득 차면 두 배로 늘리고 원형 배열을 앞에서부터 다시 배치
+        unsigned cap = q->cap ? q->cap * 2 : 8;
+        struct SharedBuf **bufs = malloc(cap * sizeof(struct SharedBuf *));
+        if (bufs == NULL) return -1;
+        for (unsigned i = 0; i < q->count; i++) {
+            bufs[i] = q->bufs[(q->head + i) & (q->cap - 1)];
+        }
+        free(q->bufs);
+        q->bufs = bufs;
+        q->cap = cap;
+        q->head = 0;
+    }
+    q->bufs[(q->head + q->count) & (q->cap - 1)] = b;
+    q->count++;
+    q->bytes += b->len;
+    metric_add(MC_MSG_OUT, 1);
+    metric_add(MC_OUTQ_BYTES, b->len);
+    return 0;
+}
+
+// 앞에서부터 최대 max개의 버퍼를 iov에 채움 (첫 번째 버퍼는 이미 보낸 부분을 건너뜀, 채운 개수 반환)
+unsigned outq_iov(const struct OutQueue *q, struct iovec *iov, unsigned max) {
+    unsigned n = 0;
+    for (; n < q->count && n < max; n++) {
+        struct SharedBuf *b = q->bufs[(q->head + n) & (q->cap - 1)];
+        size_t off = (n == 0) ? q->head_off : 0;
+        iov[n].iov_base = b->data + off;
+        iov[n].iov_len = b->len - off;
+    }
+    return n;
+}
+
+// 보낸 sent 바이트만큼 대기열을 줄임 (다 보낸 버퍼는 참조 해제, 일부만 보낸 버퍼는 위치 기록)
+void outq_consume(struct OutQueue *q, size_t sent) {
+    q->bytes -= sent;
+    metric_add(MC_BYTES_OUT, sent);
+    metric_add(MC_OUTQ_BYTES, -(int64_t)sent);
+    while (sent > 0) {
+        struct SharedBuf *b = q->bufs[q->head];
+        size_t left = b->len - q->head_off;
+        if (sent < left) {
+            q->head_off += sent;
+            break;
+        }
+        sent -= left;
+        sbuf_unref(b);
+        q->head = (q->head + 1) & (q->cap - 1);
+        q->count--;
+        q->head_off = 0;
+    }
+}
+
+// 대기 중인 버퍼를 한 번의 시스템 콜로 묶어 가능한 만큼 전송 (0: 정상 또는 EAGAIN, -1: 연결 오류)
+// writev와 같은 scatter-gather 전송이지만 MSG_NOSIGNAL을 주기 위해 sendmsg를 사용한다.
+int outq_flush(struct OutQueue *q, int fd) {
+    struct iovec iov[OUTQ_MAX_IOV];
+    struct msghdr msg;
+
+    while (q->count > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = outq_iov(q, iov, OUTQ_MAX_IOV);
+        // 이번에 다 담지 못한 버퍼가 남아 있으면 MSG_MORE로 커널에 이어서 보낼 것이 있음을 알려 세그먼트를 채움
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL | (msg.msg_iovlen < q->count ? MSG_MORE : 0));
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;  // 나머지는 EPOLLOUT 이벤트에서 전송
+            return -1;
+        }
+        metric_add(MC_SEND_CALLS, 1);
+        outq_consume(q, sent);
+    }
+    return 0;
+}
+
+// 대기열의 모든 참조를 해제하고 배열 반납
+void outq_clear(struct OutQueue *q) {
+    metric_add(MC_OUTQ_BYTES, -(int64_t)q->bytes);
+    for (unsigned i = 0; i < q->count; i++) {
+        sbuf_unref(q->bufs[(q->head + i) & (q->cap - 1)]);
+    }
+    free(q->bufs);
+    memset(q, 0, sizeof(*q));
+}
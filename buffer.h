@@ -0,0 +1,43 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+#define OUTQ_MAX_IOV 64     // writev 한 번에 묶어 보내는 최대 버퍼 수
+#define POOL_CLASSES 6      // 메시지 버퍼 풀의 크기 등급 수 (가장 큰 등급보다 큰 요청은 malloc으로 바로 할당)
+
+// 한 번 직렬화한 메시지를 여러 연결이 함께 참조하는 불변 버퍼
+// 마지막 참조가 해제될 때 메모리를 반납한다. (여러 스레드에서 ref/unref해도 안전)
+struct SharedBuf {
+    atomic_int refs;    // 참조 수
+    size_t len;         // 데이터 길이
+    char data[];        // 직렬화된 데이터 (만든 뒤에는 수정하지 않음)
+};
+
+// 연결마다 가지는 송신 대기열 (SharedBuf 참조를 순서대로 보관하는 원형 배열)
+struct OutQueue {
+    struct SharedBuf **bufs;    // 대기 중인 버퍼 참조
+    unsigned cap;       // 배열 크기 (2의 거듭제곱)
+    unsigned head;      // 가장 먼저 보낼 버퍼 위치
+    unsigned count;     // 대기 중인 버퍼 수
+    size_t head_off;    // 첫 번째 버퍼에서 이미 보낸 바이트 수
+    size_t bytes;       // 아직 보내지 않은 전체 바이트 수
+};
+
+void *pool_alloc(size_t size);
+void pool_free(void *p);
+
+struct SharedBuf *sbuf_new(size_t len);
+struct SharedBuf *sbuf_from(const void *data, size_t len);
+struct SharedBuf *sbuf_ref(struct SharedBuf *b);
+void sbuf_unref(struct SharedBuf *b);
+
+int outq_push(struct OutQueue *q, struct SharedBuf *b);
+unsigned outq_iov(const struct OutQueue *q, struct iovec *iov, unsigned max);
+void outq_consume(struct OutQueue *q, size_t sent);
+int outq_flush(struct OutQueue *q, int fd);
+void outq_clear(struct OutQueue *q);
+
+#endif
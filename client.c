@@ -1,17 +1,24 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
-#include <sys/wait.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
 
-#define TCP_PORT 5100
-#define MAX_ID_LEN 20
-#define MAX_PW_LEN 20
-#define MAX_MESSAGES 100
-#define SCREEN_WIDTH 80
+#include "protocol.h"
+#include "history.h"
+#include "render.h"
+#include "search.h"
+
+#define HEADER_LINES 6  // 채팅 화면 위쪽 안내 줄 수
+#define FOOTER_LINES 4  // 채팅 화면 아래쪽 줄 수 (구분선, 상태, 입력, 입력 후 커서가 내려가는 빈 줄)
 
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
@@ -20,33 +27,62 @@
 #define ANSI_COLOR_RESET   "\x1b[0m"
 #define ANSI_BOLD          "\x1b[1m"
 
-// 로그인 정보를 저장하는 구조체
-struct LoginInfo {
-    char id[MAX_ID_LEN];
-    char password[MAX_PW_LEN];
+#define OUTBOX_MAX (1024 * 1024)  // 서버로 아직 보내지 못한 데이터의 최대 크기
+#define PUT_CHUNK (32 * 1024)  // 올리는 파일을 나누어 보내는 조각 크기
+#define PUT_BACKLOG (2 * PUT_CHUNK)  // outbox에 쌓아 둘 최대 파일 데이터 (채팅 메시지가 그 뒤에서 오래 기다리지 않도록)
+
+// 입력 줄을 무엇으로 해석할지
+enum InputMode {
+    INPUT_CHAT,             // 채팅 메시지나 명령
+    INPUT_SEARCH_KEYWORD,   // 검색 키워드와 조건
+    INPUT_SEARCH_RESULT     // 검색 결과를 보는 중 (Enter를 누르면 채팅방으로 돌아감)
 };
 
-// 메시지 정보를 저장하는 구조체
-struct Message {
-    char id[MAX_ID_LEN];    // 메시지를 보낸 클라이언트의 아이디
-    char content[BUFSIZ];   // 메시지 내용
+// 서버로 보낼 데이터 (소켓이 가득 차면 쌓아 두었다가 쓸 수 있을 때 보냄)
+struct Outbox {
+    char *buf;
+    size_t off, len, cap;
+};
+
+// 주고받는 중인 파일
+struct Transfer {
+    int fd;  // -1이면 없음
+    off_t offset, size;  // 올릴 때만 사용
+    char name[256];
 };
 
 // 전역 변수
 int ssock;
-int pipe_fd[2];
-pid_t child_pid;
 struct LoginInfo login;
-struct Message message_history[MAX_MESSAGES];  // 채팅방을 만들기 위한 메세지 내역을 저장할 배열
-int message_count = 0;  // 채팅 히스토리의 개수를 저장할 변수
+struct FrameReader reader;  // 서버에서 받은 프레임을 모아 두는 수신 버퍼
+struct Outbox outbox;  // 서버로 보낼 데이터
+char input[BUFSIZ * 2];  // 표준 입력에서 읽었지만 아직 처리하지 않은 데이터
+size_t input_len;
+int input_mode = INPUT_CHAT;  // enum InputMode
+const char *notice;  // 입력 줄 위에 잠깐 보여 줄 안내 (다음 입력 때 지움)
+struct History history;  // 채팅 기록 (받은 메시지와 보낸 메시지 모두)
+size_t scroll = 0;  // 최신 메시지에서 위로 올라간 메시지 수 (0이면 최신 메시지를 보는 중)
+struct SearchIndex search_index;  // 채팅 기록의 트라이그램 색인
+struct SearchQuery search_query;  // 검색 중인 조건
+char search_keyword[BUFSIZ];  // 검색 중인 키워드 (조건을 뺀 나머지 단어)
+char search_sender[MAX_ID_LEN];
+struct Screen screen;  // 채팅 화면
+int screen_dirty = 1;  // 화면을 다시 그려야 하는지 (여러 메시지를 모아 한 프레임에 그림)
+int input_done = 1;  // 사용자가 입력을 마쳐서 커서를 입력 줄 처음으로 옮겨야 하는지
+volatile sig_atomic_t resized = 0;  // SIGWINCH를 받았는지
+struct Transfer put = { .fd = -1 };  // 올리는 중인 파일
+struct Transfer get = { .fd = -1 };  // 받는 중인 파일
+char notice_buf[512];  // 형식을 채운 안내 문구
 
 void clear_screen() {
     printf("\033[2J\033[H");    //ANSI 이스케이프 코드를 사용
 }
 
 void print_line() {
+    int rows, cols;
+    screen_size(&rows, &cols);
     printf(ANSI_BOLD ANSI_COLOR_BLUE);
-    for (int i = 0; i < SCREEN_WIDTH; i++) {
+    for (int i = 0; i < cols; i++) {
         printf("-");
     }
     printf(ANSI_COLOR_RESET "\n");
@@ -54,7 +90,9 @@ void print_line() {
 
 // 텍스트를 가운데 정렬하는 함수
 void print_centered(const char* text) {
-    int padding = (SCREEN_WIDTH - strlen(text)) / 2;  // 텍스트를 가운데 정렬하기 위한 공백 계산
+    int rows, cols;
+    screen_size(&rows, &cols);
+    int padding = (cols - (int)screen_width(text, strlen(text))) / 2;  // 텍스트를 가운데 정렬하기 위한 공백 계산
     printf(ANSI_BOLD ANSI_COLOR_GREEN);
     for (int i = 0; i < padding; i++) { 
         printf(" ");
@@ -62,89 +100,482 @@ void print_centered(const char* text) {
     printf("%s" ANSI_COLOR_RESET "\n", text);  // 텍스트를 가운데 정렬하여 출력
 }
 
-// 채팅방 화면을 업데이트하는 함수
-void update_chat_screen() {
-    clear_screen();  // 화면을 지우는 함수 호출
-    print_line();
-    print_centered("채팅방");
-    print_centered("(종료:/q) (검색:/s)");
-    printf(ANSI_BOLD ANSI_COLOR_YELLOW "   your id: %s\n" ANSI_COLOR_RESET, login.id);
-    print_line();
+// 한 화면에 보여 주는 메시지 수 (터미널 높이에 따라 달라짐)
+size_t page_lines() {
+    return screen.rows > HEADER_LINES + FOOTER_LINES ? screen.rows - HEADER_LINES - FOOTER_LINES : 1;
+}
 
-    int start = (message_count > MAX_MESSAGES) ? message_count - MAX_MESSAGES : 0;  // 채팅 히스토리 출력을 위한 시작 인덱스 계산
-    for (int i = start; i < message_count; i++) {
-        printf("[%s]: %s\n", message_history[i].id, message_history[i].content);  // 채팅 히스토리 출력
+// 메시지 하나를 "[아이디]: 내용" 형식으로 row번째 줄에 설정 (show_time이면 앞에 받은 시각을 붙임)
+void set_message_line(int row, const struct HistoryMsg *m, int show_time) {
+    char line[MAX_ID_LEN + BUFSIZ + 16];
+    size_t len = 0;
+    if (show_time) {
+        time_t t = m->ts / 1000;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        len = strftime(line, sizeof(line), "%H:%M ", &tm);
     }
+    len += snprintf(line + len, sizeof(line) - len, "[%.*s]: ", (int)m->id_len, m->id);
+    size_t text_len = m->len < sizeof(line) - len ? m->len : sizeof(line) - len;
+    memcpy(line + len, m->text, text_len);
+    screen_set(&screen, row, NULL, line, len + text_len, ALIGN_LEFT);
+}
 
-    print_line();
-    printf(ANSI_BOLD ANSI_COLOR_GREEN "메시지를 입력하세요 : " ANSI_COLOR_RESET);
-    fflush(stdout);  // 출력 버퍼를 비우는 함수 호출
+// 채팅 화면의 아래쪽 (구분선, 상태 줄, 입력 줄)
+void set_footer(const char *status, const char *prompt) {
+    int row = screen.rows - FOOTER_LINES;
+    screen_fill(&screen, row, ANSI_BOLD ANSI_COLOR_BLUE, '-');
+    if (status) {
+        screen_set(&screen, row + 1, ANSI_BOLD ANSI_COLOR_YELLOW, status, strlen(status), ALIGN_LEFT);
+    }
+    screen_set(&screen, row + 2, ANSI_BOLD ANSI_COLOR_GREEN, prompt, strlen(prompt), ALIGN_LEFT);
+    screen_cursor(&screen, row + 2, screen_width(prompt, strlen(prompt)));
 }
 
-// 메시지를 채팅 히스토리에 추가하는 함수
-void add_message(const char* id, const char* content) { 
-    if (message_count < MAX_MESSAGES) {  // 채팅 히스토리의 개수가 최대 메시지 개수보다 작을 때
-        strcpy(message_history[message_count].id, id);  // 메시지 ID를 복사
-        strcpy(message_history[message_count].content, content);  // 메시지 내용을 복사
-        message_count++;  // 메시지 개수 증가
-    } else {  // 채팅 히스토리의 개수가 최대 개수보다 클 때
-        for (int i = 0; i < MAX_MESSAGES - 1; i++) {  // 모든 메시지를 한 칸씩 앞으로 이동
-            message_history[i] = message_history[i + 1];
+// 채팅방 화면을 만드는 함수 (scroll만큼 위로 올라간 위치에서 한 페이지)
+void draw_chat_screen() {
+    char buf[MAX_ID_LEN + 128];
+    const char *help1 = "(종료:/q) (검색:/s) (방: /join 이름, /leave, /list) (기록: /history 개수) (귓속말: /w 아이디 메시지)";
+    const char *help2 = "(이전 페이지:/u) (다음 페이지:/d) (최신 메시지:/e) (파일: /put 경로, /get 번호)";
+
+    screen_fill(&screen, 0, ANSI_BOLD ANSI_COLOR_BLUE, '-');
+    screen_set(&screen, 1, ANSI_BOLD ANSI_COLOR_GREEN, "채팅방", strlen("채팅방"), ALIGN_CENTER);
+    screen_set(&screen, 2, ANSI_BOLD ANSI_COLOR_GREEN, help1, strlen(help1), ALIGN_CENTER);
+    screen_set(&screen, 3, ANSI_BOLD ANSI_COLOR_GREEN, help2, strlen(help2), ALIGN_CENTER);
+    int len = snprintf(buf, sizeof(buf), "   your id: %s", login.id);
+    screen_set(&screen, 4, ANSI_BOLD ANSI_COLOR_YELLOW, buf, len, ALIGN_LEFT);
+    screen_fill(&screen, 5, ANSI_BOLD ANSI_COLOR_BLUE, '-');
+
+    size_t end = history_end(&history) - scroll;
+    size_t page = page_lines();
+    size_t start = (end - history.first > page) ? end - page : history.first;  // 화면에 보여 줄 첫 메시지
+    for (size_t i = start; i < end; i++) {
+        struct HistoryMsg m;
+        if (history_get(&history, i, &m) == 0) {
+            set_message_line(HEADER_LINES + (i - start), &m, 0);  // 채팅 히스토리 출력
         }
-        strcpy(message_history[MAX_MESSAGES - 1].id, id);  // 새 메시지 ID를 마지막 위치에 복사
-        strcpy(message_history[MAX_MESSAGES - 1].content, content);  // 새 메시지 내용을 마지막 위치에 복사
     }
-    update_chat_screen();  // 채팅 화면 업데이트
+
+    const char *status = notice;
+    if (scroll > 0) {
+        snprintf(buf, sizeof(buf), "이전 기록을 보는 중입니다. 아래에 새 메시지 %zu개 (최신 메시지:/e)", scroll);
+        status = buf;
+    }
+    if (input_mode == INPUT_SEARCH_KEYWORD) {
+        set_footer(status, "검색할 키워드를 입력하세요 (조건: from:아이디 after:HH:MM before:HH:MM): ");
+    } else {
+        set_footer(status, "메시지를 입력하세요 : ");
+    }
+}
+
+// 검색 결과 중 화면에 들어가는 만큼 최근 메시지 번호를 모음
+struct SearchHits {
+    size_t *shown;
+    size_t slots;
+    size_t count;
+};
+
+void collect_hit(size_t n, void *arg) {
+    struct SearchHits *hits = arg;
+    hits->shown[hits->count++ % hits->slots] = n;
+}
+
+// 오늘 HH:MM을 밀리초 단위 UNIX 시간으로 (형식이 틀리면 -1)
+int64_t parse_clock(const char *text) {
+    int hour, min;
+    if (sscanf(text, "%d:%d", &hour, &min) != 2 || hour < 0 || hour > 23 || min < 0 || min > 59) return -1;
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = 0;
+    return mktime(&tm) * 1000LL;
+}
+
+// 검색 입력을 조건으로 나눔 ("from:아이디", "after:HH:MM", "before:HH:MM" 외의 단어는 키워드)
+void parse_search(const char *data, size_t len) {
+    char line[BUFSIZ + 1];
+    memcpy(line, data, len);
+    line[len] = '\0';
+
+    memset(&search_query, 0, sizeof(search_query));
+    size_t klen = 0;
+    char *save;
+    for (char *word = strtok_r(line, " ", &save); word != NULL; word = strtok_r(NULL, " ", &save)) {
+        int64_t t;
+        if (strncmp(word, "from:", 5) == 0 && word[5] != '\0') {
+            snprintf(search_sender, sizeof(search_sender), "%s", word + 5);
+            search_query.sender = search_sender;
+            search_query.sender_len = strlen(search_sender);
+        } else if (strncmp(word, "after:", 6) == 0 && (t = parse_clock(word + 6)) >= 0) {
+            search_query.after = t;
+        } else if (strncmp(word, "before:", 7) == 0 && (t = parse_clock(word + 7)) >= 0) {
+            search_query.before = t;
+        } else {
+            if (klen > 0) search_keyword[klen++] = ' ';  // 여러 단어는 공백 하나로 이어서 검색
+            size_t wlen = strlen(word);
+            memcpy(search_keyword + klen, word, wlen);
+            klen += wlen;
+        }
+    }
+    search_query.keyword = search_keyword;
+    search_query.len = klen;
+}
+
+// 메시지를 검색하는 함수 (보관 중인 모든 기록에서 검색해 화면에 들어가는 만큼 최근 결과를 보여 줌)
+void draw_search_screen() {
+    screen_fill(&screen, 0, ANSI_BOLD ANSI_COLOR_BLUE, '-');
+    screen_set(&screen, 1, ANSI_BOLD ANSI_COLOR_GREEN, "검색 결과", strlen("검색 결과"), ALIGN_CENTER);
+    screen_fill(&screen, 2, ANSI_BOLD ANSI_COLOR_BLUE, '-');
+
+    size_t slots = screen.rows > 3 + FOOTER_LINES ? screen.rows - 3 - FOOTER_LINES : 1;
+    size_t shown[slots];  // 가장 최근에 찾은 메시지 번호 (원형)
+    struct SearchHits hits = { .shown = shown, .slots = slots };
+    size_t found = search_run(&search_index, &history, &search_query, collect_hit, &hits);  // 검색된 메시지 개수
+
+    size_t n = found < slots ? found : slots;
+    for (size_t k = 0; k < n; k++) {
+        struct HistoryMsg m;
+        history_get(&history, shown[(found - n + k) % slots], &m);
+        set_message_line(3 + k, &m, 1);  // 검색된 메시지 출력
+    }
+
+    char status[64];
+    if (found == 0) {  // 검색된 메시지가 없을 때
+        snprintf(status, sizeof(status), "검색 결과가 없습니다.");
+    } else {
+        snprintf(status, sizeof(status), "검색 결과 %zu개 중 최근 %zu개", found, n);
+    }
+    set_footer(status, "Enter를 눌러 채팅방으로 돌아가기...");
+}
+
+// 바뀐 부분만 화면에 출력 (여러 번 호출해도 RENDER_FRAME_MS마다 한 번만 그림)
+void render() {
+    screen_begin(&screen);
+    if (input_mode == INPUT_SEARCH_RESULT) {
+        draw_search_screen();
+    } else {
+        draw_chat_screen();
+    }
+    screen_flush(&screen, !input_done);  // 입력 중인 글자가 지워지지 않도록 커서를 그대로 둠
+    input_done = 0;
+    screen_dirty = 0;
+}
+
+// 메시지를 채팅 히스토리에 추가하는 함수 (기록이 아무리 많아도 O(1))
+void add_message(const char* id, size_t id_len, const char* content, size_t len) {
+    if (history_add(&history, id, id_len, content, len) < 0) {
+        return;
+    }
+    search_index_add(&search_index, &history, history_end(&history) - 1, content, len);  // 검색 색인 갱신
+    if (scroll > 0) {  // 이전 기록을 보는 중이면 보고 있던 위치가 그대로 유지되도록 함
+        scroll++;
+    }
+    if (input_mode != INPUT_SEARCH_RESULT) {  // 검색 결과를 보는 중이면 새 메시지가 와도 다시 그리지 않음
+        screen_dirty = 1;  // 채팅 화면 업데이트
+    }
+}
+
+// 이전/다음 페이지로 이동 (pages가 음수이면 이전 기록 쪽으로)
+void scroll_pages(int pages) {
+    size_t page = page_lines();
+    size_t max = history.count > page ? history.count - page : 0;  // 가장 오래된 페이지
+    if (pages < 0) {
+        scroll = (scroll + page > max) ? max : scroll + page;
+    } else {
+        scroll = (scroll > page) ? scroll - page : 0;
+    }
+    screen_dirty = 1;
+}
+
+void sigwinch_handler(int signo) {
+    resized = 1;
+}
+
+// 단조 시계 (밀리초)
+long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
 }
 
 // SIGINT 시그널 핸들러 함수 정의
 void sigint_handler(int signo) {  
     close(ssock);   // 서버 소켓 연결 종료
-    close(pipe_fd[0]);  // 파이프 읽기 종단 닫기
-    close(pipe_fd[1]);  // 파이프 쓰기 종단 닫기
-    if (child_pid > 0) {  // 자식 프로세스가 존재하는 경우
-        kill(child_pid, SIGTERM);  // 자식 프로세스에 종료 시그널 보내기
-    }
     exit(0);
 }
 
-// 메시지를 검색하는 함수
-void search_messages() {   
-    char keyword[BUFSIZ];   // 검색할 키워드를 저장할 문자열 배열 선언
-    printf(ANSI_BOLD ANSI_COLOR_GREEN "검색할 키워드를 입력하세요: " ANSI_COLOR_RESET);
-    fgets(keyword, BUFSIZ, stdin);
-    keyword[strcspn(keyword, "\n")] = 0;  // 개행 문자 제거
+// 입력 버퍼에서 한 줄을 꺼냄 (개행 문자는 빼고, 완성된 줄이 없으면 0)
+int next_input_line(char *line, size_t cap) {
+    char *nl = memchr(input, '\n', input_len);
+    size_t len = nl ? (size_t)(nl - input) : input_len;
+    if (nl == NULL && input_len < sizeof(input)) return 0;  // 버퍼가 가득 찼으면 개행이 없어도 한 줄로 처리
+
+    size_t copy = len < cap - 1 ? len : cap - 1;
+    memcpy(line, input, copy);
+    line[copy] = '\0';
+    size_t consumed = nl ? len + 1 : len;
+    memmove(input, input + consumed, input_len - consumed);
+    input_len -= consumed;
+    return 1;
+}
 
-    clear_screen();
-    print_line();
-    print_centered("검색 결과");
-    print_line();
+// 표준 입력에서 읽은 만큼 입력 버퍼에 붙임 (0: 입력 끝)
+ssize_t read_input() {
+    ssize_t n = read(STDIN_FILENO, input + input_len, sizeof(input) - input_len);
+    if (n > 0) input_len += n;
+    return n;
+}
+
+// 한 줄을 다 입력할 때까지 기다려서 읽음 (로그인 화면에서 사용)
+int read_line(char *line, size_t cap) {
+    while (!next_input_line(line, cap)) {
+        if (read_input() <= 0) return -1;
+    }
+    return 0;
+}
 
-    int found = 0;  // 검색된 메시지 개수를 저장할 변수 초기화
-    for (int i = 0; i < message_count; i++) {
-        if (strstr(message_history[i].content, keyword) != NULL) {  // 메시지 내용에 키워드가 포함되어 있는지 확인
-            printf("[%s]: %s\n", message_history[i].id, message_history[i].content);  // 검색된 메시지 출력
-            found++;  // 검색된 메시지 개수 증가
+// 쌓아 둔 데이터를 소켓이 받는 만큼 보냄 (남은 것은 POLLOUT을 기다려 다시 보냄)
+int outbox_flush() {
+    while (outbox.off < outbox.len) {
+        ssize_t n = send(ssock, outbox.buf + outbox.off, outbox.len - outbox.off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
         }
+        outbox.off += n;
     }
+    outbox.off = outbox.len = 0;
+    return 0;
+}
 
-    if (found == 0) {  // 검색된 메시지가 없을 때
-        printf("검색 결과가 없습니다.\n");
+// 보낼 데이터를 쌓아 두고 바로 보낼 수 있는 만큼 보냄 (서버가 받지 않아 OUTBOX_MAX를 넘으면 -1, errno=ENOBUFS)
+int outbox_push(const char *data, size_t len) {
+    if (outbox.len - outbox.off + len > OUTBOX_MAX) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (outbox.len + len > outbox.cap) {
+        memmove(outbox.buf, outbox.buf + outbox.off, outbox.len - outbox.off);  // 이미 보낸 부분을 비움
+        outbox.len -= outbox.off;
+        outbox.off = 0;
+    }
+    if (outbox.len + len > outbox.cap) {
+        size_t cap = outbox.cap ? outbox.cap : BUFSIZ;
+        while (cap < outbox.len + len) cap *= 2;
+        char *buf = realloc(outbox.buf, cap);
+        if (buf == NULL) return -1;
+        outbox.buf = buf;
+        outbox.cap = cap;
+    }
+    memcpy(outbox.buf + outbox.len, data, len);
+    outbox.len += len;
+    return outbox_flush();
+}
+
+// 올리는 파일의 다음 조각들을 outbox에 쌓음 (PUT_BACKLOG까지만 쌓고 나머지는 보내지는 대로 이어서)
+void put_pump() {
+    char frame[FRAME_HEADER_LEN + 255 + PUT_CHUNK];
+    while (put.fd >= 0 && outbox.len - outbox.off < PUT_BACKLOG) {
+        off_t left = put.size - put.offset;
+        size_t len = left < PUT_CHUNK ? (size_t)left : PUT_CHUNK;
+        int last = (put.offset + (off_t)len == put.size);
+        size_t hdr = frame_encode_header(frame, FRAME_FILE_PUT, last ? FRAME_FLAG_LAST : 0,
+                                         put.name, strlen(put.name), len);
+        ssize_t n = len > 0 ? pread(put.fd, frame + hdr, len, put.offset) : 0;
+        if (n != (ssize_t)len) {  // 읽는 중에 파일이 바뀌면 빈 마지막 조각으로 끝냄 (서버는 받은 만큼 등록)
+            len = 0;
+            last = 1;
+            hdr = frame_encode_header(frame, FRAME_FILE_PUT, FRAME_FLAG_LAST, put.name, strlen(put.name), 0);
+        }
+        if (outbox_push(frame, hdr + len) < 0) return;
+        put.offset += len;
+        if (last) {
+            close(put.fd);
+            put.fd = -1;
+        }
     }
+}
 
-    print_line();
-    printf(ANSI_BOLD ANSI_COLOR_YELLOW "아무 키나 눌러 채팅방으로 돌아가기..." ANSI_COLOR_RESET);
-    getchar();
-    update_chat_screen();
+// /put 경로: 파일을 조각으로 나누어 올리기 시작
+void start_put(const char *path) {
+    struct stat st;
+    if (put.fd >= 0) {
+        notice = "이미 다른 파일을 올리고 있습니다.";
+        return;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) close(fd);
+        notice = "파일을 열 수 없습니다.";
+        return;
+    }
+    const char *base = strrchr(path, '/');
+    snprintf(put.name, sizeof(put.name), "%s", base ? base + 1 : path);
+    put.fd = fd;
+    put.offset = 0;
+    put.size = st.st_size;
+    put_pump();
+}
+
+// 받은 파일 조각을 현재 디렉토리의 파일에 이어 씀 (같은 이름이 있으면 이름.1, 이름.2, ...)
+void save_chunk(const struct Frame *f) {
+    if (get.fd < 0) {
+        char name[256];
+        size_t n = f->id_len < sizeof(name) ? f->id_len : sizeof(name) - 1;
+        for (size_t i = 0; i < n; i++) {  // 서버가 준 이름이라도 경로로 쓰이지 않게 함
+            name[i] = (f->id[i] == '/' || f->id[i] == '\0') ? '_' : f->id[i];
+        }
+        name[n] = '\0';
+        if (n == 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) strcpy(name, "file");
+        snprintf(get.name, sizeof(get.name), "%s", name);
+        for (int i = 1; i < 100; i++) {
+            get.fd = open(get.name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (get.fd >= 0 || errno != EEXIST) break;
+            snprintf(get.name, sizeof(get.name), "%.240s.%d", name, i);
+        }
+        if (get.fd < 0) get.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);  // 저장할 수 없어도 나머지 조각은 받아서 버림
+    }
+    if (write(get.fd, f->payload, f->len) != (ssize_t)f->len) {
+        snprintf(notice_buf, sizeof(notice_buf), "'%s' 파일을 저장하지 못했습니다.", get.name);
+        notice = notice_buf;
+    }
+    if (f->flags & FRAME_FLAG_LAST) {
+        close(get.fd);
+        get.fd = -1;
+        if (notice != notice_buf) {
+            snprintf(notice_buf, sizeof(notice_buf), "'%s' 파일을 받았습니다.", get.name);
+            notice = notice_buf;
+        }
+        screen_dirty = 1;
+    }
+}
+
+// 수신 버퍼에 모인 프레임을 모두 처리 (잘못된 프레임이면 -1)
+int handle_frames() {
+    struct Frame f;
+    int ret;
+    while ((ret = frame_reader_next(&reader, &f)) > 0) {
+        if (f.type == FRAME_FILE_DATA) {
+            save_chunk(&f);
+            continue;
+        }
+        if (f.type != FRAME_CHAT) continue;  // 알 수 없는 프레임은 무시
+        size_t id_len = f.id_len < MAX_ID_LEN ? f.id_len : MAX_ID_LEN - 1;
+        add_message(f.id, id_len, f.payload, f.len);  // 채팅 히스토리에 메시지 추가
+    }
+    return ret;
+}
+
+// 프레임 하나를 받을 때까지 블로킹 수신 (1: 수신, 0: 연결 종료, -1: 오류)
+int recv_frame(struct Frame *f) {
+    while (1) {
+        int ret = frame_reader_next(&reader, f);
+        if (ret != 0) return ret;
+
+        size_t avail;
+        char *space = frame_reader_space(&reader, &avail);
+        if (space == NULL) return -1;
+        ssize_t n = recv(ssock, space, avail, 0);
+        if (n <= 0) return (int)n;
+        frame_reader_commit(&reader, n);
+    }
+}
+
+// 채팅 메시지를 프레임으로 전송 (보낸 사람 아이디는 서버가 로그인 정보로 채움)
+int send_chat(const char *text) {
+    char frame[FRAME_HEADER_LEN + BUFSIZ];
+    size_t len = strlen(text);
+    if (len > FRAME_MAX_TEXT) len = FRAME_MAX_TEXT;
+    len = frame_encode(frame, FRAME_CHAT, NULL, 0, text, len);
+    return outbox_push(frame, len);
+}
+
+// 입력 한 줄 처리 (채팅을 끝내야 하면 1)
+int handle_input(const char *content) {
+    input_done = 1;  // 사용자가 Enter를 눌렀으므로 입력 줄을 새로 그림
+    screen_dirty = 1;
+    notice = NULL;
+
+    if (input_mode == INPUT_SEARCH_KEYWORD) {
+        parse_search(content, strlen(content));
+        input_mode = INPUT_SEARCH_RESULT;
+        return 0;
+    } else if (input_mode == INPUT_SEARCH_RESULT) {
+        input_mode = INPUT_CHAT;  // 채팅방으로 돌아감
+        return 0;
+    }
+
+    if (strcmp(content, "/q") == 0) {
+        send_chat("q");  // 서버에게 종료 신호 전송
+        return 1;
+    } else if (strcmp(content, "/s") == 0) {
+        input_mode = INPUT_SEARCH_KEYWORD;
+        return 0;
+    } else if (strcmp(content, "/u") == 0) {
+        scroll_pages(-1);
+        return 0;
+    } else if (strcmp(content, "/d") == 0) {
+        scroll_pages(1);
+        return 0;
+    } else if (strcmp(content, "/e") == 0) {
+        scroll = 0;
+        return 0;
+    } else if (strncmp(content, "/put ", 5) == 0) {
+        start_put(content + 5);
+        return 0;
+    } else if (strncmp(content, "/join ", 6) == 0 || strcmp(content, "/leave") == 0 ||
+               strcmp(content, "/list") == 0 || strncmp(content, "/history", 8) == 0 ||
+               strncmp(content, "/get", 4) == 0 || strncmp(content, "/w ", 3) == 0) {
+        // 채팅방 명령, 파일 받기, 귓속말은 서버로만 보내고 결과는 서버 안내 메시지로 받음
+    } else {
+        add_message(login.id, strlen(login.id), content, strlen(content));  // 채팅 히스토리에 메시지 추가
+    }
+
+    if (send_chat(content) < 0) {  // 서버 소켓으로 메시지 전송
+        if (errno == ENOBUFS) {
+            notice = "서버가 메시지를 받지 못하고 있어 보내지 못했습니다.";
+            return 0;
+        }
+        perror("send()");
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char **argv) {
     struct sockaddr_in servaddr;
     char mesg[BUFSIZ];
-    
-   
-    if (argc < 2) {
-        printf("Usage : %s IP_ADDRESS\n", argv[0]);
+    size_t history_mem = 0;  // 0이면 기록을 임시 스필 파일에 모두 보관
+    int port = TCP_PORT;     // 서버 포트 (같은 컴퓨터의 여러 서버 중 하나에 접속할 때 -p로 바꿈)
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:p:")) != -1) {
+        switch (opt) {
+        case 'H':  // 채팅 기록을 메모리에 최대 N MB까지만 보관
+            history_mem = strtoul(optarg, NULL, 10) * 1024 * 1024;
+            if (history_mem == 0) {
+                fprintf(stderr, "Invalid history size: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p':  // 서버 포트
+            port = atoi(optarg);
+            if (port <= 0 || port > 65535) {
+                fprintf(stderr, "Invalid port: %s\n", optarg);
+                return -1;
+            }
+            break;
+        default:
+            printf("Usage : %s [-H history_MB] [-p port] IP_ADDRESS\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (optind >= argc) {
+        printf("Usage : %s [-H history_MB] [-p port] IP_ADDRESS\n", argv[0]);
         return -1;
     }
 
@@ -155,8 +586,8 @@ int main(int argc, char **argv) {
 
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
-    inet_pton(AF_INET, argv[1], &(servaddr.sin_addr.s_addr));
-    servaddr.sin_port = htons(TCP_PORT);
+    inet_pton(AF_INET, argv[optind], &(servaddr.sin_addr.s_addr));
+    servaddr.sin_port = htons(port);
 
     if (connect(ssock, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
         perror("connect()");
@@ -170,97 +601,113 @@ int main(int argc, char **argv) {
     print_line();
 
     printf("채팅에서 사용할 아이디를 입력하세요: ");
-    fgets(login.id, MAX_ID_LEN, stdin);
-    login.id[strcspn(login.id, "\n")] = 0;
+    fflush(stdout);
+    read_line(login.id, MAX_ID_LEN);
 
     printf("비밀번호를 입력하세요: ");
-    fgets(login.password, MAX_PW_LEN, stdin);
-    login.password[strcspn(login.password, "\n")] = 0;
+    fflush(stdout);
+    read_line(login.password, MAX_PW_LEN);
 
-    if (send(ssock, &login, sizeof(login), 0) <= 0) { // 로그인 정보 서버로 전송
+    // 로그인 정보를 로그인 프레임으로 서버에 전송
+    size_t len = frame_encode(mesg, FRAME_LOGIN, login.id, strlen(login.id), login.password, strlen(login.password));
+    if (send(ssock, mesg, len, 0) <= 0) {
         perror("send()");
         return -1;
     }
 
-    memset(mesg, 0, BUFSIZ);
-    if (recv(ssock, mesg, BUFSIZ, 0) <= 0) {  // 서버로부터 로그인 결과 수신
+    struct Frame reply;
+    if (frame_reader_init(&reader, 4096) < 0 || recv_frame(&reply) <= 0) {  // 서버로부터 로그인 결과 수신
         perror("recv()");
         return -1;
     }
 
-    if (strcmp(mesg, "로그인 성공") != 0) {  // 수신한 mesg가 로그인 성공이 아니면 실패 출력
-        printf("로그인 실패: %s\n", mesg);
+    if (reply.type != FRAME_LOGIN_OK) {  // 로그인 성공이 아니면 실패 출력
+        printf("로그인 실패: %.*s\n", (int)reply.len, reply.payload);
         close(ssock);
         return -1;
     }
 
-    if (pipe(pipe_fd) < 0) {  // 파이프 생성
-        perror("pipe()");
+    if(signal(SIGINT, sigint_handler) == SIG_ERR) {  // SIGINT 시그널 핸들러 등록
+        perror("signal: (SIGINT)");
         return -1;
     }
 
-    if(signal(SIGINT, sigint_handler) == SIG_ERR) {  // SIGINT 시그널 핸들러 등록
-        perror("signal: (SIGINT)");
+    if (history_init(&history, history_mem) < 0 || search_index_init(&search_index) < 0 ||
+        screen_init(&screen) < 0) {
+        perror("init()");
+        return -1;
+    }
+    struct sigaction sa = { .sa_handler = sigwinch_handler };  // SA_RESTART 없이 poll()을 깨움
+    sigaction(SIGWINCH, &sa, NULL);
+    if (handle_frames() < 0) {  // 로그인 응답과 함께 받은 최근 메시지 처리
         return -1;
     }
 
-    child_pid = fork();
+    // 표준 입력과 서버 소켓을 한 poll() 루프에서 처리 (메시지가 몰려와도 입력이 밀리지 않도록 소켓은 한 번에 한 번만 읽음)
+    fcntl(ssock, F_SETFL, fcntl(ssock, F_GETFL) | O_NONBLOCK);
+    struct pollfd fds[2] = {
+        { .fd = ssock, .events = POLLIN },
+        { .fd = STDIN_FILENO, .events = POLLIN },
+    };
+    long next_frame = 0;  // 다음 프레임을 그릴 수 있는 시각
+    int quit = 0;
+    while (1) {
+        char content[BUFSIZ];
+        while (!quit && next_input_line(content, sizeof(content))) {  // 입력 버퍼에 이미 들어 있는 줄 처리
+            quit = handle_input(content);
+        }
+        if (quit) break;
 
-    if (child_pid < 0) {
-        perror("fork()");
-        return -1;
-    } else if (child_pid == 0) {
-        // 자식 프로세스: 메시지 수신
-        close(pipe_fd[1]);  // 쓰기 파이프 닫기
-        while (1) {
-            struct Message received_msg;
-            memset(&received_msg, 0, sizeof(received_msg));  // 메시지 구조체 초기화
-            if (recv(ssock, &received_msg, sizeof(received_msg), 0) <= 0) {  // 서버로부터 메시지 수신
-                perror("recv()");
-                break;
-            }
-            add_message(received_msg.id, received_msg.content);  // 채팅 히스토리에 메시지 추가
-            write(pipe_fd[0], "1", 1);  // 부모에게 메시지 수신 알림
+        int timeout = -1;
+        if (screen_dirty) {  // 지난 프레임 뒤 RENDER_FRAME_MS가 지날 때까지 메시지를 모음
+            long wait = next_frame - now_ms();
+            timeout = wait > 0 ? (int)wait : 0;
         }
-        close(pipe_fd[0]);
-        exit(0);
-    } else {
-        // 부모 프로세스: 메시지 송신
-        close(pipe_fd[0]);  // 읽기 파이프 닫기
-        update_chat_screen();  // 채팅 화면 업데이트
-        while (1) {
-            struct Message msg;
-            strcpy(msg.id, login.id);
-            
-            fgets(msg.content, BUFSIZ, stdin);
-            msg.content[strcspn(msg.content, "\n")] = 0;  // 개행 문자 제거
-
-            if (strcmp(msg.content, "/q") == 0) {
-                printf("채팅을 종료합니다.\n");
-                strcpy(msg.content, "q");  // 서버에게 종료 신호 전송
-                send(ssock, &msg, sizeof(msg), 0);  // 종료 메시지 전송
+        fds[0].events = POLLIN | (outbox.off < outbox.len ? POLLOUT : 0);
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll()");
+            break;
+        }
+        if (resized) {  // 터미널 크기가 바뀌면 새 크기로 전체를 다시 그림
+            resized = 0;
+            if (screen_resize(&screen) < 0) break;
+            screen_dirty = 1;
+        }
+        if (ready > 0 && (fds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+            size_t avail;
+            char *space = frame_reader_space(&reader, &avail);
+            ssize_t n = space ? recv(ssock, space, avail, 0) : -1;
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {  // 서버로부터 메시지 수신
+                perror("recv()");
                 break;
-            } else if (strcmp(msg.content, "/s") == 0) {
-                search_messages();
-                continue;
             }
-
-            add_message(msg.id, msg.content);  // 채팅 히스토리에 메시지 추가
-
-            if (send(ssock, &msg, sizeof(msg), 0) <= 0) {  // 서버 소켓으로 메시지 전송
-                perror("send()");
-                break;
+            if (n > 0) {
+                frame_reader_commit(&reader, n);
+                if (handle_frames() < 0) break;
             }
-
-            char buf[2];
-            read(pipe_fd[0], buf, 1);
         }
-        close(pipe_fd[1]);
+        if (ready > 0 && (fds[0].revents & POLLOUT) && outbox_flush() < 0) {
+            perror("send()");
+            break;
+        }
+        put_pump();  // 보낸 만큼 올리는 파일의 다음 조각을 쌓음
+        if (ready > 0 && fds[1].revents && read_input() <= 0) {  // 입력이 끝나면 채팅 종료
+            send_chat("q");
+            quit = 1;
+            break;
+        }
+        if (screen_dirty && now_ms() >= next_frame) {
+            render();
+            next_frame = now_ms() + RENDER_FRAME_MS;
+        }
     }
 
+    if (quit) {
+        fcntl(ssock, F_SETFL, fcntl(ssock, F_GETFL) & ~O_NONBLOCK);  // 남은 데이터를 모두 보냄
+        outbox_flush();
+        printf("\n채팅을 종료합니다.\n");
+    }
     close(ssock);
-    kill(child_pid, SIGTERM);
-    wait(NULL);
     return 0;
 }
-
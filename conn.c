@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "conn.h"
+
+#define SLAB_OBJS 1024      // 슬랩 하나에 들어가는 연결 구조체 수
+
+int conn_table_init(struct ConnTable *t, size_t obj_size) {
+    memset(t, 0, sizeof(*t));
+    t->obj_size = (obj_size + 15) & ~(size_t)15;    // 16바이트 단위로 정렬
+    return 0;
+}
+
+void conn_table_destroy(struct ConnTable *t) {
+    for (size_t i = 0; i < t->slab_count; i++) {
+        free(t->slabs[i]);
+    }
+    free(t->slabs);
+    free(t->free_slots);
+    free(t->live);
+    memset(t, 0, sizeof(*t));
+}
+
+static struct ConnEntry *slot_entry(struct ConnTable *t, uint32_t slot) {
+    return (struct ConnEntry *)(t->slabs[slot / SLAB_OBJS] + (size_t)(slot % SLAB_OBJS) * t->obj_size);
+}
+
+// 빈 슬롯이 없을 때 슬랩 하나를 더 할당하고 빈 슬롯 스택과 live 배열을 늘림
+static int conn_table_grow(struct ConnTable *t) {
+    size_t capacity = (t->slab_count + 1) * SLAB_OBJS;
+    char **slabs = realloc(t->slabs, (t->slab_count + 1) * sizeof(char *));
+    if (slabs == NULL) return -1;
+    t->slabs = slabs;
+
+    uint32_t *free_slots = realloc(t->free_slots, capacity * sizeof(uint32_t));
+    if (free_slots == NULL) return -1;
+    t->free_slots = free_slots;
+
+    void **live = realloc(t->live, capacity * sizeof(void *));
+    if (live == NULL) return -1;
+    t->live = live;
+
+    char *slab = calloc(SLAB_OBJS, t->obj_size);
+    if (slab == NULL) return -1;
+    t->slabs[t->slab_count] = slab;
+
+    uint32_t base = (uint32_t)(t->slab_count * SLAB_OBJS);
+    for (uint32_t i = SLAB_OBJS; i-- > 0;) {    // 낮은 번호의 슬롯부터 쓰도록 역순으로 쌓음
+        struct ConnEntry *e = (struct ConnEntry *)(slab + (size_t)i * t->obj_size);
+        e->slot = base + i;
+        e->gen = 1;
+        t->free_slots[t->free_count++] = base + i;
+    }
+    t->slab_count++;
+    return 0;
+}
+
+// 0으로 초기화된 연결 구조체를 할당하고 live 배열 끝에 추가 (실패 시 NULL)
+void *conn_alloc(struct ConnTable *t) {
+    if (t->free_count == 0 && conn_table_grow(t) < 0) return NULL;
+
+    uint32_t slot = t->free_slots[--t->free_count];
+    struct ConnEntry *e = slot_entry(t, slot);
+    uint32_t gen = e->gen;
+    memset(e, 0, t->obj_size);
+    e->slot = slot;
+    e->gen = gen;
+    e->in_use = 1;
+    e->live_index = (uint32_t)t->count;
+    t->live[t->count++] = e;
+    return e;
+}
+
+// 연결 구조체를 반납 (live 배열의 마지막 연결을 빈 자리로 옮기고 세대 번호를 올림)
+void conn_free(struct ConnTable *t, void *obj) {
+    struct ConnEntry *e = obj;
+    if (!e->in_use) return;
+
+    struct ConnEntry *last = t->live[--t->count];
+    t->live[e->live_index] = last;
+    last->live_index = e->live_index;
+
+    e->in_use = 0;
+    e->gen = (e->gen + 1) & CONN_GEN_MASK;
+    if (e->gen == 0) e->gen = 1;    // 세대 번호 0은 사용하지 않음
+    t->free_slots[t->free_count++] = e->slot;
+}
+
+// 핸들로 연결을 찾음 (이미 종료되었거나 슬롯이 재사용되었으면 NULL)
+void *conn_lookup(struct ConnTable *t, ConnHandle h) {
+    uint32_t slot = (uint32_t)h;
+    uint32_t gen = (uint32_t)(h >> 32);
+    if (slot / SLAB_OBJS >= t->slab_count) return NULL;
+    struct ConnEntry *e = slot_entry(t, slot);
+    return (e->in_use && e->gen == gen) ? e : NULL;
+}
+
+static size_t hash_key(uint64_t key, size_t cap) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 17) & (cap - 1);
+}
+
+// 칸 수를 두 배로 늘리고 모든 항목을 다시 넣음
+static int handle_map_grow(struct HandleMap *m) {
+    size_t cap = m->cap ? m->cap * 2 : 64;
+    struct HandleMapEntry *entries = calloc(cap, sizeof(struct HandleMapEntry));
+    if (entries == NULL) return -1;
+    for (size_t i = 0; i < m->cap; i++) {
+        if (m->entries[i].handle == CONN_HANDLE_NONE) continue;
+        size_t j = hash_key(m->entries[i].key, cap);
+        while (entries[j].handle != CONN_HANDLE_NONE) j = (j + 1) & (cap - 1);
+        entries[j] = m->entries[i];
+    }
+    free(m->entries);
+    m->entries = entries;
+    m->cap = cap;
+    return 0;
+}
+
+// key에 핸들을 연결 (이미 있으면 덮어씀)
+int handle_map_put(struct HandleMap *m, uint64_t key, ConnHandle h) {
+    if ((m->count + 1) * 4 > m->cap * 3 && handle_map_grow(m) < 0) return -1;    // 75% 이상 차면 확장
+    size_t i = hash_key(key, m->cap);
+    while (m->entries[i].handle != CONN_HANDLE_NONE && m->entries[i].key != key) {
+        i = (i + 1) & (m->cap - 1);
+    }
+    if (m->entries[i].handle == CONN_HANDLE_NONE) m->count++;
+    m->entries[i].key = key;
+    m->entries[i].handle = h;
+    return 0;
+}
+
+// key에 연결된 핸들 (없으면 CONN_HANDLE_NONE)
+ConnHandle handle_map_get(const struct HandleMap *m, uint64_t key) {
+    if (m->cap == 0) return CONN_HANDLE_NONE;
+    size_t i = hash_key(key, m->cap);
+    while (m->entries[i].handle != CONN_HANDLE_NONE) {
+        if (m->entries[i].key == key) return m->entries[i].handle;
+        i = (i + 1) & (m->cap - 1);
+    }
+    return CONN_HANDLE_NONE;
+}
+
+// key 삭제 (뒤따르는 항목을 당겨 와서 삭제 표시 없이 탐사 순서를 유지)
+void handle_map_del(struct HandleMap *m, uint64_t key) {
+    if (m->cap == 0) return;
+    size_t i = hash_key(key, m->cap);
+    while (m->entries[i].handle != CONN_HANDLE_NONE && m->entries[i].key != key) {
+        i = (i + 1) & (m->cap - 1);
+    }
+    if (m->entries[i].handle == CONN_HANDLE_NONE) return;
+
+    size_t hole = i;
+    m->entries[hole].handle = CONN_HANDLE_NONE;
+    m->count--;
+    for (size_t j = (hole + 1) & (m->cap - 1); m->entries[j].handle != CONN_HANDLE_NONE; j = (j + 1) & (m->cap - 1)) {
+        size_t home = hash_key(m->entries[j].key, m->cap);
+        // home이 (hole, j] 구간 밖에 있으면 hole로 옮겨도 탐사로 찾을 수 있음
+        if (((j - home) & (m->cap - 1)) >= ((j - hole) & (m->cap - 1))) {
+            m->entries[hole] = m->entries[j];
+            m->entries[j].handle = CONN_HANDLE_NONE;
+            hole = j;
+        }
+    }
+}
+
+void handle_map_destroy(struct HandleMap *m) {
+    free(m->entries);
+    m->entries = NULL;
+    m->cap = m->count = 0;
+}
+
+// 아이디 해시 (FNV-1a)
+static size_t hash_id(const char *id, size_t cap) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < MAX_ID_LEN && id[i] != '\0'; i++) {
+        h = (h ^ (unsigned char)id[i]) * 0x100000001B3ULL;
+    }
+    return (size_t)(h ^ (h >> 32)) & (cap - 1);
+}
+
+// 아이디가 있는 칸, 없으면 그 아이디가 들어갈 빈 칸
+static size_t id_map_find(const struct IdMap *m, const char *id) {
+    size_t i = hash_id(id, m->cap);
+    while (m->entries[i].handle != CONN_HANDLE_NONE && strncmp(m->entries[i].id, id, MAX_ID_LEN) != 0) {
+        i = (i + 1) & (m->cap - 1);
+    }
+    return i;
+}
+
+static int id_map_grow(struct IdMap *m) {
+    size_t cap = m->cap ? m->cap * 2 : 64;
+    struct IdMapEntry *entries = calloc(cap, sizeof(struct IdMapEntry));
+    if (entries == NULL) return -1;
+    for (size_t i = 0; i < m->cap; i++) {
+        if (m->entries[i].handle == CONN_HANDLE_NONE) continue;
+        size_t j = hash_id(m->entries[i].id, cap);
+        while (entries[j].handle != CONN_HANDLE_NONE) j = (j + 1) & (cap - 1);
+        entries[j] = m->entries[i];
+    }
+    free(m->entries);
+    m->entries = entries;
+    m->cap = cap;
+    return 0;
+}
+
+// 아이디에 연결을 등록 (0: 등록함, 1: 이미 같은 아이디로 접속한 연결이 있음, -1: 메모리 부족)
+int id_map_add(struct IdMap *m, const char *id, int owner, ConnHandle h) {
+    if ((m->count + 1) * 4 > m->cap * 3 && id_map_grow(m) < 0) return -1;    // 75% 이상 차면 확장
+    size_t i = id_map_find(m, id);
+    if (m->entries[i].handle != CONN_HANDLE_NONE) return 1;
+    memset(m->entries[i].id, 0, MAX_ID_LEN);
+    memcpy(m->entries[i].id, id, strnlen(id, MAX_ID_LEN - 1));
+    m->entries[i].owner = owner;
+    m->entries[i].handle = h;
+    m->count++;
+    return 0;
+}
+
+// 아이디로 접속한 연결의 핸들 (없으면 CONN_HANDLE_NONE, owner가 NULL이 아니면 가진 쪽도 돌려줌)
+ConnHandle id_map_get(const struct IdMap *m, const char *id, int *owner) {
+    if (m->cap == 0) return CONN_HANDLE_NONE;
+    const struct IdMapEntry *e = &m->entries[id_map_find(m, id)];
+    if (owner != NULL) *owner = e->owner;
+    return e->handle;
+}
+
+// 아이디 삭제 (그 아이디가 연결 h의 것일 때만, 뒤따르는 항목을 당겨 와서 탐사 순서를 유지)
+void id_map_del(struct IdMap *m, const char *id, ConnHandle h) {
+    if (m->cap == 0) return;
+    size_t hole = id_map_find(m, id);
+    if (m->entries[hole].handle == CONN_HANDLE_NONE || m->entries[hole].handle != h) return;
+
+    m->entries[hole].handle = CONN_HANDLE_NONE;
+    m->count--;
+    for (size_t j = (hole + 1) & (m->cap - 1); m->entries[j].handle != CONN_HANDLE_NONE; j = (j + 1) & (m->cap - 1)) {
+        size_t home = hash_id(m->entries[j].id, m->cap);
+        if (((j - home) & (m->cap - 1)) >= ((j - hole) & (m->cap - 1))) {
+            m->entries[hole] = m->entries[j];
+            m->entries[j].handle = CONN_HANDLE_NONE;
+            hole = j;
+        }
+    }
+}
+
+void id_map_destroy(struct IdMap *m) {
+    free(m->entries);
+    m->entries = NULL;
+    m->cap = m->count = 0;
+}
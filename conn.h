@@ -0,0 +1,87 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+// 연결 핸들: 하위 32비트는 슬롯 번호, 상위 32비트는 세대 번호
+// 연결이 종료되어 슬롯(과 소켓 디스크립터)이 재사용되면 세대 번호가 바뀌므로
+// 예전 핸들로는 새 연결을 찾을 수 없다.
+typedef uint64_t ConnHandle;
+
+#define CONN_HANDLE_NONE 0      // 유효한 연결을 가리키지 않는 핸들 (세대 번호는 1부터 시작)
+#define CONN_GEN_MASK 0x7FFFFFFF    // 세대 번호는 31비트 안에서 돎 (핸들의 최상위 비트는 io_uring 요청 구분에 씀)
+
+// 연결 테이블에서 할당하는 모든 연결 구조체의 맨 앞에 두는 공통 헤더
+struct ConnEntry {
+    uint32_t slot;          // 슬롯 번호
+    uint32_t gen;           // 세대 번호 (슬롯을 반납할 때마다 증가)
+    uint32_t live_index;    // live 배열에서의 위치
+    uint32_t in_use;        // 사용 중 여부
+};
+
+// 슬랩 할당기 기반의 연결 테이블
+// 연결 구조체는 슬랩(고정 크기 묶음) 단위로 할당되어 주소가 바뀌지 않고,
+// 빈 슬롯은 스택으로 관리하여 추가/삭제가 O(1)이다. 살아 있는 연결은 live 배열에
+// 빈틈없이 모여 있어 브로드캐스트할 때 순서대로 훑을 수 있다.
+struct ConnTable {
+    size_t obj_size;        // 연결 구조체 크기 (struct ConnEntry 포함)
+    char **slabs;           // 슬랩 배열
+    size_t slab_count;      // 할당한 슬랩 수
+    uint32_t *free_slots;   // 빈 슬롯 스택
+    size_t free_count;      // 빈 슬롯 수
+    void **live;            // 살아 있는 연결 배열
+    size_t count;           // 살아 있는 연결 수
+};
+
+// 정수 키(프로세스 ID 등) -> 연결 핸들 해시 테이블 (open addressing, 선형 탐사)
+struct HandleMapEntry {
+    uint64_t key;
+    ConnHandle handle;      // CONN_HANDLE_NONE이면 빈 칸
+};
+
+struct HandleMap {
+    struct HandleMapEntry *entries;
+    size_t cap;             // 칸 수 (2의 거듭제곱)
+    size_t count;           // 사용 중인 칸 수
+};
+
+// 로그인 아이디 -> 연결 핸들 해시 테이블 (open addressing, 선형 탐사)
+// 아이디마다 연결이 하나뿐이므로 귓속말 대상 찾기와 중복 로그인 확인이 모두 O(1)이다.
+struct IdMapEntry {
+    char id[MAX_ID_LEN];
+    int owner;              // 연결을 가진 쪽 (멀티코어 모드의 샤드 번호)
+    ConnHandle handle;      // CONN_HANDLE_NONE이면 빈 칸
+};
+
+struct IdMap {
+    struct IdMapEntry *entries;
+    size_t cap;             // 칸 수 (2의 거듭제곱)
+    size_t count;           // 사용 중인 칸 수
+};
+
+int conn_table_init(struct ConnTable *t, size_t obj_size);
+void conn_table_destroy(struct ConnTable *t);
+void *conn_alloc(struct ConnTable *t);
+void conn_free(struct ConnTable *t, void *obj);
+void *conn_lookup(struct ConnTable *t, ConnHandle h);
+
+int handle_map_put(struct HandleMap *m, uint64_t key, ConnHandle h);
+ConnHandle handle_map_get(const struct HandleMap *m, uint64_t key);
+void handle_map_del(struct HandleMap *m, uint64_t key);
+void handle_map_destroy(struct HandleMap *m);
+
+int id_map_add(struct IdMap *m, const char *id, int owner, ConnHandle h);
+ConnHandle id_map_get(const struct IdMap *m, const char *id, int *owner);
+void id_map_del(struct IdMap *m, const char *id, ConnHandle h);
+void id_map_destroy(struct IdMap *m);
+
+// 연결 구조체의 핸들
+static inline ConnHandle conn_handle(const void *obj) {
+    const struct ConnEntry *e = obj;
+    return ((uint64_t)e->gen << 32) | e->slot;
+}
+
+#endif
@@ -0,0 +1,397 @@
+// ---------------------------------------------------------------------------
+// 무중단 재시작 (연결 넘기기)
+//
+// 새 서버 프로세스를 -u 옵션으로 실행하면 실행 중인 서버의 재시작 소켓(-U, SOCK_SEQPACKET)에
+// 접속해 서버 소켓, 모든 클라이언트 소켓과 연결마다의 상태(아이디, 방, 처리하지 않은 수신 데이터,
+// 보내지 못한 송신 데이터, 주고받는 중인 파일)를 SCM_RIGHTS로 넘겨받는다. 새 프로세스는 저장소,
+// 스풀, 샤드처럼 실패할 수 있는 준비를 모두 마친 뒤에 알리고, 이전 프로세스는 그때 종료한다.
+// 그 전에 새 프로세스가 실패하면 이전 프로세스가 멈춘 곳부터 이어서 서비스하므로 연결을 잃지 않는다.
+// 넘기는 동안 도착한 데이터와 새 연결은 커널의 소켓 버퍼와 accept 대기열에 남아 있으므로
+// 클라이언트는 연결이 끊기지 않고 다시 접속하지도 않는다.
+//
+// 상태는 바이트 스트림처럼 이어 쓰고 HANDOFF_MSG_MAX마다 메시지 하나로 보내며, 항목마다의
+// 디스크립터는 그 항목이 시작되는 메시지에 붙인다. 그래서 받는 쪽은 항목 머리를 읽을 때
+// 그 항목의 디스크립터를 이미 받아 두고 있다.
+//   새 → 이전: HandoffHello
+//   이전 → 새: HandoffState | 스풀 파일 목록 | (HandoffConn | 수신 데이터 | 송신 데이터)... | HandoffConn(END)
+//   새 → 이전: 1바이트 (다 받고 서비스 준비를 마침, 그동안 이전 프로세스는 저장소에 쓰지 않고 기다림)
+//   이전 → 새: 1바이트 (넘기기를 확정함, 이전 프로세스는 종료하고 새 프로세스는 종료를 기다린 뒤 서비스)
+// ---------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "handoff.h"
+#include "log.h"
+
+// 새 프로세스가 받은 메시지 (디스크립터는 항목 머리를 읽을 때 차례로 꺼냄)
+struct HandoffReader {
+    int sock;
+    size_t start, end;
+    int *fds;
+    size_t fd_head, fd_count, fd_cap;
+    char buf[HANDOFF_MSG_MAX];
+};
+
+static int set_path(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// 재시작 소켓을 엶 (실패하면 -1, 재시작 요청은 받지 않고 서비스는 계속함)
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (set_path(&addr, path) < 0) {
+        log_msg(LOG_WARNING, "재시작 소켓 경로가 너무 깁니다: %s", path);
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        log_msg(LOG_WARNING, "재시작 소켓 생성 실패: %m");
+        return -1;
+    }
+    // 남아 있는 소켓 파일이 살아 있는 서버의 것이면 지우지 않음
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        log_msg(LOG_WARNING, "재시작 소켓 %s을(를) 다른 서버가 사용 중입니다. 무중단 재시작을 받지 않습니다.", path);
+        close(sock);
+        return -1;
+    }
+    close(sock);
+    unlink(path);
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(path, 0600) < 0 || listen(sock, 1) < 0) {
+        log_msg(LOG_WARNING, "재시작 소켓 %s 열기 실패: %m", path);
+        if (sock >= 0) close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 새 프로세스의 접속을 받아 요청을 확인 (같은 사용자가 실행한 같은 형식의 서버만, 아니면 -1)
+int handoff_accept(int lsock) {
+    struct HandoffHello hello;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    struct timeval tv = { .tv_sec = HANDOFF_ACK_SEC, .tv_usec = 0 };
+
+    int sock = accept4(lsock, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) return -1;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != getuid()) {
+        log_msg(LOG_WARNING, "다른 사용자의 재시작 요청을 거절합니다.");
+        close(sock);
+        return -1;
+    }
+    if (recv(sock, &hello, sizeof(hello), 0) != (ssize_t)sizeof(hello) ||
+        hello.magic != HANDOFF_MAGIC || hello.version != HANDOFF_VERSION) {
+        log_msg(LOG_WARNING, "형식이 다른 재시작 요청을 거절합니다.");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 쓰던 메시지를 보냄
+int handoff_flush(struct HandoffWriter *w) {
+    struct msghdr msg;
+    struct iovec iov = { .iov_base = w->buf, .iov_len = w->len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+
+    if (w->len == 0) return 0;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (w->nfds > 0) {
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * w->nfds);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * w->nfds);
+        memcpy(CMSG_DATA(cm), w->fds, sizeof(int) * w->nfds);
+    }
+    while (sendmsg(w->sock, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    w->len = 0;
+    w->nfds = 0;
+    return 0;
+}
+
+// 항목 하나를 이어 씀 (fds는 항목의 첫 바이트가 들어가는 메시지에 붙음)
+int handoff_put(struct HandoffWriter *w, const void *data, size_t len, const int *fds, int nfds) {
+    const char *p = data;
+
+    if (nfds > 0) {
+        if ((w->len == HANDOFF_MSG_MAX || w->nfds + nfds > HANDOFF_MAX_FDS) && handoff_flush(w) < 0) return -1;
+        memcpy(w->fds + w->nfds, fds, sizeof(int) * nfds);
+        w->nfds += nfds;
+    }
+    while (len > 0) {
+        if (w->len == HANDOFF_MSG_MAX && handoff_flush(w) < 0) return -1;
+        size_t n = HANDOFF_MSG_MAX - w->len;
+        if (n > len) n = len;
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 새 프로세스가 서비스 준비를 마쳤다고 알리기를 기다림 (HANDOFF_ACK_SEC 안에 오지 않거나 연결이 끊기면 -1)
+int handoff_wait_ack(int sock) {
+    char ack;
+    ssize_t n;
+    while ((n = recv(sock, &ack, 1, 0)) < 0 && errno == EINTR) {}
+    return (n == 1) ? 0 : -1;
+}
+
+// 넘기기를 확정했다고 알림 (보낸 뒤에는 이전 프로세스가 종료해야 함)
+int handoff_confirm(int sock) {
+    char bye = 1;
+    return (send(sock, &bye, 1, MSG_NOSIGNAL) == 1) ? 0 : -1;
+}
+
+// 받는 디스크립터가 많으므로 열 수 있는 디스크립터 수를 최대로 올림
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// 다음 메시지를 받아 디스크립터는 대기열에 붙임 (연결이 끊기거나 디스크립터가 잘리면 -1)
+static int reader_fill(struct HandoffReader *r) {
+    struct msghdr msg;
+    struct iovec iov = { .iov_base = r->buf, .iov_len = sizeof(r->buf) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    while ((n = recvmsg(r->sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (n <= 0) return -1;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (r->fd_count + count > r->fd_cap) {
+            size_t cap = r->fd_cap ? r->fd_cap * 2 : HANDOFF_MAX_FDS;
+            while (cap < r->fd_count + count) cap *= 2;
+            int *fds = realloc(r->fds, cap * sizeof(int));
+            if (fds == NULL) return -1;
+            r->fds = fds;
+            r->fd_cap = cap;
+        }
+        memcpy(r->fds + r->fd_count, CMSG_DATA(cm), count * sizeof(int));
+        r->fd_count += count;
+    }
+    // 디스크립터 한도에 걸려 일부를 받지 못했으면 어느 연결의 것인지 알 수 없으므로 포기
+    if (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) {
+        errno = EMFILE;
+        return -1;
+    }
+    r->start = 0;
+    r->end = (size_t)n;
+    return 0;
+}
+
+static int reader_get(struct HandoffReader *r, void *out, size_t len) {
+    char *p = out;
+    while (len > 0) {
+        if (r->start == r->end && reader_fill(r) < 0) return -1;
+        size_t n = r->end - r->start;
+        if (n > len) n = len;
+        memcpy(p, r->buf + r->start, n);
+        r->start += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 항목에 붙어 온 디스크립터를 차례로 꺼냄 (없으면 -1)
+static int reader_fd(struct HandoffReader *r) {
+    return (r->fd_head < r->fd_count) ? r->fds[r->fd_head++] : -1;
+}
+
+// 받은 내용을 모두 버림 (아직 꺼내지 않은 디스크립터까지 닫음)
+static void handoff_discard(struct Handoff *h, struct HandoffReader *r) {
+    for (size_t i = 0; i < r->fd_count; i++) {
+        close(r->fds[i]);
+    }
+    free(r->fds);
+    if (h->sock >= 0) close(h->sock);
+    h->sock = -1;
+    handoff_free(h);
+}
+
+// 실행 중인 서버에 접속해 모든 상태를 받음 (실패하면 -1, 받은 디스크립터는 모두 닫음)
+// 이전 프로세스는 handoff_finish로 준비를 마쳤다고 알리기 전까지 멈춘 채로 기다리며, 실패하면 이어서 서비스한다.
+int handoff_receive(const char *path, struct Handoff *h) {
+    static struct HandoffReader r;
+    struct sockaddr_un addr;
+    struct HandoffHello hello = { .magic = HANDOFF_MAGIC, .version = HANDOFF_VERSION };
+    size_t cap = 0;
+
+    memset(h, 0, sizeof(*h));
+    h->relay_fd = -1;
+    memset(&r, 0, sizeof(r));
+    raise_fd_limit();
+
+    if (set_path(&addr, path) < 0) {
+        fprintf(stderr, "재시작 소켓 경로가 너무 깁니다: %s\n", path);
+        return -1;
+    }
+    h->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (h->sock < 0 || connect(h->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "실행 중인 서버의 재시작 소켓 %s에 연결할 수 없습니다: %s\n", path, strerror(errno));
+        if (h->sock >= 0) close(h->sock);
+        return -1;
+    }
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(h->sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) {
+        h->peer = cred.pid;
+    }
+    r.sock = h->sock;
+    if (send(h->sock, &hello, sizeof(hello), MSG_NOSIGNAL) != (ssize_t)sizeof(hello) ||
+        reader_get(&r, &h->state, sizeof(h->state)) < 0) {
+        goto fail;
+    }
+    // 서버 소켓과 중계 서버 소켓
+    if (h->state.nlisten == 0 || h->state.nlisten > HANDOFF_MAX_FDS) goto fail;
+    h->listen_fds = malloc(h->state.nlisten * sizeof(int));
+    if (h->listen_fds == NULL) goto fail;
+    for (uint32_t i = 0; i < h->state.nlisten; i++) {
+        h->listen_fds[i] = -1;
+    }
+    for (uint32_t i = 0; i < h->state.nlisten; i++) {
+        if ((h->listen_fds[i] = reader_fd(&r)) < 0) goto fail;
+    }
+    if (h->state.has_relay && (h->relay_fd = reader_fd(&r)) < 0) goto fail;
+    h->spool = malloc(h->state.spool_len ? h->state.spool_len : 1);
+    if (h->spool == NULL || reader_get(&r, h->spool, h->state.spool_len) < 0) goto fail;
+
+    // 연결마다의 상태
+    while (1) {
+        struct HandoffConn conn;
+        if (reader_get(&r, &conn, sizeof(conn)) < 0) goto fail;
+        if (conn.kind == HANDOFF_END) break;
+        if (conn.kind != HANDOFF_CONN) goto fail;
+
+        if (h->count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            struct HandoffClient *clients = realloc(h->clients, cap * sizeof(struct HandoffClient));
+            if (clients == NULL) goto fail;
+            h->clients = clients;
+        }
+        struct HandoffClient *c = &h->clients[h->count++];
+        c->conn = conn;
+        c->fd = reader_fd(&r);
+        c->upload_fd = (conn.has_upload && conn.upload.fd >= 0) ? reader_fd(&r) : -1;
+        c->file_fd = conn.has_file ? reader_fd(&r) : -1;
+        c->in = malloc(conn.in_len ? conn.in_len : 1);
+        c->out = malloc(conn.out_len ? conn.out_len : 1);
+        if (c->fd < 0 || (conn.has_upload && conn.upload.fd >= 0 && c->upload_fd < 0) ||
+            (conn.has_file && c->file_fd < 0) || c->in == NULL || c->out == NULL ||
+            reader_get(&r, c->in, conn.in_len) < 0 || reader_get(&r, c->out, conn.out_len) < 0) {
+            goto fail;
+        }
+    }
+    free(r.fds);
+    return 0;
+
+fail:
+    fprintf(stderr, "실행 중인 서버에서 상태를 받지 못했습니다: %s\n", strerror(errno));
+    handoff_discard(h, &r);
+    return -1;
+}
+
+// 이전 프로세스가 완전히 끝나기를 기다림 (재시작 소켓, 통계 소켓을 닫아야 새 프로세스가 다시 열 수 있음)
+// pidfd를 쓸 수 없으면 재시작 연결이 닫히기를 기다린다.
+static void wait_peer_exit(struct Handoff *h) {
+    struct pollfd pfd = { .fd = -1, .events = POLLIN };
+    char buf;
+    ssize_t n;
+
+#ifdef SYS_pidfd_open
+    if (h->peer > 0) pfd.fd = (int)syscall(SYS_pidfd_open, h->peer, 0);
+#endif
+    if (pfd.fd < 0) {
+        while ((n = recv(h->sock, &buf, 1, 0)) != 0) {
+            if (n < 0 && errno != EINTR) break;
+        }
+        return;
+    }
+    int ret;
+    while ((ret = poll(&pfd, 1, HANDOFF_ACK_SEC * 1000)) < 0 && errno == EINTR) {}
+    if (ret == 0) {
+        log_msg(LOG_WARNING, "이전 서버 프로세스(pid %d)가 종료하지 않았습니다.", (int)h->peer);
+    }
+    close(pfd.fd);
+}
+
+// 서비스 준비를 마쳤다고 알리고, 이전 프로세스가 넘기기를 확정하면 종료하기를 기다림 (확정하지 않으면 -1)
+// 실패할 수 있는 준비를 모두 마친 뒤에 호출한다. -1이면 이전 프로세스가 이어서 서비스하므로 이 프로세스는 끝내야 한다.
+int handoff_finish(struct Handoff *h) {
+    char ready = 1, bye;
+    ssize_t n = -1;
+    struct timeval tv = { .tv_sec = HANDOFF_ACK_SEC, .tv_usec = 0 };
+
+    // 준비하는 데 HANDOFF_ACK_SEC를 넘기면 이전 프로세스는 이어서 서비스하고 연결을 닫으므로 확정이 오지 않음
+    setsockopt(h->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (send(h->sock, &ready, 1, MSG_NOSIGNAL) == 1) {
+        while ((n = recv(h->sock, &bye, 1, 0)) < 0 && errno == EINTR) {}
+    }
+    if (n != 1) {
+        log_msg(LOG_ERR, "이전 서버 프로세스가 넘기기를 확정하지 않았습니다. 이전 프로세스가 이어서 서비스합니다.");
+        close(h->sock);
+        h->sock = -1;
+        return -1;
+    }
+    wait_peer_exit(h);
+    close(h->sock);
+    h->sock = -1;
+    return 0;
+}
+
+// 받은 상태의 메모리를 해제 (디스크립터는 이미 서비스에 넘겼으므로 닫지 않음)
+void handoff_free(struct Handoff *h) {
+    for (size_t i = 0; i < h->count; i++) {
+        free(h->clients[i].in);
+        free(h->clients[i].out);
+    }
+    free(h->clients);
+    free(h->listen_fds);
+    free(h->spool);
+    h->clients = NULL;
+    h->listen_fds = NULL;
+    h->spool = NULL;
+    h->count = 0;
+}
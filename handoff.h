@@ -0,0 +1,99 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "protocol.h"
+#include "room.h"
+#include "spool.h"
+
+#define HANDOFF_SOCKET_PATH "/tmp/chat_server_handoff.sock"    // 무중단 재시작 소켓 기본 경로 (-U 옵션으로 변경)
+#define HANDOFF_MAGIC 0x43484f46    // "CHOF"
+#define HANDOFF_VERSION 2           // 넘기는 상태의 형식 (struct HandoffState, struct HandoffConn을 바꾸면 올림)
+#define HANDOFF_MSG_MAX (64 * 1024) // SOCK_SEQPACKET 메시지 하나의 최대 크기
+#define HANDOFF_MAX_FDS 250         // 메시지 하나에 담는 최대 디스크립터 수 (커널 한도 SCM_MAX_FD 253 이하)
+#define HANDOFF_QUIESCE_MS 2000     // 진행 중인 io_uring 송신이 끝나기를 기다리는 최대 시간 (넘으면 그 연결은 끊음)
+#define HANDOFF_ACK_SEC 30          // 새 프로세스가 서비스 준비를 마쳤다고(이전 프로세스가 종료한다고) 알려 오기를 기다리는 최대 시간
+#define HANDOFF_DRAIN_MS 50         // 줄어드는 샤드의 서버 소켓은 이 시간 동안 새 연결이 없어야 닫음 (연결 중이던 클라이언트가 끊기지 않도록)
+
+// 새 프로세스가 처음 보내는 요청
+struct HandoffHello {
+    uint32_t magic;
+    uint32_t version;
+};
+
+// 서버 전체 상태 (디스크립터: 샤드마다 서버 소켓 nlisten개, 이어서 중계 서버 소켓이 있으면 하나)
+struct HandoffState {
+    uint32_t nlisten;           // 샤드 수만큼의 서버 소켓
+    uint32_t has_relay;         // 중계 서버 소켓을 넘기는지 여부
+    uint32_t node_id;           // 중계 서버 번호 (새 프로세스가 이어서 씀)
+    uint64_t relay_seq;         // 마지막으로 매긴 중계 순번
+    uint32_t spool_len;         // 이어서 오는 스풀 파일 목록 크기
+};
+
+enum HandoffKind {
+    HANDOFF_CONN = 1,           // 연결 하나
+    HANDOFF_END                 // 마지막
+};
+
+// 연결 하나의 상태 (디스크립터: 소켓, 올리는 중인 파일, 내려보내는 중인 파일 순서로 있는 것만)
+// 뒤에 아직 처리하지 않은 수신 데이터 in_len바이트와 보내지 못한 송신 데이터 out_len바이트가 이어진다.
+struct HandoffConn {
+    uint32_t kind;              // enum HandoffKind
+    int32_t state;              // reactor의 연결 상태 (로그인 전, 채팅 중)
+    int32_t proto;              // enum Proto
+    char id[MAX_ID_LEN];
+    char room[MAX_ROOM_NAME];   // 들어가 있는 방 이름 (새 프로세스는 방 번호를 새로 정함)
+    uint32_t in_len;
+    uint32_t out_len;
+    uint32_t has_upload;
+    uint32_t has_file;
+    struct SpoolUpload upload;  // fd는 넘긴 디스크립터로 바뀜
+    struct SpoolSend file;
+};
+
+// 새 프로세스가 받은 연결 (디스크립터는 받은 것, in/out은 malloc한 복사본)
+struct HandoffClient {
+    struct HandoffConn conn;
+    int fd;
+    int upload_fd;
+    int file_fd;
+    char *in;
+    char *out;
+};
+
+// 새 프로세스가 받은 전체 상태
+struct Handoff {
+    int sock;                   // 이전 프로세스와의 연결 (handoff_finish에서 닫음)
+    pid_t peer;                 // 이전 프로세스 (종료를 기다림)
+    struct HandoffState state;
+    int *listen_fds;            // state.nlisten개
+    int relay_fd;               // -1이면 없음
+    void *spool;                // 스풀 파일 목록 (state.spool_len바이트)
+    struct HandoffClient *clients;
+    size_t count;
+};
+
+// 이전 프로세스가 상태를 쓰는 버퍼 (HANDOFF_MSG_MAX마다, 디스크립터는 그 항목이 시작되는 메시지에 붙여 보냄)
+struct HandoffWriter {
+    int sock;
+    size_t len;
+    int nfds;
+    int fds[HANDOFF_MAX_FDS];
+    char buf[HANDOFF_MSG_MAX];
+};
+
+int handoff_listen(const char *path);
+int handoff_accept(int lsock);
+int handoff_put(struct HandoffWriter *w, const void *data, size_t len, const int *fds, int nfds);
+int handoff_flush(struct HandoffWriter *w);
+int handoff_wait_ack(int sock);
+int handoff_confirm(int sock);
+
+int handoff_receive(const char *path, struct Handoff *h);
+int handoff_finish(struct Handoff *h);
+void handoff_free(struct Handoff *h);
+
+#endif
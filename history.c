@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "history.h"
+
+// 채팅 기록 초기화 (mem_cap이 0이면 임시 스필 파일을, 아니면 mem_cap 바이트 메모리 원형 아레나를 사용)
+// 스필 파일을 만들 수 없으면 8MB 메모리 원형 아레나로 대신한다.
+int history_init(struct History *h, size_t mem_cap) {
+    memset(h, 0, sizeof(*h));
+    h->spill_fd = -1;
+
+    if (mem_cap == 0) {
+        const char *dir = getenv("TMPDIR");
+        char path[512];
+        snprintf(path, sizeof(path), "%s/chat_history_XXXXXX", dir ? dir : "/tmp");
+        int fd = mkstemp(path);
+        if (fd >= 0) {
+            unlink(path);    // 클라이언트가 종료되면 자동으로 지워지도록 이름을 없앰
+            void *map = MAP_FAILED;
+            if (ftruncate(fd, HISTORY_FILE_INITIAL) == 0) {
+                map = mmap(NULL, HISTORY_FILE_INITIAL, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (map != MAP_FAILED) {
+                h->arena = map;
+                h->arena_cap = HISTORY_FILE_INITIAL;
+                h->spill_fd = fd;
+            } else {
+                close(fd);
+            }
+        }
+        if (h->spill_fd < 0) mem_cap = 8 * 1024 * 1024;
+    }
+    if (h->spill_fd < 0) {
+        h->arena = malloc(mem_cap);
+        if (h->arena == NULL) return -1;
+        h->arena_cap = mem_cap;
+    }
+
+    // 메모리 상한 모드는 색인을 늘리지 않으므로 메시지 평균 32바이트를 기준으로 미리 잡음
+    h->entry_cap = HISTORY_ENTRIES_INITIAL;
+    while (h->spill_fd < 0 && h->entry_cap < h->arena_cap / 32) h->entry_cap *= 2;
+    h->entries = malloc(h->entry_cap * sizeof(struct HistoryEntry));
+    if (h->entries == NULL) return -1;
+    return 0;
+}
+
+// 가장 오래된 메시지를 버림 (메모리 상한 모드)
+static void history_evict(struct History *h) {
+    h->first++;
+    h->count--;
+}
+
+static struct HistoryEntry *oldest(const struct History *h) {
+    return &h->entries[h->first & (h->entry_cap - 1)];
+}
+
+// 스필 파일과 mmap 영역을 두 배로 늘림 (복사 없이 커널이 매핑만 옮김)
+static int grow_spill(struct History *h, size_t need) {
+    size_t cap = h->arena_cap;
+    while (cap < need) cap *= 2;
+    if (ftruncate(h->spill_fd, cap) < 0) return -1;
+    void *map = mremap(h->arena, h->arena_cap, cap, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) return -1;
+    h->arena = map;
+    h->arena_cap = cap;
+    return 0;
+}
+
+// 원형 색인을 두 배로 늘리고 가장 오래된 메시지부터 다시 배치 (스필 파일 모드)
+static int grow_entries(struct History *h) {
+    size_t cap = h->entry_cap * 2;
+    struct HistoryEntry *entries = malloc(cap * sizeof(struct HistoryEntry));
+    if (entries == NULL) return -1;
+    for (size_t i = 0; i < h->count; i++) {
+        entries[(h->first + i) & (cap - 1)] = h->entries[(h->first + i) & (h->entry_cap - 1)];
+    }
+    free(h->entries);
+    h->entries = entries;
+    h->entry_cap = cap;
+    return 0;
+}
+
+// 메시지를 기록에 추가 (기록 크기와 관계없이 O(1), 늘리는 비용은 분할 상환)
+int history_add(struct History *h, const char *id, size_t id_len, const char *text, size_t len) {
+    size_t size = id_len + len;
+
+    if (h->spill_fd >= 0) {
+        if (h->write_pos + size > h->arena_cap && grow_spill(h, h->write_pos + size) < 0) return -1;
+        if (h->count == h->entry_cap && grow_entries(h) < 0) return -1;
+    } else {
+        if (size > h->arena_cap) return -1;
+        if (h->write_pos + size > h->arena_cap) {
+            // 아레나 끝에 남은 자리는 비워 두고 처음으로 돌아감 (그 뒤에 있던 가장 오래된 메시지부터 버림)
+            while (h->count > 0 && oldest(h)->off >= h->write_pos) history_evict(h);
+            h->write_pos = 0;
+        }
+        // 새 메시지가 덮어쓰는 자리에 있던 메시지를 버림
+        while (h->count > 0 && oldest(h)->off >= h->write_pos && oldest(h)->off < h->write_pos + size) {
+            history_evict(h);
+        }
+        if (h->count == h->entry_cap) history_evict(h);
+    }
+
+    memcpy(h->arena + h->write_pos, id, id_len);
+    memcpy(h->arena + h->write_pos + id_len, text, len);
+    struct HistoryEntry *e = &h->entries[history_end(h) & (h->entry_cap - 1)];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    e->off = h->write_pos;
+    e->ts = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    e->id_len = (uint32_t)id_len;
+    e->len = (uint32_t)len;
+    h->write_pos += size;
+    h->count++;
+    return 0;
+}
+
+// 처음부터 센 번호가 n인 메시지를 꺼냄 (이미 버렸거나 없으면 -1)
+int history_get(const struct History *h, size_t n, struct HistoryMsg *msg) {
+    if (n < h->first || n >= history_end(h)) return -1;
+    const struct HistoryEntry *e = &h->entries[n & (h->entry_cap - 1)];
+    msg->ts = e->ts;
+    msg->id = h->arena + e->off;
+    msg->id_len = e->id_len;
+    msg->text = msg->id + e->id_len;
+    msg->len = e->len;
+    return 0;
+}
+
+// 받은 시각이 ts 이후인 첫 메시지 번호 (메시지는 받은 순서대로 쌓이므로 이진 탐색)
+size_t history_find_time(const struct History *h, int64_t ts) {
+    size_t lo = h->first, hi = history_end(h);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (h->entries[mid & (h->entry_cap - 1)].ts < ts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,53 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_FILE_INITIAL (1024 * 1024)  // 스필 파일 처음 크기 (가득 차면 두 배로 늘림)
+#define HISTORY_ENTRIES_INITIAL 1024        // 메시지 색인 처음 크기 (2의 거듭제곱)
+
+// 메시지 하나의 위치 (아레나에는 아이디와 내용이 구분자 없이 이어서 저장됨)
+struct HistoryEntry {
+    uint64_t off;           // 아레나 안의 위치
+    int64_t ts;             // 받은 시각 (밀리초 단위 UNIX 시간)
+    uint32_t len;           // 내용 길이
+    uint32_t id_len;        // 아이디 길이
+};
+
+// 클라이언트 채팅 기록
+// 메시지를 가변 길이로 아레나 끝에 이어 쓰고, 위치는 원형 색인에 기록하므로 새 메시지는 항상 O(1)이다.
+// spill_fd가 있으면 아레나는 지워진 임시 파일을 mmap한 것으로, 가득 차면 파일을 늘려 오래된 기록을
+// 모두 보관한다(메모리에 올라가 있지 않은 부분은 커널이 파일에서 다시 읽음). spill_fd가 -1이면
+// 크기가 정해진 메모리 원형 아레나로, 자리가 모자라면 가장 오래된 메시지부터 버린다.
+struct History {
+    char *arena;            // 메시지 저장 공간
+    size_t arena_cap;       // 아레나 크기
+    size_t write_pos;       // 다음 메시지를 쓸 위치
+    int spill_fd;           // 스필 파일 (-1이면 메모리 상한 모드)
+    struct HistoryEntry *entries;   // 메시지 위치 원형 색인
+    size_t entry_cap;       // 색인 크기 (2의 거듭제곱)
+    size_t first;           // 보관 중인 가장 오래된 메시지 번호 (처음부터 센 번호)
+    size_t count;           // 보관 중인 메시지 수
+};
+
+// 꺼낸 메시지 (아레나를 가리키며 null 종료되지 않음)
+struct HistoryMsg {
+    int64_t ts;
+    const char *id;
+    size_t id_len;
+    const char *text;
+    size_t len;
+};
+
+int history_init(struct History *h, size_t mem_cap);
+int history_add(struct History *h, const char *id, size_t id_len, const char *text, size_t len);
+int history_get(const struct History *h, size_t n, struct HistoryMsg *msg);
+size_t history_find_time(const struct History *h, int64_t ts);
+
+// 처음부터 센 다음 메시지 번호 (보관 중인 메시지는 first부터 이 값 - 1까지)
+static inline size_t history_end(const struct History *h) {
+    return h->first + h->count;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "ipc.h"
+
+static pid_t ipc_pid;    // 칸에 기록할 이 프로세스의 pid (레코드마다 getpid()를 부르지 않도록)
+
+static void ipc_after_fork(void) {
+    ipc_pid = getpid();
+}
+
+// 공유 메모리 링 버퍼와 doorbell eventfd 생성 (fork() 전에 호출해야 자식 프로세스와 공유됨)
+struct IpcRing *ipc_ring_create(void) {
+    struct IpcRing *r = mmap(NULL, sizeof(struct IpcRing), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED) return NULL;
+
+    atomic_init(&r->head, 0);
+    r->tail = 0;
+    atomic_init(&r->sleeping, 0);
+    for (size_t i = 0; i < IPC_RING_SLOTS; i++) {
+        atomic_init(&r->slots[i].seq, i);
+        r->slots[i].owner = 0;
+    }
+    r->doorbell = eventfd(0, EFD_NONBLOCK);
+    if (r->doorbell < 0) {
+        munmap(r, sizeof(struct IpcRing));
+        return NULL;
+    }
+    ipc_pid = getpid();
+    pthread_atfork(NULL, NULL, ipc_after_fork);
+    return r;
+}
+
+// 부모 프로세스가 잠들어 있으면 doorbell을 울림
+static void ipc_ring_wake(struct IpcRing *r) {
+    atomic_thread_fence(memory_order_seq_cst);    // 레코드 게시가 sleeping 확인보다 먼저 보이도록 보장
+    if (atomic_exchange(&r->sleeping, 0)) {
+        uint64_t one = 1;
+        write(r->doorbell, &one, sizeof(one));
+    }
+}
+
+// 빈 칸 하나를 예약하고 쓸 위치를 반환 (링이 가득 차면 부모 프로세스가 비울 때까지 기다림)
+struct IpcMessage *ipc_ring_reserve(struct IpcRing *r, size_t *pos) {
+    size_t p = atomic_load_explicit(&r->head, memory_order_relaxed);
+    while (1) {
+        struct IpcSlot *slot = &r->slots[p & (IPC_RING_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)p;
+        if (dif == 0) {    // 비어 있는 칸: 다른 생산자보다 먼저 예약
+            if (atomic_compare_exchange_weak_explicit(&r->head, &p, p + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                slot->owner = ipc_pid;
+                *pos = p;
+                return &slot->msg;
+            }
+        } else if (dif < 0) {    // 링이 가득 참: 부모 프로세스를 깨우고 잠시 양보
+            ipc_ring_wake(r);
+            sched_yield();
+            p = atomic_load_explicit(&r->head, memory_order_relaxed);
+        } else {    // 다른 생산자가 먼저 예약함
+            p = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+}
+
+// 예약한 칸에 레코드를 다 썼음을 알리고 필요하면 부모 프로세스를 깨움
+void ipc_ring_publish(struct IpcRing *r, size_t pos) {
+    atomic_store_explicit(&r->slots[pos & (IPC_RING_SLOTS - 1)].seq, pos + 1, memory_order_release);
+    ipc_ring_wake(r);
+}
+
+// 다음 레코드를 반환 (없으면 NULL, 부모 프로세스 전용)
+struct IpcMessage *ipc_ring_peek(struct IpcRing *r) {
+    struct IpcSlot *slot = &r->slots[r->tail & (IPC_RING_SLOTS - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    return (seq == r->tail + 1) ? &slot->msg : NULL;
+}
+
+// ipc_ring_peek()로 꺼낸 레코드의 칸을 생산자에게 돌려줌
+void ipc_ring_release(struct IpcRing *r) {
+    struct IpcSlot *slot = &r->slots[r->tail & (IPC_RING_SLOTS - 1)];
+    slot->owner = 0;    // 다음 생산자가 예약한 뒤 owner를 쓰기 전까지는 어느 프로세스의 칸도 아님
+    atomic_store_explicit(&slot->seq, r->tail + IPC_RING_SLOTS, memory_order_release);
+    r->tail++;
+}
+
+// 종료한 프로세스 pid가 예약만 하고 게시하지 못한 칸을 IPC_SKIP 레코드로 게시 (부모 프로세스 전용, 게시한 칸 수 반환)
+// 그대로 두면 ipc_ring_peek()가 그 칸에서 멈추고 링이 가득 차 다른 자식 프로세스들도 모두 멈춘다.
+// waitpid()로 거둔 뒤에 호출하므로 그 프로세스가 칸에 더 쓰는 일은 없다.
+int ipc_ring_reap(struct IpcRing *r, pid_t pid) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    int count = 0;
+    for (size_t p = r->tail; p != head; p++) {
+        struct IpcSlot *slot = &r->slots[p & (IPC_RING_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != p || slot->owner != pid) continue;
+        slot->msg.type = IPC_SKIP;
+        slot->msg.handle = CONN_HANDLE_NONE;
+        atomic_store_explicit(&slot->seq, p + 1, memory_order_release);
+        count++;
+    }
+    return count;
+}
+
+// 부모 프로세스가 doorbell을 기다리기 직전에 호출 (이미 레코드가 있으면 0을 반환하고 기다리지 않음)
+int ipc_ring_prepare_wait(struct IpcRing *r) {
+    atomic_store(&r->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);    // sleeping 설정이 링 확인보다 먼저 보이도록 보장
+    if (ipc_ring_peek(r) != NULL) {
+        atomic_store(&r->sleeping, 0);
+        return 0;
+    }
+    return 1;
+}
+
+// doorbell에서 깨어난 뒤 호출 (eventfd 카운터를 비움)
+void ipc_ring_finish_wait(struct IpcRing *r) {
+    uint64_t count;
+    atomic_store(&r->sleeping, 0);
+    read(r->doorbell, &count, sizeof(count));
+}
@@ -0,0 +1,50 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "protocol.h"
+#include "conn.h"
+
+#define IPC_RING_SLOTS 1024     // 링 버퍼 칸 수 (2의 거듭제곱)
+#define IPC_SKIP (-1)           // 예약한 자식 프로세스가 다 쓰기 전에 종료한 칸 (부모 프로세스가 건너뜀)
+
+// 자식 프로세스가 부모 프로세스에게 보내는 레코드
+struct IpcMessage {
+    int type;               // FRAME_LOGIN: 로그인 완료 알림, FRAME_CHAT: 브로드캐스트 요청, FRAME_RELAY: 다른 서버에서 중계된 메시지
+    ConnHandle handle;      // 보낸 자식 프로세스가 맡은 연결 (부모 프로세스의 연결 테이블 핸들, FRAME_RELAY는 CONN_HANDLE_NONE)
+    int proto;              // 클라이언트 프로토콜 (FRAME_LOGIN), 방 번호 (FRAME_RELAY)
+    size_t len;             // 메시지 길이 (FRAME_CHAT)
+    uint64_t received;      // 자식 프로세스가 레코드를 받은 시각 (metric_now_us(), 처리 지연 측정용)
+    struct Message msg;     // 구 버전 클라이언트에게 그대로 보낼 수 있는 형태로 저장
+};
+
+struct IpcSlot {
+    atomic_size_t seq;      // 칸의 상태를 나타내는 순번 (생산자/소비자 동기화용)
+    pid_t owner;            // 칸을 예약한 프로세스 (게시 전에 종료하면 부모 프로세스가 건너뛸 수 있도록, 비어 있으면 0)
+    struct IpcMessage msg;
+};
+
+// fork() 전에 공유 메모리에 만드는 다중 생산자 / 단일 소비자 링 버퍼
+// 자식 프로세스들은 빈 칸을 CAS로 예약해 레코드를 쓰고, 부모 프로세스는 순서대로 꺼낸다.
+struct IpcRing {
+    atomic_size_t head;         // 다음에 예약할 위치 (생산자들이 공유)
+    char pad1[64 - sizeof(atomic_size_t)];
+    size_t tail;                // 다음에 꺼낼 위치 (부모 프로세스만 사용)
+    atomic_int sleeping;        // 부모 프로세스가 doorbell을 기다리는 중인지 여부
+    int doorbell;               // 부모 프로세스를 깨우는 eventfd
+    char pad2[64 - sizeof(size_t) - sizeof(atomic_int) - sizeof(int)];
+    struct IpcSlot slots[IPC_RING_SLOTS];
+};
+
+struct IpcRing *ipc_ring_create(void);
+struct IpcMessage *ipc_ring_reserve(struct IpcRing *r, size_t *pos);
+void ipc_ring_publish(struct IpcRing *r, size_t pos);
+struct IpcMessage *ipc_ring_peek(struct IpcRing *r);
+void ipc_ring_release(struct IpcRing *r);
+int ipc_ring_reap(struct IpcRing *r, pid_t pid);
+int ipc_ring_prepare_wait(struct IpcRing *r);
+void ipc_ring_finish_wait(struct IpcRing *r);
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "log.h"
+
+#define LOG_BATCH_BYTES (64 * 1024)     // 파일에 한 번에 쓰는 최대 크기
+
+int log_level = LOG_NOTICE;
+
+static struct LogRing *log_ring;    // 공유 메모리 로그 링 버퍼 (log_init() 전에는 NULL)
+static int log_fd = -1;             // 로그 파일 (-1이면 syslog로 보냄)
+static pid_t log_owner;             // 백그라운드 스레드를 실행하는 프로세스
+static pid_t log_pid;               // 현재 프로세스 ID (getpid()는 매번 시스템 콜이므로 fork() 때만 갱신)
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;    // 백그라운드 스레드와 log_sync가 함께 비우지 않도록
+
+static const char *level_names[] = {
+    [LOG_EMERG] = "emerg", [LOG_ALERT] = "alert", [LOG_CRIT] = "crit", [LOG_ERR] = "err",
+    [LOG_WARNING] = "warning", [LOG_NOTICE] = "notice", [LOG_INFO] = "info", [LOG_DEBUG] = "debug",
+};
+
+// 레벨 이름(err, warning, notice, info, debug)을 syslog 우선순위로 변환 (모르는 이름이면 -1)
+int log_level_from_name(const char *name) {
+    for (int i = 0; i <= LOG_DEBUG; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static void log_after_fork(void) {
+    log_pid = getpid();
+}
+
+// 로그 링 버퍼를 만들고 로그 파일을 엶 (path가 NULL이면 syslog로 보냄)
+// 데몬화하면 작업 디렉토리가 바뀌므로 데몬화 전에 호출하고, 링은 fork() 전에 만들어야 자식 프로세스와 공유된다.
+int log_init(const char *path, int level) {
+    log_level = level;
+    if (path != NULL) {
+        log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (log_fd < 0) {
+            perror("open(log)");
+            return -1;
+        }
+    }
+
+    struct LogRing *r = mmap(NULL, sizeof(struct LogRing), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED) {
+        perror("mmap(log)");
+        return -1;
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->dropped, 0);
+    r->tail = 0;
+    for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+        atomic_init(&r->slots[i].seq, i);
+    }
+    log_ring = r;
+    log_pid = getpid();
+    pthread_atfork(NULL, NULL, log_after_fork);
+    return 0;
+}
+
+// 로그 한 줄을 링 버퍼에 넣음 (시스템 콜 없이 포맷만 하며, 링이 가득 차면 기다리지 않고 버림)
+void log_write(int level, const char *fmt, ...) {
+    va_list ap;
+    struct LogRing *r = log_ring;
+
+    if (r == NULL) {    // 초기화 전에는 syslog로 바로 보냄
+        va_start(ap, fmt);
+        vsyslog(level, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    size_t p = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct LogSlot *slot;
+    while (1) {
+        slot = &r->slots[p & (LOG_RING_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)p;
+        if (dif == 0) {    // 비어 있는 칸: 다른 생산자보다 먼저 예약
+            if (atomic_compare_exchange_weak_explicit(&r->head, &p, p + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {    // 링이 가득 참: 입출력 경로를 막지 않도록 버림
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return;
+        } else {    // 다른 생산자가 먼저 예약함
+            p = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->pid = log_pid;
+    clock_gettime(CLOCK_REALTIME, &slot->ts);    // vDSO로 처리되어 시스템 콜이 일어나지 않음
+    va_start(ap, fmt);
+    vsnprintf(slot->text, LOG_LINE_MAX, fmt, ap);
+    va_end(ap);
+    atomic_store_explicit(&slot->seq, p + 1, memory_order_release);
+}
+
+// 링이 가득 차서 버린 줄 수
+unsigned long log_dropped(void) {
+    return log_ring ? atomic_load_explicit(&log_ring->dropped, memory_order_relaxed) : 0;
+}
+
+// 로그 한 줄을 "시각 [레벨] (pid) 내용" 형식으로 out에 붙임
+static size_t format_line(char *out, size_t cap, const struct LogSlot *slot) {
+    struct tm tm;
+    char when[32];
+    localtime_r(&slot->ts.tv_sec, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    int n = snprintf(out, cap, "%s.%03ld [%s] (%d) %s\n", when, slot->ts.tv_nsec / 1000000,
+                     level_names[slot->level & LOG_PRIMASK], (int)slot->pid, slot->text);
+    return (n < 0) ? 0 : ((size_t)n < cap ? (size_t)n : cap - 1);
+}
+
+// 링 버퍼에 쌓인 로그를 모두 꺼내 파일(한 번의 write로 묶어서) 또는 syslog로 보냄
+static void log_flush(struct LogRing *r) {
+    static char batch[LOG_BATCH_BYTES];
+    static unsigned long reported;
+    size_t used = 0;
+
+    while (1) {
+        struct LogSlot *slot = &r->slots[r->tail & (LOG_RING_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != r->tail + 1) break;
+
+        if (log_fd < 0) {
+            if (slot->pid == log_owner) {
+                syslog(slot->level, "%s", slot->text);
+            } else {
+                syslog(slot->level, "(%d) %s", (int)slot->pid, slot->text);
+            }
+        } else {
+            if (used + LOG_LINE_MAX + 64 > sizeof(batch)) {
+                write(log_fd, batch, used);
+                used = 0;
+            }
+            used += format_line(batch + used, sizeof(batch) - used, slot);
+        }
+        atomic_store_explicit(&slot->seq, r->tail + LOG_RING_SLOTS, memory_order_release);
+        r->tail++;
+    }
+
+    // 지난번 이후 버린 줄이 있으면 알림
+    unsigned long dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    if (dropped != reported) {
+        char line[96];
+        int n = snprintf(line, sizeof(line), "로그 링 버퍼가 가득 차서 %lu줄을 버렸습니다. (누적 %lu줄)",
+                         dropped - reported, dropped);
+        if (log_fd < 0) {
+            syslog(LOG_WARNING, "%s", line);
+        } else if (used + n + 1 <= sizeof(batch)) {
+            memcpy(batch + used, line, n);
+            used += n;
+            batch[used++] = '\n';
+        }
+        reported = dropped;
+    }
+    if (used > 0) {
+        write(log_fd, batch, used);
+    }
+}
+
+// 백그라운드 로그 스레드: 주기적으로 링 버퍼를 비움
+static void *log_thread(void *arg) {
+    struct LogRing *r = arg;
+    struct timespec period = { .tv_sec = 0, .tv_nsec = LOG_FLUSH_MS * 1000000L };
+    while (1) {
+        pthread_mutex_lock(&flush_lock);
+        log_flush(r);
+        pthread_mutex_unlock(&flush_lock);
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+// 링 버퍼에 남은 로그를 바로 씀 (프로세스를 끝내기 전에 호출, 백그라운드 스레드를 시작한 프로세스에서만)
+void log_sync(void) {
+    if (log_ring == NULL || log_owner != log_pid) return;
+    pthread_mutex_lock(&flush_lock);
+    log_flush(log_ring);
+    pthread_mutex_unlock(&flush_lock);
+}
+
+// 백그라운드 로그 스레드 시작 (데몬화한 뒤 링 버퍼를 비울 프로세스에서 호출)
+int log_start(void) {
+    pthread_t thread;
+    if (log_ring == NULL) return -1;
+    log_owner = getpid();
+
+    // 메인 루프가 signalfd로 받는 SIGCHLD를 이 스레드가 가로채지 않도록 모든 시그널을 막은 채로 만듦
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&thread, NULL, log_thread, log_ring);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define LOG_RING_SLOTS 4096     // 로그 링 버퍼 칸 수 (2의 거듭제곱)
+#define LOG_LINE_MAX 256        // 로그 한 줄 최대 길이 (넘으면 잘림)
+#define LOG_FLUSH_MS 50         // 백그라운드 스레드가 링 버퍼를 비우는 주기
+
+// 로그 한 줄 (레벨은 syslog 우선순위 LOG_ERR ~ LOG_DEBUG를 그대로 사용)
+struct LogSlot {
+    atomic_size_t seq;      // 칸의 상태를 나타내는 순번 (생산자/소비자 동기화용)
+    int level;
+    pid_t pid;              // 로그를 남긴 프로세스 (fork 모드의 자식 프로세스 구분용)
+    struct timespec ts;     // 로그를 남긴 시각
+    char text[LOG_LINE_MAX];
+};
+
+// fork() 전에 공유 메모리에 만드는 다중 생산자 / 단일 소비자 로그 링 버퍼
+// 생산자(reactor 스레드, 자식 프로세스)는 빈 칸이 없으면 기다리지 않고 줄을 버리며,
+// 부모 프로세스의 백그라운드 스레드만 링을 비워 파일이나 syslog에 한꺼번에 쓴다.
+struct LogRing {
+    atomic_size_t head;         // 다음에 예약할 위치 (생산자들이 공유)
+    char pad1[64 - sizeof(atomic_size_t)];
+    atomic_ulong dropped;       // 링이 가득 차서 버린 줄 수
+    char pad2[64 - sizeof(atomic_ulong)];
+    size_t tail;                // 다음에 꺼낼 위치 (백그라운드 스레드만 사용)
+    struct LogSlot slots[LOG_RING_SLOTS];
+};
+
+extern int log_level;   // 이 레벨보다 덜 중요한 로그는 포맷하지 않고 버림
+
+// 레벨이 꺼져 있으면 인자도 계산하지 않음
+#define log_msg(level, ...) do { \
+    if ((level) <= log_level) log_write((level), __VA_ARGS__); \
+} while (0)
+
+int log_level_from_name(const char *name);
+int log_init(const char *path, int level);
+int log_start(void);
+void log_sync(void);
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+unsigned long log_dropped(void);
+
+#endif
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+#include "log.h"
+#include "store.h"
+
+#define METRICS_TEXT_MAX (16 * 1024)    // 관리 소켓으로 보내는 통계 텍스트 최대 크기
+
+// fork() 전에 공유 메모리에 만드는 통계 영역
+// 앞의 METRICS_THREAD_SLOTS칸은 reactor 스레드와 부모 프로세스가, 나머지는 연결 테이블의
+// 슬롯 번호에 따라 자식 프로세스가 쓴다. (같은 슬롯의 자식 프로세스는 한 번에 하나뿐이므로 쓰는 쪽은 항상 하나)
+struct MetricsShared {
+    atomic_uint next_thread;    // 다음에 나누어 줄 스레드 칸
+    atomic_uint child_high;     // 자식 프로세스가 쓴 가장 큰 칸 번호 + 1 (읽을 때 그 뒤는 건너뜀)
+    char pad[64 - 2 * sizeof(atomic_uint)];
+    struct MetricSlot slots[];
+};
+
+__thread struct MetricSlot *metric_slot;
+
+static struct MetricsShared *metrics;   // 공유 통계 영역 (metrics_init() 전에는 NULL)
+static int metrics_child_slots;         // 자식 프로세스 칸 수
+static int admin_sock = -1;             // 관리용 유닉스 도메인 소켓
+static const char *server_mode;         // 서버 동작 모드 이름
+static time_t started;                  // 서버 시작 시각
+
+// 카운터 이름 (Prometheus 텍스트 형식)
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} counter_info[MC_COUNT] = {
+    [MC_ACCEPTED] = { "chat_connections_accepted_total", "counter", "Accepted connections" },
+    [MC_REJECTED] = { "chat_connections_rejected_total", "counter", "Connections rejected at the client limit" },
+    [MC_CLOSED] = { "chat_connections_closed_total", "counter", "Closed connections" },
+    [MC_MSG_IN] = { "chat_messages_in_total", "counter", "Chat messages received" },
+    [MC_MSG_OUT] = { "chat_messages_out_total", "counter", "Messages sent to clients" },
+    [MC_BYTES_IN] = { "chat_bytes_in_total", "counter", "Bytes received" },
+    [MC_BYTES_OUT] = { "chat_bytes_out_total", "counter", "Bytes sent" },
+    [MC_SEND_CALLS] = { "chat_send_calls_total", "counter", "send/sendmsg calls to clients" },
+    [MC_DROPPED] = { "chat_messages_dropped_total", "counter", "Messages dropped for slow clients" },
+    [MC_SLOW_CLOSED] = { "chat_slow_disconnects_total", "counter", "Slow clients disconnected" },
+    [MC_OUTQ_BYTES] = { "chat_outbound_queue_bytes", "gauge", "Bytes waiting in outbound queues" },
+    [MC_LOGIN_TIMEOUTS] = { "chat_login_timeouts_total", "counter", "Connections closed for not logging in in time" },
+    [MC_FILE_BYTES_OUT] = { "chat_file_bytes_sent_total", "counter", "File bytes sent with sendfile" },
+    [MC_RATE_LIMITED] = { "chat_rate_limited_total", "counter", "Messages that exceeded the per-client rate limit" },
+    [MC_RELAY_OUT] = { "chat_relay_sent_total", "counter", "Local chat messages relayed to other servers" },
+    [MC_RELAY_IN] = { "chat_relay_received_total", "counter", "Chat messages relayed from other servers and delivered locally" },
+    [MC_RELAY_DUPLICATES] = { "chat_relay_duplicates_total", "counter", "Relayed messages dropped as duplicates or loops" },
+    [MC_BYTES_COPIED] = { "chat_bytes_copied_total", "counter", "Message bytes copied in user space (encoding, IPC, store, relay)" },
+    [MC_BUF_ALLOCS] = { "chat_buffer_heap_allocs_total", "counter", "Message buffers allocated with malloc because the pool was empty" },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} hist_info[MH_COUNT] = {
+    [MH_FANOUT] = { "chat_fanout_us", "Time to send one broadcast to a room (microseconds)" },
+    [MH_PROCESS] = { "chat_process_us", "Time from receiving a chat message to finishing it (microseconds)" },
+};
+
+// 공유 통계 영역을 만들고 현재 스레드에 첫 번째 칸을 배정 (fork() 전에 호출해야 자식 프로세스와 공유됨)
+// 자식 프로세스 칸은 건드린 페이지만 실제 메모리를 차지한다.
+int metrics_init(int child_slots) {
+    size_t size = sizeof(struct MetricsShared) +
+                  (size_t)(METRICS_THREAD_SLOTS + child_slots) * sizeof(struct MetricSlot);
+    struct MetricsShared *m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED) {
+        perror("mmap(metrics)");
+        return -1;
+    }
+    atomic_init(&m->next_thread, 1);
+    atomic_init(&m->child_high, 0);
+    metrics = m;
+    metrics_child_slots = child_slots;
+    metric_slot = &m->slots[0];
+    started = time(NULL);
+    return 0;
+}
+
+// 현재 스레드에 빈 칸을 배정 (reactor 스레드 시작 시 호출, 칸이 모자라면 이 스레드는 집계하지 않음)
+void metrics_thread_slot(void) {
+    if (metrics == NULL) return;
+    unsigned i = atomic_fetch_add(&metrics->next_thread, 1);
+    metric_slot = (i < METRICS_THREAD_SLOTS) ? &metrics->slots[i] : NULL;
+}
+
+// 자식 프로세스에 연결 테이블 슬롯 번호에 해당하는 칸을 배정
+// 칸은 같은 슬롯을 이어받는 다음 자식 프로세스가 계속 누적해서 쓴다.
+void metrics_child_slot(uint32_t index) {
+    if (metrics == NULL || index >= (uint32_t)metrics_child_slots) {
+        metric_slot = NULL;
+        return;
+    }
+    metric_slot = &metrics->slots[METRICS_THREAD_SLOTS + index];
+    unsigned high = atomic_load(&metrics->child_high);
+    while (high < index + 1 && !atomic_compare_exchange_weak(&metrics->child_high, &high, index + 1)) {}
+}
+
+// 모든 칸을 더해 한 번의 스냅샷으로 만듦
+static void metrics_collect(struct MetricSlot *total) {
+    memset(total, 0, sizeof(*total));
+    unsigned threads = atomic_load(&metrics->next_thread);
+    unsigned children = atomic_load(&metrics->child_high);
+    if (threads > METRICS_THREAD_SLOTS) threads = METRICS_THREAD_SLOTS;
+
+    for (unsigned i = 0; i < METRICS_THREAD_SLOTS + children; i++) {
+        if (i >= threads && i < METRICS_THREAD_SLOTS) continue;
+        const struct MetricSlot *s = &metrics->slots[i];
+        for (int c = 0; c < MC_COUNT; c++) {
+            total->counters[c] += __atomic_load_n(&s->counters[c], __ATOMIC_RELAXED);
+        }
+        for (int h = 0; h < MH_COUNT; h++) {
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                total->hist[h][b] += __atomic_load_n(&s->hist[h][b], __ATOMIC_RELAXED);
+            }
+            total->hist_sum[h] += __atomic_load_n(&s->hist_sum[h], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// out의 used 위치에 포맷한 문자열을 이어 씀 (넘치면 잘림)
+static void emit(char *out, size_t cap, size_t *used, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+static void emit(char *out, size_t cap, size_t *used, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out + *used, cap - *used, fmt, ap);
+    va_end(ap);
+    if (n > 0) *used += ((size_t)n < cap - *used) ? (size_t)n : cap - *used - 1;
+}
+
+// 스냅샷을 Prometheus 텍스트 형식으로 out에 씀 (쓴 길이 반환)
+static size_t metrics_format(char *out, size_t cap) {
+    struct MetricSlot t;
+    size_t used = 0;
+    metrics_collect(&t);
+
+    emit(out, cap, &used, "# HELP chat_info Server mode\n# TYPE chat_info gauge\nchat_info{mode=\"%s\"} 1\n", server_mode);
+    emit(out, cap, &used, "# TYPE chat_uptime_seconds gauge\nchat_uptime_seconds %ld\n", (long)(time(NULL) - started));
+    for (int c = 0; c < MC_COUNT; c++) {
+        emit(out, cap, &used, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", counter_info[c].name, counter_info[c].help,
+             counter_info[c].name, counter_info[c].type, counter_info[c].name, (long long)t.counters[c]);
+    }
+    emit(out, cap, &used, "# HELP chat_connections_active Connections currently open\n# TYPE chat_connections_active gauge\n"
+         "chat_connections_active %llu\n", (unsigned long long)(t.counters[MC_ACCEPTED] - t.counters[MC_CLOSED]));
+
+    for (int h = 0; h < MH_COUNT; h++) {
+        const char *name = hist_info[h].name;
+        uint64_t count = 0;
+        emit(out, cap, &used, "# HELP %s %s\n# TYPE %s histogram\n", name, hist_info[h].help, name);
+        for (int b = 0; b < METRICS_BUCKETS; b++) {    // 누적 구간 (마지막 구간은 나머지 전부)
+            count += t.hist[h][b];
+            if (b < METRICS_BUCKETS - 1) {
+                emit(out, cap, &used, "%s_bucket{le=\"%llu\"} %llu\n", name, 1ULL << b, (unsigned long long)count);
+            } else {
+                emit(out, cap, &used, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+            }
+        }
+        emit(out, cap, &used, "%s_sum %llu\n%s_count %llu\n", name, (unsigned long long)t.hist_sum[h], name, (unsigned long long)count);
+    }
+
+    emit(out, cap, &used, "# TYPE chat_log_dropped_total counter\nchat_log_dropped_total %lu\n", log_dropped());
+    if (store_enabled()) {
+        emit(out, cap, &used, "# TYPE chat_store_last_seq gauge\nchat_store_last_seq %llu\n", (unsigned long long)store_last_seq());
+    }
+    return used;
+}
+
+// 관리 소켓 스레드: 연결마다 스냅샷 하나를 보내고 닫음
+static void *admin_thread(void *arg) {
+    static char text[METRICS_TEXT_MAX];
+    struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+    (void)arg;
+
+    while (1) {
+        int fd = accept(admin_sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) log_msg(LOG_ERR, "관리 소켓 accept() 실패: %m");
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));    // 읽지 않는 클라이언트 때문에 멈추지 않도록
+        size_t len = metrics_format(text, sizeof(text));
+        for (size_t off = 0; off < len;) {
+            ssize_t n = send(fd, text + off, len - off, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            off += n;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// 관리용 유닉스 도메인 소켓을 열고 통계를 보내는 스레드 시작 (데몬화한 뒤 부모 프로세스에서 호출)
+// 다른 서버가 이미 쓰고 있는 경로이면 경고만 남기고 서버는 통계 없이 계속 동작한다.
+int metrics_serve(const char *path, const char *mode) {
+    struct sockaddr_un addr;
+    pthread_t thread;
+
+    if (metrics == NULL) return -1;
+    server_mode = mode;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_msg(LOG_WARNING, "관리 소켓 경로가 너무 깁니다: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    admin_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (admin_sock < 0) {
+        log_msg(LOG_WARNING, "관리 소켓 생성 실패: %m");
+        return -1;
+    }
+    // 남아 있는 소켓 파일이 살아 있는 서버의 것이면 지우지 않음
+    if (connect(admin_sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        log_msg(LOG_WARNING, "관리 소켓 %s을(를) 다른 서버가 사용 중입니다. 통계를 제공하지 않습니다.", path);
+        close(admin_sock);
+        admin_sock = -1;
+        return -1;
+    }
+    close(admin_sock);
+    unlink(path);
+    admin_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (admin_sock < 0 || bind(admin_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(path, 0600) < 0 || listen(admin_sock, 16) < 0) {
+        log_msg(LOG_WARNING, "관리 소켓 %s 열기 실패: %m", path);
+        if (admin_sock >= 0) close(admin_sock);
+        admin_sock = -1;
+        return -1;
+    }
+
+    // 메인 루프가 signalfd로 받는 SIGCHLD를 이 스레드가 가로채지 않도록 모든 시그널을 막은 채로 만듦
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&thread, NULL, admin_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        log_msg(LOG_WARNING, "관리 소켓 스레드 생성 실패");
+        return -1;
+    }
+    pthread_detach(thread);
+    log_msg(LOG_NOTICE, "관리 소켓 %s에서 통계를 제공합니다.", path);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_THREAD_SLOTS 64     // reactor 스레드와 부모 프로세스가 쓰는 칸 수 (자식 프로세스 칸은 그 뒤에 이어짐)
+#define METRICS_BUCKETS 32          // 히스토그램 구간 수 (i번째 구간은 2^i 마이크로초 이하)
+#define METRICS_SOCKET_PATH "/tmp/chat_server_admin.sock"   // 관리용 유닉스 도메인 소켓 기본 경로 (-A 옵션으로 변경)
+
+// 누적 카운터 (MC_OUTQ_BYTES만 늘었다 줄었다 하는 현재값)
+enum MetricCounter {
+    MC_ACCEPTED,        // 받아들인 연결
+    MC_REJECTED,        // 최대 클라이언트 수에 도달해 거부한 연결
+    MC_CLOSED,          // 종료된 연결
+    MC_MSG_IN,          // 받은 채팅 메시지
+    MC_MSG_OUT,         // 보낸 메시지 (브로드캐스트 수신자마다, 안내와 최근 메시지 포함)
+    MC_BYTES_IN,        // 받은 바이트
+    MC_BYTES_OUT,       // 보낸 바이트
+    MC_SEND_CALLS,      // 클라이언트에게 보낸 send/sendmsg 호출 수 (MC_MSG_OUT과 비교하면 모아 보낸 정도를 알 수 있음)
+    MC_DROPPED,         // 송신 대기열 상한 때문에 버린 메시지
+    MC_SLOW_CLOSED,     // 송신 대기열 상한 때문에 끊은 연결
+    MC_OUTQ_BYTES,      // 송신 대기열에 남아 있는 바이트
+    MC_LOGIN_TIMEOUTS,  // 로그인 시간 안에 로그인하지 않아 끊은 연결
+    MC_FILE_BYTES_OUT,  // sendfile로 보낸 파일 내용 바이트 (MC_BYTES_OUT에도 포함)
+    MC_RATE_LIMITED,    // 전송 속도 제한에 걸린 메시지 (버림, 늦춤, 연결 종료)
+    MC_RELAY_OUT,       // 다른 서버로 중계한 이 서버의 채팅 메시지
+    MC_RELAY_IN,        // 다른 서버에서 중계되어 와 이 서버의 방에 전달한 메시지
+    MC_RELAY_DUPLICATES,    // 이미 받았거나 자기 것이라 버린 중계 메시지
+    MC_BYTES_COPIED,    // 메시지 내용을 사용자 공간에서 복사한 바이트 (직렬화, 프로세스 간 전달, 저장, 중계)
+    MC_BUF_ALLOCS,      // 풀이 비어 있어 malloc으로 새로 할당한 메시지 버퍼
+    MC_COUNT
+};
+
+// 마이크로초 단위 히스토그램
+enum MetricHist {
+    MH_FANOUT,          // 브로드캐스트 한 번(같은 방 멤버 전체에 전송)에 걸린 시간
+    MH_PROCESS,         // 채팅 메시지를 받은 뒤 처리(저장, 브로드캐스트)가 끝날 때까지 걸린 시간
+    MH_COUNT
+};
+
+// 스레드(또는 자식 프로세스) 하나가 혼자 쓰는 칸
+// 쓰는 쪽은 잠금이나 원자적 덧셈 없이 자기 칸만 갱신하고, 읽는 쪽이 모든 칸을 더해서 보여 준다.
+struct MetricSlot {
+    uint64_t counters[MC_COUNT];
+    uint64_t hist[MH_COUNT][METRICS_BUCKETS];
+    uint64_t hist_sum[MH_COUNT];    // 관측값 합계 (마이크로초)
+} __attribute__((aligned(64)));     // 이웃한 칸과 캐시 라인을 공유하지 않도록 정렬
+
+extern __thread struct MetricSlot *metric_slot;    // 현재 스레드의 칸 (초기화 전에는 NULL)
+
+int metrics_init(int child_slots);
+void metrics_thread_slot(void);
+void metrics_child_slot(uint32_t index);
+int metrics_serve(const char *path, const char *mode);
+
+// 자기 칸만 쓰므로 읽고 더해서 저장하면 되지만, 읽는 스레드가 찢어진 값을 보지 않도록 원자적으로 저장
+static inline void metric_add(int counter, int64_t n) {
+    struct MetricSlot *s = metric_slot;
+    if (s == NULL) return;
+    __atomic_store_n(&s->counters[counter], s->counters[counter] + (uint64_t)n, __ATOMIC_RELAXED);
+}
+
+// 단조 시계 (마이크로초, vDSO로 처리되어 시스템 콜이 일어나지 않음)
+static inline uint64_t metric_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 관측값 하나를 히스토그램에 기록 (2의 거듭제곱 구간이므로 나눗셈 없이 구간을 찾음)
+static inline void metric_observe(int hist, uint64_t us) {
+    struct MetricSlot *s = metric_slot;
+    if (s == NULL) return;
+    int b = (us <= 1) ? 0 : 64 - __builtin_clzll(us - 1);
+    if (b >= METRICS_BUCKETS) b = METRICS_BUCKETS - 1;
+    __atomic_store_n(&s->hist[hist][b], s->hist[hist][b] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->hist_sum[hist], s->hist_sum[hist] + us, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "protocol.h"
+
+#define FRAME_READER_MAX (FRAME_HEADER_LEN + 255 + FRAME_MAX_PAYLOAD)  // 수신 버퍼 최대 크기
+
+// 프레임을 out에 직렬화하고 전체 길이를 반환 (out은 frame_size() 이상이어야 함)
+size_t frame_encode(char *out, int type, const char *id, size_t id_len, const void *payload, size_t len) {
+    size_t hdr = frame_encode_header(out, type, 0, id, id_len, len);
+    if (len > 0) memcpy(out + hdr, payload, len);
+    return hdr + len;
+}
+
+// 헤더와 id만 직렬화하고 그 길이를 반환 (payload는 호출한 쪽이 뒤에 이어 보냄, 예: sendfile)
+size_t frame_encode_header(char *out, int type, int flags, const char *id, size_t id_len, size_t len) {
+    uint32_t nlen = htonl((uint32_t)len);
+    out[0] = (char)FRAME_MAGIC;
+    out[1] = (char)type;
+    out[2] = (char)id_len;
+    out[3] = (char)flags;
+    memcpy(out + 4, &nlen, sizeof(nlen));
+    if (id_len > 0) memcpy(out + FRAME_HEADER_LEN, id, id_len);
+    return FRAME_HEADER_LEN + id_len;
+}
+
+int frame_reader_init(struct FrameReader *r, size_t cap) {
+    r->buf = malloc(cap);
+    r->cap = r->buf ? cap : 0;
+    r->start = r->end = 0;
+    r->max = FRAME_READER_MAX;
+    return r->buf ? 0 : -1;
+}
+
+void frame_reader_free(struct FrameReader *r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->cap = r->start = r->end = 0;
+}
+
+// recv()로 데이터를 받을 위치와 크기를 반환 (더 이상 받을 수 없으면 NULL)
+char *frame_reader_space(struct FrameReader *r, size_t *avail) {
+    if (r->start > 0 && (r->end == r->cap || r->start >= r->cap / 2)) {  // 처리한 앞부분을 버리고 앞으로 당김
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->end == r->cap) {    // 버퍼가 가득 차면 최대 프레임 크기까지 두 배씩 늘림
+        size_t cap = r->cap ? r->cap * 2 : 4096;
+        if (cap > r->max) cap = r->max;
+        if (cap <= r->cap) {
+            *avail = 0;
+            return NULL;
+        }
+        char *p = realloc(r->buf, cap);
+        if (p == NULL) {
+            *avail = 0;
+            return NULL;
+        }
+        r->buf = p;
+        r->cap = cap;
+    }
+    *avail = r->cap - r->end;
+    return r->buf + r->end;
+}
+
+// recv()로 받은 n바이트를 버퍼에 반영
+void frame_reader_commit(struct FrameReader *r, size_t n) {
+    r->end += n;
+}
+
+// 완성된 프레임 하나를 꺼냄 (1: 프레임 있음, 0: 데이터 부족, -1: 잘못된 프레임)
+int frame_reader_next(struct FrameReader *r, struct Frame *f) {
+    size_t pending = r->end - r->start;
+    const unsigned char *p = (const unsigned char *)r->buf + r->start;
+    uint32_t nlen;
+
+    if (pending < FRAME_HEADER_LEN) return 0;
+    if (p[0] != FRAME_MAGIC) return -1;
+
+    memcpy(&nlen, p + 4, sizeof(nlen));
+    size_t len = ntohl(nlen);
+    if (len > FRAME_MAX_PAYLOAD) return -1;
+
+    size_t total = frame_size(p[2], len);
+    if (pending < total) return 0;
+
+    f->type = p[1];
+    f->flags = p[3];
+    f->id = (const char *)p + FRAME_HEADER_LEN;
+    f->id_len = p[2];
+    f->payload = f->id + f->id_len;
+    f->len = len;
+
+    r->start += total;
+    if (r->start == r->end) r->start = r->end = 0;    // 모두 처리했으면 버퍼를 비움
+    return 1;
+}
+
+// 고정 크기 레코드(구 버전 구조체)를 꺼냄 (데이터가 부족하면 NULL)
+const char *frame_reader_take(struct FrameReader *r, size_t n) {
+    if (r->end - r->start < n) return NULL;
+    const char *p = r->buf + r->start;
+    r->start += n;
+    if (r->start == r->end) r->start = r->end = 0;
+    return p;
+}
+
+// 처리하지 않은 데이터의 첫 바이트 (데이터가 없으면 -1)
+int frame_reader_peek(struct FrameReader *r) {
+    if (r->start == r->end) return -1;
+    return (unsigned char)r->buf[r->start];
+}
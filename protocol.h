@@ -0,0 +1,89 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TCP_PORT 5100
+#define MAX_ID_LEN 20
+#define MAX_PW_LEN 20
+
+// 구 버전 클라이언트가 사용하는 고정 크기 로그인 정보
+struct LoginInfo {
+    char id[MAX_ID_LEN];
+    char password[MAX_PW_LEN];
+};
+
+// 구 버전 클라이언트가 사용하는 고정 크기 메시지 (약 8KB)
+struct Message {
+    char id[MAX_ID_LEN];    // 메시지를 보낸 클라이언트의 아이디
+    char content[BUFSIZ];   // 메시지 내용
+};
+
+// ---------------------------------------------------------------------------
+// 가변 길이 프레임 프로토콜
+//
+//  0        1        2        3        4                 8
+//  +--------+--------+--------+--------+-----------------+--------+---------+
+//  | 0xFF   | type   | id_len | flags  | payload_len(BE) | id ... | payload |
+//  +--------+--------+--------+--------+-----------------+--------+---------+
+//
+// 첫 바이트 0xFF는 UTF-8 문자열에 나타나지 않으므로, 서버는 연결의 첫 바이트만 보고
+// 구 버전 클라이언트(struct LoginInfo로 시작)와 새 클라이언트를 구분할 수 있다.
+// ---------------------------------------------------------------------------
+
+#define FRAME_MAGIC 0xFF
+#define FRAME_HEADER_LEN 8
+#define FRAME_MAX_PAYLOAD (64 * 1024)   // 프레임 하나의 최대 payload 크기
+#define FRAME_MAX_TEXT (BUFSIZ - 1)     // 채팅 메시지 최대 길이 (구 버전 struct Message에 들어가는 크기)
+
+enum FrameType {
+    FRAME_LOGIN = 1,    // 클라이언트 -> 서버: id=아이디, payload=비밀번호
+    FRAME_LOGIN_OK,     // 서버 -> 클라이언트: payload=결과 문자열
+    FRAME_LOGIN_FAIL,   // 서버 -> 클라이언트: payload=실패 사유
+    FRAME_CHAT,         // 양방향: id=보낸 사람(클라이언트 -> 서버는 생략 가능), payload=메시지 내용
+    FRAME_FILE_PUT,     // 클라이언트 -> 서버: id=파일 이름, payload=파일 내용 일부 (마지막 조각은 FRAME_FLAG_LAST)
+    FRAME_FILE_DATA,    // 서버 -> 클라이언트: id=파일 이름, payload=파일 내용 일부 (/get 요청, 마지막 조각은 FRAME_FLAG_LAST)
+    FRAME_RELAY_HELLO,  // 서버 <-> 서버: payload=보낸 서버 번호 (중계 연결을 맺자마자 보냄)
+    FRAME_RELAY         // 서버 <-> 서버: payload=중계할 채팅 메시지 레코드들 (형식은 relay.c 참고)
+};
+
+#define FRAME_FLAG_LAST 0x01    // 파일의 마지막 조각 (FRAME_FILE_PUT, FRAME_FILE_DATA)
+
+// 수신한 프레임 (id와 payload는 FrameReader 버퍼를 가리키며 null 종료되지 않음)
+struct Frame {
+    int type;
+    int flags;
+    const char *id;
+    size_t id_len;
+    const char *payload;
+    size_t len;
+};
+
+// 부분 수신과 한 번에 여러 프레임 수신을 처리하는 증분 파서
+struct FrameReader {
+    char *buf;      // 수신 버퍼
+    size_t cap;     // 버퍼 크기
+    size_t start;   // 아직 처리하지 않은 데이터의 시작 위치
+    size_t end;     // 수신한 데이터의 끝 위치
+    size_t max;     // 버퍼를 늘릴 수 있는 최대 크기 (기본값은 가장 큰 프레임 하나)
+};
+
+// 헤더 + id + payload 전체 크기
+static inline size_t frame_size(size_t id_len, size_t len) {
+    return FRAME_HEADER_LEN + id_len + len;
+}
+
+size_t frame_encode(char *out, int type, const char *id, size_t id_len, const void *payload, size_t len);
+size_t frame_encode_header(char *out, int type, int flags, const char *id, size_t id_len, size_t len);
+
+int frame_reader_init(struct FrameReader *r, size_t cap);
+void frame_reader_free(struct FrameReader *r);
+char *frame_reader_space(struct FrameReader *r, size_t *avail);
+void frame_reader_commit(struct FrameReader *r, size_t n);
+int frame_reader_next(struct FrameReader *r, struct Frame *f);
+const char *frame_reader_take(struct FrameReader *r, size_t n);
+int frame_reader_peek(struct FrameReader *r);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RATE_BURST_SEC 2            // 버킷 크기 (초당 허용량의 몇 초 분량까지 몰아서 보낼 수 있는지)
+#define RATE_UNIT 1000000           // 토큰 하나를 나누는 단위 (마이크로초마다 초당 허용량만큼 채우므로 나눗셈이 없음)
+
+// 연결 하나의 토큰 버킷 (메시지 수와 바이트 수, 연결을 맡은 스레드나 프로세스만 쓰므로 잠금이 없음)
+// 토큰은 RATE_UNIT 단위 정수로 세고, 음수는 늦추기(RATE_DELAY)로 미리 당겨 쓴 빚이다.
+struct RateLimit {
+    uint64_t last;              // 마지막으로 토큰을 채운 시각 (마이크로초)
+    uint32_t msg_rate;          // 초당 메시지 수 (0이면 제한하지 않음)
+    uint32_t byte_rate;         // 초당 바이트 수 (0이면 제한하지 않음)
+    int64_t msgs;               // 남은 메시지 토큰
+    int64_t bytes;              // 남은 바이트 토큰
+    int64_t msg_cap;            // 메시지 버킷 크기
+    int64_t byte_cap;           // 바이트 버킷 크기
+};
+
+// 초당 rate개를 허용하는 버킷의 크기 (바이트 버킷은 가장 큰 프레임 하나는 항상 들어가도록)
+static inline int64_t rate_capacity(uint32_t rate, size_t min) {
+    uint64_t cap = (uint64_t)rate * RATE_BURST_SEC;
+    return (int64_t)(cap < min ? min : cap) * RATE_UNIT;
+}
+
+// 버킷을 가득 채운 상태로 초기화 (max_bytes는 한 번에 꺼낼 수 있는 최대 바이트 수)
+static inline void rate_limit_init(struct RateLimit *r, uint32_t msg_rate, uint32_t byte_rate, size_t max_bytes, uint64_t now_us) {
+    r->last = now_us;
+    r->msg_rate = msg_rate;
+    r->byte_rate = byte_rate;
+    r->msgs = r->msg_cap = rate_capacity(msg_rate, 1);
+    r->bytes = r->byte_cap = rate_capacity(byte_rate, max_bytes);
+}
+
+// 비용만큼 토큰을 꺼냄 (0이면 허용, 부족하면 토큰이 다시 찰 때까지 남은 마이크로초)
+// debt가 0이 아니면 부족해도 꺼내 빚으로 남기고, 돌려준 시간만큼 다음 메시지를 늦추게 한다.
+// 곱셈과 비교 몇 번뿐이므로 메시지마다 불러도 부담이 없다.
+static inline uint64_t rate_take(struct RateLimit *r, uint64_t now_us, uint32_t msgs, size_t bytes, int debt) {
+    if (r->msg_rate == 0 && r->byte_rate == 0) return 0;
+
+    uint64_t elapsed = now_us - r->last;
+    if (elapsed > (uint64_t)RATE_BURST_SEC * RATE_UNIT) elapsed = (uint64_t)RATE_BURST_SEC * RATE_UNIT;    // 곱셈 넘침 방지 (버킷은 그 전에 가득 참)
+    r->last = now_us;
+
+    int64_t msg_cost = (int64_t)msgs * RATE_UNIT, byte_cost = (int64_t)bytes * RATE_UNIT;
+    uint64_t wait = 0;
+    if (r->msg_rate != 0) {
+        r->msgs += (int64_t)elapsed * r->msg_rate;
+        if (r->msgs > r->msg_cap) r->msgs = r->msg_cap;
+        if (r->msgs < msg_cost) wait = (uint64_t)(msg_cost - r->msgs) / r->msg_rate + 1;
+    }
+    if (r->byte_rate != 0) {
+        r->bytes += (int64_t)elapsed * r->byte_rate;
+        if (r->bytes > r->byte_cap) r->bytes = r->byte_cap;
+        if (r->bytes < byte_cost) {
+            uint64_t w = (uint64_t)(byte_cost - r->bytes) / r->byte_rate + 1;
+            if (w > wait) wait = w;
+        }
+    }
+    if (wait == 0 || debt) {
+        if (r->msg_rate != 0) r->msgs -= msg_cost;
+        if (r->byte_rate != 0) r->bytes -= byte_cost;
+    }
+    return wait;
+}
+
+#endif
@@ -0,0 +1,1547 @@
+// ---------------------------------------------------------------------------
+// epoll 이벤트 루프(reactor) 모드
+// 하나의 스레드가 자신이 맡은 소켓을 모두 비차단(edge-triggered)으로 관리하며
+// 로그인, 메시지 수신, 브로드캐스트를 자식 프로세스 없이 처리한다.
+//
+// 멀티코어 모드에서는 코어마다 reactor(샤드)를 하나씩 실행한다. 각 샤드는
+// SO_REUSEPORT로 같은 포트에 자신의 서버 소켓을 열어 커널이 연결을 나누어 주고,
+// 다른 샤드의 클라이언트에게 보낼 메시지는 그 샤드의 lock-free 수신함에 넣는다.
+//
+// io_uring 백엔드(-b uring)는 같은 처리 함수를 쓰되 epoll 대신 multishot accept,
+// 제공 버퍼 링을 쓰는 multishot recv로 받고, 한 바퀴 동안 쌓인 송신을 연결마다
+// sendmsg 요청 하나로 만들어 한 번의 io_uring_enter로 제출한다.
+//
+// 파일 내려받기는 송신 대기열이 비었을 때만 조각 단위로 sendfile하고, 한 바퀴에
+// SPOOL_BURST 조각까지만 보낸 뒤 모아 보내기 목록으로 다음 바퀴에 이어서 보낸다.
+//
+// 로그인 전 연결은 샤드의 타이머 휠에 기한을 걸어 두고, 기한 안에 로그인하지 않으면
+// 끊는다. 로그인한 연결은 만료 시 상태만 보고 건너뛰므로 영향을 받지 않는다.
+//
+// 무중단 재시작 요청을 받으면 모든 샤드가 읽기와 accept를 멈춘 뒤 재시작 스레드가 서버 소켓과
+// 연결 테이블을 새 프로세스에 넘기고, 새 프로세스가 준비를 마쳤다고 알리면 종료한다(handoff.c).
+// 새 프로세스는 받은 연결을 샤드에 나누어 등록하고 이어서 서비스한다.
+// ---------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <linux/filter.h>
+
+#include "server.h"
+#include "uring.h"
+
+// 이벤트 루프에서 관리하는 클라이언트 연결 상태
+enum ConnState {
+    CONN_LOGIN,  // 로그인 정보 수신 대기
+    CONN_CHAT    // 로그인 완료, 채팅 메시지 수신 중
+};
+
+struct Shard;
+
+struct Client {
+    struct ConnEntry hdr;   // 연결 테이블 공통 헤더 (슬롯, 세대 번호)
+    int fd;                 // 클라이언트 소켓
+    int state;              // 연결 상태 (enum ConnState)
+    int proto;              // 프로토콜 (enum Proto)
+    char id[MAX_ID_LEN];    // 로그인한 아이디
+    struct RoomLink room;   // 들어가 있는 채팅방과 멤버 배열에서의 위치
+    struct FrameReader reader;  // 부분 수신된 프레임을 모아 두는 수신 버퍼
+    struct OutQueue outq;   // 송신 대기열 (공유 버퍼 참조)
+    unsigned long dropped;  // 대기열 상한 때문에 버린 메시지 수
+    int pending;            // 모아 보내기(FLUSH_BATCH) 목록에 들어가 있는지 여부
+    int sending;            // io_uring 송신 요청이 진행 중인지 여부 (순서를 지키도록 연결마다 하나씩만 보냄)
+    struct SpoolUpload *upload; // 올리는 중인 파일 (없으면 NULL)
+    struct SpoolSend *file;     // 내려보내는 중인 파일 (없으면 NULL)
+    struct RateLimit rate;  // 전송 속도 제한 (로그인할 때 초기화)
+    int throttled;          // 속도 제한으로 읽기를 멈춘 상태인지 여부 (RATE_DELAY)
+    int recv_stopped;       // 멈춘 동안 io_uring multishot recv가 끝났는지 여부 (다시 읽을 때 새로 걺)
+};
+
+// 다른 샤드로 전달하는 브로드캐스트 메시지나 귓속말 (직렬화된 프레임을 복사하지 않고 참조만 넘김)
+struct ShardMsg {
+    struct ShardMsg *next;  // 수신함 연결
+    ConnHandle to;          // 귓속말을 받는 연결 (CONN_HANDLE_NONE이면 room에 브로드캐스트)
+    uint32_t room;          // 메시지를 보낸 채팅방
+    struct SharedBuf *frame;    // 채팅 프레임
+};
+
+// reactor 하나의 상태 (스레드 하나가 소유)
+struct Shard {
+    int index;              // 샤드 번호
+    int epfd;               // epoll 인스턴스
+    int ssock;              // 이 샤드의 서버 소켓
+    int evfd;               // 수신함에 메시지가 들어왔음을 알리는 eventfd
+    _Atomic(struct ShardMsg *) inbox;   // 다른 샤드가 넣는 lock-free 수신함 (스택)
+    struct ConnTable conns; // 이 샤드의 연결 테이블
+    struct RoomIndex rooms; // 이 샤드의 채팅방별 멤버 배열 (브로드캐스트에 사용)
+    ConnHandle *pending;    // 모아 둔 메시지를 아직 보내지 않은 연결 (FLUSH_BATCH)
+    size_t pending_count;
+    size_t pending_cap;
+    uint64_t pending_since; // 목록이 비어 있다가 처음 채워진 시각 (metric_now_us())
+    struct Uring *uring;    // io_uring 백엔드 (NULL이면 epoll)
+    struct TimerWheel logins;   // 로그인 기한 (CONN_LOGIN 상태로 accept한 연결)
+    struct TimerWheel delays;   // 속도 제한으로 읽기를 멈춘 연결을 다시 읽을 시각
+    int handoff;            // 무중단 재시작으로 멈추는 중 (io_uring accept를 다시 걸지 않음)
+    int accept_stopped;     // 멈추는 동안 io_uring multishot accept가 끝났는지 여부
+    pthread_t thread;
+};
+
+// 진행 중인 io_uring 송신 요청
+// 커널이 끝낼 때까지 msghdr, iovec과 보내는 버퍼의 참조를 붙잡아 두므로 그 사이 연결이 종료되어도 안전하다.
+struct SendOp {
+    ConnHandle handle;      // 보내는 연결
+    int poll;               // 송신 대신 소켓이 쓰기 가능해질 때까지 기다리는 요청 (파일 전송)
+    struct msghdr msg;
+    unsigned count;         // 버퍼 수
+    struct SharedBuf *bufs[OUTQ_MAX_IOV];
+    struct iovec iov[OUTQ_MAX_IOV];
+};
+
+static struct Shard *shards;        // 전체 샤드 배열
+static int shard_count;             // 샤드 수
+static atomic_int total_clients;    // 모든 샤드의 접속자 수 합계
+static struct IdMap users;          // 로그인 아이디 -> 연결 (owner는 샤드 번호, 중복 로그인 거부와 귓속말)
+static pthread_mutex_t users_lock = PTHREAD_MUTEX_INITIALIZER;    // users를 보호 (여러 샤드가 함께 씀)
+static atomic_int handoff_requested;        // 무중단 재시작 요청을 받아 샤드들이 멈춰야 함
+static pthread_barrier_t handoff_barrier;   // 샤드들과 재시작 스레드가 단계를 맞춤 (샤드 수 + 1)
+
+// epoll 이벤트의 data.u64로 클라이언트가 아닌 디스크립터를 구분하기 위한 표식
+// (세대 번호가 0인 핸들은 연결 테이블에서 절대 나오지 않음)
+#define LISTEN_TAG 1
+#define INBOX_TAG 2
+#define CANCEL_TAG 3            // 속도 제한으로 멈추는 연결의 multishot recv 취소 요청
+
+// 읽기를 멈춘 io_uring 연결이 수신 버퍼에 모아 둘 수 있는 최대 크기
+// 취소가 처리되기 전에 받은 데이터는 제공 버퍼 전체를 넘을 수 없으므로 그만큼과 잘린 프레임 하나를 더 둔다.
+#define THROTTLE_BACKLOG (URING_BUF_COUNT * URING_BUF_SIZE + FRAME_HEADER_LEN + 255 + FRAME_MAX_PAYLOAD)
+#define SEND_TAG (1ULL << 63)   // io_uring 송신 요청 (나머지 비트는 struct SendOp 주소, 핸들은 최상위 비트를 쓰지 않음)
+
+// 클라이언트 연결 종료 및 자원 해제
+// 같은 epoll_wait 결과에 남아 있는 이 연결의 이벤트는 핸들의 세대 번호가 바뀌어 무시된다.
+static void ev_close_client(struct Shard *sh, struct Client *c) {
+    if (sh->uring != NULL) {    // 진행 중인 multishot recv는 close만으로 끝나지 않으므로 먼저 끊음
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    close(c->fd);    // close하면 epoll 등록도 자동으로 해제됨
+    if (c->state == CONN_CHAT) {
+        pthread_mutex_lock(&users_lock);
+        id_map_del(&users, c->id, conn_handle(c));
+        pthread_mutex_unlock(&users_lock);
+    }
+    frame_reader_free(&c->reader);
+    outq_clear(&c->outq);
+    spool_upload_free(c->upload);
+    spool_send_close(c->file);
+    room_leave(&sh->rooms, c);
+    conn_free(&sh->conns, c);    // live 배열의 마지막 연결이 이 자리로 옮겨짐
+    atomic_fetch_sub(&total_clients, 1);
+    metric_add(MC_CLOSED, 1);
+}
+
+// 연결을 모아 보내기 목록에 추가 (이미 들어가 있으면 그대로)
+// 목록에는 핸들을 넣으므로 보내기 전에 종료된 연결은 보낼 때 건너뛴다.
+static int shard_defer(struct Shard *sh, struct Client *c) {
+    if (c->pending) return 0;
+    if (sh->pending_count == sh->pending_cap) {
+        size_t cap = sh->pending_cap ? sh->pending_cap * 2 : 64;
+        ConnHandle *p = realloc(sh->pending, cap * sizeof(ConnHandle));
+        if (p == NULL) return (sh->uring || c->file) ? -1 : outq_flush(&c->outq, c->fd);    // 목록을 늘릴 수 없으면 바로 전송
+        sh->pending = p;
+        sh->pending_cap = cap;
+    }
+    if (sh->pending_count == 0) sh->pending_since = metric_now_us();
+    sh->pending[sh->pending_count++] = conn_handle(c);
+    c->pending = 1;
+    return 0;
+}
+
+// 서버 소켓에 multishot accept 요청 (연결마다 완료 항목이 하나씩 옴)
+static void uring_arm_accept(struct Shard *sh) {
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = sh->ssock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = LISTEN_TAG;
+}
+
+// 수신함 eventfd에 multishot poll 요청
+static void uring_arm_inbox(struct Shard *sh) {
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = sh->evfd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = INBOX_TAG;
+}
+
+// 연결에 multishot recv 요청 (데이터가 올 때마다 커널이 제공 버퍼 링에서 버퍼를 골라 채움)
+static int uring_arm_recv(struct Shard *sh, struct Client *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = conn_handle(c);
+    return 0;
+}
+
+// 송신 대기열 앞부분으로 io_uring sendmsg 요청을 만듦 (제출은 이벤트 루프가 한꺼번에, 실패하면 -1)
+static int uring_send(struct Shard *sh, struct Client *c) {
+    struct SendOp *op = pool_alloc(sizeof(struct SendOp));
+    if (op == NULL) return -1;
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) {
+        pool_free(op);
+        return -1;
+    }
+
+    op->handle = conn_handle(c);
+    op->poll = 0;
+    op->count = outq_iov(&c->outq, op->iov, OUTQ_MAX_IOV);
+    for (unsigned i = 0; i < op->count; i++) {
+        op->bufs[i] = sbuf_ref(c->outq.bufs[(c->outq.head + i) & (c->outq.cap - 1)]);
+    }
+    memset(&op->msg, 0, sizeof(op->msg));
+    op->msg.msg_iov = op->iov;
+    op->msg.msg_iovlen = op->count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&op->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (op->count < c->outq.count ? MSG_MORE : 0);
+    sqe->user_data = SEND_TAG | (uint64_t)(uintptr_t)op;
+    c->sending = 1;
+    metric_add(MC_SEND_CALLS, 1);
+    return 0;
+}
+
+// 소켓이 쓰기 가능해질 때 완료되는 poll 요청 (io_uring 백엔드에서 sendfile이 EAGAIN일 때)
+static int uring_arm_pollout(struct Shard *sh, struct Client *c) {
+    struct SendOp *op = pool_alloc(sizeof(struct SendOp));
+    if (op == NULL) return -1;
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) {
+        pool_free(op);
+        return -1;
+    }
+    op->handle = conn_handle(c);
+    op->poll = 1;
+    op->count = 0;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = c->fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = SEND_TAG | (uint64_t)(uintptr_t)op;
+    c->sending = 1;
+    return 0;
+}
+
+// 파일 조각을 chunks개까지 보내고 다 보냈으면 파일을 닫음 (enum SpoolSendResult, 오류 시 -1)
+static int ev_send_file(struct Client *c, int chunks) {
+    int ret = spool_send(c->file, c->fd, chunks);
+    if (ret == SPOOL_DONE) {
+        log_msg(LOG_INFO, "사용자 '%s'에게 '%s' 파일을 보냈습니다.", c->id, c->file->name);
+        spool_send_close(c->file);
+        c->file = NULL;
+    }
+    return ret;
+}
+
+// 송신 대기열과 내려보내는 파일을 소켓에 씀 (epoll 백엔드, 연결을 종료해야 하면 -1 반환)
+// 파일 조각을 보내는 도중이면 프레임이 섞이지 않도록 그 조각을 먼저 끝내고, 채팅 메시지를 모두 보낸 뒤에만
+// 새 조각을 chunks개까지 보낸다. 보낼 조각이 남았으면 모아 보내기 목록에 넣어 다음 바퀴에 이어서 보낸다.
+static int ev_write(struct Shard *sh, struct Client *c, int chunks) {
+    int ret;
+    if (c->file != NULL && spool_send_busy(c->file)) {
+        if ((ret = ev_send_file(c, 0)) < 0) return -1;
+        if (ret == SPOOL_BLOCKED) return 0;    // EPOLLOUT에서 이어서
+    }
+    if (outq_flush(&c->outq, c->fd) < 0) return -1;
+    if (c->file == NULL || c->outq.count > 0) return 0;
+    if ((ret = ev_send_file(c, chunks)) < 0) return -1;
+    return ret == SPOOL_YIELD ? shard_defer(sh, c) : 0;
+}
+
+// io_uring 백엔드의 송신 (연결을 종료해야 하면 -1 반환)
+// 진행 중인 요청이 없을 때만 보내며, 파일 조각은 sendmsg 요청과 섞이지 않도록 이 스레드에서 직접 sendfile한다.
+static int uring_write(struct Shard *sh, struct Client *c) {
+    int ret;
+    if (c->sending) return 0;    // 진행 중인 요청이 끝나면 다시 목록에 들어옴
+    if (c->file != NULL && spool_send_busy(c->file)) {
+        if ((ret = ev_send_file(c, 0)) < 0) return -1;
+        if (ret == SPOOL_BLOCKED) return uring_arm_pollout(sh, c);
+    }
+    if (c->outq.count > 0) return uring_send(sh, c);
+    if (c->file == NULL) return 0;
+    if ((ret = ev_send_file(c, SPOOL_BURST)) < 0) return -1;
+    if (ret == SPOOL_BLOCKED) return uring_arm_pollout(sh, c);
+    return ret == SPOOL_YIELD ? shard_defer(sh, c) : 0;
+}
+
+// 모아 둔 메시지를 연결마다 한 번의 sendmsg로 전송 (io_uring 백엔드는 요청만 만들어 두고 한꺼번에 제출)
+// 보내는 도중 다시 목록에 들어간 연결(파일 조각이 남은 연결)은 다음 바퀴에 처리한다.
+static void shard_flush_pending(struct Shard *sh) {
+    size_t count = sh->pending_count;
+    for (size_t i = 0; i < count; i++) {
+        struct Client *c = conn_lookup(&sh->conns, sh->pending[i]);
+        if (c == NULL) continue;    // 그 사이 종료된 연결
+        c->pending = 0;
+        if ((sh->uring != NULL ? uring_write(sh, c) : ev_write(sh, c, SPOOL_BURST)) < 0) {
+            ev_close_client(sh, c);
+        }
+    }
+    sh->pending_count -= count;
+    memmove(sh->pending, sh->pending + count, sh->pending_count * sizeof(ConnHandle));
+    if (sh->pending_count > 0) sh->pending_since = metric_now_us();
+}
+
+// 모아 보내기 목록을 비울 때까지 남은 시간 (epoll_wait 타임아웃, 목록이 비어 있으면 -1)
+static int shard_flush_timeout(struct Shard *sh) {
+    if (sh->pending_count == 0) return -1;
+    uint64_t elapsed = (metric_now_us() - sh->pending_since) / 1000;
+    return (elapsed >= (uint64_t)config.flush_window_ms) ? 0 : config.flush_window_ms - (int)elapsed;
+}
+
+// 로그인 기한이 지난 연결을 끊음 (그 사이 로그인했거나 종료된 연결은 건너뜀)
+static void shard_login_expired(ConnHandle h, void *arg) {
+    struct Shard *sh = arg;
+    struct Client *c = conn_lookup(&sh->conns, h);
+    if (c == NULL || c->state != CONN_LOGIN) return;
+    log_msg(LOG_NOTICE, "로그인 시간 초과로 연결을 끊습니다. (샤드 %d)", sh->index);
+    metric_add(MC_LOGIN_TIMEOUTS, 1);
+    ev_close_client(sh, c);
+}
+
+// 이벤트 루프가 기다릴 시간 (모아 보내기 목록, 로그인 기한, 멈춘 연결을 다시 읽을 시각 중 먼저 오는 쪽)
+static int shard_timeout(struct Shard *sh) {
+    uint64_t now = metric_now_us() / 1000;
+    return timer_min_timeout(shard_flush_timeout(sh),
+                             timer_min_timeout(timer_timeout(&sh->logins, now), timer_timeout(&sh->delays, now)));
+}
+
+// 송신 대기열에 넣은 메시지를 전송 (연결을 종료해야 하면 -1 반환)
+// FLUSH_LATENCY는 바로 보내고, FLUSH_BATCH와 io_uring 백엔드는 이벤트 루프 한 바퀴가 끝날 때 모아서 보낸다.
+static int ev_flush(struct Shard *sh, struct Client *c) {
+    if (sh->uring != NULL || config.flush_policy == FLUSH_BATCH) {
+        return shard_defer(sh, c);
+    }
+    return ev_write(sh, c, 0);
+}
+
+// 버퍼 참조를 송신 대기열에 넣고 전송 (연결을 종료해야 하면 -1 반환)
+// 대기열이 상한을 넘은 느린 클라이언트는 설정에 따라 메시지를 버리거나 연결을 끊는다.
+static int ev_send(struct Shard *sh, struct Client *c, struct SharedBuf *b) {
+    if (c->outq.bytes + b->len > config.out_hwm) {
+        if (config.slow_policy == SLOW_DROP) {
+            metric_add(MC_DROPPED, 1);
+            if (c->dropped++ == 0) {
+                log_msg(LOG_WARNING, "느린 클라이언트 %s: 송신 대기열 상한 초과, 메시지를 버립니다.", c->id);
+            }
+            return 0;
+        }
+        log_msg(LOG_WARNING, "느린 클라이언트 %s: 송신 대기열 상한 초과, 연결을 종료합니다.", c->id);
+        metric_add(MC_SLOW_CLOSED, 1);
+        return -1;
+    }
+    if (outq_push(&c->outq, sbuf_ref(b)) < 0) {
+        sbuf_unref(b);
+        return -1;
+    }
+    return ev_flush(sh, c);
+}
+
+// 채팅 프레임을 프로토콜에 맞게 한 클라이언트에게 전송 (legacy는 구 버전 클라이언트용 구조체를 처음 필요할 때 만들어 둠)
+static int ev_send_chat(struct Shard *sh, struct Client *c, struct SharedBuf *frame, struct SharedBuf **legacy) {
+    if (c->proto == PROTO_LEGACY) {
+        if (*legacy == NULL && (*legacy = make_legacy_chat(frame)) == NULL) return 0;
+        return ev_send(sh, c, *legacy);
+    }
+    return ev_send(sh, c, frame);
+}
+
+// 서버 안내 메시지를 한 클라이언트에게 전송 (연결을 종료해야 하면 -1 반환)
+static int ev_send_notice(struct Shard *sh, struct Client *c, const char *text, size_t len) {
+    struct SharedBuf *legacy = NULL;
+    struct SharedBuf *frame = make_chat_frame(NOTICE_ID, text, len);
+    if (frame == NULL) return -1;
+    int ret = ev_send_chat(sh, c, frame, &legacy);
+    sbuf_unref(legacy);
+    sbuf_unref(frame);
+    return ret;
+}
+
+// /history를 요청한 클라이언트에게 저장소의 메시지를 보낼 때 쓰는 상태
+struct HistoryCtx {
+    struct Shard *sh;
+    struct Client *c;
+    int failed;             // 전송 실패 (연결을 종료해야 함)
+};
+
+// 저장소에서 읽은 메시지 하나를 요청한 클라이언트에게 전송
+static int ev_send_history(const struct StoreRecord *rec, void *arg) {
+    struct HistoryCtx *ctx = arg;
+    struct SharedBuf *legacy = NULL;
+    char id[MAX_ID_LEN];
+    size_t len = history_record(rec, id);
+    struct SharedBuf *frame = make_chat_frame(id, rec->text, len);
+    if (frame == NULL || ev_send_chat(ctx->sh, ctx->c, frame, &legacy) < 0) {
+        ctx->failed = 1;
+    }
+    sbuf_unref(legacy);
+    sbuf_unref(frame);
+    return ctx->failed;
+}
+
+// 이 샤드에서 room 채팅방에 있는 클라이언트에게 브로드캐스트 (sender 제외)
+// 모든 수신자가 같은 프레임 버퍼를 참조하며, 구 버전 클라이언트용 구조체는 처음 필요할 때 한 번만 만든다.
+static void ev_sendtoall_message(struct Shard *sh, struct Client *sender, uint32_t room, struct SharedBuf *frame) {
+    struct SharedBuf *legacy = NULL;
+    struct RoomMembers *m = room_members(&sh->rooms, room);
+    uint64_t start = metric_now_us();
+
+    for (uint32_t i = m->count; i-- > 0;) {    // 뒤에서부터 순회하여 도중에 제거되어도 안전
+        struct Client *c = m->members[i];
+        if (c == sender) continue;
+        if (ev_send_chat(sh, c, frame, &legacy) < 0) {
+            ev_close_client(sh, c);    // 전송 실패한 클라이언트는 연결 종료
+        }
+    }
+    sbuf_unref(legacy);
+    metric_observe(MH_FANOUT, metric_now_us() - start);
+}
+
+// 다른 샤드의 수신함에 메시지를 넣음 (여러 스레드가 동시에 호출해도 안전)
+static void shard_post(struct Shard *sh, struct ShardMsg *m) {
+    struct ShardMsg *head = atomic_load_explicit(&sh->inbox, memory_order_relaxed);
+    do {
+        m->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&sh->inbox, &head, m,
+                                                    memory_order_release, memory_order_relaxed));
+    if (head == NULL) {    // 비어 있던 수신함에 처음 넣은 경우에만 깨움
+        uint64_t one = 1;
+        write(sh->evfd, &one, sizeof(one));
+    }
+}
+
+// 수신함의 메시지를 모두 꺼내 이 샤드의 클라이언트에게 전달
+static void shard_drain_inbox(struct Shard *sh) {
+    uint64_t count;
+    read(sh->evfd, &count, sizeof(count));
+
+    struct ShardMsg *m = atomic_exchange_explicit(&sh->inbox, NULL, memory_order_acquire);
+    struct ShardMsg *fifo = NULL;
+    while (m != NULL) {    // 스택 순서를 뒤집어 보낸 순서대로 처리
+        struct ShardMsg *next = m->next;
+        m->next = fifo;
+        fifo = m;
+        m = next;
+    }
+    while (fifo != NULL) {
+        struct ShardMsg *next = fifo->next;
+        if (fifo->to != CONN_HANDLE_NONE) {    // 귓속말: 받는 사람이 그 사이 종료되었으면 버림
+            struct Client *c = conn_lookup(&sh->conns, fifo->to);
+            struct SharedBuf *legacy = NULL;
+            if (c != NULL && ev_send_chat(sh, c, fifo->frame, &legacy) < 0) ev_close_client(sh, c);
+            sbuf_unref(legacy);
+        } else {
+            ev_sendtoall_message(sh, NULL, fifo->room, fifo->frame);
+        }
+        sbuf_unref(fifo->frame);
+        pool_free(fifo);
+        fifo = next;
+    }
+}
+
+// 보낸 사람이 있는 채팅방의 모든 샤드 멤버에게 브로드캐스트 (자기 샤드는 바로, 다른 샤드는 수신함을 통해 전달)
+// 메시지는 여기서 한 번만 직렬화하고 모든 샤드와 수신자가 같은 버퍼를 참조한다.
+static void shard_broadcast(struct Shard *sh, struct Client *sender, const char *text, size_t len) {
+    uint32_t room = sender->room.room;
+    struct SharedBuf *frame = make_chat_frame(sender->id, text, len);
+    if (frame == NULL) return;
+
+    store_append(room_registry_name(room), sender->id, text, len);
+    replay_push(room, sbuf_ref(frame));    // 나중에 들어온 클라이언트에게 같은 버퍼를 다시 보낼 수 있도록 보관
+
+    ev_sendtoall_message(sh, sender, room, frame);
+
+    // 방의 멤버가 모두 이 샤드에 있으면 다른 샤드는 깨우지 않음
+    int remote = room_registry_members(room) - (int)room_members(&sh->rooms, room)->count;
+    for (int i = 0; remote > 0 && i < shard_count; i++) {
+        if (&shards[i] == sh) continue;
+        struct ShardMsg *m = pool_alloc(sizeof(struct ShardMsg));
+        if (m == NULL) continue;
+        m->to = CONN_HANDLE_NONE;
+        m->room = room;
+        m->frame = sbuf_ref(frame);
+        shard_post(&shards[i], m);
+    }
+    sbuf_unref(frame);
+}
+
+// 다른 서버에서 중계된 메시지를 같은 이름의 방에 있는 모든 샤드 멤버에게 전달 (중계 스레드에서 호출)
+// 샤드의 방 멤버 목록은 그 샤드만 읽으므로 멤버가 있으면 모든 샤드의 수신함에 넣는다.
+static void reactor_relay_deliver(const char *name, const char *id, const char *text, size_t len) {
+    int room = room_registry_find(name, 1);
+    if (room < 0) return;
+    struct SharedBuf *frame = make_chat_frame(id, text, len);
+    if (frame == NULL) return;
+
+    store_append(name, id, text, len);
+    replay_push(room, sbuf_ref(frame));
+    for (int i = 0; room_registry_members(room) > 0 && i < shard_count; i++) {
+        struct ShardMsg *m = pool_alloc(sizeof(struct ShardMsg));
+        if (m == NULL) continue;
+        m->to = CONN_HANDLE_NONE;
+        m->room = room;
+        m->frame = sbuf_ref(frame);
+        shard_post(&shards[i], m);
+    }
+    sbuf_unref(frame);
+}
+
+// 귓속말을 받는 사람 한 명에게만 보내고 보낸 사람에게 결과를 알림 (연결을 종료해야 하면 -1 반환)
+// 받는 사람은 아이디 색인으로 바로 찾고, 다른 샤드에 있으면 그 샤드의 수신함에 넣어 그 샤드가 보내게 한다.
+static int ev_whisper(struct Shard *sh, struct Client *c, const char *to, const char *body, size_t len) {
+    char text[BUFSIZ], reply[BUFSIZ];
+    size_t text_len, reply_len;
+    ConnHandle h = CONN_HANDLE_NONE;
+    int owner = 0, failed = 0;
+
+    if (to != NULL) {
+        pthread_mutex_lock(&users_lock);
+        h = id_map_get(&users, to, &owner);
+        pthread_mutex_unlock(&users_lock);
+    }
+    format_whisper(to, h != CONN_HANDLE_NONE, body, len, text, &text_len, reply, &reply_len);
+    struct SharedBuf *frame = (h != CONN_HANDLE_NONE) ? make_chat_frame(c->id, text, text_len) : NULL;
+    if (frame != NULL && owner == sh->index) {
+        struct Client *t = conn_lookup(&sh->conns, h);
+        struct SharedBuf *legacy = NULL;
+        if (t != NULL && ev_send_chat(sh, t, frame, &legacy) < 0) {
+            if (t == c) failed = 1;    // 자기 자신에게 보낸 귓속말
+            else ev_close_client(sh, t);
+        }
+        sbuf_unref(legacy);
+    } else if (frame != NULL) {
+        struct ShardMsg *m = pool_alloc(sizeof(struct ShardMsg));
+        if (m != NULL) {
+            m->to = h;
+            m->room = ROOM_NONE;
+            m->frame = sbuf_ref(frame);
+            shard_post(&shards[owner], m);
+        }
+    }
+    sbuf_unref(frame);
+    return failed ? -1 : ev_send_notice(sh, c, reply, reply_len);
+}
+
+// 연결의 수신을 시작 (epoll 등록 또는 io_uring multishot recv)
+static int ev_watch(struct Shard *sh, struct Client *c) {
+    if (sh->uring != NULL) return uring_arm_recv(sh, c);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = conn_handle(c);
+    return epoll_ctl(sh->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// accept한 연결을 등록하고 로그인 기한을 건 뒤 수신을 시작 (최대 클라이언트 수에 도달했으면 거부)
+// 소켓은 accept4(또는 io_uring accept)가 비차단 모드로 만들어 준다.
+static void ev_add_client(struct Shard *sh, int csock, const struct sockaddr_in *cliaddr) {
+    char addr[INET_ADDRSTRLEN];
+
+    if (atomic_fetch_add(&total_clients, 1) >= config.max_clients) {
+        atomic_fetch_sub(&total_clients, 1);
+        metric_add(MC_REJECTED, 1);
+        log_msg(LOG_WARNING, "최대 클라이언트 수에 도달했습니다. 연결을 거부합니다.");
+        close(csock);
+        return;
+    }
+
+    struct Client *c = conn_alloc(&sh->conns);
+    if (c == NULL) {
+        close(csock);
+        atomic_fetch_sub(&total_clients, 1);
+        return;
+    }
+    metric_add(MC_ACCEPTED, 1);
+    c->fd = csock;
+    c->state = CONN_LOGIN;
+    c->room.room = ROOM_NONE;
+
+    if (frame_reader_init(&c->reader, 512) < 0 ||
+        timer_add(&sh->logins, conn_handle(c), metric_now_us() / 1000 + config.login_timeout_ms) < 0 ||
+        ev_watch(sh, c) < 0) {
+        ev_close_client(sh, c);
+        return;
+    }
+
+    if (LOG_NOTICE <= log_level) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        if (cliaddr == NULL && getpeername(csock, (struct sockaddr *)&peer, &plen) == 0) {    // multishot accept는 주소를 주지 않음
+            cliaddr = &peer;
+        }
+        inet_ntop(AF_INET, cliaddr ? &cliaddr->sin_addr : &(struct in_addr){0}, addr, sizeof(addr));
+        log_msg(LOG_NOTICE, "클라이언트 연결됨: %s (샤드 %d)", addr, sh->index);
+    }
+}
+
+// 새 연결을 모두 accept (edge-triggered이므로 EAGAIN이 나올 때까지 반복)
+// accept4로 받으면서 비차단 모드로 만들어 연결마다 fcntl 호출이 없다.
+static void ev_accept(struct Shard *sh) {
+    struct sockaddr_in cliaddr;
+    while (1) {
+        socklen_t clen = sizeof(cliaddr);
+        int csock = accept4(sh->ssock, (struct sockaddr *)&cliaddr, &clen, SOCK_NONBLOCK);
+        if (csock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_msg(LOG_ERR, "accept4() 실패: %m");
+            }
+            return;
+        }
+        ev_add_client(sh, csock, &cliaddr);
+    }
+}
+
+// 올리는 파일의 조각 하나를 처리 (연결을 종료해야 하면 -1 반환)
+// 마지막 조각이면 스풀에 등록하고 결과를 알려 준 뒤 방의 다른 사람들에게 파일이 올라왔음을 알린다.
+static int ev_handle_file(struct Shard *sh, struct Client *c, struct Record *rec) {
+    char reply[BUFSIZ], announce[BUFSIZ];
+    size_t reply_len, announce_len;
+
+    if (c->upload == NULL && (c->upload = spool_upload_start(rec->name, rec->name_len)) == NULL) {
+        return -1;
+    }
+    spool_upload_write(c->upload, rec->text, rec->len);    // 실패하면 나머지 조각은 무시하고 마지막 조각에서 알림
+    if (!(rec->flags & FRAME_FLAG_LAST)) return 0;
+
+    int ok = (spool_upload_end(c->upload) == 0);
+    commit_upload(ok ? c->upload->tmp : NULL, c->upload->name, reply, &reply_len, announce, &announce_len);
+    spool_upload_free(c->upload);
+    c->upload = NULL;
+    if (ev_send_notice(sh, c, reply, reply_len) < 0) {
+        return -1;
+    }
+    if (announce_len > 0 && c->room.room != ROOM_NONE) {
+        shard_broadcast(sh, c, announce, announce_len);
+    }
+    return 0;
+}
+
+// 수신한 레코드 하나를 처리 (연결을 종료해야 하면 -1 반환)
+static int ev_handle_record(struct Shard *sh, struct Client *c, struct Record *rec) {
+    if (c->state == CONN_LOGIN) {
+        strcpy(c->id, rec->id);
+
+        // 같은 아이디로 이미 접속한 연결이 있거나 아이디 표를 늘리지 못하면 거부
+        // (보내 둔 것이 없는 비차단 소켓이므로 짧은 응답은 한 번에 보내짐)
+        pthread_mutex_lock(&users_lock);
+        int added = id_map_add(&users, c->id, sh->index, conn_handle(c));
+        pthread_mutex_unlock(&users_lock);
+        if (added != 0) {
+            char mesg[FRAME_HEADER_LEN + 64];
+            if (added < 0) {
+                send(c->fd, mesg, encode_login_fail(mesg, c->proto, "서버 오류로 로그인할 수 없습니다."), MSG_NOSIGNAL);
+                log_msg(LOG_ERR, "사용자 '%s' 로그인 실패: 아이디 표를 늘릴 메모리 부족", c->id);
+            } else {
+                send(c->fd, mesg, encode_login_fail(mesg, c->proto, "이미 접속 중인 아이디입니다."), MSG_NOSIGNAL);
+                log_msg(LOG_NOTICE, "사용자 '%s' 중복 로그인 거부", c->id);
+            }
+            return -1;
+        }
+        c->state = CONN_CHAT;
+        rate_limit_init(&c->rate, config.rate_msgs, config.rate_bytes, FRAME_MAX_PAYLOAD, metric_now_us());
+
+        // 패스워드와 관계 없이 무조건 로그인 성공
+        struct SharedBuf *reply = make_login_reply(c->proto);
+        if (reply == NULL || outq_push(&c->outq, reply) < 0) {
+            sbuf_unref(reply);
+            return -1;
+        }
+        if (room_join(&sh->rooms, c, LOBBY_ROOM) < 0) {    // 로그인하면 기본 방에 들어감
+            return -1;
+        }
+
+        // 로그인 결과와 기본 방의 최근 메시지를 한 번에 묶어 전송
+        // (구 버전 클라이언트는 로그인 결과를 길이 없이 recv() 한 번으로 읽으므로 보내지 않음)
+        if (c->proto == PROTO_FRAME) {
+            queue_replay(&c->outq, c->proto, LOBBY_ROOM);
+        }
+        if (ev_flush(sh, c) < 0) {
+            return -1;
+        }
+        log_msg(LOG_NOTICE, "사용자 '%s' 로그인 성공", c->id);
+        return 0;
+    }
+
+    if (rec->type == FRAME_FILE_PUT) {
+        return ev_handle_file(sh, c, rec);
+    }
+    if (rec->type != FRAME_CHAT) return 0;    // 알 수 없는 프레임은 무시
+
+    log_msg(LOG_DEBUG, "클라이언트로부터 받은 메시지: %s: %.*s", c->id, (int)rec->len, rec->text);
+
+    // 클라이언트가 '/q'를 보내면 종료
+    if (rec->len == 1 && rec->text[0] == 'q') {
+        log_msg(LOG_NOTICE, "클라이언트 %s 종료", c->id);
+        return -1;
+    }
+
+    // 채팅방 명령은 보낸 사람에게만 결과를 알려 주고 브로드캐스트하지 않음
+    char reply[BUFSIZ];
+    size_t reply_len;
+    uint32_t room = c->room.room;
+    if (handle_room_command(&sh->rooms, c, rec->text, rec->len, reply, &reply_len)) {
+        if (ev_send_notice(sh, c, reply, reply_len) < 0) {
+            return -1;
+        }
+        if (c->room.room != room) {    // 다른 방으로 옮겼으면 그 방의 최근 메시지 전송
+            queue_replay(&c->outq, c->proto, c->room.room);
+            return ev_flush(sh, c);
+        }
+        return 0;
+    }
+
+    // 저장소에 남아 있는 이 방의 최근 메시지를 보낸 사람에게만 전송
+    int history = parse_history_command(rec->text, rec->len);
+    if (history > 0) {
+        struct HistoryCtx ctx = { .sh = sh, .c = c };
+        store_read_last(history, room_registry_name(c->room.room), ev_send_history, &ctx);
+        return ctx.failed ? -1 : 0;
+    }
+
+    // 스풀에 올라온 파일을 요청한 사람에게 내려보냄 (안내 메시지 뒤에 조각 단위로)
+    int file = parse_get_command(rec->text, rec->len);
+    if (file >= 0) {
+        struct SpoolSend *s = open_download(file, c->proto, c->file != NULL, reply, &reply_len);
+        if (ev_send_notice(sh, c, reply, reply_len) < 0) {
+            spool_send_close(s);
+            return -1;
+        }
+        if (s == NULL) return 0;
+        c->file = s;
+        return shard_defer(sh, c);
+    }
+
+    // 귓속말은 방에 브로드캐스트하지 않고 저장하지도 않음
+    char to[MAX_ID_LEN];
+    const char *body;
+    size_t body_len;
+    int whisper = parse_whisper_command(rec->text, rec->len, to, &body, &body_len);
+    if (whisper >= 0) {
+        return ev_whisper(sh, c, whisper ? to : NULL, body, body_len);
+    }
+
+    shard_broadcast(sh, c, rec->text, rec->len);
+    relay_publish(room_registry_name(c->room.room), c->id, rec->text, rec->len);
+    return 0;
+}
+
+// multishot 요청(연결의 recv 또는 accept)을 취소 (reader가 있으면 취소 전에 받는 데이터를 모아 둘 수 있도록 상한을 늘림)
+static int uring_cancel(struct Shard *sh, uint64_t user_data, struct FrameReader *reader) {
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = user_data;
+    sqe->user_data = CANCEL_TAG;
+    if (reader != NULL) reader->max = THROTTLE_BACKLOG;
+    return 0;
+}
+
+// 연결의 모든 io_uring 요청(recv, 송신, 쓰기 가능을 기다리는 poll)을 취소 (무중단 재시작)
+// 아직 시작하지 않은 송신은 -ECANCELED로 끝나고 보내지 않은 데이터는 송신 대기열에 남는다.
+static int uring_cancel_all(struct Shard *sh, struct Client *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(sh->uring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = c->fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = CANCEL_TAG;
+    c->reader.max = THROTTLE_BACKLOG;
+    return 0;
+}
+
+// 속도 제한(RATE_DELAY)을 넘은 연결의 읽기를 delay_us 동안 멈춤 (연결을 종료해야 하면 -1 반환)
+// epoll은 소켓을 읽지 않기만 하면 되고, io_uring은 multishot recv를 취소한다. 취소가 처리되기 전에 이미 받은
+// 데이터는 수신 버퍼에 모아 두므로 버퍼 상한을 THROTTLE_BACKLOG까지 늘린다.
+static int ev_throttle(struct Shard *sh, struct Client *c, uint64_t delay_us) {
+    c->throttled = 1;
+    if (timer_add(&sh->delays, conn_handle(c), (metric_now_us() + delay_us) / 1000 + 1) < 0) return -1;
+    return (sh->uring != NULL) ? uring_cancel(sh, conn_handle(c), &c->reader) : 0;
+}
+
+// 수신 버퍼 r에 모인 레코드를 모두 처리 (연결을 종료해야 하면 -1 반환)
+// 레코드는 r 안을 가리키는 채로 처리하므로 처리하는 동안 r의 데이터가 바뀌면 안 된다.
+static int ev_process(struct Shard *sh, struct Client *c, struct FrameReader *r, uint64_t received) {
+    struct Record rec;
+    uint64_t delay = 0;
+    int ret = 0;
+    while (!c->throttled && (ret = read_record(r, &c->proto, c->state == CONN_CHAT, &rec)) > 0) {
+        if (c->state == CONN_CHAT) {
+            int verdict = rate_check(&c->rate, &rec, c->id, received, &delay);
+            if (verdict < 0) return -1;
+            if (verdict > 0) continue;    // 버린 메시지
+        }
+        if (ev_handle_record(sh, c, &rec) < 0) return -1;
+        if (delay > 0 && ev_throttle(sh, c, delay) < 0) return -1;
+        if (rec.type == FRAME_CHAT) {    // 같은 recv()로 받은 앞 메시지를 처리하며 기다린 시간도 포함
+            metric_add(MC_MSG_IN, 1);
+            metric_observe(MH_PROCESS, metric_now_us() - received);
+        }
+    }
+    return ret < 0 ? -1 : 0;    // 0: 데이터 부족(또는 읽기를 멈춤), -1: 프로토콜 오류
+}
+
+// 소켓에서 읽을 수 있는 데이터를 모두 읽어 처리 (연결을 종료해야 하면 -1 반환)
+// 한 번의 recv()에 프레임 일부만 오거나 여러 프레임이 함께 올 수 있다.
+static int ev_read(struct Shard *sh, struct Client *c) {
+    while (!c->throttled) {    // 멈춘 동안 읽지 않고 소켓에 남겨 두어 TCP 흐름 제어로 보내는 쪽을 멈춤
+        size_t avail;
+        char *space = frame_reader_space(&c->reader, &avail);
+        if (space == NULL) return -1;    // 최대 프레임 크기를 넘는 잘못된 데이터
+
+        ssize_t n = recv(c->fd, space, avail, 0);
+        if (n == 0) return -1;    // 클라이언트가 연결을 종료함
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        frame_reader_commit(&c->reader, n);
+        metric_add(MC_BYTES_IN, n);
+        if (ev_process(sh, c, &c->reader, metric_now_us()) < 0) return -1;
+    }
+    return 0;
+}
+
+// 커널이 제공 버퍼에 받아 둔 데이터를 처리 (연결을 종료해야 하면 -1 반환)
+// 수신 버퍼에 이어 붙일 데이터가 없으면 제공 버퍼 안에서 바로 레코드를 꺼내 처리하고,
+// 잘린 마지막 프레임이나 읽기를 멈춘 뒤 남은 부분만 수신 버퍼로 옮긴다.
+static int ev_feed(struct Shard *sh, struct Client *c, const char *data, size_t len) {
+    uint64_t received = metric_now_us();
+    metric_add(MC_BYTES_IN, len);
+    if (c->reader.start == c->reader.end) {
+        struct FrameReader view = { .buf = (char *)data, .cap = len, .start = 0, .end = len, .max = len };
+        if (ev_process(sh, c, &view, received) < 0) return -1;
+        data += view.start;
+        len = view.end - view.start;
+    }
+    while (len > 0) {
+        size_t avail;
+        char *space = frame_reader_space(&c->reader, &avail);
+        if (space == NULL) return -1;
+        size_t n = len < avail ? len : avail;
+        memcpy(space, data, n);
+        metric_add(MC_BYTES_COPIED, n);
+        frame_reader_commit(&c->reader, n);
+        data += n;
+        len -= n;
+        if (ev_process(sh, c, &c->reader, received) < 0) return -1;
+    }
+    return 0;
+}
+
+// multishot recv 완료 항목 처리 (받은 버퍼는 처리한 뒤 바로 제공 버퍼 링에 돌려줌)
+static void uring_on_recv(struct Shard *sh, const struct io_uring_cqe *cqe) {
+    struct Client *c = conn_lookup(&sh->conns, cqe->user_data);    // 이미 종료된 연결이면 NULL
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (c != NULL && cqe->res > 0 && ev_feed(sh, c, uring_buf(sh->uring, bid), cqe->res) < 0) {
+            ev_close_client(sh, c);
+            c = NULL;
+        }
+        uring_buf_recycle(sh->uring, bid);
+    }
+    if (c == NULL) return;
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)) {    // 연결 종료 또는 오류
+        ev_close_client(sh, c);
+        return;
+    }
+    if (cqe->flags & IORING_CQE_F_MORE) return;
+    if (c->throttled) {    // 속도 제한으로 취소한 수신은 다시 읽을 때 새로 걺
+        c->recv_stopped = 1;
+    } else if (uring_arm_recv(sh, c) < 0) {    // 제공 버퍼가 바닥나 멈춘 수신을 다시 시작
+        ev_close_client(sh, c);
+    }
+}
+
+// sendmsg(또는 파일 전송을 위한 poll) 완료 항목 처리 (보낸 만큼 대기열을 줄이고 남았으면 다음 바퀴에 이어서 보냄)
+static void uring_on_send(struct Shard *sh, struct SendOp *op, int res) {
+    struct Client *c = conn_lookup(&sh->conns, op->handle);
+    int op_poll = op->poll;
+    for (unsigned i = 0; i < op->count; i++) {
+        sbuf_unref(op->bufs[i]);
+    }
+    pool_free(op);
+    if (c == NULL) return;
+
+    c->sending = 0;
+    if (res == -ECANCELED && sh->handoff) {    // 무중단 재시작으로 취소됨 (보내지 않은 데이터는 새 프로세스가 보냄)
+        res = 0;
+    } else if (res < 0) {
+        ev_close_client(sh, c);
+        return;
+    }
+    if (!op_poll) outq_consume(&c->outq, res);
+    if ((c->outq.count > 0 || c->file != NULL) && shard_defer(sh, c) < 0) {
+        ev_close_client(sh, c);
+    }
+}
+
+// 토큰이 다시 찬 연결의 읽기를 재개 (멈춘 동안 쌓인 레코드를 처리하고 소켓을 다시 읽음)
+static void shard_rate_resume(ConnHandle h, void *arg) {
+    struct Shard *sh = arg;
+    struct Client *c = conn_lookup(&sh->conns, h);
+    if (c == NULL || !c->throttled) return;
+
+    c->throttled = 0;
+    if (ev_process(sh, c, &c->reader, metric_now_us()) < 0) {
+        ev_close_client(sh, c);
+        return;
+    }
+    if (c->throttled) return;    // 쌓여 있던 레코드로 다시 제한에 걸림
+    if (sh->uring != NULL) {
+        if (c->recv_stopped && uring_arm_recv(sh, c) < 0) {
+            ev_close_client(sh, c);
+            return;
+        }
+        c->recv_stopped = 0;
+    } else if (ev_read(sh, c) < 0) {    // edge-triggered이므로 멈춘 동안 도착한 데이터는 직접 읽어야 함
+        ev_close_client(sh, c);
+    }
+}
+
+// 쌓인 완료 항목을 모두 처리
+// 무중단 재시작으로 멈추는 동안 끝난 accept는 다시 걸지 않는다.
+static void uring_dispatch(struct Shard *sh) {
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(sh->uring)) != NULL) {
+        struct io_uring_cqe e = *cqe;    // 처리 도중 완료 큐 칸이 재사용될 수 있도록 복사한 뒤 바로 돌려줌
+        uring_cqe_seen(sh->uring);
+
+        if (e.user_data & SEND_TAG) {
+            uring_on_send(sh, (struct SendOp *)(uintptr_t)(e.user_data & ~SEND_TAG), e.res);
+        } else if (e.user_data == LISTEN_TAG) {    // 서버 소켓: 새 연결
+            if (e.res >= 0) {
+                ev_add_client(sh, e.res, NULL);
+            } else if (!(sh->handoff && e.res == -ECANCELED)) {
+                log_msg(LOG_ERR, "accept 실패: %s", strerror(-e.res));
+            }
+            if (!(e.flags & IORING_CQE_F_MORE)) {
+                if (sh->handoff) {
+                    sh->accept_stopped = 1;
+                } else {
+                    uring_arm_accept(sh);
+                }
+            }
+        } else if (e.user_data == INBOX_TAG) {    // 다른 샤드에서 온 브로드캐스트
+            shard_drain_inbox(sh);
+            if (!(e.flags & IORING_CQE_F_MORE)) uring_arm_inbox(sh);
+        } else if (e.user_data == CANCEL_TAG) {
+            // 취소 결과는 취소된 recv(또는 accept)의 완료 항목으로 처리함
+        } else {
+            uring_on_recv(sh, &e);
+        }
+    }
+}
+
+// 무중단 재시작을 위해 io_uring 요청을 모두 멈춤
+// accept와 모든 연결의 요청을 취소하고, 취소 전에 받은 데이터는 처리하지 않고 수신 버퍼에 모아 둔다.
+// 이미 진행 중이던 송신은 끝날 때까지 기다리며, HANDOFF_QUIESCE_MS 안에 멈추지 않은 연결은 끊는다.
+static void uring_quiesce(struct Shard *sh) {
+    uint64_t deadline = metric_now_us() + HANDOFF_QUIESCE_MS * 1000ULL;
+
+    sh->accept_stopped = 0;
+    if (uring_cancel(sh, LISTEN_TAG, NULL) < 0) sh->accept_stopped = 1;    // 취소하지 못한 accept로 받은 연결은 이 프로세스와 함께 닫힘
+    for (size_t i = 0; i < sh->conns.count; i++) {
+        struct Client *c = sh->conns.live[i];
+        c->throttled = 1;
+        uring_cancel_all(sh, c);    // 취소하지 못하면 멈추지 않은 연결로 남아 끊김
+    }
+
+    while (1) {
+        int busy = !sh->accept_stopped;
+        for (size_t i = 0; i < sh->conns.count && !busy; i++) {
+            struct Client *c = sh->conns.live[i];
+            busy = c->sending || !c->recv_stopped;
+        }
+        uint64_t now = metric_now_us();
+        if (!busy || now >= deadline) break;
+        if (uring_submit_wait(sh->uring, (int)((deadline - now) / 1000) + 1) < 0) break;
+        uring_dispatch(sh);
+    }
+
+    for (size_t i = sh->conns.count; i-- > 0;) {
+        struct Client *c = sh->conns.live[i];
+        if (c->sending || !c->recv_stopped) {
+            log_msg(LOG_WARNING, "재시작 전에 멈추지 않은 연결을 끊습니다. (샤드 %d)", sh->index);
+            ev_close_client(sh, c);
+        }
+    }
+}
+
+// 무중단 재시작: 읽기와 accept를 멈추고 재시작 스레드가 연결을 넘기는 동안 기다림
+// 넘기는 데 성공하면 재시작 스레드가 프로세스를 끝내므로 돌아오지 않고, 실패하면 멈춘 곳부터 이어서 서비스한다.
+static void shard_handoff(struct Shard *sh) {
+    sh->handoff = 1;
+    if (sh->uring != NULL) uring_quiesce(sh);    // epoll은 이벤트를 처리하지 않기만 하면 됨 (도착한 이벤트는 epoll에 남음)
+    pthread_barrier_wait(&handoff_barrier);    // 모든 샤드가 멈춤 (이후로는 다른 샤드의 수신함에 넣는 메시지가 없음)
+    shard_drain_inbox(sh);                     // 멈추기 전에 받은 다른 샤드의 메시지를 송신 대기열에 넣음
+    pthread_barrier_wait(&handoff_barrier);    // 재시작 스레드가 연결 테이블을 읽기 시작
+    pthread_barrier_wait(&handoff_barrier);    // 넘기기 실패
+
+    sh->handoff = 0;
+    if (sh->uring == NULL) return;
+    for (size_t i = sh->conns.count; i-- > 0;) {    // 뒤에서부터 순회하여 도중에 종료되어도 안전
+        shard_rate_resume(conn_handle((struct Client *)sh->conns.live[i]), sh);
+    }
+    if (sh->accept_stopped) uring_arm_accept(sh);
+}
+
+// 샤드 하나의 io_uring 이벤트 루프
+// 완료 항목을 처리하며 쌓인 요청(다시 거는 수신, 송신)은 다음 io_uring_enter 한 번으로 함께 제출된다.
+static void *shard_loop_uring(struct Shard *sh) {
+    uring_arm_accept(sh);
+    uring_arm_inbox(sh);
+    while (1) {
+        if (uring_submit_wait(sh->uring, shard_timeout(sh)) < 0) {
+            log_msg(LOG_ERR, "io_uring_enter() 실패: %m");
+            return NULL;
+        }
+        uring_dispatch(sh);
+
+        // 이번 바퀴에서 모아 둔 메시지의 송신 요청을 만듦 (다음 io_uring_enter에서 한꺼번에 제출)
+        if (shard_flush_timeout(sh) == 0) {
+            shard_flush_pending(sh);
+        }
+        timer_expire(&sh->logins, metric_now_us() / 1000, shard_login_expired, sh);
+        timer_expire(&sh->delays, metric_now_us() / 1000, shard_rate_resume, sh);
+        if (atomic_load_explicit(&handoff_requested, memory_order_acquire)) {
+            shard_handoff(sh);
+        }
+    }
+}
+
+// 샤드 하나의 epoll 이벤트 루프
+static void *shard_loop(void *arg) {
+    struct Shard *sh = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (sh->index > 0) {    // 첫 번째 샤드는 메인 스레드에서 실행되어 이미 칸을 받았음
+        metrics_thread_slot();
+    }
+    if (sh->uring != NULL) {
+        return shard_loop_uring(sh);
+    }
+
+    while (1) {
+        int nev = epoll_wait(sh->epfd, events, MAX_EVENTS, shard_timeout(sh));
+        if (nev < 0) {
+            if (errno == EINTR) continue;
+            log_msg(LOG_ERR, "epoll_wait() 실패: %m");
+            return NULL;
+        }
+
+        for (int i = 0; i < nev; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG) {    // 서버 소켓: 새 연결 수락
+                ev_accept(sh);
+                continue;
+            }
+            if (tag == INBOX_TAG) {    // 다른 샤드에서 온 브로드캐스트
+                shard_drain_inbox(sh);
+                continue;
+            }
+
+            struct Client *c = conn_lookup(&sh->conns, tag);
+            if (c == NULL) continue;    // 이번 처리 도중 이미 종료된 연결 (디스크립터가 재사용되었어도 무시됨)
+
+            if (events[i].events & EPOLLOUT) {    // 송신 가능: 대기열에 남은 데이터와 파일 조각 전송
+                if (ev_write(sh, c, SPOOL_BURST) < 0) {
+                    ev_close_client(sh, c);
+                    continue;
+                }
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                if (ev_read(sh, c) < 0) {
+                    ev_close_client(sh, c);
+                }
+            }
+        }
+
+        // 이번 바퀴에서 모아 둔 메시지를 전송 (시간 창을 정했으면 그 시간이 지났을 때만)
+        if (shard_flush_timeout(sh) == 0) {
+            shard_flush_pending(sh);
+        }
+        timer_expire(&sh->logins, metric_now_us() / 1000, shard_login_expired, sh);
+        timer_expire(&sh->delays, metric_now_us() / 1000, shard_rate_resume, sh);
+        if (atomic_load_explicit(&handoff_requested, memory_order_acquire)) {
+            shard_handoff(sh);
+        }
+    }
+}
+
+// 샤드 초기화 (서버 소켓, 수신함 eventfd, io_uring 또는 epoll 등록)
+// io_uring을 요청했지만 커널이 지원하지 않으면 경고를 남기고 epoll로 동작한다.
+static int shard_init(struct Shard *sh, int index, int ssock) {
+    struct epoll_event ev;
+
+    sh->index = index;
+    sh->ssock = ssock;
+    atomic_init(&sh->inbox, NULL);
+    conn_table_init(&sh->conns, sizeof(struct Client));
+    room_index_init(&sh->rooms, offsetof(struct Client, room));
+    timer_wheel_init(&sh->logins, metric_now_us() / 1000);
+    timer_wheel_init(&sh->delays, metric_now_us() / 1000);
+
+    if (set_nonblocking(ssock) < 0 || (sh->evfd = eventfd(0, EFD_NONBLOCK)) < 0) {
+        log_msg(LOG_ERR, "샤드 초기화 실패: %m");
+        return -1;
+    }
+
+    if (config.io_backend == IO_URING) {
+        sh->uring = malloc(sizeof(struct Uring));
+        if (sh->uring != NULL && uring_init(sh->uring) == 0) {
+            return 0;
+        }
+        free(sh->uring);
+        sh->uring = NULL;
+        log_msg(LOG_WARNING, "io_uring(multishot recv, 제공 버퍼 링)을 사용할 수 없어 샤드 %d은(는) epoll로 동작합니다.", index);
+    }
+
+    if ((sh->epfd = epoll_create1(0)) < 0) {
+        log_msg(LOG_ERR, "epoll 초기화 실패: %m");
+        return -1;
+    }
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = LISTEN_TAG;
+    if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, ssock, &ev) < 0) {
+        log_msg(LOG_ERR, "epoll_ctl() 실패: %m");
+        return -1;
+    }
+    ev.events = EPOLLIN;    // 수신함은 한 번에 모두 비우므로 level-triggered로 충분
+    ev.data.u64 = INBOX_TAG;
+    if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, sh->evfd, &ev) < 0) {
+        log_msg(LOG_ERR, "epoll_ctl() 실패: %m");
+        return -1;
+    }
+    return 0;
+}
+
+// 연결 하나의 상태와 디스크립터를 씀 (수신 버퍼에서 처리하지 않은 데이터와 송신 대기열에서 보내지 않은 데이터가 뒤따름)
+static int handoff_put_client(struct HandoffWriter *w, struct Client *c) {
+    struct HandoffConn h;
+    int fds[3], nfds = 0;
+
+    memset(&h, 0, sizeof(h));
+    h.kind = HANDOFF_CONN;
+    h.state = c->state;
+    h.proto = c->proto;
+    memcpy(h.id, c->id, sizeof(h.id));
+    if (c->room.room != ROOM_NONE) {
+        snprintf(h.room, sizeof(h.room), "%s", room_registry_name(c->room.room));
+    }
+    h.in_len = c->reader.end - c->reader.start;
+    h.out_len = c->outq.bytes;
+    fds[nfds++] = c->fd;
+    if (c->upload != NULL) {
+        h.has_upload = 1;
+        h.upload = *c->upload;
+        if (c->upload->fd >= 0) fds[nfds++] = c->upload->fd;
+    }
+    if (c->file != NULL) {
+        h.has_file = 1;
+        h.file = *c->file;
+        fds[nfds++] = c->file->fd;
+    }
+    if (handoff_put(w, &h, sizeof(h), fds, nfds) < 0 ||
+        handoff_put(w, c->reader.buf + c->reader.start, h.in_len, NULL, 0) < 0) {
+        return -1;
+    }
+    for (unsigned i = 0; i < c->outq.count; i++) {
+        struct SharedBuf *b = c->outq.bufs[(c->outq.head + i) & (c->outq.cap - 1)];
+        size_t off = (i == 0) ? c->outq.head_off : 0;
+        if (handoff_put(w, b->data + off, b->len - off, NULL, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+// 서버 소켓, 스풀 파일 목록, 모든 샤드의 연결을 새 프로세스에 넘기고 서비스 준비를 마쳤다는 응답을 기다림 (실패하면 -1)
+// 샤드들이 모두 멈춰 있는 동안 재시작 스레드에서 호출하므로 연결 테이블을 잠금 없이 읽는다.
+static int handoff_send(int sock, size_t *count) {
+    static struct HandoffWriter w;
+    struct HandoffState st;
+    struct HandoffConn end;
+    int fds[HANDOFF_MAX_FDS], nfds = 0, relay_fd;
+    void *spool;
+
+    if (shard_count >= HANDOFF_MAX_FDS) return -1;
+    w.sock = sock;
+    w.len = 0;
+    w.nfds = 0;
+    memset(&st, 0, sizeof(st));
+    st.nlisten = shard_count;
+    for (int i = 0; i < shard_count; i++) {
+        fds[nfds++] = shards[i].ssock;
+    }
+    relay_handoff_state(&relay_fd, &st.node_id, &st.relay_seq);
+    if (relay_fd >= 0) {
+        st.has_relay = 1;
+        fds[nfds++] = relay_fd;
+    }
+    st.spool_len = spool_export(&spool);
+    int ret = (spool == NULL) ? -1 : handoff_put(&w, &st, sizeof(st), fds, nfds);
+    if (ret == 0) ret = handoff_put(&w, spool, st.spool_len, NULL, 0);
+    free(spool);
+    if (ret < 0) return -1;
+
+    *count = 0;
+    for (int i = 0; i < shard_count; i++) {
+        struct Shard *sh = &shards[i];
+        for (size_t j = 0; j < sh->conns.count; j++) {
+            if (handoff_put_client(&w, sh->conns.live[j]) < 0) return -1;
+            (*count)++;
+        }
+    }
+    memset(&end, 0, sizeof(end));
+    end.kind = HANDOFF_END;
+    if (handoff_put(&w, &end, sizeof(end), NULL, 0) < 0 || handoff_flush(&w) < 0) return -1;
+    return handoff_wait_ack(sock);
+}
+
+// 무중단 재시작 스레드: 새 프로세스가 접속하면 모든 샤드를 멈추고 상태를 넘긴 뒤 프로세스를 끝냄
+// 새 프로세스가 준비를 마치기 전에 실패하면 샤드들을 다시 돌리고 다음 요청을 기다린다.
+// 새 프로세스가 저장소를 이어서 쓰므로, 넘기는 동안에는 중계 스레드도 저장소에 쓰지 않도록 막아 둔다.
+static void *handoff_thread(void *arg) {
+    int lsock = (int)(intptr_t)arg;
+
+    metrics_thread_slot();
+    while (1) {
+        int sock = handoff_accept(lsock);
+        if (sock < 0) continue;
+
+        log_msg(LOG_NOTICE, "새 서버 프로세스에 연결을 넘깁니다.");
+        uint64_t start = metric_now_us();
+        atomic_store_explicit(&handoff_requested, 1, memory_order_release);
+        for (int i = 0; i < shard_count; i++) {    // 이벤트를 기다리는 샤드를 깨움
+            uint64_t one = 1;
+            write(shards[i].evfd, &one, sizeof(one));
+        }
+        pthread_barrier_wait(&handoff_barrier);    // 모든 샤드가 멈춤
+        pthread_barrier_wait(&handoff_barrier);    // 샤드들이 수신함까지 비움
+
+        size_t count = 0;
+        store_pause();
+        if (handoff_send(sock, &count) == 0 && handoff_confirm(sock) == 0) {
+            log_msg(LOG_NOTICE, "연결 %zu개를 넘겼습니다. (%.1f ms) 이전 프로세스를 종료합니다.",
+                    count, (metric_now_us() - start) / 1000.0);
+            log_sync();
+            exit(0);
+        }
+        log_msg(LOG_ERR, "새 서버 프로세스에 연결을 넘기지 못했습니다. 이어서 서비스합니다.");
+        store_resume();
+        close(sock);
+        atomic_store_explicit(&handoff_requested, 0, memory_order_relaxed);
+        pthread_barrier_wait(&handoff_barrier);    // 샤드들을 다시 돌림
+    }
+    return NULL;
+}
+
+// 재시작 소켓을 열고 재시작 스레드를 시작 (실패해도 서비스는 계속함)
+static void handoff_serve(const char *path) {
+    pthread_t thread;
+    int lsock = handoff_listen(path);
+    if (lsock < 0) return;
+    pthread_barrier_init(&handoff_barrier, NULL, shard_count + 1);
+
+    // 샤드 스레드가 받을 시그널을 이 스레드가 가로채지 않도록 모든 시그널을 막은 채로 만듦
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&thread, NULL, handoff_thread, (void *)(intptr_t)lsock);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        log_msg(LOG_WARNING, "재시작 스레드 생성 실패");
+        close(lsock);
+        return;
+    }
+    pthread_detach(thread);
+}
+
+// 이전 프로세스에서 넘겨받은 연결을 샤드에 등록 (샤드 스레드를 시작하기 전에 호출)
+// 처리하지 않은 수신 데이터와 보내지 못한 송신 데이터를 그대로 이어받으므로 클라이언트는 끊김을 알아차리지 못한다.
+static void shard_adopt(struct Shard *sh, struct HandoffClient *hc) {
+    struct HandoffConn *h = &hc->conn;
+
+    atomic_fetch_add(&total_clients, 1);
+    struct Client *c = conn_alloc(&sh->conns);
+    if (c == NULL) {
+        close(hc->fd);
+        if (hc->upload_fd >= 0) close(hc->upload_fd);
+        if (hc->file_fd >= 0) close(hc->file_fd);
+        atomic_fetch_sub(&total_clients, 1);
+        return;
+    }
+    c->fd = hc->fd;
+    c->state = h->state;
+    c->proto = h->proto;
+    memcpy(c->id, h->id, sizeof(c->id));
+    c->id[MAX_ID_LEN - 1] = '\0';
+    c->room.room = ROOM_NONE;
+    if (h->has_upload && (c->upload = malloc(sizeof(struct SpoolUpload))) != NULL) {
+        *c->upload = h->upload;
+        c->upload->fd = hc->upload_fd;
+    } else if (hc->upload_fd >= 0) {
+        close(hc->upload_fd);
+    }
+    if (h->has_file && (c->file = malloc(sizeof(struct SpoolSend))) != NULL) {
+        *c->file = h->file;
+        c->file->fd = hc->file_fd;
+    } else if (hc->file_fd >= 0) {
+        close(hc->file_fd);
+    }
+
+    // 수신 버퍼는 넘겨받은 데이터가 들어가도록 (멈추는 동안 모아 둔 데이터는 최대 프레임보다 클 수 있음)
+    size_t cap = h->in_len > 512 ? h->in_len : 512;
+    if (frame_reader_init(&c->reader, cap) < 0 || (h->has_upload && c->upload == NULL) ||
+        (h->has_file && c->file == NULL)) {
+        ev_close_client(sh, c);
+        return;
+    }
+    if (cap > c->reader.max) c->reader.max = cap;
+    memcpy(c->reader.buf, hc->in, h->in_len);
+    frame_reader_commit(&c->reader, h->in_len);
+    if (h->out_len > 0) {
+        struct SharedBuf *b = sbuf_from(hc->out, h->out_len);
+        if (b == NULL || outq_push(&c->outq, b) < 0) {
+            sbuf_unref(b);
+            ev_close_client(sh, c);
+            return;
+        }
+    }
+
+    int failed;
+    if (c->state == CONN_CHAT) {
+        int room = room_registry_find(h->room[0] ? h->room : LOBBY_NAME, 1);
+        pthread_mutex_lock(&users_lock);
+        failed = id_map_add(&users, c->id, sh->index, conn_handle(c));
+        pthread_mutex_unlock(&users_lock);
+        if (failed < 0) {
+            log_msg(LOG_ERR, "넘겨받은 사용자 '%s' 등록 실패: 아이디 표를 늘릴 메모리 부족", c->id);
+        } else if (failed > 0) {
+            log_msg(LOG_NOTICE, "넘겨받은 사용자 '%s'와 같은 아이디가 이미 접속 중이라 연결을 종료합니다.", c->id);
+        }
+        rate_limit_init(&c->rate, config.rate_msgs, config.rate_bytes, FRAME_MAX_PAYLOAD, metric_now_us());
+        if (failed) c->state = CONN_LOGIN;    // 아이디 등록에 실패했으면 종료할 때 지우지 않도록
+        failed = failed || room_join(&sh->rooms, c, room < 0 ? LOBBY_ROOM : (uint32_t)room) < 0;
+    } else {
+        failed = timer_add(&sh->logins, conn_handle(c), metric_now_us() / 1000 + config.login_timeout_ms) < 0;
+    }
+    if (failed || ev_watch(sh, c) < 0) {
+        ev_close_client(sh, c);
+    }
+}
+
+// 이전 프로세스와 샤드 수가 다르면 새 연결이 앞의 shard_count개 서버 소켓에만 가도록 SO_REUSEPORT 그룹에 분배 프로그램을 붙임
+// 그룹 안의 소켓 순서는 listen한 순서(첫 번째 샤드부터)이고 뒤에서부터 닫으면 바뀌지 않으므로 앞의 shard_count개가 이 프로세스의 서버 소켓이다.
+static int reactor_steer(int sock) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RANDOM),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)shard_count),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+// 이전 프로세스의 샤드가 더 많았으면 남는 서버 소켓의 accept 대기열을 비워 등록하고 닫음
+// 닫을 때 대기열에 남은 연결은 끊기므로, 새 연결이 더 오지 않도록 분배한 뒤 HANDOFF_DRAIN_MS 동안 조용해질 때까지 비운다.
+static void reactor_drain(struct Handoff *h) {
+    struct pollfd pfds[HANDOFF_MAX_FDS];
+    uint64_t deadline = metric_now_us() + HANDOFF_QUIESCE_MS * 1000ULL;
+
+    if (h->state.nlisten <= (uint32_t)shard_count) return;
+    uint32_t count = h->state.nlisten - shard_count;
+    for (uint32_t i = 0; i < count; i++) {
+        pfds[i].fd = h->listen_fds[shard_count + i];
+        pfds[i].events = POLLIN;
+    }
+    while (1) {
+        for (uint32_t i = 0; i < count; i++) {
+            int csock;
+            while ((csock = accept4(pfds[i].fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                ev_add_client(&shards[i % shard_count], csock, NULL);
+            }
+        }
+        if (poll(pfds, count, HANDOFF_DRAIN_MS) == 0) break;
+        if (metric_now_us() >= deadline) {    // 분배하지 못해 연결이 계속 오면 기다리지 않고 닫음
+            log_msg(LOG_WARNING, "남는 서버 소켓에 연결이 계속 들어와 그대로 닫습니다.");
+            break;
+        }
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        close(pfds[i].fd);
+    }
+}
+
+// 넘기기를 확정한 뒤 bind만 해 둔 서버 소켓을 listen하고, 샤드 수가 바뀌었으면 새 연결의 분배를 바꿈
+static void reactor_listen(struct Handoff *h) {
+    struct epoll_event ev;
+
+    for (int i = (int)h->state.nlisten; i < shard_count; i++) {
+        struct Shard *sh = &shards[i];
+        if (listen(sh->ssock, SOMAXCONN) == 0) continue;
+
+        // 거의 없는 일이지만 실패하면 첫 번째 샤드의 서버 소켓을 함께 씀
+        log_msg(LOG_ERR, "샤드 %d 서버 소켓 listen 실패: %m", i);
+        close(sh->ssock);
+        sh->ssock = dup(shards[0].ssock);
+        if (sh->uring == NULL && sh->ssock >= 0) {
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.u64 = LISTEN_TAG;
+            epoll_ctl(sh->epfd, EPOLL_CTL_ADD, sh->ssock, &ev);
+        }
+    }
+    if (h->state.nlisten != (uint32_t)shard_count && reactor_steer(shards[0].ssock) < 0) {
+        log_msg(LOG_WARNING, "SO_REUSEPORT 분배 프로그램을 붙이지 못했습니다: %m");
+    }
+}
+
+// 넘겨받은 연결을 모두 샤드에 나누어 등록하고, 남은 수신 데이터의 메시지를 처리하고 송신 대기열은 다음 바퀴에 보냄
+static void reactor_adopt(struct Handoff *h) {
+    reactor_listen(h);
+    reactor_drain(h);
+    for (size_t i = 0; i < h->count; i++) {
+        shard_adopt(&shards[i % shard_count], &h->clients[i]);
+    }
+    // 모든 연결을 등록한 뒤에 처리해야 다른 샤드의 연결도 브로드캐스트를 받음
+    for (int i = 0; i < shard_count; i++) {
+        struct Shard *sh = &shards[i];
+        for (size_t j = sh->conns.count; j-- > 0;) {
+            struct Client *c = sh->conns.live[j];
+            if (ev_process(sh, c, &c->reader, metric_now_us()) < 0 ||
+                ((c->outq.count > 0 || c->file != NULL) && shard_defer(sh, c) < 0)) {
+                ev_close_client(sh, c);
+            }
+        }
+    }
+    log_msg(LOG_NOTICE, "이전 서버 프로세스에서 연결 %zu개를 넘겨받았습니다.", h->count);
+}
+
+// reactor 준비 (nshards가 1이면 단일 이벤트 루프, 그 이상이면 코어마다 스레드 하나)
+// ssock은 첫 번째 샤드가 사용하고, 나머지 샤드는 SO_REUSEPORT로 같은 포트에 서버 소켓을 새로 연다.
+// takeover가 있으면(무중단 재시작) 이전 프로세스의 서버 소켓을 이어받고 모자라는 서버 소켓은 bind만 해 둔다.
+// 실패할 수 있는 준비는 모두 여기서 하므로 실패해도 이전 프로세스가 이어서 서비스한다.
+int reactor_init(int ssock, int nshards, struct Handoff *takeover) {
+    struct rlimit rl;
+
+    // 수천 개의 연결을 받을 수 있도록 열 수 있는 디스크립터 수를 최대로 올림
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // 송신 중 상대가 끊겨도 서버가 종료되지 않도록 SIGPIPE 무시
+    signal(SIGPIPE, SIG_IGN);
+
+    shards = calloc(nshards, sizeof(struct Shard));
+    if (shards == NULL) return -1;
+    shard_count = nshards;
+
+    // 샤드가 늘면 같은 포트에 서버 소켓을 더 열어야 하므로 이전 서버 소켓도 SO_REUSEPORT여야 함
+    if (takeover != NULL && (uint32_t)nshards > takeover->state.nlisten) {
+        int reuse = 0;
+        socklen_t len = sizeof(reuse);
+        if (getsockopt(ssock, SOL_SOCKET, SO_REUSEPORT, &reuse, &len) < 0 || !reuse) {
+            log_msg(LOG_ERR, "이전 서버가 SO_REUSEPORT 없이(-m epoll) 실행되어 샤드 %d개로 이어받을 수 없습니다. "
+                             "같은 모드로 재시작하세요.", nshards);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < nshards; i++) {
+        int sock;
+        if (i == 0) {
+            sock = ssock;
+        } else if (takeover == NULL) {
+            sock = open_listen_socket(SOMAXCONN, 1);
+        } else if ((uint32_t)i < takeover->state.nlisten) {
+            sock = takeover->listen_fds[i];
+        } else {
+            sock = bind_listen_socket(1);    // 이전 프로세스가 종료하기 전에는 연결을 나누어 받지 않도록 listen은 나중에
+        }
+        if (sock < 0 || shard_init(&shards[i], i, sock) < 0) {
+            log_msg(LOG_ERR, "샤드 %d 초기화 실패", i);
+            return -1;
+        }
+    }
+
+    // 다른 서버에서 중계된 메시지는 샤드 수신함으로 전달하므로 샤드를 모두 만든 뒤에 준비
+    if (takeover != NULL) {
+        relay_adopt(takeover->relay_fd, takeover->state.node_id, takeover->state.relay_seq);
+    }
+    return relay_prepare(config.relay_port, config.node_id, reactor_relay_deliver);
+}
+
+// reactor 실행 (reactor_init 뒤에, 무중단 재시작이면 이전 프로세스가 넘기기를 확정한 뒤 호출)
+// takeover가 있으면 이전 프로세스의 연결을 샤드에 등록하고 이어서 서비스한다.
+int reactor_run(struct Handoff *takeover) {
+    int nshards = shard_count;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (takeover != NULL) {
+        reactor_adopt(takeover);
+        handoff_free(takeover);
+    }
+    handoff_serve(config.handoff_path);
+    relay_run();    // 실패해도 (이미 넘겨받은 연결이 있으므로) 중계 없이 서비스함
+
+    const char *backend = shards[0].uring ? "io_uring" : "epoll";
+    if (nshards == 1) {
+        log_msg(LOG_NOTICE, "%s 이벤트 루프 모드로 동작합니다.", backend);
+    } else {
+        log_msg(LOG_NOTICE, "멀티코어 모드로 동작합니다. 샤드 %d개 (%s)", nshards, backend);
+    }
+
+    // 첫 번째 샤드는 현재 스레드에서 실행하고 나머지는 스레드를 만들어 코어에 하나씩 고정
+    for (int i = 1; i < nshards; i++) {
+        if (pthread_create(&shards[i].thread, NULL, shard_loop, &shards[i]) != 0) {
+            log_msg(LOG_ERR, "샤드 %d 스레드 생성 실패", i);
+            return -1;
+        }
+        if (ncpu > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % ncpu, &set);
+            pthread_setaffinity_np(shards[i].thread, sizeof(set), &set);
+        }
+    }
+    if (nshards > 1 && ncpu > 1) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    shard_loop(&shards[0]);
+    return -1;
+}
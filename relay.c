@@ -0,0 +1,677 @@
+// ---------------------------------------------------------------------------
+// 서버 간 중계
+//
+// 여러 서버가 중계 포트(-P)로 서로 연결을 유지하며, 한 서버의 방에 올라온 채팅 메시지를
+// 다른 서버의 같은 이름의 방에도 전달한다. 메시지마다 처음 받은 서버(원본)의 번호와 그 서버가
+// 매긴 순번을 붙이고, 받은 서버는 처음 보는 (원본, 순번)만 전달한 뒤 받은 연결을 뺀 나머지
+// 연결로 다시 보낸다. 그래서 서버들이 사슬이나 고리 모양으로 연결되어도 모든 서버에 한 번씩
+// 퍼지고, 여러 경로로 돌아온 메시지나 자기 메시지는 버려진다.
+//
+// 중계는 전용 스레드 하나가 맡는다. 서버 스레드(fork 모드의 부모 프로세스, reactor 샤드)는
+// relay_publish로 레코드를 대기열에 붙이기만 하고, 중계 스레드가 깨어날 때마다 그동안 쌓인
+// 레코드를 연결마다 FRAME_RELAY 프레임 하나로 묶어 보낸다. 끊긴 동안의 메시지는 다시 보내지 않는다.
+//
+// FRAME_RELAY_HELLO payload는 보낸 서버 번호(4), FRAME_RELAY payload는 레코드를 이어 붙인 것이다:
+//   | origin(4) | seq(8) | room_len(1) | id_len(1) | len(2) | room | id | text |  (정수는 네트워크 바이트 순서)
+// ---------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "relay.h"
+#include "protocol.h"
+#include "room.h"
+#include "log.h"
+#include "metrics.h"
+
+#define RELAY_REC_HEADER 16                 // origin + seq + room_len + id_len + len
+#define RELAY_LISTEN_TAG RELAY_MAX_LINKS    // epoll 이벤트의 data.u32 (그보다 작으면 links 배열 번호)
+#define RELAY_WAKE_TAG (RELAY_MAX_LINKS + 1)
+
+// 보낼 데이터를 모아 두는 버퍼 (앞에서부터 보내고 다 보내면 비움)
+struct RelayBuf {
+    char *data;
+    size_t off;                 // 이미 보낸 위치
+    size_t len;
+    size_t cap;
+};
+
+// 다른 서버와의 중계 연결 하나
+struct RelayLink {
+    int fd;                     // -1이면 빈 칸
+    int peer;                   // 이 연결을 맺은 -J 이웃 서버 번호 (상대가 접속해 온 연결은 -1)
+    int connecting;             // 비차단 connect() 진행 중
+    int want_out;               // EPOLLOUT을 기다리는 중
+    uint32_t node;              // 상대 서버 번호 (FRAME_RELAY_HELLO를 받기 전에는 0)
+    struct FrameReader reader;
+    struct RelayBuf out;        // 송신 버퍼가 가득 차 보내지 못한 프레임
+};
+
+// -J로 지정한 이웃 서버 (끊기면 RELAY_RETRY_MS마다 다시 연결)
+struct RelayPeer {
+    char host[256];
+    char port[8];
+    int link;                   // 연결된 links 번호 (-1이면 끊김)
+    uint64_t retry_at;          // 다음 연결 시도 시각 (밀리초, UINT64_MAX면 자기 자신이라 연결하지 않음)
+};
+
+// 원본 서버마다 받은 순번 기록 (최근 RELAY_WINDOW개)
+struct RelayOrigin {
+    uint32_t node;
+    uint64_t top;               // 받은 가장 큰 순번
+    uint64_t mask;              // bit i: top - i 순번을 받았는지 여부
+};
+
+// 해석한 레코드 (포인터는 받은 프레임을 가리키며 null 종료되지 않음)
+struct RelayRecord {
+    uint32_t origin;
+    uint64_t seq;
+    const char *room;
+    size_t room_len;
+    const char *id;
+    size_t id_len;
+    const char *text;
+    size_t len;
+    size_t size;                // 레코드 전체 크기
+};
+
+static struct {
+    pthread_mutex_t lock;       // pending과 seq를 보호 (서버 스레드들이 함께 씀)
+    struct RelayBuf pending;    // 중계 스레드가 다음에 깨어날 때 보낼 이 서버의 메시지
+    struct RelayBuf spare;      // 중계 스레드가 보내는 중인 이전 pending (다 보내면 비워서 맞바꿈)
+    uint64_t seq;               // 마지막으로 매긴 순번
+    uint32_t node;              // 이 서버 번호
+    int wake_fd;                // 중계 스레드를 깨우는 eventfd (-1이면 중계하지 않음)
+    int listen_fd;              // 다른 서버의 접속을 받는 소켓 (-1이면 나가는 연결만)
+    int epfd;
+    relay_deliver_fn deliver;
+} relay = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake_fd = -1,
+    .listen_fd = -1,
+    .epfd = -1,
+};
+
+static struct RelayPeer peers[RELAY_MAX_PEERS];
+static int peer_count;
+static uint32_t adopted_node;       // 무중단 재시작에서 이어받은 서버 번호 (0이면 없음)
+static uint64_t adopted_seq;        // 이어받은 마지막 순번
+static int prepared_wake = -1;      // relay_prepare가 만든 eventfd (relay_run이 중계 스레드를 시작하면 relay.wake_fd가 됨)
+static int relay_port;
+static struct RelayLink links[RELAY_MAX_LINKS];     // 이하는 중계 스레드만 씀
+static struct RelayOrigin origins[RELAY_MAX_NODES];
+static unsigned origin_count;
+static unsigned origin_evict;   // 표가 가득 찼을 때 다음에 덮어쓸 칸
+static struct RelayBuf forward; // 받은 프레임 중 다른 연결로 다시 보낼 레코드
+
+static void relay_link_close(struct RelayLink *l);
+
+static uint64_t relay_now_ms(void) {
+    return metric_now_us() / 1000;
+}
+
+// n바이트를 붙일 자리를 마련해 반환 (보내지 않은 데이터가 max를 넘거나 메모리가 없으면 NULL)
+static char *relay_buf_reserve(struct RelayBuf *b, size_t n, size_t max) {
+    if (b->len - b->off + n > max) return NULL;
+    if (b->len + n > b->cap && b->off > 0) {    // 보낸 앞부분을 버리고 앞으로 당김
+        memmove(b->data, b->data + b->off, b->len - b->off);
+        b->len -= b->off;
+        b->off = 0;
+    }
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        char *p = realloc(b->data, cap);
+        if (p == NULL) return NULL;
+        b->data = p;
+        b->cap = cap;
+    }
+    char *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+static void relay_buf_free(struct RelayBuf *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+// 레코드 하나를 out에 쓰고 크기를 반환
+static size_t relay_encode(char *out, uint32_t origin, uint64_t seq, const char *room, size_t room_len,
+                           const char *id, size_t id_len, const char *text, size_t len) {
+    uint32_t o = htonl(origin), hi = htonl((uint32_t)(seq >> 32)), lo = htonl((uint32_t)seq);
+    uint16_t l = htons((uint16_t)len);
+    memcpy(out, &o, 4);
+    memcpy(out + 4, &hi, 4);
+    memcpy(out + 8, &lo, 4);
+    out[12] = (char)room_len;
+    out[13] = (char)id_len;
+    memcpy(out + 14, &l, 2);
+    memcpy(out + RELAY_REC_HEADER, room, room_len);
+    memcpy(out + RELAY_REC_HEADER + room_len, id, id_len);
+    memcpy(out + RELAY_REC_HEADER + room_len + id_len, text, len);
+    return RELAY_REC_HEADER + room_len + id_len + len;
+}
+
+// 레코드 하나를 해석 (잘렸거나 길이 제한을 넘으면 -1)
+static int relay_decode(const char *p, size_t avail, struct RelayRecord *r) {
+    uint32_t o, hi, lo;
+    uint16_t l;
+    if (avail < RELAY_REC_HEADER) return -1;
+    memcpy(&o, p, 4);
+    memcpy(&hi, p + 4, 4);
+    memcpy(&lo, p + 8, 4);
+    memcpy(&l, p + 14, 2);
+    r->origin = ntohl(o);
+    r->seq = (uint64_t)ntohl(hi) << 32 | ntohl(lo);
+    r->room_len = (unsigned char)p[12];
+    r->id_len = (unsigned char)p[13];
+    r->len = ntohs(l);
+    r->size = RELAY_REC_HEADER + r->room_len + r->id_len + r->len;
+    if (r->room_len == 0 || r->room_len >= MAX_ROOM_NAME || r->id_len >= MAX_ID_LEN ||
+        r->len > FRAME_MAX_TEXT || r->size > avail) {
+        return -1;
+    }
+    r->room = p + RELAY_REC_HEADER;
+    r->id = r->room + r->room_len;
+    r->text = r->id + r->id_len;
+    return 0;
+}
+
+// 원본 서버가 매긴 순번을 처음 보는지 확인하고 기록 (1: 처음, 0: 이미 받았거나 기억하는 범위보다 오래됨)
+static int relay_first_seen(uint32_t node, uint64_t seq) {
+    struct RelayOrigin *o = NULL;
+    for (unsigned i = 0; i < origin_count; i++) {
+        if (origins[i].node == node) {
+            o = &origins[i];
+            break;
+        }
+    }
+    if (o == NULL) {    // 새 원본 서버 (표가 가득 차면 돌아가며 덮어씀)
+        o = &origins[origin_count < RELAY_MAX_NODES ? origin_count++ : origin_evict++ % RELAY_MAX_NODES];
+        o->node = node;
+        o->top = seq;
+        o->mask = 1;
+        return 1;
+    }
+    if (seq > o->top) {
+        uint64_t shift = seq - o->top;
+        o->mask = (shift >= RELAY_WINDOW) ? 1 : (o->mask << shift) | 1;
+        o->top = seq;
+        return 1;
+    }
+    uint64_t age = o->top - seq;
+    if (age >= RELAY_WINDOW || (o->mask & (1ULL << age))) return 0;
+    o->mask |= 1ULL << age;
+    return 1;
+}
+
+// EPOLLOUT 감시를 켜거나 끔
+static void relay_link_watch(struct RelayLink *l, int out) {
+    if (l->want_out == out) return;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+    ev.data.u32 = (uint32_t)(l - links);
+    epoll_ctl(relay.epfd, EPOLL_CTL_MOD, l->fd, &ev);
+    l->want_out = out;
+}
+
+// 쌓인 데이터를 보낼 수 있는 만큼 보냄 (남으면 쓰기 가능해질 때까지 기다리고, 오류면 연결을 닫음)
+static void relay_link_send(struct RelayLink *l) {
+    while (l->out.off < l->out.len) {
+        ssize_t n = send(l->fd, l->out.data + l->out.off, l->out.len - l->out.off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            relay_link_close(l);
+            return;
+        }
+        l->out.off += n;
+    }
+    if (l->out.off == l->out.len) l->out.off = l->out.len = 0;
+    relay_link_watch(l, l->out.len > 0);
+}
+
+// 연결을 맺자마자 이 서버 번호를 알림
+static void relay_send_hello(struct RelayLink *l) {
+    uint32_t node = htonl(relay.node);
+    char *p = relay_buf_reserve(&l->out, frame_size(0, sizeof(node)), RELAY_OUT_MAX);
+    if (p == NULL) {
+        relay_link_close(l);
+        return;
+    }
+    frame_encode(p, FRAME_RELAY_HELLO, "", 0, &node, sizeof(node));
+    relay_link_send(l);
+}
+
+static void relay_link_close(struct RelayLink *l) {
+    if (l->node != 0) {
+        log_msg(LOG_WARNING, "서버 %u와의 중계 연결이 끊겼습니다.", l->node);
+    }
+    close(l->fd);    // epoll 등록도 해제됨
+    l->fd = -1;
+    frame_reader_free(&l->reader);
+    relay_buf_free(&l->out);
+    if (l->peer >= 0) {
+        peers[l->peer].link = -1;
+        peers[l->peer].retry_at = relay_now_ms() + RELAY_RETRY_MS;
+    }
+}
+
+// 빈 칸에 연결을 등록 (칸이 없거나 실패하면 소켓을 닫고 NULL)
+static struct RelayLink *relay_link_add(int fd, int peer, int connecting) {
+    for (int i = 0; i < RELAY_MAX_LINKS; i++) {
+        struct RelayLink *l = &links[i];
+        if (l->fd >= 0) continue;
+
+        memset(l, 0, sizeof(*l));
+        l->fd = fd;
+        l->peer = peer;
+        l->connecting = connecting;
+        l->want_out = connecting;
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (connecting ? EPOLLOUT : 0);    // connect()가 끝나면 쓰기 가능해짐
+        ev.data.u32 = (uint32_t)i;
+        if (frame_reader_init(&l->reader, 4096) < 0 || epoll_ctl(relay.epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            frame_reader_free(&l->reader);
+            close(fd);
+            l->fd = -1;
+            return NULL;
+        }
+        // 묶어 보내기는 중계 스레드가 하므로 프레임은 바로 나가도록
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (!connecting) relay_send_hello(l);
+        return l;
+    }
+    log_msg(LOG_WARNING, "중계 연결이 최대 개수(%d)에 도달했습니다.", RELAY_MAX_LINKS);
+    close(fd);
+    return NULL;
+}
+
+// 이웃 서버에 비차단 connect() 시작 (실패하면 RELAY_RETRY_MS 뒤에 다시 시도)
+static void relay_dial(int i) {
+    struct RelayPeer *p = &peers[i];
+    struct addrinfo hints, *res;
+
+    p->retry_at = relay_now_ms() + RELAY_RETRY_MS;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(p->host, p->port, &hints, &res) != 0) return;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && (connect(fd, res->ai_addr, res->ai_addrlen) == 0 || errno == EINPROGRESS)) {
+        struct RelayLink *l = relay_link_add(fd, i, 1);
+        if (l != NULL) p->link = (int)(l - links);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    freeaddrinfo(res);
+}
+
+// 비차단 connect()가 끝남 (실패면 닫고 나중에 다시 시도)
+static void relay_connected(struct RelayLink *l) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(l->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        log_msg(LOG_DEBUG, "중계 서버 %s:%s 연결 실패: %s", peers[l->peer].host, peers[l->peer].port, strerror(err));
+        relay_link_close(l);
+        return;
+    }
+    l->connecting = 0;
+    relay_send_hello(l);
+}
+
+// 끊긴 이웃 서버 중 다시 시도할 때가 된 곳에 연결하고, 다음 시도까지 남은 밀리초를 반환 (-1은 기다릴 일이 없음)
+static int relay_connect_peers(void) {
+    uint64_t now = relay_now_ms();
+    int timeout = -1;
+    for (int i = 0; i < peer_count; i++) {
+        struct RelayPeer *p = &peers[i];
+        if (p->link >= 0 || p->retry_at == UINT64_MAX) continue;
+        if (p->retry_at <= now) relay_dial(i);
+        if (p->link < 0) {
+            int t = (int)(p->retry_at - now);
+            if (timeout < 0 || t < timeout) timeout = t;
+        }
+    }
+    return timeout;
+}
+
+// 레코드들을 RELAY_BATCH_MAX 이하의 FRAME_RELAY 프레임으로 묶어 except를 뺀 모든 연결에 보냄
+// 프레임 헤더는 한 번만 만들고, 연결마다 송신 버퍼에 이어 붙인 뒤 한꺼번에 보낸다.
+static void relay_forward(const char *data, size_t len, int except) {
+    char hdr[FRAME_HEADER_LEN];
+    struct RelayRecord r;
+    size_t off = 0;
+
+    while (off < len) {
+        size_t n = 0;
+        while (off + n < len && relay_decode(data + off + n, len - off - n, &r) == 0 &&
+               (n == 0 || n + r.size <= RELAY_BATCH_MAX)) {
+            n += r.size;
+        }
+        if (n == 0) break;
+        frame_encode_header(hdr, FRAME_RELAY, 0, "", 0, n);
+        for (int i = 0; i < RELAY_MAX_LINKS; i++) {
+            struct RelayLink *l = &links[i];
+            if (i == except || l->fd < 0 || l->connecting) continue;
+            char *p = relay_buf_reserve(&l->out, FRAME_HEADER_LEN + n, RELAY_OUT_MAX);
+            if (p == NULL) {    // 상대가 받지 못할 만큼 밀림: 끊고 다시 연결 (그 사이 메시지는 잃음)
+                log_msg(LOG_WARNING, "서버 %u로 보낼 중계 데이터가 너무 많아 연결을 끊습니다.", l->node);
+                relay_link_close(l);
+                continue;
+            }
+            memcpy(p, hdr, FRAME_HEADER_LEN);
+            memcpy(p + FRAME_HEADER_LEN, data + off, n);
+        }
+        off += n;
+    }
+    for (int i = 0; i < RELAY_MAX_LINKS; i++) {
+        if (links[i].fd >= 0 && !links[i].connecting && links[i].out.len > links[i].out.off) relay_link_send(&links[i]);
+    }
+}
+
+// 서버 스레드들이 쌓아 둔 이 서버의 메시지를 모든 연결로 보냄
+static void relay_flush_pending(void) {
+    uint64_t count;
+    read(relay.wake_fd, &count, sizeof(count));
+
+    pthread_mutex_lock(&relay.lock);    // 비운 이전 버퍼와 맞바꾸므로 서버 스레드는 보내는 동안 기다리지 않음
+    struct RelayBuf batch = relay.pending;
+    relay.pending = relay.spare;
+    pthread_mutex_unlock(&relay.lock);
+
+    relay_forward(batch.data, batch.len, -1);
+    batch.off = batch.len = 0;
+    relay.spare = batch;
+}
+
+// 받은 FRAME_RELAY의 레코드 중 처음 보는 것만 이 서버의 방에 전달하고, 받은 연결을 뺀 나머지 연결로 다시 보냄
+static int relay_receive(struct RelayLink *l, const char *data, size_t len) {
+    struct RelayRecord r;
+    char room[MAX_ROOM_NAME], id[MAX_ID_LEN];
+
+    forward.off = forward.len = 0;
+    for (size_t off = 0; off < len; off += r.size) {
+        if (relay_decode(data + off, len - off, &r) < 0) return -1;
+        if (r.origin == relay.node || !relay_first_seen(r.origin, r.seq)) {    // 돌아온 자기 메시지나 다른 경로로 이미 받은 메시지
+            metric_add(MC_RELAY_DUPLICATES, 1);
+            continue;
+        }
+        memcpy(room, r.room, r.room_len);
+        room[r.room_len] = '\0';
+        memcpy(id, r.id, r.id_len);
+        id[r.id_len] = '\0';
+        relay.deliver(room, id, r.text, r.len);
+        metric_add(MC_RELAY_IN, 1);
+
+        char *p = relay_buf_reserve(&forward, r.size, FRAME_MAX_PAYLOAD);
+        if (p != NULL) memcpy(p, data + off, r.size);
+    }
+    if (forward.len > 0) relay_forward(forward.data, forward.len, (int)(l - links));
+    return 0;
+}
+
+// 받은 프레임 하나를 처리 (연결을 닫아야 하면 -1)
+static int relay_handle_frame(struct RelayLink *l, const struct Frame *f) {
+    if (f->type == FRAME_RELAY) return relay_receive(l, f->payload, f->len);
+    if (f->type != FRAME_RELAY_HELLO) return 0;    // 모르는 프레임은 무시
+
+    uint32_t node;
+    if (f->len != sizeof(node)) return -1;
+    memcpy(&node, f->payload, sizeof(node));
+    node = ntohl(node);
+    if (node == relay.node) {    // 자기 자신에게 연결함 (-J에 자기 주소가 있으면 다시 시도하지 않음)
+        log_msg(LOG_WARNING, "같은 서버 번호(%u)의 중계 연결을 닫습니다.", node);
+        if (l->peer >= 0) {
+            peers[l->peer].link = -1;
+            peers[l->peer].retry_at = UINT64_MAX;
+            l->peer = -1;
+        }
+        return -1;
+    }
+    l->node = node;
+    log_msg(LOG_NOTICE, "서버 %u와 중계 연결되었습니다.", node);
+    return 0;
+}
+
+// 연결에서 받을 수 있는 만큼 받아 완성된 프레임을 처리
+static void relay_link_read(struct RelayLink *l) {
+    struct Frame f;
+    int ret;
+    while (1) {
+        size_t avail;
+        char *space = frame_reader_space(&l->reader, &avail);
+        if (space == NULL) {
+            relay_link_close(l);
+            return;
+        }
+        ssize_t n = recv(l->fd, space, avail, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            relay_link_close(l);
+            return;
+        }
+        frame_reader_commit(&l->reader, n);
+        while ((ret = frame_reader_next(&l->reader, &f)) == 1) {
+            if (relay_handle_frame(l, &f) < 0) {
+                relay_link_close(l);
+                return;
+            }
+        }
+        if (ret < 0) {
+            relay_link_close(l);
+            return;
+        }
+    }
+}
+
+static void relay_accept(void) {
+    int fd;
+    while ((fd = accept4(relay.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        relay_link_add(fd, -1, 0);
+    }
+}
+
+static void *relay_thread(void *arg) {
+    struct epoll_event events[64];
+    (void)arg;
+
+    metrics_thread_slot();
+    while (1) {
+        int nev = epoll_wait(relay.epfd, events, 64, relay_connect_peers());
+        for (int i = 0; i < nev; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == RELAY_LISTEN_TAG) {
+                relay_accept();
+                continue;
+            }
+            if (tag == RELAY_WAKE_TAG) {
+                relay_flush_pending();
+                continue;
+            }
+            struct RelayLink *l = &links[tag];
+            if (l->fd < 0) continue;    // 같은 이벤트 묶음에서 앞서 닫힌 연결
+            if (l->connecting) {
+                relay_connected(l);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) relay_link_send(l);
+            if (l->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) relay_link_read(l);
+        }
+    }
+    return NULL;
+}
+
+// -J 옵션의 "호스트:포트"를 이웃 서버로 등록 (형식이 잘못되었거나 너무 많으면 -1)
+int relay_add_peer(const char *addr) {
+    const char *colon = strrchr(addr, ':');
+    if (colon == NULL || colon == addr || peer_count >= RELAY_MAX_PEERS) return -1;
+    size_t host_len = colon - addr;
+    int port = atoi(colon + 1);
+    if (host_len >= sizeof(peers[0].host) || port <= 0 || port > 65535) return -1;
+
+    struct RelayPeer *p = &peers[peer_count++];
+    memcpy(p->host, addr, host_len);
+    p->host[host_len] = '\0';
+    snprintf(p->port, sizeof(p->port), "%d", port);
+    p->link = -1;
+    return 0;
+}
+
+// 중계 준비 (실패할 수 있는 중계 서버 소켓, epoll, eventfd만 만들고 스레드는 relay_run이 시작)
+// port와 이웃 서버가 모두 없으면 중계하지 않는다. port가 0이면 다른 서버의 접속은 받지 않고 -J 이웃 서버에만 연결한다.
+// node_id가 0이면 시각과 pid로 정한다. 여러 서버가 같은 번호를 쓰면 서로의 메시지를 버리므로 겹치지 않아야 한다.
+int relay_prepare(int port, uint32_t node_id, relay_deliver_fn deliver) {
+    struct timespec ts;
+
+    if (relay.listen_fd >= 0) {    // 이어받은 소켓이 새 설정의 중계 포트가 아니면 닫고 새로 엶
+        struct sockaddr_in local;
+        socklen_t local_len = sizeof(local);
+        if (port == 0 || getsockname(relay.listen_fd, (struct sockaddr *)&local, &local_len) < 0 ||
+            ntohs(local.sin_port) != port) {
+            close(relay.listen_fd);
+            relay.listen_fd = -1;
+        }
+    }
+    if (port == 0 && peer_count == 0) return 0;
+    for (int i = 0; i < RELAY_MAX_LINKS; i++) links[i].fd = -1;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (node_id == 0) node_id = adopted_node;
+    relay.node = node_id ? node_id : (uint32_t)(now_us ^ (now_us >> 32) ^ ((uint64_t)getpid() << 16));
+    if (relay.node == 0) relay.node = 1;
+    relay.seq = now_us > adopted_seq ? now_us : adopted_seq;    // 같은 번호로 다시 시작해도 순번이 이전 실행보다 커서 새 메시지가 중복으로 걸러지지 않음
+    relay.deliver = deliver;
+
+    relay.epfd = epoll_create1(EPOLL_CLOEXEC);
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (relay.epfd < 0 || wake_fd < 0) {
+        log_msg(LOG_ERR, "중계 준비 실패: %m");
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = RELAY_WAKE_TAG;
+    epoll_ctl(relay.epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    if (port > 0 && relay.listen_fd < 0) {
+        struct sockaddr_in addr;
+        int reuse = 1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        relay.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (relay.listen_fd < 0 ||
+            setsockopt(relay.listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+            bind(relay.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(relay.listen_fd, 16) < 0) {
+            log_msg(LOG_ERR, "중계 포트 %d 열기 실패: %m", port);
+            return -1;
+        }
+    }
+    if (relay.listen_fd >= 0) {
+        ev.data.u32 = RELAY_LISTEN_TAG;
+        epoll_ctl(relay.epfd, EPOLL_CTL_ADD, relay.listen_fd, &ev);
+    }
+
+    prepared_wake = wake_fd;
+    relay_port = port;
+    return 0;
+}
+
+// relay_prepare로 준비한 중계 스레드를 시작 (중계하지 않으면 아무것도 하지 않음)
+int relay_run(void) {
+    pthread_t thread;
+    if (prepared_wake < 0) return 0;
+
+    // 메인 루프가 signalfd로 받는 SIGCHLD를 이 스레드가 가로채지 않도록 모든 시그널을 막은 채로 만듦
+    relay.wake_fd = prepared_wake;
+    prepared_wake = -1;
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&thread, NULL, relay_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        log_msg(LOG_ERR, "중계 스레드 생성 실패");
+        relay.wake_fd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    log_msg(LOG_NOTICE, "서버 간 중계를 시작합니다. 서버 번호 %u, 중계 포트 %d, 이웃 서버 %d개", relay.node, relay_port, peer_count);
+    return 0;
+}
+
+// 중계 시작 (데몬화한 뒤 부모 프로세스에서 호출)
+int relay_start(int port, uint32_t node_id, relay_deliver_fn deliver) {
+    return (relay_prepare(port, node_id, deliver) < 0) ? -1 : relay_run();
+}
+
+// 무중단 재시작: 새 프로세스에 넘길 중계 서버 소켓(없으면 -1), 서버 번호, 마지막 순번
+void relay_handoff_state(int *listen_fd, uint32_t *node_id, uint64_t *seq) {
+    pthread_mutex_lock(&relay.lock);
+    *listen_fd = relay.listen_fd;
+    *node_id = relay.node;
+    *seq = relay.seq;
+    pthread_mutex_unlock(&relay.lock);
+}
+
+// 무중단 재시작: 이전 프로세스의 중계 서버 소켓과 번호, 순번을 이어받음 (relay_start 전에 호출)
+// 이웃 서버와의 연결은 넘겨받지 않으며, 이웃 서버가 끊긴 연결을 다시 맺는다.
+void relay_adopt(int listen_fd, uint32_t node_id, uint64_t seq) {
+    relay.listen_fd = listen_fd;
+    adopted_node = node_id;
+    adopted_seq = seq;
+}
+
+// 이 서버의 방에 올라온 채팅 메시지를 다른 서버로 보내도록 대기열에 붙임 (중계하지 않으면 아무것도 하지 않음)
+// 서버 스레드는 붙이기만 하고, 중계 스레드가 깨어나면 그동안 쌓인 메시지를 프레임 하나로 묶어 보낸다.
+void relay_publish(const char *room, const char *id, const char *text, size_t len) {
+    if (relay.wake_fd < 0) return;
+    size_t room_len = strnlen(room, MAX_ROOM_NAME - 1), id_len = strnlen(id, MAX_ID_LEN - 1);
+    if (len > FRAME_MAX_TEXT) len = FRAME_MAX_TEXT;
+
+    pthread_mutex_lock(&relay.lock);
+    int wake = (relay.pending.len == 0);    // 비어 있던 대기열에 처음 붙인 경우에만 깨움
+    char *p = relay_buf_reserve(&relay.pending, RELAY_REC_HEADER + room_len + id_len + len, RELAY_OUT_MAX);
+    if (p != NULL) relay_encode(p, relay.node, ++relay.seq, room, room_len, id, id_len, text, len);
+    pthread_mutex_unlock(&relay.lock);
+
+    if (p == NULL) return;    // 중계 스레드가 밀림: 다른 서버로는 보내지 않음
+    metric_add(MC_RELAY_OUT, 1);
+    metric_add(MC_BYTES_COPIED, id_len + len);
+    if (wake) {
+        uint64_t one = 1;
+        write(relay.wake_fd, &one, sizeof(one));
+    }
+}
+
+// fork()한 자식 프로세스에서 물려받은 중계 디스크립터를 닫음 (부모가 끊은 연결이 자식 때문에 남지 않도록)
+void relay_close_fds(void) {
+    if (relay.wake_fd < 0) return;
+    for (int i = 0; i < RELAY_MAX_LINKS; i++) {
+        if (links[i].fd >= 0) close(links[i].fd);
+    }
+    if (relay.listen_fd >= 0) close(relay.listen_fd);
+    close(relay.epfd);
+    close(relay.wake_fd);
+    relay.wake_fd = -1;
+}
@@ -0,0 +1,27 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RELAY_MAX_PEERS 16              // -J로 지정할 수 있는 최대 이웃 서버 수
+#define RELAY_MAX_LINKS 64              // 동시에 유지하는 최대 중계 연결 수 (나가는 연결과 들어온 연결 합계)
+#define RELAY_MAX_NODES 256             // 중복을 걸러내기 위해 기억하는 최대 원본 서버 수
+#define RELAY_WINDOW 64                 // 원본 서버마다 기억하는 최근 순번 수 (순서가 바뀌어 도착해도 이 범위 안이면 받음)
+#define RELAY_BATCH_MAX (60 * 1024)     // 중계 프레임 하나에 묶는 최대 레코드 바이트 (FRAME_MAX_PAYLOAD 이하)
+#define RELAY_OUT_MAX (16 * 1024 * 1024)    // 중계 연결마다 보내지 못하고 쌓아 둘 수 있는 최대 바이트 (넘으면 끊고 다시 연결)
+#define RELAY_RETRY_MS 1000             // 끊긴 이웃 서버에 다시 연결을 시도하는 간격
+
+// 다른 서버에서 중계되어 온 채팅 메시지를 이 서버의 같은 이름의 방에 전달하는 함수 (중계 스레드에서 호출)
+typedef void (*relay_deliver_fn)(const char *room, const char *id, const char *text, size_t len);
+
+int relay_add_peer(const char *addr);
+int relay_prepare(int port, uint32_t node_id, relay_deliver_fn deliver);
+int relay_run(void);
+int relay_start(int port, uint32_t node_id, relay_deliver_fn deliver);
+void relay_publish(const char *room, const char *id, const char *text, size_t len);
+void relay_close_fds(void);
+void relay_handoff_state(int *listen_fd, uint32_t *node_id, uint64_t *seq);
+void relay_adopt(int listen_fd, uint32_t node_id, uint64_t seq);
+
+#endif
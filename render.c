@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "render.h"
+
+#define STYLE_RESET "\x1b[0m"
+#define STYLE_MAX 32        // 줄 앞에 붙는 색상 코드의 최대 길이
+
+// 터미널 크기 (터미널이 아니면 80x24)
+void screen_size(int *rows, int *cols) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        *rows = ws.ws_row;
+        *cols = ws.ws_col;
+    } else {
+        *rows = 24;
+        *cols = 80;
+    }
+}
+
+// UTF-8 문자 하나를 해독 (잘못된 바이트열이면 0을 반환)
+static size_t utf8_decode(const unsigned char *p, size_t len, unsigned int *cp) {
+    size_t n;
+    if (p[0] < 0x80) { *cp = p[0]; return 1; }
+    else if ((p[0] & 0xE0) == 0xC0) { *cp = p[0] & 0x1F; n = 2; }
+    else if ((p[0] & 0xF0) == 0xE0) { *cp = p[0] & 0x0F; n = 3; }
+    else if ((p[0] & 0xF8) == 0xF0) { *cp = p[0] & 0x07; n = 4; }
+    else return 0;
+    if (n > len) return 0;
+    for (size_t i = 1; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+        *cp = (*cp << 6) | (p[i] & 0x3F);
+    }
+    return n;
+}
+
+// 문자 하나가 터미널에서 차지하는 칸 수 (한글, 한자, 전각 문자, 이모지는 2칸)
+static int char_width(unsigned int cp) {
+    if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF) ||
+        (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) ||
+        (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60) ||
+        (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1FAFF) ||
+        (cp >= 0x20000 && cp <= 0x3FFFD)) {
+        return 2;
+    }
+    return 1;
+}
+
+// text가 터미널에서 차지하는 칸 수
+size_t screen_width(const char *text, size_t len) {
+    size_t width = 0;
+    for (size_t i = 0; i < len; ) {
+        unsigned int cp;
+        size_t n = utf8_decode((const unsigned char *)text + i, len - i, &cp);
+        width += n ? char_width(cp) : 1;
+        i += n ? n : 1;
+    }
+    return width;
+}
+
+// text를 폭 max_width 안에 들어가는 만큼 out에 복사 (제어 문자와 잘못된 바이트는 '?'로 바꿈)
+static size_t fit_text(char *out, const char *text, size_t len, size_t max_width) {
+    size_t used = 0, width = 0;
+    for (size_t i = 0; i < len; ) {
+        unsigned int cp;
+        size_t n = utf8_decode((const unsigned char *)text + i, len - i, &cp);
+        int w = (n && cp >= 0x20 && cp != 0x7F) ? char_width(cp) : 1;
+        if (width + w > max_width) break;
+        if (n && cp >= 0x20 && cp != 0x7F) {
+            memcpy(out + used, text + i, n);
+            used += n;
+        } else {
+            out[used++] = '?';  // 메시지에 들어 있는 이스케이프 코드가 화면을 흐트러뜨리지 않도록 함
+        }
+        width += w;
+        i += n ? n : 1;
+    }
+    return used;
+}
+
+// 줄 버퍼를 터미널 크기에 맞게 다시 할당
+static int screen_alloc(struct Screen *s) {
+    free(s->prev);
+    free(s->next);
+    free(s->prev_len);
+    free(s->next_len);
+    free(s->out);
+
+    s->line_cap = (size_t)s->cols * 4 + STYLE_MAX + sizeof(STYLE_RESET);   // UTF-8 문자는 최대 4바이트
+    s->prev = malloc(s->rows * s->line_cap);
+    s->next = malloc(s->rows * s->line_cap);
+    s->prev_len = calloc(s->rows, sizeof(size_t));
+    s->next_len = calloc(s->rows, sizeof(size_t));
+    s->out_cap = s->rows * (s->line_cap + 16) + 64;    // 줄마다 커서 이동과 줄 끝 지우기 코드
+    s->out = malloc(s->out_cap);
+    if (!s->prev || !s->next || !s->prev_len || !s->next_len || !s->out) return -1;
+    s->full = 1;
+    return 0;
+}
+
+// 현재 터미널 크기로 화면 초기화
+int screen_init(struct Screen *s) {
+    memset(s, 0, sizeof(*s));
+    screen_size(&s->rows, &s->cols);
+    return screen_alloc(s);
+}
+
+// 터미널 크기가 바뀌었으면 줄 버퍼를 다시 만들고 다음 프레임에서 전체를 다시 그림
+int screen_resize(struct Screen *s) {
+    int rows, cols;
+    screen_size(&rows, &cols);
+    if (rows == s->rows && cols == s->cols) {
+        s->full = 1;
+        return 0;
+    }
+    s->rows = rows;
+    s->cols = cols;
+    return screen_alloc(s);
+}
+
+// 새 프레임 시작 (모든 줄을 빈 줄로)
+void screen_begin(struct Screen *s) {
+    memset(s->next_len, 0, s->rows * sizeof(size_t));
+    s->cursor_row = s->rows - 1;
+    s->cursor_col = 0;
+}
+
+// row번째 줄을 style 색상으로 설정 (화면 폭을 넘는 부분은 잘림)
+void screen_set(struct Screen *s, int row, const char *style, const char *text, size_t len, int align) {
+    if (row < 0 || row >= s->rows) return;
+    char *line = s->next + row * s->line_cap;
+    size_t used = 0;
+
+    size_t style_len = style ? strlen(style) : 0;
+    if (style_len > STYLE_MAX) style_len = STYLE_MAX;
+    memcpy(line, style, style_len);
+    used += style_len;
+
+    if (align == ALIGN_CENTER) {
+        size_t width = screen_width(text, len);
+        size_t padding = width < (size_t)s->cols ? (s->cols - width) / 2 : 0;  // 텍스트를 가운데 정렬하기 위한 공백 계산
+        memset(line + used, ' ', padding);
+        used += padding;
+        used += fit_text(line + used, text, len, s->cols - padding);
+    } else {
+        used += fit_text(line + used, text, len, s->cols);
+    }
+
+    if (style_len > 0) {
+        memcpy(line + used, STYLE_RESET, sizeof(STYLE_RESET) - 1);
+        used += sizeof(STYLE_RESET) - 1;
+    }
+    s->next_len[row] = used;
+}
+
+// row번째 줄을 문자 c로 가득 채움 (구분선)
+void screen_fill(struct Screen *s, int row, const char *style, char c) {
+    char buf[s->cols];
+    memset(buf, c, s->cols);
+    screen_set(s, row, style, buf, s->cols, ALIGN_LEFT);
+}
+
+// 프레임을 그린 뒤 커서를 둘 위치
+void screen_cursor(struct Screen *s, int row, int col) {
+    s->cursor_row = row < s->rows ? row : s->rows - 1;
+    s->cursor_col = col < s->cols ? col : s->cols - 1;
+}
+
+// 이번 프레임에서 바뀐 줄만 출력 (keep_cursor가 1이면 사용자가 입력 중인 커서 위치를 그대로 둠)
+int screen_flush(struct Screen *s, int keep_cursor) {
+    size_t used = 0;
+    int changed = 0;
+
+    if (s->full) {
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b[2J");
+        keep_cursor = 0;
+    } else if (keep_cursor) {
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b" "7");     // 커서 위치 저장
+    }
+
+    for (int row = 0; row < s->rows; row++) {
+        char *next = s->next + row * s->line_cap;
+        char *prev = s->prev + row * s->line_cap;
+        size_t len = s->next_len[row];
+        if (!s->full && len == s->prev_len[row] && memcmp(next, prev, len) == 0) continue;
+
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b[%d;1H", row + 1);
+        memcpy(s->out + used, next, len);
+        used += len;
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b[K");      // 줄의 나머지를 지움
+        memcpy(prev, next, len);
+        s->prev_len[row] = len;
+        changed = 1;
+    }
+
+    if (keep_cursor) {
+        if (!changed) return 0;
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b" "8");     // 커서 위치 복원
+    } else {
+        used += snprintf(s->out + used, s->out_cap - used, "\x1b[%d;%dH", s->cursor_row + 1, s->cursor_col + 1);
+    }
+    s->full = 0;
+
+    for (size_t off = 0; off < used; ) {
+        ssize_t n = write(STDOUT_FILENO, s->out + off, used - off);
+        if (n < 0) return -1;
+        off += n;
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+
+#define RENDER_FRAME_MS 16  // 화면을 다시 그리는 최소 간격 (초당 최대 60번)
+
+// 줄 단위로 바뀐 부분만 다시 그리는 터미널 화면
+// 한 프레임의 줄을 next에 모두 만든 뒤 screen_flush()가 지난번에 그린 prev와 다른 줄만
+// 커서 이동 코드와 함께 출력 버퍼 하나에 모아 write() 한 번으로 보낸다.
+struct Screen {
+    int rows, cols;         // 터미널 크기
+    size_t line_cap;        // 줄 하나에 들어가는 최대 바이트 수 (색상 코드 포함)
+    char *prev;             // 지난번에 그린 줄 (rows * line_cap)
+    char *next;             // 이번 프레임의 줄
+    size_t *prev_len, *next_len;
+    char *out;              // 출력 버퍼
+    size_t out_cap;
+    int cursor_row, cursor_col;     // 프레임을 그린 뒤 커서를 둘 위치
+    int full;               // 1이면 화면을 지우고 모든 줄을 다시 그림 (처음, 크기 변경, 화면이 흐트러졌을 때)
+};
+
+enum ScreenAlign {
+    ALIGN_LEFT,
+    ALIGN_CENTER
+};
+
+void screen_size(int *rows, int *cols);
+size_t screen_width(const char *text, size_t len);
+int screen_init(struct Screen *s);
+int screen_resize(struct Screen *s);
+void screen_begin(struct Screen *s);
+void screen_set(struct Screen *s, int row, const char *style, const char *text, size_t len, int align);
+void screen_fill(struct Screen *s, int row, const char *style, char c);
+void screen_cursor(struct Screen *s, int row, int col);
+int screen_flush(struct Screen *s, int keep_cursor);
+
+// 다음 프레임에서 화면 전체를 다시 그리도록 함
+static inline void screen_invalidate(struct Screen *s) {
+    s->full = 1;
+}
+
+#endif
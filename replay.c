@@ -0,0 +1,64 @@
+#include <stdlib.h>
+
+#include "replay.h"
+#include "room.h"
+
+static struct ReplayRing rings[MAX_ROOMS];
+static size_t replay_max_count;     // 방마다 보관할 메시지 수 (0이면 보관하지 않음)
+static size_t replay_max_bytes;     // 방마다 보관할 최대 바이트 수
+
+// 보관 한도 설정 (스레드를 만들기 전에 한 번 호출)
+void replay_init(size_t max_count, size_t max_bytes) {
+    replay_max_count = max_count < REPLAY_MAX_COUNT ? max_count : REPLAY_MAX_COUNT;
+    replay_max_bytes = max_bytes;
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        pthread_mutex_init(&rings[i].lock, NULL);
+    }
+}
+
+// 방의 최근 메시지로 프레임을 추가 (참조 하나를 가져감)
+void replay_push(uint32_t room, struct SharedBuf *frame) {
+    struct ReplayRing *r = &rings[room];
+    struct SharedBuf *evicted[REPLAY_MAX_COUNT];
+    size_t nevicted = 0;
+
+    if (replay_max_count == 0 || frame->len > replay_max_bytes) {
+        sbuf_unref(frame);
+        return;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    if (r->bufs == NULL && (r->bufs = calloc(REPLAY_MAX_COUNT, sizeof(struct SharedBuf *))) == NULL) {
+        pthread_mutex_unlock(&r->lock);
+        sbuf_unref(frame);
+        return;
+    }
+    while (r->count > 0 && (r->count == replay_max_count || r->bytes + frame->len > replay_max_bytes)) {
+        struct SharedBuf *old = r->bufs[r->head];
+        r->head = (r->head + 1) & (REPLAY_MAX_COUNT - 1);
+        r->count--;
+        r->bytes -= old->len;
+        evicted[nevicted++] = old;
+    }
+    r->bufs[(r->head + r->count) & (REPLAY_MAX_COUNT - 1)] = frame;
+    r->count++;
+    r->bytes += frame->len;
+    pthread_mutex_unlock(&r->lock);
+
+    for (size_t i = 0; i < nevicted; i++) {    // 해제는 잠금 밖에서
+        sbuf_unref(evicted[i]);
+    }
+}
+
+// 방의 최근 메시지를 오래된 것부터 최대 max개 out에 담음 (각각 참조를 하나씩 올려 주며, 담은 수 반환)
+size_t replay_collect(uint32_t room, struct SharedBuf **out, size_t max) {
+    struct ReplayRing *r = &rings[room];
+
+    pthread_mutex_lock(&r->lock);
+    size_t n = r->count < max ? r->count : max;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = sbuf_ref(r->bufs[(r->head + r->count - n + i) & (REPLAY_MAX_COUNT - 1)]);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
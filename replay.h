@@ -0,0 +1,26 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "buffer.h"
+
+#define REPLAY_MAX_COUNT 1024   // 방마다 보관할 수 있는 최대 메시지 수 (2의 거듭제곱)
+
+// 방마다 최근 브로드캐스트 프레임을 보관하는 원형 배열 (실시간 전송에 쓴 SharedBuf를 참조만 함)
+// 메시지 수와 전체 바이트 수가 모두 상한 안에 들도록 오래된 메시지부터 버린다.
+struct ReplayRing {
+    pthread_mutex_t lock;   // 여러 샤드가 같은 방에 추가/조회하므로 방마다 잠금
+    struct SharedBuf **bufs;    // 프레임 참조 (REPLAY_MAX_COUNT칸, 처음 추가할 때 할당)
+    unsigned head;          // 가장 오래된 메시지 위치
+    unsigned count;         // 보관 중인 메시지 수
+    size_t bytes;           // 보관 중인 전체 바이트 수
+};
+
+void replay_init(size_t max_count, size_t max_bytes);
+void replay_push(uint32_t room, struct SharedBuf *frame);
+size_t replay_collect(uint32_t room, struct SharedBuf **out, size_t max);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "room.h"
+
+#define ROOM_HASH_SIZE (MAX_ROOMS * 2)  // 이름 -> 방 번호 해시 테이블 칸 수 (2의 거듭제곱)
+
+// 모든 샤드가 함께 쓰는 채팅방 목록
+// 방 번호는 만들어진 순서대로 붙고 삭제하지 않으므로, 번호와 이름은 한 번 정해지면 바뀌지 않는다.
+// 방을 찾거나 만드는 것은 join 때만 일어나므로 뮤텍스로 보호하고,
+// 브로드캐스트와 /list에서 읽는 멤버 수는 원자적 변수로 잠금 없이 읽는다.
+static struct {
+    pthread_mutex_t lock;
+    char names[MAX_ROOMS][MAX_ROOM_NAME];
+    atomic_int members[MAX_ROOMS];      // 모든 샤드를 합친 방의 멤버 수
+    atomic_uint count;                  // 만든 방 수
+    uint32_t hash[ROOM_HASH_SIZE];      // 이름 해시 -> 방 번호 + 1 (0이면 빈 칸)
+} registry = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .names = { LOBBY_NAME },
+    .count = 1,
+};
+
+static uint32_t name_hash(const char *name) {
+    uint32_t h = 2166136261u;    // FNV-1a
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+// 이름으로 방 번호를 찾음 (create가 참이면 없을 때 새로 만듦, 실패 시 -1)
+int room_registry_find(const char *name, int create) {
+    if (strcmp(name, LOBBY_NAME) == 0) return LOBBY_ROOM;
+
+    pthread_mutex_lock(&registry.lock);
+    uint32_t pos = name_hash(name) & (ROOM_HASH_SIZE - 1);
+    while (registry.hash[pos] != 0) {
+        uint32_t room = registry.hash[pos] - 1;
+        if (strcmp(registry.names[room], name) == 0) {
+            pthread_mutex_unlock(&registry.lock);
+            return (int)room;
+        }
+        pos = (pos + 1) & (ROOM_HASH_SIZE - 1);
+    }
+
+    uint32_t room = atomic_load_explicit(&registry.count, memory_order_relaxed);
+    if (!create || room >= MAX_ROOMS) {
+        pthread_mutex_unlock(&registry.lock);
+        return -1;
+    }
+    memcpy(registry.names[room], name, strnlen(name, MAX_ROOM_NAME - 1));
+    registry.hash[pos] = room + 1;
+    atomic_store_explicit(&registry.count, room + 1, memory_order_release);    // 이름을 쓴 뒤에 공개
+    pthread_mutex_unlock(&registry.lock);
+    return (int)room;
+}
+
+const char *room_registry_name(uint32_t room) {
+    return registry.names[room];
+}
+
+// 모든 샤드를 합친 방의 멤버 수
+int room_registry_members(uint32_t room) {
+    return atomic_load_explicit(&registry.members[room], memory_order_relaxed);
+}
+
+// 지금까지 만든 방 수 (방 번호는 0부터 이 값 - 1까지)
+uint32_t room_registry_count(void) {
+    return atomic_load_explicit(&registry.count, memory_order_acquire);
+}
+
+void room_index_init(struct RoomIndex *idx, size_t link_offset) {
+    memset(idx->rooms, 0, sizeof(idx->rooms));
+    idx->link_offset = link_offset;
+}
+
+// 방에 들어감 (이미 다른 방에 있으면 먼저 나옴, 실패 시 -1)
+int room_join(struct RoomIndex *idx, void *obj, uint32_t room) {
+    struct RoomLink *link = room_link(idx, obj);
+    if (link->room == room) return 0;
+
+    struct RoomMembers *m = &idx->rooms[room];
+    if (m->count == m->cap) {    // 멤버 배열이 가득 차면 두 배로 늘림
+        uint32_t cap = m->cap ? m->cap * 2 : 16;
+        void **members = realloc(m->members, cap * sizeof(void *));
+        if (members == NULL) return -1;
+        m->members = members;
+        m->cap = cap;
+    }
+
+    room_leave(idx, obj);
+    link->room = room;
+    link->index = m->count;
+    m->members[m->count++] = obj;
+    atomic_fetch_add_explicit(&registry.members[room], 1, memory_order_relaxed);
+    return 0;
+}
+
+// 방에서 나옴 (멤버 배열의 마지막 멤버를 빈 자리로 옮김)
+void room_leave(struct RoomIndex *idx, void *obj) {
+    struct RoomLink *link = room_link(idx, obj);
+    if (link->room == ROOM_NONE) return;
+
+    struct RoomMembers *m = &idx->rooms[link->room];
+    void *last = m->members[--m->count];
+    m->members[link->index] = last;
+    room_link(idx, last)->index = link->index;
+    atomic_fetch_sub_explicit(&registry.members[link->room], 1, memory_order_relaxed);
+    link->room = ROOM_NONE;
+}
@@ -0,0 +1,54 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_ROOMS 1024          // 만들 수 있는 최대 채팅방 수 (방 번호는 재사용하지 않음)
+#define MAX_ROOM_NAME 32        // 채팅방 이름 최대 길이 (null 종료 문자 포함)
+#define LOBBY_ROOM 0            // 로그인하면 처음 들어가는 기본 채팅방
+#define LOBBY_NAME "lobby"
+#define ROOM_NONE UINT32_MAX    // 아직 어느 방에도 들어가지 않음 (로그인 전)
+
+// 연결 구조체마다 하나씩 두는 방 소속 정보
+// index는 방의 멤버 배열에서의 위치로, 방을 나갈 때 O(1)로 자리를 비우는 데 쓴다.
+struct RoomLink {
+    uint32_t room;          // 들어가 있는 방 번호 (ROOM_NONE이면 없음)
+    uint32_t index;         // 멤버 배열에서의 위치
+};
+
+// 방 하나의 멤버 배열 (빈틈없이 모여 있어 브로드캐스트할 때 순서대로 훑을 수 있음)
+struct RoomMembers {
+    void **members;         // 멤버 연결 구조체
+    uint32_t count;         // 멤버 수
+    uint32_t cap;           // 배열 크기
+};
+
+// 방 번호 -> 멤버 배열 색인 (reactor 샤드 또는 fork 모드의 부모 프로세스마다 하나씩)
+// 연결 구조체 안의 struct RoomLink 위치(link_offset)를 알고 있어
+// 배열 끝의 멤버를 빈 자리로 옮길 때 그 멤버의 index도 함께 고친다.
+struct RoomIndex {
+    struct RoomMembers rooms[MAX_ROOMS];
+    size_t link_offset;     // 연결 구조체 안의 struct RoomLink 위치
+};
+
+int room_registry_find(const char *name, int create);
+const char *room_registry_name(uint32_t room);
+int room_registry_members(uint32_t room);
+uint32_t room_registry_count(void);
+
+void room_index_init(struct RoomIndex *idx, size_t link_offset);
+int room_join(struct RoomIndex *idx, void *obj, uint32_t room);
+void room_leave(struct RoomIndex *idx, void *obj);
+
+// 연결 구조체의 방 소속 정보
+static inline struct RoomLink *room_link(const struct RoomIndex *idx, void *obj) {
+    return (struct RoomLink *)((char *)obj + idx->link_offset);
+}
+
+// 방의 멤버 배열
+static inline struct RoomMembers *room_members(struct RoomIndex *idx, uint32_t room) {
+    return &idx->rooms[room];
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "search.h"
+
+#define SEARCH_BUCKETS (1u << SEARCH_BUCKET_BITS)
+#define POSTING_INITIAL 16      // 목록 처음 크기
+
+// ASCII 대문자를 소문자로 (UTF-8 멀티바이트 문자는 그대로)
+static inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t trigram_hash(const unsigned char *p) {
+    uint32_t key = (uint32_t)fold(p[0]) << 16 | (uint32_t)fold(p[1]) << 8 | fold(p[2]);
+    return (key * 2654435761u) >> (32 - SEARCH_BUCKET_BITS);
+}
+
+int search_index_init(struct SearchIndex *idx) {
+    idx->buckets = calloc(SEARCH_BUCKETS, sizeof(struct Posting));
+    return idx->buckets ? 0 : -1;
+}
+
+// 목록 끝에 메시지 번호 추가 (가득 차면 기록에서 버린 메시지를 먼저 지우고, 그래도 모자라면 두 배로 늘림)
+static int posting_push(struct Posting *p, size_t first, uint32_t n) {
+    if (p->len == p->cap) {
+        while (p->start < p->len && p->ids[p->start] < first) p->start++;
+        if (p->start > 0) {
+            memmove(p->ids, p->ids + p->start, (p->len - p->start) * sizeof(uint32_t));
+            p->len -= p->start;
+            p->start = 0;
+        }
+    }
+    if (p->len == p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : POSTING_INITIAL;
+        uint32_t *ids = realloc(p->ids, cap * sizeof(uint32_t));
+        if (ids == NULL) return -1;
+        p->ids = ids;
+        p->cap = cap;
+    }
+    p->ids[p->len++] = n;
+    return 0;
+}
+
+// 기록에 방금 추가한 n번 메시지를 색인에 추가 (메시지 길이에 비례, 기록 크기와 무관)
+int search_index_add(struct SearchIndex *idx, const struct History *h, size_t n, const char *text, size_t len) {
+    const unsigned char *p = (const unsigned char *)text;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct Posting *post = &idx->buckets[trigram_hash(p + i)];
+        if (post->len > post->start && post->ids[post->len - 1] == (uint32_t)n) continue;  // 같은 메시지에 같은 트라이그램이 또 있음
+        if (posting_push(post, h->first, (uint32_t)n) < 0) return -1;
+    }
+    return 0;
+}
+
+// 목록에서 n 이상인 첫 위치 (from부터 이진 탐색)
+static uint32_t posting_lower_bound(const struct Posting *p, uint32_t from, size_t n) {
+    uint32_t lo = from, hi = p->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int match_at(const unsigned char *hay, const unsigned char *needle, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (fold(hay[i]) != needle[i]) return 0;
+    }
+    return 1;
+}
+
+#ifdef __SSE2__
+// 16바이트를 한 번에 ASCII 소문자로 ('A'~'Z' 범위인 바이트에만 0x20을 더함)
+static inline __m128i fold16(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+// hay에 소문자로 바꾼 needle이 들어 있는지 확인
+// SSE2로 16개 위치에서 needle의 첫 바이트와 마지막 바이트를 한꺼번에 비교하고, 둘 다 맞는 위치만 전체를 비교한다.
+// 올바른 UTF-8에서는 글자 첫 바이트와 이어지는 바이트가 겹치지 않으므로 바이트 비교로도 글자 중간에서 맞는 일이 없다.
+static int contains_folded(const char *text, size_t len, const unsigned char *needle, size_t nlen) {
+    const unsigned char *hay = (const unsigned char *)text;
+    size_t i = 0;
+    if (nlen == 0) return 1;
+    if (nlen > len) return 0;
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+    for (; i + nlen - 1 + 16 <= len; i += 16) {
+        __m128i block_first = fold16(_mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i block_last = fold16(_mm_loadu_si128((const __m128i *)(hay + i + nlen - 1)));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                        _mm_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            if (match_at(hay + i + __builtin_ctz(mask), needle, nlen)) return 1;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i + nlen <= len; i++) {
+        if (fold(hay[i]) == needle[0] && match_at(hay + i, needle, nlen)) return 1;
+    }
+    return 0;
+}
+
+// 후보 메시지가 실제로 조건에 맞는지 확인
+static int confirm(const struct History *h, size_t n, const struct SearchQuery *q, const unsigned char *needle) {
+    struct HistoryMsg m;
+    if (history_get(h, n, &m) < 0) return 0;
+    if (q->sender_len > 0 && (m.id_len != q->sender_len || memcmp(m.id, q->sender, m.id_len) != 0)) return 0;
+    return contains_folded(m.text, m.len, needle, q->len);
+}
+
+// 조건에 맞는 메시지를 찾아 오래된 순서로 fn을 호출하고 찾은 개수를 반환
+// 시각 조건은 기록에서 이진 탐색으로 범위를 좁히고, 검색어가 3바이트 이상이면 검색어의 트라이그램
+// 목록을 교집합해 후보만 확인한다. 검색어가 짧으면 범위 안의 메시지를 모두 확인한다.
+size_t search_run(const struct SearchIndex *idx, const struct History *h, const struct SearchQuery *q,
+                  search_hit_fn fn, void *arg) {
+    size_t lo = q->after ? history_find_time(h, q->after) : h->first;
+    size_t hi = q->before ? history_find_time(h, q->before) : history_end(h);
+    size_t found = 0;
+
+    unsigned char *needle = malloc(q->len + 1);
+    if (needle == NULL) return 0;
+    for (size_t i = 0; i < q->len; i++) needle[i] = fold(q->keyword[i]);
+
+    if (q->len < 3) {
+        for (size_t n = lo; n < hi; n++) {
+            if (confirm(h, n, q, needle)) {
+                fn(n, arg);
+                found++;
+            }
+        }
+        free(needle);
+        return found;
+    }
+
+    // 검색어의 트라이그램 목록을 모으고 가장 짧은 목록을 기준으로 삼음
+    const struct Posting *lists[SEARCH_MAX_TRIGRAMS];
+    uint32_t cursor[SEARCH_MAX_TRIGRAMS];
+    size_t nlists = 0, shortest = 0;
+    for (size_t i = 0; i + 3 <= q->len && nlists < SEARCH_MAX_TRIGRAMS; i++) {
+        const struct Posting *p = &idx->buckets[trigram_hash(needle + i)];
+        int dup = 0;
+        for (size_t k = 0; k < nlists; k++) dup |= (lists[k] == p);
+        if (dup) continue;
+        cursor[nlists] = posting_lower_bound(p, p->start, lo);
+        lists[nlists] = p;
+        if (p->len - cursor[nlists] < lists[shortest]->len - cursor[shortest]) shortest = nlists;
+        nlists++;
+    }
+
+    const struct Posting *base = lists[shortest];
+    for (uint32_t i = cursor[shortest]; i < base->len && base->ids[i] < hi; i++) {
+        uint32_t n = base->ids[i];
+        int all = 1;
+        for (size_t k = 0; k < nlists && all; k++) {
+            if (k == shortest) continue;
+            cursor[k] = posting_lower_bound(lists[k], cursor[k], n);
+            all = cursor[k] < lists[k]->len && lists[k]->ids[cursor[k]] == n;
+        }
+        if (all && confirm(h, n, q, needle)) {
+            fn(n, arg);
+            found++;
+        }
+    }
+    free(needle);
+    return found;
+}
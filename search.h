@@ -0,0 +1,45 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "history.h"
+
+#define SEARCH_BUCKET_BITS 16   // 트라이그램 해시 버킷 수 (2의 거듭제곱)
+#define SEARCH_MAX_TRIGRAMS 64  // 검색어에서 사용하는 최대 트라이그램 수
+
+// 트라이그램 하나(또는 해시가 같은 트라이그램들)가 들어 있는 메시지 번호 목록 (오름차순)
+struct Posting {
+    uint32_t *ids;          // 메시지 번호 (세션 동안 2^32개를 넘지 않는다고 가정)
+    uint32_t start;         // 기록에서 버린 메시지를 건너뛴 첫 위치
+    uint32_t len, cap;
+};
+
+// 채팅 기록의 트라이그램 역색인
+// 메시지 내용을 ASCII 대소문자를 무시하고 바이트 단위 트라이그램으로 나눠 메시지 번호를 기록한다.
+// UTF-8 한글 한 글자는 3바이트이므로 한 글자 검색어도 트라이그램 하나로 찾을 수 있다.
+// 해시가 충돌하거나 트라이그램이 모두 있어도 이어져 있지 않을 수 있으므로 후보는 본문에서 다시 확인한다.
+struct SearchIndex {
+    struct Posting *buckets;
+};
+
+// 검색 조건 (비어 있는 조건은 무시)
+struct SearchQuery {
+    const char *keyword;    // 내용에 포함된 문자열 (ASCII 대소문자 무시)
+    size_t len;
+    const char *sender;     // 보낸 사람 아이디 (정확히 일치)
+    size_t sender_len;
+    int64_t after;          // 이 시각 이후에 받은 메시지 (밀리초 단위 UNIX 시간, 0이면 제한 없음)
+    int64_t before;         // 이 시각 전에 받은 메시지 (0이면 제한 없음)
+};
+
+// 찾은 메시지마다 오래된 순서로 호출되는 콜백
+typedef void (*search_hit_fn)(size_t n, void *arg);
+
+int search_index_init(struct SearchIndex *idx);
+int search_index_add(struct SearchIndex *idx, const struct History *h, size_t n, const char *text, size_t len);
+size_t search_run(const struct SearchIndex *idx, const struct History *h, const struct SearchQuery *q,
+                  search_hit_fn fn, void *arg);
+
+#endif
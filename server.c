@@ -1,8 +1,10 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/wait.h>
 #include <fcntl.h>
@@ -10,68 +12,1065 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
 
-#define TCP_PORT 5100
-#define MAX_ID_LEN 20
-#define MAX_PW_LEN 20
-#define MAX_CLIENTS 10
+#include "server.h"
+#include "ipc.h"
+#include "log.h"
 
-struct LoginInfo {
-    char id[MAX_ID_LEN];
-    char password[MAX_PW_LEN];
+#define IPC_BATCH 64    // 부모 프로세스가 링 버퍼에서 한 번에 꺼내 처리하는 최대 레코드 수
+
+// fork 모드에서 부모 프로세스가 관리하는 클라이언트
+struct ForkClient {
+    struct ConnEntry hdr;   // 연결 테이블 공통 헤더
+    int sock;               // 클라이언트 소켓 (부모 프로세스가 브로드캐스트에 사용)
+    pid_t pid;              // 클라이언트를 맡은 자식 프로세스 ID (로그인 전이면 0)
+    int proto;              // 클라이언트 프로토콜 (로그인이 끝나면 자식 프로세스가 알려줌)
+    char id[MAX_ID_LEN];    // 로그인 아이디
+    struct FrameReader reader;  // 로그인이 끝날 때까지 부모 프로세스가 받는 수신 버퍼 (자식 프로세스가 그대로 물려받음)
+    struct RoomLink room;   // 들어가 있는 채팅방과 멤버 배열에서의 위치
+    struct OutQueue outq;   // 송신 대기열 (아직 보내지 못했거나 FLUSH_BATCH로 모아 둔 메시지)
+    int pending;            // pending_clients 목록에 들어가 있는지 여부
+    int watching;           // 보낼 데이터가 남아 client_epfd에서 EPOLLOUT을 기다리는지 여부
+    int closing;            // 느린 클라이언트라 끊는 중 (자식 프로세스가 종료될 때까지 더 보내지 않음)
+    unsigned long dropped;  // 대기열 상한 때문에 버린 메시지 수
+    struct SpoolSend *file; // 내려보내는 중인 파일 (부모 프로세스가 조각 단위로 전송)
 };
 
-struct Message {
-    char id[MAX_ID_LEN];
-    char content[BUFSIZ];
+struct ConnTable clients;  // 접속한 클라이언트 테이블
+struct HandleMap client_pids;  // 자식 프로세스 ID -> 클라이언트 핸들
+struct IdMap users;  // 로그인 아이디 -> 클라이언트 핸들 (중복 로그인 거부와 귓속말)
+struct RoomIndex rooms;  // 채팅방별 멤버 배열 (브로드캐스트에 사용)
+ConnHandle my_handle;  // 자식 프로세스가 맡은 클라이언트 핸들 (fork() 전에 정해짐)
+struct IpcRing *ipc_ring; // 자식 프로세스 -> 부모 프로세스 메시지 전달용 공유 메모리 링 버퍼
+ConnHandle *pending_clients;  // 쌓아 둔 메시지를 아직 보내지 않은 클라이언트 (FLUSH_BATCH)
+size_t pending_count, pending_cap;
+uint64_t pending_since;  // 목록이 비어 있다가 처음 채워진 시각 (metric_now_us())
+int client_epfd;  // 로그인 정보를 기다리는 연결과 보낼 데이터가 남은 연결의 epoll 인스턴스 (부모 프로세스)
+struct TimerWheel logins;  // 로그인 기한
+
+struct ServerConfig config = {
+    .max_clients = DEFAULT_MAX_CLIENTS,
+    .out_hwm = 1024 * 1024,     // 기본 송신 대기열 상한 1MB
+    .slow_policy = SLOW_CLOSE,
+    .replay_count = 50,         // 기본으로 최근 메시지 50개를
+    .replay_bytes = 256 * 1024, // 방마다 256KB까지 보관
+    .flush_policy = FLUSH_LATENCY,
+    .flush_window_ms = 0,
+    .io_backend = IO_EPOLL,
+    .login_timeout_ms = 10 * 1000,  // 접속 후 10초 안에 로그인해야 함
+    .rate_msgs = 0,             // 기본으로 전송 속도를 제한하지 않음
+    .rate_bytes = 0,
+    .rate_action = RATE_DELAY,
+    .port = TCP_PORT,
+    .relay_port = 0,            // 기본으로 다른 서버와 중계하지 않음
+    .node_id = 0,
+    .handoff_path = HANDOFF_SOCKET_PATH,
 };
 
-int client_sockets[MAX_CLIENTS];  // 다중 클라이언트 소켓 배열
-int client_count = 0;  // 현재 접속한 클라이언트 수
-pid_t client_pids[MAX_CLIENTS];  // 클라이언트 프로세스 ID 배열
-int pipe_fd[2]; // 파이프 디스크립터 정의
+// 수신 버퍼에서 레코드 하나를 꺼냄 (1: 있음, 0: 데이터 부족, -1: 프로토콜 오류)
+// 구 버전 클라이언트는 고정 크기 구조체를, 새 클라이언트는 프레임을 보낸다.
+int read_record(struct FrameReader *r, int *proto, int logged_in, struct Record *rec) {
+    if (*proto == PROTO_UNKNOWN) {
+        int first = frame_reader_peek(r);
+        if (first < 0) return 0;
+        *proto = (first == FRAME_MAGIC) ? PROTO_FRAME : PROTO_LEGACY;
+    }
 
-// 메시지를 모든 클라이언트에게 전송하는 함수 (인자로 받은 소켓을 제외하고 모든 클라이언트에게 메시지 전송)
-void sendtoall_message(struct Message *msg, int sender_sock) {
-    for (int i = 0; i < client_count; i++) {    // 모든 클라이언트에 대해 반복
-        if (client_sockets[i] != sender_sock) {     // 발신자를 제외한 모든 클라이언트에게 메시지 전송
-            send(client_sockets[i], msg, sizeof(struct Message), 0);   // 클라이언트 소켓으로 메시지 전송
+    if (*proto == PROTO_LEGACY) {
+        if (!logged_in) {
+            const struct LoginInfo *login = (const void *)frame_reader_take(r, sizeof(struct LoginInfo));
+            if (login == NULL) return 0;
+            rec->type = FRAME_LOGIN;
+            memcpy(rec->id, login->id, MAX_ID_LEN);
+            rec->id[MAX_ID_LEN - 1] = '\0';
+        } else {
+            const struct Message *msg = (const void *)frame_reader_take(r, sizeof(struct Message));
+            if (msg == NULL) return 0;
+            rec->type = FRAME_CHAT;
+            rec->text = msg->content;
+            rec->len = strnlen(msg->content, BUFSIZ);
         }
+        return 1;
+    }
+
+    struct Frame f;
+    int ret = frame_reader_next(r, &f);
+    if (ret <= 0) return ret;
+    if (!logged_in && f.type != FRAME_LOGIN) return -1;    // 첫 프레임은 반드시 로그인
+    rec->type = f.type;
+    rec->flags = f.flags;
+    if (f.type == FRAME_FILE_PUT) {    // id 자리에 파일 이름, payload는 자르지 않음
+        rec->name = f.id;
+        rec->name_len = f.id_len;
+        rec->text = f.payload;
+        rec->len = f.len;
+        return 1;
     }
+    if (f.id_len >= MAX_ID_LEN) return -1;
+    if (f.type == FRAME_LOGIN) {
+        memcpy(rec->id, f.id, f.id_len);
+        rec->id[f.id_len] = '\0';
+    }
+    rec->text = f.payload;
+    rec->len = f.len > FRAME_MAX_TEXT ? FRAME_MAX_TEXT : f.len;
+    return 1;
 }
 
-// 클라이언트 제거 함수
-void remove_client(int csock) {
-    for (int i = 0; i < client_count; i++) {    // 모든 클라이언트에 대해 반복
-        if (client_sockets[i] == csock) {    // 제거할 클라이언트 소켓을 찾았을 때
-            client_sockets[i] = client_sockets[client_count - 1];    // 마지막 클라이언트의 소켓을 현재 위치로 이동
-            client_pids[i] = client_pids[client_count - 1];    // 마지막 클라이언트의 프로세스 ID를 현재 위치로 이동
-            client_count--;    // 클라이언트 수 감소
-            printf("클라이언트 제거됨. 현재 접속자 수: %d\n", client_count);
-            break;
+// 로그인 결과를 프로토콜에 맞게 직렬화하여 out에 저장하고 길이를 반환
+size_t encode_login_reply(char *out, int proto) {
+    const char *reply = "로그인 성공";
+    if (proto == PROTO_LEGACY) {
+        strcpy(out, reply);
+        return strlen(reply) + 1;    // +1을 추가하여 null 종료 문자 포함
+    }
+    return frame_encode(out, FRAME_LOGIN_OK, NULL, 0, reply, strlen(reply));
+}
+
+// 로그인 거부 사유를 프로토콜에 맞게 직렬화하여 out에 저장하고 길이를 반환
+size_t encode_login_fail(char *out, int proto, const char *reason) {
+    if (proto == PROTO_LEGACY) {
+        strcpy(out, reason);
+        return strlen(reason) + 1;
+    }
+    return frame_encode(out, FRAME_LOGIN_FAIL, NULL, 0, reason, strlen(reason));
+}
+
+// 채팅 메시지를 프로토콜에 맞게 직렬화하여 out에 저장하고 길이를 반환
+// (out은 sizeof(struct Message) 이상이어야 함)
+size_t encode_chat(char *out, int proto, const char *id, const char *text, size_t len) {
+    if (proto == PROTO_LEGACY) {
+        // 구 버전 클라이언트는 고정 크기 구조체 전체를 받으므로 내용을 쓰지 않는 부분만 0으로 채움
+        struct Message *msg = (struct Message *)out;
+        size_t id_len = strnlen(id, MAX_ID_LEN - 1);
+        memcpy(msg->id, id, id_len);
+        memset(msg->id + id_len, 0, MAX_ID_LEN - id_len);
+        memcpy(msg->content, text, len);
+        memset(msg->content + len, 0, BUFSIZ - len);
+        metric_add(MC_BYTES_COPIED, id_len + len);
+        return sizeof(struct Message);
+    }
+    size_t id_len = strlen(id);
+    metric_add(MC_BYTES_COPIED, id_len + len);
+    return frame_encode(out, FRAME_CHAT, id, id_len, text, len);
+}
+
+// 채팅방 명령(/join 이름, /leave, /list)이면 처리하고 보낸 사람에게 돌려줄 안내 문구를 reply에 씀
+// reply는 BUFSIZ 이상이어야 한다. (1: 명령을 처리함, 0: 일반 채팅 메시지)
+int handle_room_command(struct RoomIndex *idx, void *obj, const char *text, size_t len, char *reply, size_t *reply_len) {
+    struct RoomLink *link = room_link(idx, obj);
+    int n;
+
+    if (len > 6 && memcmp(text, "/join ", 6) == 0) {    // 방에 들어감 (없으면 새로 만듦)
+        char name[MAX_ROOM_NAME];
+        size_t name_len = len - 6;
+        if (name_len >= MAX_ROOM_NAME || memchr(text + 6, ' ', name_len) != NULL) {
+            n = snprintf(reply, BUFSIZ, "방 이름은 공백 없이 %d자 이하로 입력하세요.", MAX_ROOM_NAME - 1);
+        } else {
+            memcpy(name, text + 6, name_len);
+            name[name_len] = '\0';
+            int room = room_registry_find(name, 1);
+            if (room < 0 || room_join(idx, obj, (uint32_t)room) < 0) {
+                n = snprintf(reply, BUFSIZ, "'%s' 방에 들어갈 수 없습니다.", name);
+            } else {
+                n = snprintf(reply, BUFSIZ, "'%s' 방에 들어왔습니다.", name);
+            }
+        }
+    } else if (len == 6 && memcmp(text, "/leave", 6) == 0) {    // 방을 나가 기본 방으로 돌아감
+        if (link->room == LOBBY_ROOM) {
+            n = snprintf(reply, BUFSIZ, "이미 기본 방(%s)에 있습니다.", LOBBY_NAME);
+        } else {
+            const char *name = room_registry_name(link->room);
+            room_join(idx, obj, LOBBY_ROOM);
+            n = snprintf(reply, BUFSIZ, "'%s' 방을 나왔습니다.", name);
+        }
+    } else if (len == 5 && memcmp(text, "/list", 5) == 0) {    // 사람이 있는 방 목록과 멤버 수
+        n = snprintf(reply, BUFSIZ, "현재 방: %s / 방 목록:", room_registry_name(link->room));
+        uint32_t rooms = room_registry_count();
+        for (uint32_t r = 0; r < rooms && n < BUFSIZ; r++) {
+            int members = room_registry_members(r);
+            if (members > 0) {
+                n += snprintf(reply + n, BUFSIZ - n, " %s(%d)", room_registry_name(r), members);
+            }
+        }
+    } else {
+        return 0;
+    }
+    *reply_len = (n < BUFSIZ) ? (size_t)n : BUFSIZ - 1;
+    return 1;
+}
+
+// 방의 최근 메시지를 송신 대기열에 추가 (추가한 메시지 수 반환)
+// 실시간 브로드캐스트에 쓴 프레임 버퍼를 그대로 참조하며, 구 버전 클라이언트에게만 struct Message로 변환한다.
+// 송신 대기열 상한을 넘는 부분은 보내지 않는다.
+size_t queue_replay(struct OutQueue *q, int proto, uint32_t room) {
+    struct SharedBuf *bufs[REPLAY_MAX_COUNT];
+    size_t n = replay_collect(room, bufs, config.replay_count), queued = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        struct SharedBuf *b = bufs[i];
+        if (proto == PROTO_LEGACY) {
+            b = make_legacy_chat(bufs[i]);
+            sbuf_unref(bufs[i]);
+        }
+        if (b == NULL || q->bytes + b->len > config.out_hwm || outq_push(q, b) < 0) {
+            sbuf_unref(b);
+            continue;
+        }
+        queued++;
+    }
+    return queued;
+}
+
+// /history [개수] 명령이면 보낼 메시지 수를, 아니면 -1을 반환
+int parse_history_command(const char *text, size_t len) {
+    if (len < 8 || memcmp(text, "/history", 8) != 0 || (len > 8 && text[8] != ' ')) return -1;
+    int n = 0;
+    for (size_t i = 9; i < len && text[i] >= '0' && text[i] <= '9' && n <= STORE_HISTORY_MAX; i++) {
+        n = n * 10 + (text[i] - '0');
+    }
+    if (n <= 0) n = HISTORY_DEFAULT;
+    return n > STORE_HISTORY_MAX ? STORE_HISTORY_MAX : n;
+}
+
+// 저장소에서 읽은 메시지의 보낸 사람 아이디를 null 종료 문자열로 id에 복사하고 보낼 내용 길이를 반환
+size_t history_record(const struct StoreRecord *rec, char *id) {
+    size_t id_len = rec->id_len < MAX_ID_LEN ? rec->id_len : MAX_ID_LEN - 1;
+    memcpy(id, rec->id, id_len);
+    id[id_len] = '\0';
+    return rec->len > FRAME_MAX_TEXT ? FRAME_MAX_TEXT : rec->len;
+}
+
+// /get 번호 명령이면 파일 번호를, 아니면 -1을 반환 (번호가 없으면 0)
+int parse_get_command(const char *text, size_t len) {
+    if (len < 4 || memcmp(text, "/get", 4) != 0 || (len > 4 && text[4] != ' ')) return -1;
+    int n = 0;
+    for (size_t i = 5; i < len && text[i] >= '0' && text[i] <= '9' && n < 100000000; i++) {
+        n = n * 10 + (text[i] - '0');
+    }
+    return n;
+}
+
+// /get으로 요청한 파일을 열고 요청한 사람에게 보낼 안내 문구를 reply에 씀 (reply는 BUFSIZ 이상)
+// 보낼 수 없으면(파일 공유가 꺼짐, 구 버전 클라이언트, 이미 받는 중, 없는 번호) NULL을 반환한다.
+struct SpoolSend *open_download(int num, int proto, int busy, char *reply, size_t *reply_len) {
+    struct SpoolSend *s = NULL;
+    int n;
+    if (!spool_enabled()) {
+        n = snprintf(reply, BUFSIZ, "파일 공유가 꺼져 있습니다.");
+    } else if (proto != PROTO_FRAME) {
+        n = snprintf(reply, BUFSIZ, "파일은 새 클라이언트에서만 받을 수 있습니다.");
+    } else if (busy) {
+        n = snprintf(reply, BUFSIZ, "이미 다른 파일을 받고 있습니다. 끝난 뒤에 다시 요청하세요.");
+    } else if ((s = spool_send_open(num)) == NULL) {
+        n = snprintf(reply, BUFSIZ, "#%d 파일이 없습니다.", num);
+    } else {
+        n = snprintf(reply, BUFSIZ, "#%d '%s' 파일(%llu바이트)을 보냅니다.", num, s->name, (unsigned long long)s->size);
+    }
+    *reply_len = (n < BUFSIZ) ? (size_t)n : BUFSIZ - 1;
+    return s;
+}
+
+// 다 올린 임시 파일을 스풀에 등록하고 올린 사람에게 보낼 안내(reply)와 방에 알릴 메시지(announce)를 만듦
+// tmp가 NULL이면 올리기에 실패한 것이며 announce_len은 0이 된다. (reply, announce는 BUFSIZ 이상)
+void commit_upload(const char *tmp, const char *name, char *reply, size_t *reply_len, char *announce, size_t *announce_len) {
+    uint64_t size;
+    int num = (tmp != NULL) ? spool_commit(tmp, name, &size) : -1;
+    int n;
+
+    *announce_len = 0;
+    if (!spool_enabled()) {
+        n = snprintf(reply, BUFSIZ, "파일 공유가 꺼져 있습니다.");
+    } else if (num < 0) {
+        n = snprintf(reply, BUFSIZ, "'%s' 파일을 올리지 못했습니다. (최대 %llu MB)", name,
+                     (unsigned long long)(SPOOL_MAX_SIZE >> 20));
+    } else {
+        n = snprintf(reply, BUFSIZ, "'%s' 파일을 #%d로 올렸습니다.", name, num);
+        int a = snprintf(announce, BUFSIZ, "[파일] #%d %s (%llu바이트) - /get %d 으로 받기",
+                         num, name, (unsigned long long)size, num);
+        *announce_len = (a < BUFSIZ) ? (size_t)a : BUFSIZ - 1;
+    }
+    *reply_len = (n < BUFSIZ) ? (size_t)n : BUFSIZ - 1;
+}
+
+// 로그인한 연결이 보낸 채팅 메시지와 파일 조각에 토큰 버킷을 적용 (0: 처리, 1: 버림, -1: 연결 종료)
+// RATE_DELAY이면 메시지는 처리하고 토큰이 다시 찰 때까지 기다릴 시간을 *delay_us에 쓴다. 파일 조각은 버리면
+// 파일이 깨지므로 RATE_DROP이어도 늦추기만 한다.
+int rate_check(struct RateLimit *r, const struct Record *rec, const char *id, uint64_t now_us, uint64_t *delay_us) {
+    int chat = (rec->type == FRAME_CHAT);
+    int delay = (config.rate_action == RATE_DELAY || (!chat && config.rate_action == RATE_DROP));
+
+    *delay_us = 0;
+    if (!chat && rec->type != FRAME_FILE_PUT) return 0;
+    uint64_t wait = rate_take(r, now_us, chat, rec->len, delay);
+    if (wait == 0) return 0;
+
+    metric_add(MC_RATE_LIMITED, 1);
+    if (config.rate_action == RATE_CLOSE) {
+        log_msg(LOG_WARNING, "클라이언트 %s 전송 속도 제한 초과로 연결 종료", id);
+        return -1;
+    }
+    if (delay) {
+        *delay_us = wait;
+        return 0;
+    }
+    log_msg(LOG_DEBUG, "클라이언트 %s 전송 속도 제한 초과로 메시지를 버림", id);
+    return 1;
+}
+
+// 귓속말 명령(/w 아이디 메시지)이면 받는 사람 아이디를 to에, 전할 내용을 body에 두고 1을 반환 (to는 MAX_ID_LEN 이상)
+// 아이디나 내용이 빠졌으면 0, 귓속말 명령이 아니면 -1을 반환한다.
+int parse_whisper_command(const char *text, size_t len, char *to, const char **body, size_t *body_len) {
+    if (len < 2 || memcmp(text, "/w", 2) != 0 || (len > 2 && text[2] != ' ')) return -1;
+    size_t i = 3, start;
+    while (i < len && text[i] == ' ') i++;
+    for (start = i; i < len && text[i] != ' '; i++);
+    if (i == start || i - start >= MAX_ID_LEN) return 0;
+    memcpy(to, text + start, i - start);
+    to[i - start] = '\0';
+    while (i < len && text[i] == ' ') i++;
+    if (i == len) return 0;
+    *body = text + i;
+    *body_len = len - i;
+    return 1;
+}
+
+// 받는 사람에게 보낼 귓속말(text)과 보낸 사람에게 돌려줄 안내(reply)를 만듦 (text, reply는 BUFSIZ 이상)
+// to가 NULL이면 형식이 잘못된 명령이며, 받는 사람이 접속 중이 아니면(online이 0) text_len은 0이 된다.
+void format_whisper(const char *to, int online, const char *body, size_t body_len,
+                    char *text, size_t *text_len, char *reply, size_t *reply_len) {
+    int n, t = 0;
+    if (to == NULL) {
+        n = snprintf(reply, BUFSIZ, "사용법: /w 아이디 메시지");
+    } else if (!online) {
+        n = snprintf(reply, BUFSIZ, "'%s' 님은 접속 중이 아닙니다.", to);
+    } else {
+        n = snprintf(reply, BUFSIZ, "[귓속말 → %s] %.*s", to, (int)body_len, body);
+        t = snprintf(text, BUFSIZ, "[귓속말] %.*s", (int)body_len, body);
+    }
+    *reply_len = (n < BUFSIZ) ? (size_t)n : BUFSIZ - 1;
+    *text_len = (t < BUFSIZ) ? (size_t)t : BUFSIZ - 1;
+}
+
+// 소켓을 비차단 모드로 설정
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// 서버 소켓을 만들어 config.port에 bind만 함 (실패 시 -1 반환)
+// reuseport가 참이면 여러 소켓이 같은 포트를 나누어 받도록 SO_REUSEPORT를 설정한다.
+// SO_REUSEPORT 소켓은 listen해야 연결을 나누어 받으므로, bind만 해 둔 소켓에는 아직 연결이 오지 않는다.
+int bind_listen_socket(int reuseport) {
+    int ssock;
+    struct sockaddr_in servaddr;
+
+    // 서버 소켓 생성
+    if ((ssock = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+        perror("socket()");
+        return -1;
+    }
+
+    // 재시작 시 TIME_WAIT 상태의 연결 때문에 bind()가 실패하지 않도록 설정
+    int reuse = 1;
+    setsockopt(ssock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // 지연 우선 모드는 Nagle 알고리즘을 꺼서 작은 메시지도 바로 나가게 함 (accept한 소켓이 그대로 물려받음)
+    if (config.flush_policy == FLUSH_LATENCY) {
+        setsockopt(ssock, IPPROTO_TCP, TCP_NODELAY, &reuse, sizeof(reuse));
+    }
+    if (reuseport && setsockopt(ssock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(ssock);
+        return -1;
+    }
+
+    // 주소 구조체에 주소 지정
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    servaddr.sin_port = htons(config.port);
+
+    // bind 함수를 사용하여 서버 소켓의 주소 설정
+    if (bind(ssock, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0){
+        perror("bind()");
+        close(ssock);
+        return -1;
+    }
+    return ssock;
+}
+
+// 서버 소켓을 만들어 config.port에 bind하고 listen 상태로 만듦 (실패 시 -1 반환)
+int open_listen_socket(int backlog, int reuseport) {
+    int ssock = bind_listen_socket(reuseport);
+    if (ssock < 0) {
+        return -1;
+    }
+
+    // 동시에 접속하는 클라이언트의 처리를 위한 대기 큐를 설정
+    if (listen(ssock, backlog) < 0){
+        perror("listen()");
+        close(ssock);
+        return -1;
+    }
+    return ssock;
+}
+
+// 로그인 결과를 공유 버퍼로 만듦
+struct SharedBuf *make_login_reply(int proto) {
+    struct SharedBuf *b = sbuf_new(FRAME_HEADER_LEN + 64);
+    if (b != NULL) b->len = encode_login_reply(b->data, proto);
+    return b;
+}
+
+// 브로드캐스트할 채팅 메시지를 프레임으로 한 번만 직렬화 (모든 수신자가 이 버퍼를 함께 참조)
+struct SharedBuf *make_chat_frame(const char *id, const char *text, size_t len) {
+    size_t id_len = strlen(id);
+    struct SharedBuf *b = sbuf_new(frame_size(id_len, len));
+    if (b == NULL) return NULL;
+    frame_encode(b->data, FRAME_CHAT, id, id_len, text, len);
+    metric_add(MC_BYTES_COPIED, id_len + len);
+    return b;
+}
+
+// 채팅 프레임을 구 버전 클라이언트용 struct Message로 변환
+struct SharedBuf *make_legacy_chat(const struct SharedBuf *frame) {
+    struct SharedBuf *b = sbuf_new(sizeof(struct Message));
+    if (b == NULL) return NULL;
+    char id[MAX_ID_LEN];
+    size_t id_len = (unsigned char)frame->data[2];
+    const char *text = frame->data + FRAME_HEADER_LEN + id_len;
+    memcpy(id, frame->data + FRAME_HEADER_LEN, id_len);
+    id[id_len] = '\0';
+    encode_chat(b->data, PROTO_LEGACY, id, text, frame->len - FRAME_HEADER_LEN - id_len);
+    return b;
+}
+
+// 짧은 메시지 하나를 바로 전송하고 보낸 메시지 수와 바이트 수를 통계에 반영 (끊기 직전의 로그인 거부에만 사용)
+void send_client(int sock, const void *buf, size_t len) {
+    ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+    metric_add(MC_MSG_OUT, 1);
+    metric_add(MC_SEND_CALLS, 1);
+    if (n > 0) metric_add(MC_BYTES_OUT, n);
+}
+
+// 보낼 데이터가 남았으면 EPOLLOUT을 기다리고, 다 보냈으면 등록을 해제
+void watch_client(struct ForkClient *c, int want) {
+    struct epoll_event ev;
+    if (c->watching == want) return;
+    ev.events = EPOLLOUT;
+    ev.data.u64 = conn_handle(c);
+    if (epoll_ctl(client_epfd, want ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, c->sock, &ev) == 0) {
+        c->watching = want;
+    }
+}
+
+// 느린 클라이언트의 연결을 끊음 (소켓은 자식 프로세스도 가지고 있으므로 shutdown으로 끊고, 자식 프로세스가 종료되면 정리됨)
+void close_client(struct ForkClient *c) {
+    if (c->closing) return;
+    c->closing = 1;
+    shutdown(c->sock, SHUT_RDWR);
+    watch_client(c, 0);
+    outq_clear(&c->outq);
+    spool_send_close(c->file);
+    c->file = NULL;
+}
+
+// 파일 조각을 chunks개까지 보내고 다 보냈으면 파일을 닫음 (enum SpoolSendResult, 오류 시 -1)
+int send_file_chunks(struct ForkClient *c, int chunks) {
+    int ret = spool_send(c->file, c->sock, chunks);
+    if (ret == SPOOL_DONE) {
+        log_msg(LOG_INFO, "사용자 '%s'에게 '%s' 파일을 보냈습니다.", c->id, c->file->name);
+        spool_send_close(c->file);
+        c->file = NULL;
+    }
+    return ret;
+}
+
+// 송신 대기열과 내려보내는 파일을 비차단 소켓에 씀 (연결을 끊어야 하면 -1, 남은 데이터는 EPOLLOUT에서 이어서 보냄)
+// 파일 조각을 보내는 도중이면 프레임이 섞이지 않도록 그 조각을 먼저 끝내고, 채팅 메시지를 모두 보낸 뒤에만
+// 새 조각을 하나씩 보내 다른 클라이언트의 메시지 처리가 밀리지 않게 한다.
+int write_client(struct ForkClient *c) {
+    int ret;
+    if (c->closing) return 0;
+    if (c->file != NULL && spool_send_busy(c->file)) {
+        if ((ret = send_file_chunks(c, 0)) < 0) return -1;
+        if (ret == SPOOL_BLOCKED) {
+            watch_client(c, 1);
+            return 0;
+        }
+    }
+    if (outq_flush(&c->outq, c->sock) < 0) return -1;
+    if (c->file != NULL && c->outq.count == 0 && send_file_chunks(c, 1) < 0) return -1;
+    watch_client(c, c->outq.count > 0 || c->file != NULL);
+    return 0;
+}
+
+// 클라이언트를 모아 보내기 목록에 추가 (FLUSH_BATCH)
+void defer_client(struct ForkClient *c) {
+    if (c->pending) return;
+    if (pending_count == pending_cap) {
+        size_t cap = pending_cap ? pending_cap * 2 : 64;
+        ConnHandle *p = realloc(pending_clients, cap * sizeof(ConnHandle));
+        if (p == NULL) {    // 목록을 늘릴 수 없으면 바로 전송
+            if (write_client(c) < 0) close_client(c);
+            return;
+        }
+        pending_clients = p;
+        pending_cap = cap;
+    }
+    if (pending_count == 0) pending_since = metric_now_us();
+    pending_clients[pending_count++] = conn_handle(c);
+    c->pending = 1;
+}
+
+// 송신 대기열에 넣은 메시지를 전송 (FLUSH_LATENCY는 바로, FLUSH_BATCH는 링 버퍼를 한 번 비운 뒤 모아서)
+// EPOLLOUT을 기다리는 중이면 송신 버퍼가 가득 찬 것이므로 그때 이어서 보낸다.
+void flush_client(struct ForkClient *c) {
+    if (config.flush_policy == FLUSH_BATCH) {
+        defer_client(c);
+    } else if (!c->watching && write_client(c) < 0) {
+        close_client(c);
+    }
+}
+
+// 버퍼 참조를 송신 대기열에 넣고 전송
+// 대기열이 상한을 넘은 느린 클라이언트는 설정에 따라 메시지를 버리거나 연결을 끊는다.
+void send_buf(struct ForkClient *c, struct SharedBuf *b) {
+    if (c->closing) return;
+    if (c->outq.bytes + b->len > config.out_hwm) {
+        if (config.slow_policy == SLOW_DROP) {
+            metric_add(MC_DROPPED, 1);
+            if (c->dropped++ == 0) {
+                log_msg(LOG_WARNING, "느린 클라이언트 %s: 송신 대기열 상한 초과, 메시지를 버립니다.", c->id);
+            }
+            return;
+        }
+        log_msg(LOG_WARNING, "느린 클라이언트 %s: 송신 대기열 상한 초과, 연결을 종료합니다.", c->id);
+        metric_add(MC_SLOW_CLOSED, 1);
+        close_client(c);
+        return;
+    }
+    if (outq_push(&c->outq, sbuf_ref(b)) < 0) {
+        sbuf_unref(b);
+        close_client(c);
+        return;
+    }
+    flush_client(c);
+}
+
+// 채팅 프레임을 프로토콜에 맞게 한 클라이언트에게 전송 (legacy는 구 버전 클라이언트용 구조체를 처음 필요할 때 만들어 둠)
+void send_chat(struct ForkClient *c, struct SharedBuf *frame, struct SharedBuf **legacy) {
+    if (c->proto == PROTO_LEGACY) {
+        if (*legacy == NULL && (*legacy = make_legacy_chat(frame)) == NULL) return;
+        send_buf(c, *legacy);
+    } else {
+        send_buf(c, frame);
+    }
+}
+
+// 서버 안내 메시지를 한 클라이언트에게 전송
+void send_notice(struct ForkClient *c, const char *text, size_t len) {
+    struct SharedBuf *legacy = NULL;
+    struct SharedBuf *frame = make_chat_frame(NOTICE_ID, text, len);
+    if (frame == NULL) return;
+    send_chat(c, frame, &legacy);
+    sbuf_unref(legacy);
+    sbuf_unref(frame);
+}
+
+// 모아 보내기 목록을 비울 때까지 남은 시간 (poll 타임아웃, 목록이 비어 있으면 -1)
+int flush_timeout() {
+    if (pending_count == 0) return -1;
+    uint64_t elapsed = (metric_now_us() - pending_since) / 1000;
+    return (elapsed >= (uint64_t)config.flush_window_ms) ? 0 : config.flush_window_ms - (int)elapsed;
+}
+
+// 쌓아 둔 메시지를 클라이언트마다 한 번의 sendmsg로 전송 (다 보내지 못한 클라이언트는 EPOLLOUT에서 이어서)
+void flush_clients() {
+    for (size_t i = 0; i < pending_count; i++) {
+        struct ForkClient *c = conn_lookup(&clients, pending_clients[i]);
+        if (c == NULL) continue;    // 그 사이 종료된 클라이언트
+        c->pending = 0;
+        if (!c->watching && write_client(c) < 0) close_client(c);
+    }
+    pending_count = 0;
+}
+
+// 메시지를 room 채팅방의 모든 클라이언트에게 전송하는 함수 (보낸 사람 제외, 다른 서버에서 중계된 메시지는 sender가 NULL)
+// 프로토콜별로 한 번씩만 직렬화하고, 새 클라이언트에게는 실제 길이만큼만 전송한다.
+// 구 버전 struct Message는 받는 구 버전 클라이언트가 있을 때만 프레임에서 만든다.
+// 프레임 버퍼는 방의 최근 메시지로 보관하여 나중에 들어온 클라이언트에게 그대로 다시 보낸다.
+// 모든 메시지는 받는 클라이언트의 송신 대기열을 거치며, FLUSH_BATCH에서는 링 버퍼를 한 번 비운 뒤 모아서 보낸다.
+void sendtoall_message(const char *id, const char *text, size_t len, uint32_t room, struct ForkClient *sender) {
+    struct SharedBuf *frame = make_chat_frame(id, text, len);
+    if (frame == NULL) return;
+    struct SharedBuf *legacy = NULL;
+    struct RoomMembers *m = room_members(&rooms, room);
+    uint64_t start = metric_now_us();
+
+    for (uint32_t i = 0; i < m->count; i++) {    // 채팅방 멤버 배열을 순서대로 반복
+        struct ForkClient *c = m->members[i];
+        if (c == sender || c->proto == PROTO_UNKNOWN) continue;
+        send_chat(c, frame, &legacy);    // 발신자를 제외한 모든 클라이언트에게 메시지 전송
+    }
+    sbuf_unref(legacy);
+    metric_observe(MH_FANOUT, metric_now_us() - start);
+    replay_push(room, frame);    // 나중에 들어온 클라이언트에게 다시 보낼 수 있도록 보관
+}
+
+// 클라이언트 제거 함수 (O(1): 연결 테이블의 마지막 클라이언트가 빈 자리로 옮겨짐)
+void remove_client(struct ForkClient *c) {
+    if (c->pid == 0) {
+        // 로그인 전 연결: 그 사이 fork()한 자식 프로세스들도 디스크립터를 물려받았으므로 close만으로는 끊기지 않음
+        shutdown(c->sock, SHUT_RDWR);
+        frame_reader_free(&c->reader);
+    } else {
+        handle_map_del(&client_pids, c->pid);
+    }
+    id_map_del(&users, c->id, conn_handle(c));    // 이 연결이 등록한 아이디일 때만 지워짐
+    // 그 사이 fork()한 다른 자식 프로세스에 디스크립터가 남아 있으면 close만으로는 epoll 등록이 풀리지 않음
+    epoll_ctl(client_epfd, EPOLL_CTL_DEL, c->sock, NULL);
+    close(c->sock);    // 부모 프로세스가 가지고 있던 소켓 닫기
+    outq_clear(&c->outq);
+    spool_send_close(c->file);
+    room_leave(&rooms, c);
+    conn_free(&clients, c);
+    metric_add(MC_CLOSED, 1);
+    printf("클라이언트 제거됨. 현재 접속자 수: %zu\n", clients.count);
+}
+
+// 클라이언트가 들어간 방의 최근 메시지를 송신 대기열에 넣어 한 번의 sendmsg로 묶어 전송
+void send_replay(struct ForkClient *c) {
+    if (!c->closing && queue_replay(&c->outq, c->proto, c->room.room) > 0) {
+        flush_client(c);
+    }
+}
+
+// 저장소에서 읽은 메시지를 /history를 요청한 클라이언트에게 전송 (연결을 끊었으면 읽기를 멈춤)
+int send_history(const struct StoreRecord *rec, void *arg) {
+    struct ForkClient *c = arg;
+    struct SharedBuf *legacy = NULL;
+    char id[MAX_ID_LEN];
+    size_t len = history_record(rec, id);
+    struct SharedBuf *frame = make_chat_frame(id, rec->text, len);
+    if (frame != NULL) send_chat(c, frame, &legacy);
+    sbuf_unref(legacy);
+    sbuf_unref(frame);
+    return c->closing;
+}
+
+// 파일 내려보내기 시작 (대기열의 안내 메시지 뒤에, 소켓이 쓰기 가능할 때마다 메인 루프에서 조각을 하나씩 보냄)
+void start_download(struct ForkClient *c, struct SpoolSend *s) {
+    if (c->closing) {
+        spool_send_close(s);
+        return;
+    }
+    c->file = s;
+    flush_client(c);
+}
+
+// 귓속말을 받는 사람 한 명에게만 보내고 보낸 사람에게 결과를 알림 (받는 사람은 아이디 색인으로 바로 찾음)
+void send_whisper(struct ForkClient *sender, const char *to, const char *body, size_t len) {
+    static char text[BUFSIZ], reply[BUFSIZ];
+    size_t text_len, reply_len;
+    struct ForkClient *t = (to != NULL) ? conn_lookup(&clients, id_map_get(&users, to, NULL)) : NULL;
+    struct SharedBuf *frame, *legacy = NULL;
+
+    format_whisper(to, t != NULL, body, len, text, &text_len, reply, &reply_len);
+    if (t != NULL && (frame = make_chat_frame(sender->id, text, text_len)) != NULL) {
+        send_chat(t, frame, &legacy);    // 대기열을 거치므로 모아 둔 메시지보다 앞서지 않음
+        sbuf_unref(legacy);
+        sbuf_unref(frame);
+    }
+    send_notice(sender, reply, reply_len);
+}
+
+// 공유 메모리 링 버퍼에 쌓인 레코드를 한 번에 최대 IPC_BATCH개까지 꺼내 처리
+// 시그널 핸들러가 아닌 부모 프로세스의 메인 루프에서 호출하므로 send()를 안전하게 사용할 수 있다.
+void drain_ipc_ring() {
+    static char reply[BUFSIZ], announce[BUFSIZ];
+    size_t reply_len, announce_len;
+    char to[MAX_ID_LEN];
+    const char *body;
+    size_t body_len;
+    int history, file, whisper;
+    struct IpcMessage *ipc;
+    for (int n = 0; n < IPC_BATCH && (ipc = ipc_ring_peek(ipc_ring)) != NULL; n++) {
+        // 레코드를 보낸 클라이언트 (이미 종료되어 슬롯이 재사용되었으면 NULL)
+        struct ForkClient *sender = conn_lookup(&clients, ipc->handle);
+        uint32_t room = sender ? sender->room.room : ROOM_NONE;    // 명령을 처리하기 전의 방
+
+        if (ipc->type == FRAME_RELAY) {    // 다른 서버에서 중계된 메시지: 저장한 뒤 같은 이름의 방의 모든 클라이언트에게 전송
+            store_append(room_registry_name(ipc->proto), ipc->msg.id, ipc->msg.content, ipc->len);
+            sendtoall_message(ipc->msg.id, ipc->msg.content, ipc->len, ipc->proto, NULL);
+        } else if (sender == NULL) {
+            // 종료된 클라이언트가 보낸 레코드와 다 쓰지 못한 칸(IPC_SKIP)은 버림 (다 올린 파일도 등록하지 않고 지움)
+            if (ipc->type == FRAME_FILE_PUT && ipc->msg.content[0] != '\0') spool_discard(ipc->msg.content);
+        } else if (ipc->type == FRAME_FILE_PUT) {    // 자식 프로세스가 다 받은 파일: 등록하고 방에 알림
+            const char *tmp = ipc->msg.content;    // "임시 파일 이름\0파일 이름" (실패하면 임시 파일 이름이 빔)
+            commit_upload(tmp[0] ? tmp : NULL, tmp + strlen(tmp) + 1, reply, &reply_len, announce, &announce_len);
+            send_notice(sender, reply, reply_len);
+            if (announce_len > 0 && sender->room.room != ROOM_NONE) {    // 알림은 보낸 사람의 채팅 메시지로 저장하고 브로드캐스트
+                store_append(room_registry_name(sender->room.room), ipc->msg.id, announce, announce_len);
+                sendtoall_message(ipc->msg.id, announce, announce_len, sender->room.room, sender);
+            }
+        } else if (ipc->type == FRAME_LOGIN) {    // 로그인 완료: 클라이언트 프로토콜 기록 후 기본 방에 들어감
+            sender->proto = ipc->proto;
+            room_join(&rooms, sender, LOBBY_ROOM);
+            if (sender->proto == PROTO_FRAME) {    // 구 버전 클라이언트는 로그인 결과와 섞이지 않도록 보내지 않음
+                send_replay(sender);
+            }
+        } else if (handle_room_command(&rooms, sender, ipc->msg.content, ipc->len, reply, &reply_len)) {
+            // 채팅방 명령은 보낸 사람에게만 결과를 알려 주고 브로드캐스트하지 않음 (대기열을 거치므로 쌓아 둔 메시지 뒤에 감)
+            send_notice(sender, reply, reply_len);
+            if (sender->room.room != room) {    // 다른 방으로 옮겼으면 그 방의 최근 메시지 전송
+                send_replay(sender);
+            }
+        } else if ((history = parse_history_command(ipc->msg.content, ipc->len)) > 0) {
+            // 저장소에 남아 있는 이 방의 최근 메시지를 보낸 사람에게만 전송
+            store_read_last(history, room_registry_name(sender->room.room), send_history, sender);
+        } else if ((file = parse_get_command(ipc->msg.content, ipc->len)) >= 0) {
+            // 스풀에 올라온 파일을 요청한 사람에게 내려보냄 (안내 메시지 뒤에 조각 단위로)
+            struct SpoolSend *s = open_download(file, sender->proto, sender->file != NULL, reply, &reply_len);
+            send_notice(sender, reply, reply_len);
+            if (s != NULL) start_download(sender, s);
+        } else if ((whisper = parse_whisper_command(ipc->msg.content, ipc->len, to, &body, &body_len)) >= 0) {
+            send_whisper(sender, whisper ? to : NULL, body, body_len);
+        } else if (sender->room.room != ROOM_NONE) {    // 저장한 뒤 같은 채팅방의 다른 클라이언트와 다른 서버에 메시지 전송
+            store_append(room_registry_name(sender->room.room), ipc->msg.id, ipc->msg.content, ipc->len);
+            sendtoall_message(ipc->msg.id, ipc->msg.content, ipc->len, sender->room.room, sender);
+            relay_publish(room_registry_name(sender->room.room), ipc->msg.id, ipc->msg.content, ipc->len);
         }
+        if (sender != NULL && ipc->type == FRAME_CHAT) {    // 자식 프로세스가 받은 뒤 링 버퍼에서 기다린 시간도 포함
+            metric_observe(MH_PROCESS, metric_now_us() - ipc->received);
+        }
+        ipc_ring_release(ipc_ring);    // 칸을 자식 프로세스들에게 돌려줌
     }
 }
 
-// 자식 프로세스 종료를 처리하는 시그널 핸들러
-void sigchld_handler(int signo) {   
+// 종료된 자식 프로세스를 모두 거두고 클라이언트 제거
+// 시그널 핸들러가 아니라 메인 루프에서 signalfd로 SIGCHLD를 받아 호출하므로 테이블을 안전하게 수정할 수 있다.
+void reap_children(int sigfd) {
+    struct signalfd_siginfo info;
     pid_t pid;
     int status;  // 자식 프로세스 상태 변수
+
+    while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {}    // 겹친 SIGCHLD는 한 번에 처리
+    while (ipc_ring_peek(ipc_ring) != NULL) {    // 종료한 자식 프로세스가 마지막으로 보낸 레코드를 먼저 처리
+        drain_ipc_ring();
+    }
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {    // 자식 프로세스가 종료되었을 때
-        for (int i = 0; i < client_count; i++) {    // 모든 클라이언트에 대해 반복
-            if (client_pids[i] == pid) {    // 종료된 자식 프로세스를 찾았을 때
-                remove_client(client_sockets[i]);    // 클라이언트 제거
-                break;
-            }
+        // 칸을 예약한 채 죽었으면 (SIGKILL 등) 그 칸을 건너뛰어야 뒤의 레코드를 꺼낼 수 있음
+        if (ipc_ring_reap(ipc_ring, pid) > 0) {
+            log_msg(LOG_WARNING, "자식 프로세스 %d가 링 버퍼에 레코드를 다 쓰지 못하고 종료했습니다.", (int)pid);
+            while (ipc_ring_peek(ipc_ring) != NULL) drain_ipc_ring();
+        }
+        struct ForkClient *c = conn_lookup(&clients, handle_map_get(&client_pids, pid));
+        if (c != NULL) {
+            remove_client(c);    // 클라이언트 제거
+        }
+    }
+}
+
+// 링 버퍼에 handle 연결의 레코드를 써서 부모 프로세스의 메인 루프에 전달
+// 칸 전체를 지우지 않고 아이디와 내용 len바이트만 씀 (읽는 쪽은 len만 보고, 구 버전 클라이언트에게 칸을 그대로 보내지 않음)
+void publish_ipc_as(ConnHandle handle, int type, int proto, const char *id, const char *text, size_t len) {
+    size_t pos;
+    struct IpcMessage *ipc = ipc_ring_reserve(ipc_ring, &pos);
+    ipc->type = type;
+    ipc->handle = handle;
+    ipc->proto = proto;
+    ipc->len = len;
+    ipc->received = metric_now_us();
+    size_t id_len = strnlen(id, MAX_ID_LEN - 1);
+    memcpy(ipc->msg.id, id, id_len);
+    ipc->msg.id[id_len] = '\0';
+    memcpy(ipc->msg.content, text, len);
+    metric_add(MC_BYTES_COPIED, id_len + len);
+    ipc_ring_publish(ipc_ring, pos);
+}
+
+// 링 버퍼에 레코드를 써서 부모 프로세스에게 전달 (자식 프로세스에서 호출)
+void publish_ipc(int type, int proto, const char *id, const char *text, size_t len) {
+    publish_ipc_as(my_handle, type, proto, id, text, len);
+}
+
+// 다른 서버에서 중계된 메시지를 링 버퍼로 메인 루프에 넘김 (부모 프로세스의 중계 스레드에서 호출)
+// 방 번호는 proto 자리에 담고, 보낸 클라이언트가 없으므로 핸들은 비워 둔다.
+void fork_relay_deliver(const char *room, const char *id, const char *text, size_t len) {
+    int r = room_registry_find(room, 1);
+    if (r < 0) return;
+    publish_ipc_as(CONN_HANDLE_NONE, FRAME_RELAY, r, id, text, len);
+}
+
+// 자식 프로세스에서 레코드 하나를 받을 때까지 기다려 수신 (1: 수신, 0: 연결 종료, -1: 오류)
+int child_recv_record(int csock, struct FrameReader *r, int *proto, int logged_in, struct Record *rec) {
+    while (1) {
+        int ret = read_record(r, proto, logged_in, rec);
+        if (ret != 0) return ret;
+
+        size_t avail;
+        char *space = frame_reader_space(r, &avail);
+        if (space == NULL) return -1;
+        ssize_t n = recv(csock, space, avail, 0);
+        if (n < 0 && errno == EINTR) continue;    // 수신 실패 시 다시 시도
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // 부모 프로세스가 같은 소켓에 비차단으로 보내므로 소켓은 비차단 모드 (읽을 수 있을 때까지 기다림)
+            struct pollfd p = { .fd = csock, .events = POLLIN };
+            poll(&p, 1, -1);
+            continue;
         }
+        if (n <= 0) return (int)n;
+        frame_reader_commit(r, n);
+        metric_add(MC_BYTES_IN, n);
+    }
+}
+
+// 로그인 전 연결에서 받을 수 있는 데이터를 모두 읽고 로그인 레코드를 꺼냄 (부모 프로세스, 비차단 소켓)
+// (1: 로그인 정보를 모두 받음, 0: 아직 부족함, -1: 연결 종료 또는 잘못된 데이터)
+int login_recv_record(struct ForkClient *c, struct Record *rec) {
+    while (1) {
+        int ret = read_record(&c->reader, &c->proto, 0, rec);
+        if (ret != 0) return ret;
+
+        size_t avail;
+        char *space = frame_reader_space(&c->reader, &avail);
+        if (space == NULL) return -1;
+        ssize_t n = recv(c->sock, space, avail, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        frame_reader_commit(&c->reader, n);
+        metric_add(MC_BYTES_IN, n);
     }
 }
 
-// 자식 프로세스가 메시지를 보내면 부모 프로세스에게 알리는 시그널 핸들러
-void sigusr1_handler(int signo) { 
-    struct Message msg;
-    read(pipe_fd[0], &msg, sizeof(msg));    // 파이프에서 메시지 읽기
-    sendtoall_message(&msg, -1);    // 모든 클라이언트에게 메시지 전송
+// 올리는 파일의 조각을 스풀 임시 파일에 씀 (자식 프로세스)
+// 마지막 조각을 받으면 "임시 파일 이름\0파일 이름"을 부모 프로세스에게 보내 등록과 알림을 맡긴다.
+void child_upload(struct SpoolUpload **up, struct ForkClient *c, const struct Record *rec) {
+    char info[BUFSIZ];
+    if (*up == NULL && (*up = spool_upload_start(rec->name, rec->name_len)) == NULL) return;
+    spool_upload_write(*up, rec->text, rec->len);    // 실패하면 나머지 조각은 무시하고 마지막 조각에서 알림
+    if (!(rec->flags & FRAME_FLAG_LAST)) return;
+
+    struct SpoolUpload *u = *up;
+    int ok = (spool_upload_end(u) == 0);
+    int n = snprintf(info, sizeof(info), "%s%c%s", ok ? u->tmp : "", '\0', u->name);
+    publish_ipc(FRAME_FILE_PUT, c->proto, c->id, info, n + 1);    // 파일 이름 끝의 null 종료 문자 포함
+    spool_upload_free(u);
+    *up = NULL;
+}
+
+// 로그인한 클라이언트를 맡는 자식 프로세스 (돌아오지 않음)
+// 부모 프로세스가 로그인 레코드까지 읽은 수신 버퍼를 물려받으므로 로그인 뒤에 함께 온 메시지도 그대로 처리된다.
+void run_child(struct ForkClient *c, int ssock, int sigfd) {
+    char mesg[BUFSIZ];
+    struct Record rec;
+    struct SpoolUpload *upload = NULL;
+    struct RateLimit rate;
+    uint64_t delay;
+    sigset_t mask;
+    int n;
+
+    close(ssock);    // 서버 소켓 닫기
+    close(sigfd);
+    close(client_epfd);
+    relay_close_fds();
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    metrics_child_slot(c->hdr.slot);    // 같은 슬롯을 맡았던 이전 자식 프로세스의 칸을 이어서 씀
+
+    // 패스워드와 관계 없이 무조건 로그인 성공
+    n = encode_login_reply(mesg, c->proto);
+
+    // 인증 결과 전송
+    metric_add(MC_MSG_OUT, 1);
+    metric_add(MC_BYTES_OUT, n);
+    if (send(c->sock, mesg, n, 0) <= 0) {
+        perror("인증 결과 전송 실패");
+        exit(1);
+    }
+
+    // printf 대신 로그 링 버퍼 사용
+    log_msg(LOG_NOTICE, "사용자 '%s' 로그인 성공", c->id);
+
+    // 부모 프로세스에게 로그인 완료와 클라이언트 프로토콜을 알림
+    publish_ipc(FRAME_LOGIN, c->proto, c->id, "", 0);
+    rate_limit_init(&rate, config.rate_msgs, config.rate_bytes, FRAME_MAX_PAYLOAD, metric_now_us());
+
+    // 클라이언트로부터 메시지를 받아 모든 클라이언트에게 브로드캐스트하는 루프
+    while (1) {
+        // 클라이언트로부터 메시지 읽기
+        n = child_recv_record(c->sock, &c->reader, &c->proto, 1, &rec);
+        if (n <= 0) {
+            perror("클라이언트로부터 recv() 실패");
+            break;
+        }
+
+        // 속도 제한: 이 클라이언트만 맡은 프로세스이므로 늦출 때는 그만큼 잠들어 소켓을 읽지 않음
+        n = rate_check(&rate, &rec, c->id, metric_now_us(), &delay);
+        if (n < 0) break;
+        if (n > 0) continue;
+        if (delay > 0) usleep(delay);
+
+        if (rec.type == FRAME_FILE_PUT) {
+            child_upload(&upload, c, &rec);
+            continue;
+        }
+        if (rec.type != FRAME_CHAT) continue;    // 알 수 없는 프레임은 무시
+
+        // 메시지 내용은 debug 레벨에서만 남김
+        log_msg(LOG_DEBUG, "클라이언트로부터 받은 메시지: %s: %.*s", c->id, (int)rec.len, rec.text);
+
+        // 클라이언트가 '/q'를 보내면 종료
+        if (rec.len == 1 && rec.text[0] == 'q') {
+            // printf 대신 로그 링 버퍼 사용
+            log_msg(LOG_NOTICE, "클라이언트 %s 종료", c->id);
+            break;
+        }
+
+        // 공유 메모리 링 버퍼를 통해 부모 프로세스에게 메시지 전달
+        metric_add(MC_MSG_IN, 1);
+        publish_ipc(FRAME_CHAT, c->proto, c->id, rec.text, rec.len);
+    }
+
+    spool_upload_free(upload);    // 다 받지 못한 파일은 지움
+    frame_reader_free(&c->reader);
+    close(c->sock);
+    exit(0);
+}
+
+// 로그인을 마친 클라이언트를 맡을 자식 프로세스 생성
+void start_child(struct ForkClient *c, const struct Record *login, int ssock, int sigfd) {
+    pid_t pid;
+    char mesg[FRAME_HEADER_LEN + 64];
+
+    // 같은 아이디로 이미 접속한 클라이언트가 있거나 아이디 표를 늘리지 못하면 거부
+    // (아직 비차단 소켓이지만 짧은 응답이므로 한 번에 보내짐)
+    strcpy(c->id, login->id);
+    int added = id_map_add(&users, c->id, 0, conn_handle(c));
+    if (added < 0) {
+        send_client(c->sock, mesg, encode_login_fail(mesg, c->proto, "서버 오류로 로그인할 수 없습니다."));
+        log_msg(LOG_ERR, "사용자 '%s' 로그인 실패: 아이디 표를 늘릴 메모리 부족", c->id);
+        remove_client(c);
+        return;
+    }
+    if (added > 0) {
+        send_client(c->sock, mesg, encode_login_fail(mesg, c->proto, "이미 접속 중인 아이디입니다."));
+        log_msg(LOG_NOTICE, "사용자 '%s' 중복 로그인 거부", c->id);
+        remove_client(c);
+        return;
+    }
+
+    // 이제부터 자식 프로세스가 읽으므로 부모 프로세스는 읽기를 기다리지 않음
+    // 소켓은 비차단 모드 그대로 두어 부모 프로세스의 송신이 느린 클라이언트 때문에 멈추지 않게 한다.
+    if (epoll_ctl(client_epfd, EPOLL_CTL_DEL, c->sock, NULL) < 0) {
+        remove_client(c);
+        return;
+    }
+    my_handle = conn_handle(c);    // 자식 프로세스가 자신의 핸들을 알 수 있도록 fork() 전에 정함
+
+    if ((pid = fork()) < 0) {
+        perror("fork()");
+        remove_client(c);
+        return;
+    }
+    if (pid == 0) {    // 자식 프로세스
+        run_child(c, ssock, sigfd);
+    }
+
+    // 부모 프로세스
+    c->pid = pid;  // 클라이언트 프로세스 ID를 저장
+    handle_map_put(&client_pids, pid, my_handle);
+    frame_reader_free(&c->reader);    // 남은 데이터는 자식 프로세스가 처리
+}
+
+// 로그인 정보가 도착한 연결을 읽어 로그인을 마친 연결만 자식 프로세스에게 넘기고, 보낼 데이터가 남은 연결에는 이어서 보냄
+// 로그인 전에는 fork()하지 않으므로 접속만 하고 아무것도 보내지 않는 연결은 프로세스를 차지하지 않는다.
+void handle_client_events(int ssock, int sigfd) {
+    struct epoll_event events[MAX_EVENTS];
+    struct Record rec;
+    int nev = epoll_wait(client_epfd, events, MAX_EVENTS, 0);
+
+    for (int i = 0; i < nev; i++) {
+        struct ForkClient *c = conn_lookup(&clients, events[i].data.u64);
+        if (c == NULL) continue;
+        if (c->pid != 0) {    // 보낼 데이터가 남은 연결
+            if (write_client(c) < 0) close_client(c);
+            continue;
+        }
+        int ret = login_recv_record(c, &rec);
+        if (ret < 0) {    // 로그인 전에 연결을 끊었거나 잘못된 데이터를 보냄
+            remove_client(c);
+        } else if (ret > 0) {
+            start_child(c, &rec, ssock, sigfd);
+        }
+    }
+}
+
+// 로그인 기한이 지난 연결을 끊음 (이미 로그인했거나 종료된 연결은 건너뜀)
+void login_expired(ConnHandle h, void *arg) {
+    struct ForkClient *c = conn_lookup(&clients, h);
+    (void)arg;
+    if (c == NULL || c->pid != 0) return;
+    log_msg(LOG_NOTICE, "로그인 시간 초과로 연결을 끊습니다.");
+    metric_add(MC_LOGIN_TIMEOUTS, 1);
+    remove_client(c);
+}
+
+// 대기 중인 새 연결을 한 번에 최대 ACCEPT_BATCH개까지 accept4로 받아 로그인 대기 목록에 등록
+// 재접속이 몰려도 연결마다 fork()를 기다리지 않고, 나머지는 다음 poll에서 이어서 받는다.
+void accept_clients(int ssock) {
+    struct sockaddr_in cliaddr;
+    char addr[INET_ADDRSTRLEN];
+    uint64_t deadline = metric_now_us() / 1000 + config.login_timeout_ms;
+
+    for (int i = 0; i < ACCEPT_BATCH; i++) {
+        socklen_t clen = sizeof(cliaddr);  // 클라이언트 주소 길이 초기화
+        int csock = accept4(ssock, (struct sockaddr *)&cliaddr, &clen, SOCK_NONBLOCK);  // 클라이언트 연결 accept
+        if (csock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept4()");
+            }
+            return;
+        }
+
+        if (clients.count >= (size_t)config.max_clients) {   // 접속 클라이언트 수가 최대 클라이언트 수에 도달했을 때
+            printf("최대 클라이언트 수에 도달했습니다. 연결을 거부합니다.\n");
+            metric_add(MC_REJECTED, 1);
+            close(csock);
+            continue;
+        }
+
+        struct ForkClient *client = conn_alloc(&clients);
+        if (client == NULL) {
+            close(csock);
+            continue;
+        }
+        client->sock = csock;
+        client->proto = PROTO_UNKNOWN;
+        client->room.room = ROOM_NONE;
+        metric_add(MC_ACCEPTED, 1);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = conn_handle(client);
+        if (frame_reader_init(&client->reader, 512) < 0 || epoll_ctl(client_epfd, EPOLL_CTL_ADD, csock, &ev) < 0 ||
+            timer_add(&logins, conn_handle(client), deadline) < 0) {
+            remove_client(client);
+            continue;
+        }
+
+        // 새로운 클라이언트를 받으면 클라이언트의 IP 주소를 문자열로 변환
+        inet_ntop(AF_INET, &cliaddr.sin_addr, addr, sizeof(addr));
+        // printf 대신 로그 링 버퍼 사용
+        log_msg(LOG_NOTICE, "클라이언트 연결됨: %s", addr);  // 연결된 클라이언트의 IP 주소 출력
+    }
 }
 
 // 서버 데몬화
@@ -117,149 +1116,235 @@ void daemonize() {
 
 int main(int argc, char **argv)
 {
-    // 서버 데몬화
-    daemonize();
+    int opt;
+    enum ServerMode mode = MODE_FORK;
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);  // 멀티코어 모드의 reactor 스레드 수 (기본값: 코어 수)
+    const char *log_path = NULL;  // 로그 파일 경로 (기본값: syslog)
+    const char *store_dir = NULL;  // 메시지 저장소 디렉토리 (기본값: 저장하지 않음)
+    const char *spool_dir = NULL;  // 파일 공유 스풀 디렉토리 (기본값: 파일 공유를 하지 않음)
+    const char *admin_path = METRICS_SOCKET_PATH;  // 통계를 제공하는 관리용 유닉스 도메인 소켓 (데몬화 후 열리므로 절대 경로)
+    int takeover = 0;  // 실행 중인 서버의 연결을 넘겨받아 무중단으로 교체
+    struct Handoff handoff;  // 넘겨받은 서버 소켓과 연결
 
-    // syslog를 사용하여 로그 남기기
-    syslog(LOG_NOTICE, "채팅 서버 데몬이 시작되었습니다.");
-
-    int ssock; // 서버 소켓 디스크립터  
-    socklen_t clen; // 클라이언트 주소 길이
-    pid_t pid; // 자식 프로세스 ID
-    int n;  // 데이터 전송 및 수신 변수
-    struct sockaddr_in servaddr, cliaddr; // 서버 및 클라이언트 주소 구조체
-    char mesg[BUFSIZ];
-
-    // 자식 프로세스 종료 시그널 핸들러
-    if(signal(SIGCHLD, sigchld_handler) == SIG_ERR) {
-        perror("signal: (SIGCHLD)");
+    // 실행 옵션 처리 (-m fork|epoll|threads, -t 스레드 수, -c 최대 클라이언트 수, -w 송신 대기열 상한, -s 느린 클라이언트 처리,
+    //  -l 로그 레벨, -L 로그 파일, -d 메시지 저장소 디렉토리, -r 로그인 시 보낼 최근 메시지 수, -R 방마다 보관할 최근 메시지 바이트 수,
+    //  -f 브로드캐스트 전송 방식, -F 모아 보내는 최대 시간(밀리초), -b 이벤트 루프 모드의 입출력 방식, -A 관리 소켓 경로,
+    //  -T 접속 후 로그인해야 하는 시간(초), -S 파일 공유 스풀 디렉토리, -M 연결마다 초당 메시지 수, -B 연결마다 초당 바이트 수,
+    //  -O 속도 제한을 넘었을 때 처리, -p 클라이언트 포트, -P 중계 포트, -J 중계할 이웃 서버 호스트:포트(여러 번 지정 가능),
+    //  -N 중계에 쓰는 서버 번호, -u 실행 중인 서버를 무중단으로 교체, -U 무중단 재시작 소켓 경로)
+    while ((opt = getopt(argc, argv, "m:t:c:w:s:l:L:d:r:R:f:F:b:A:T:S:M:B:O:p:P:J:N:uU:")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "fork") == 0) {
+            mode = MODE_FORK;
+        } else if (opt == 'm' && strcmp(optarg, "epoll") == 0) {
+            mode = MODE_EPOLL;
+        } else if (opt == 'm' && strcmp(optarg, "threads") == 0) {
+            mode = MODE_THREADS;
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            nthreads = atoi(optarg);
+        } else if (opt == 'c' && atoi(optarg) > 0) {
+            config.max_clients = atoi(optarg);
+        } else if (opt == 'w' && atol(optarg) > 0) {
+            config.out_hwm = atol(optarg);
+        } else if (opt == 's' && strcmp(optarg, "drop") == 0) {
+            config.slow_policy = SLOW_DROP;
+        } else if (opt == 's' && strcmp(optarg, "close") == 0) {
+            config.slow_policy = SLOW_CLOSE;
+        } else if (opt == 'l' && log_level_from_name(optarg) >= 0) {
+            log_level = log_level_from_name(optarg);
+        } else if (opt == 'L') {
+            log_path = optarg;
+        } else if (opt == 'd') {
+            store_dir = optarg;
+        } else if (opt == 'r' && atol(optarg) >= 0) {
+            config.replay_count = atol(optarg);
+        } else if (opt == 'R' && atol(optarg) > 0) {
+            config.replay_bytes = atol(optarg);
+        } else if (opt == 'f' && strcmp(optarg, "latency") == 0) {
+            config.flush_policy = FLUSH_LATENCY;
+        } else if (opt == 'f' && strcmp(optarg, "batch") == 0) {
+            config.flush_policy = FLUSH_BATCH;
+        } else if (opt == 'F' && atoi(optarg) >= 0) {
+            config.flush_window_ms = atoi(optarg);
+        } else if (opt == 'b' && strcmp(optarg, "epoll") == 0) {
+            config.io_backend = IO_EPOLL;
+        } else if (opt == 'b' && strcmp(optarg, "uring") == 0) {
+            config.io_backend = IO_URING;
+        } else if (opt == 'A') {
+            admin_path = optarg;
+        } else if (opt == 'T' && atoi(optarg) > 0) {
+            config.login_timeout_ms = atoi(optarg) * 1000;
+        } else if (opt == 'S') {
+            spool_dir = optarg;
+        } else if (opt == 'M' && atol(optarg) >= 0) {
+            config.rate_msgs = atol(optarg);
+        } else if (opt == 'B' && atol(optarg) >= 0) {
+            config.rate_bytes = atol(optarg);
+        } else if (opt == 'O' && strcmp(optarg, "drop") == 0) {
+            config.rate_action = RATE_DROP;
+        } else if (opt == 'O' && strcmp(optarg, "delay") == 0) {
+            config.rate_action = RATE_DELAY;
+        } else if (opt == 'O' && strcmp(optarg, "close") == 0) {
+            config.rate_action = RATE_CLOSE;
+        } else if (opt == 'p' && atoi(optarg) > 0 && atoi(optarg) <= 65535) {
+            config.port = atoi(optarg);
+        } else if (opt == 'P' && atoi(optarg) > 0 && atoi(optarg) <= 65535) {
+            config.relay_port = atoi(optarg);
+        } else if (opt == 'J' && relay_add_peer(optarg) == 0) {
+            // 이웃 서버로 등록됨 (형식이 잘못되었거나 너무 많으면 사용법 출력)
+        } else if (opt == 'N' && strtoul(optarg, NULL, 10) > 0) {
+            config.node_id = (uint32_t)strtoul(optarg, NULL, 10);
+        } else if (opt == 'u') {
+            takeover = 1;
+        } else if (opt == 'U') {
+            config.handoff_path = optarg;
+        } else {
+            fprintf(stderr, "Usage : %s [-m fork|epoll|threads] [-t threads] [-c max_clients] [-w out_hwm_bytes] [-s drop|close]"
+                            " [-l err|warning|notice|info|debug] [-L log_file] [-d store_dir] [-r replay_count] [-R replay_bytes]"
+                            " [-f latency|batch] [-F flush_window_ms] [-b epoll|uring] [-A admin_socket] [-T login_timeout_sec] [-S spool_dir]"
+                            " [-M msgs_per_sec] [-B bytes_per_sec] [-O drop|delay|close] [-p port] [-P relay_port]"
+                            " [-J relay_host:port]... [-N node_id] [-u] [-U handoff_socket]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (takeover && mode == MODE_FORK) {    // fork 모드는 자식 프로세스마다 읽던 스트림과 상태를 가지고 있어 넘길 수 없음
+        fprintf(stderr, "무중단 재시작(-u)은 이벤트 루프 모드(-m epoll|threads)에서만 사용할 수 있습니다.\n");
         return -1;
     }
+    replay_init(config.replay_count, config.replay_bytes);
 
-    // 자식 프로세스가 메시지를 보내면 부모 프로세스에게 알리는 시그널 핸들러
-    if(signal(SIGUSR1, sigusr1_handler) == SIG_ERR) {
-        perror("signal: (SIGUSR1)");
+    // 로그 링 버퍼는 자식 프로세스와 공유하도록 fork() 전에, 로그 파일은 작업 디렉토리가 바뀌기 전에 준비
+    if (log_init(log_path, log_level) < 0) {
         return -1;
     }
-
-    // 서버 소켓 생성
-    if ((ssock = socket(AF_INET, SOCK_STREAM, 0)) < 0){
-        perror("socket()");
+    // 무중단 재시작: 실행 중인 서버의 서버 소켓과 연결을 모두 받음 (이전 서버는 멈춘 채 저장소에 쓰지 않고 기다림)
+    // 실패할 수 있는 준비를 모두 마친 뒤 handoff_finish로 알려야 이전 서버가 종료하고, 그 전에 실패하면 이전 서버가 이어서 서비스한다.
+    if (takeover && handoff_receive(config.handoff_path, &handoff) < 0) {
         return -1;
     }
-
-    // 파이프 생성
-    if (pipe(pipe_fd) < 0) {
-        perror("pipe()");
+    if (store_dir != NULL && store_open(store_dir) < 0) {
+        return -1;
+    }
+    if (spool_dir != NULL && spool_open(spool_dir, takeover) < 0) {
+        return -1;
+    }
+    if (takeover) {
+        spool_import(handoff.spool, handoff.state.spool_len);
+    }
+    // 통계 영역도 자식 프로세스와 공유하도록 fork() 전에 (자식 프로세스 칸은 연결 테이블 슬롯마다 하나)
+    if (metrics_init(mode == MODE_FORK ? config.max_clients : 0) < 0) {
         return -1;
     }
 
-    // 주소 구조체에 주소 지정
-    memset(&servaddr, 0, sizeof(servaddr));
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    servaddr.sin_port = htons(TCP_PORT);
+    // 서버 데몬화
+    daemonize();
 
-    // bind 함수를 사용하여 서버 소켓의 주소 설정
-    if (bind(ssock, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0){
-        perror("bind()");
+    // 백그라운드 로그 스레드는 데몬화한 프로세스에서 시작
+    if (log_start() < 0 || store_start() < 0) {
         return -1;
     }
+    log_msg(LOG_NOTICE, "채팅 서버 데몬이 시작되었습니다.");
+    // 실패해도 서버는 계속 동작 (무중단 재시작이면 이전 서버가 통계 소켓을 닫은 뒤에)
+    const char *mode_name = mode == MODE_FORK ? "fork" : (mode == MODE_EPOLL ? "epoll" : "threads");
+    if (!takeover) {
+        metrics_serve(admin_path, mode_name);
+    }
 
-    // 동시에 접속하는 클라이언트의 처리를 위한 대기 큐를 설정(최대 10개 접속)
-    if (listen(ssock, MAX_CLIENTS) < 0){
-        perror("listen()");
+    int ssock; // 서버 소켓 디스크립터  
+
+    // 서버 소켓 생성 (재접속이 몰려도 연결이 버려지지 않도록 대기 큐는 시스템 최대값으로 설정)
+    // 무중단 재시작이면 이전 서버의 소켓을 그대로 쓰므로 accept 대기열에 있던 연결도 이어받는다.
+    ssock = takeover ? handoff.listen_fds[0] : open_listen_socket(SOMAXCONN, mode == MODE_THREADS);
+    if (ssock < 0) {
         return -1;
     }
 
-    // printf 대신 syslog 사용
-    syslog(LOG_NOTICE, "서버가 시작되었습니다. 포트 %d", TCP_PORT);
+    // printf 대신 로그 링 버퍼 사용
+    log_msg(LOG_NOTICE, "서버가 시작되었습니다. 포트 %d", config.port);
 
-    // 무한 루프를 사용하여 클라이언트 연결 처리
-    while (1) {
-        clen = sizeof(cliaddr);  // 클라이언트 주소 길이 초기화
-        int csock = accept(ssock, (struct sockaddr *)&cliaddr, &clen);  // 클라이언트 연결 accept
-        if (csock < 0) {
-            perror("accept()");
-            continue;
+    // 이벤트 루프 모드는 자식 프로세스 없이 하나의 루프(멀티코어 모드는 코어마다 하나)에서 모든 클라이언트를 처리
+    if (mode != MODE_FORK) {
+        if (reactor_init(ssock, mode == MODE_THREADS ? nthreads : 1, takeover ? &handoff : NULL) < 0 ||
+            (takeover && handoff_finish(&handoff) < 0)) {
+            log_sync();    // 종료하기 전에 실패 이유를 로그 파일에 남김
+            return -1;
         }
-
-        if (client_count >= MAX_CLIENTS) {   // 접속 클라이언트 수가 최대 클라이언트 수에 도달했을 때
-            printf("최대 클라이언트 수에 도달했습니다. 연결을 거부합니다.\n");
-            close(csock);
-            continue;
+        if (takeover) {
+            metrics_serve(admin_path, mode_name);
         }
+        int ret = reactor_run(takeover ? &handoff : NULL);
+        close(ssock);
+        closelog();
+        return ret;
+    }
 
-        // 자식 프로세스 생성
-        if ((pid = fork()) < 0) {
-            perror("fork()");
-        } else if (pid == 0) {    // 자식 프로세스
-            close(ssock);    // 서버 소켓 닫기
-            close(pipe_fd[0]); // 파이프 읽기 닫기
-
-            // 로그인 정보 수신
-            struct LoginInfo login;
-            if (recv(csock, &login, sizeof(login), 0) <= 0) {
-                perror("로그인 정보 수신 실패");
-                exit(1);
-            }
-
-            // 패스워드와 관계 없이 무조건 로그인 성공
-            strcpy(mesg, "로그인 성공");
+    // 자식 프로세스와 공유할 링 버퍼 생성 (fork() 전에 만들어야 공유됨)
+    if ((ipc_ring = ipc_ring_create()) == NULL) {
+        perror("ipc_ring_create()");
+        return -1;
+    }
+    // 다른 서버에서 중계된 메시지는 중계 스레드가 자식 프로세스처럼 링 버퍼로 메인 루프에 넘김
+    if (relay_start(config.relay_port, config.node_id, fork_relay_deliver) < 0) {
+        return -1;
+    }
 
-            // 인증 결과 전송
-            if (send(csock, mesg, strlen(mesg) + 1, 0) <= 0) {  // +1을 추가하여 null 종료 문자 포함
-                perror("인증 결과 전송 실패");
-                exit(1);
-            }
+    // 자식 프로세스 종료 시그널을 signalfd로 받아 메인 루프에서 처리
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    int sigfd;
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0 || (sigfd = signalfd(-1, &mask, SFD_NONBLOCK)) < 0) {
+        perror("signalfd()");
+        return -1;
+    }
+    conn_table_init(&clients, sizeof(struct ForkClient));
+    room_index_init(&rooms, offsetof(struct ForkClient, room));
+    timer_wheel_init(&logins, metric_now_us() / 1000);
+    signal(SIGPIPE, SIG_IGN);    // sendfile()에는 MSG_NOSIGNAL이 없으므로 파일을 받던 클라이언트가 끊겨도 종료되지 않도록
 
-            // printf 대신 syslog 사용
-            syslog(LOG_NOTICE, "사용자 '%s' 로그인 성공", login.id);
-
-            // 클라이언트로부터 메시지를 받아 모든 클라이언트에게 브로드캐스트하는 루프
-            while (1) {
-                struct Message msg;
-                memset(&msg, 0, sizeof(msg));
-                // 클라이언트로부터 메시지 읽기
-                n = recv(csock, &msg, sizeof(msg), 0);  // 클라이언트로부터 메시지 수신
-                if (n <= 0) {
-                    if (n < 0 && errno == EINTR) continue;    // 수신 실패 시 다시 시도
-                    perror("클라이언트로부터 recv() 실패");
-                    break;
-                }
-                // printf 대신 syslog 사용
-                syslog(LOG_NOTICE, "클라이언트로부터 받은 메시지: %s: %s", msg.id, msg.content);
-
-                // 파이프를 통해 부모 프로세스에게 메시지 전달
-                write(pipe_fd[1], &msg, sizeof(msg));  // 파이프에 메시지 쓰기
-                kill(getppid(), SIGUSR1);  // getppid()를 사용하여 부모 프로세스에게 시그널 전달
-
-                // 클라이언트가 '/q'를 보내면 종료 (클라이언트가 종료되면 클라이언트 소켓이 닫히고, 클라이언트 프로세스 ID가 -1로 설정됨)
-                if (strcmp(msg.content, "q") == 0) {
-                    // printf 대신 syslog 사용
-                    syslog(LOG_NOTICE, "클라이언트 %s 종료", msg.id);
-                    break;
-                }
-            }
+    // 로그인 전 연결은 부모 프로세스가 비차단으로 읽으므로 서버 소켓도 비차단으로 (accept를 EAGAIN까지 반복)
+    if (set_nonblocking(ssock) < 0 || (client_epfd = epoll_create1(0)) < 0) {
+        perror("epoll_create1()");
+        return -1;
+    }
 
-            close(pipe_fd[1]);
-            close(csock);
-            exit(0);
-        } else {
-            // 부모 프로세스
-            client_sockets[client_count] = csock;  // 클라이언트 소켓을 배열에 저장
-            client_pids[client_count] = pid;  // 클라이언트 프로세스 ID를 배열에 저장
-            client_count++;  // 클라이언트 수 증가
-            
-            // 새로운 클라이언트를 받으면 클라이언트의 IP 주소를 문자열로 변환
-            inet_ntop(AF_INET, &cliaddr.sin_addr, mesg, BUFSIZ);
-            // printf 대신 syslog 사용
-            syslog(LOG_NOTICE, "클라이언트 연결됨: %s", mesg);  // 연결된 클라이언트의 IP 주소 출력
+    // 무한 루프를 사용하여 새 연결, 로그인 정보, 자식 프로세스가 보낸 메시지, 자식 프로세스 종료를 처리
+    struct pollfd fds[4];
+    fds[0].fd = ssock;
+    fds[0].events = POLLIN;
+    fds[1].fd = ipc_ring->doorbell;
+    fds[1].events = POLLIN;
+    fds[2].fd = sigfd;
+    fds[2].events = POLLIN;
+    fds[3].fd = client_epfd;
+    fds[3].events = POLLIN;
+    while (1) {
+        // 처리할 레코드가 없을 때만 기다림 (모아 둔 메시지나 로그인 기한이 있으면 그때까지만)
+        int timeout = 0;
+        if (ipc_ring_prepare_wait(ipc_ring)) {
+            timeout = timer_min_timeout(flush_timeout(), timer_timeout(&logins, metric_now_us() / 1000));
+        }
+        int ready = poll(fds, 4, timeout);
+        ipc_ring_finish_wait(ipc_ring);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll()");
+        }
+        drain_ipc_ring();
+        if (flush_timeout() == 0) {    // 링 버퍼를 한 번 비우는 동안 쌓인 메시지를 모아서 전송
+            flush_clients();
+        }
+        if (ready > 0 && (fds[2].revents & POLLIN)) {
+            reap_children(sigfd);
+        }
+        if (ready > 0 && (fds[3].revents & POLLIN)) {
+            handle_client_events(ssock, sigfd);
+        }
+        timer_expire(&logins, metric_now_us() / 1000, login_expired, NULL);    // 로그인하지 않고 버티는 연결 정리
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            accept_clients(ssock);
         }
     }
 
-    close(pipe_fd[0]);
-    close(pipe_fd[1]);
     close(ssock);
     closelog();
     return 0;
@@ -0,0 +1,123 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "protocol.h"
+#include "buffer.h"
+#include "conn.h"
+#include "room.h"
+#include "log.h"
+#include "store.h"
+#include "replay.h"
+#include "metrics.h"
+#include "timer.h"
+#include "spool.h"
+#include "ratelimit.h"
+#include "relay.h"
+#include "handoff.h"
+
+#define DEFAULT_MAX_CLIENTS 100000  // 기본 최대 클라이언트 수 (-c 옵션으로 변경)
+#define MAX_EVENTS 1024         // epoll_wait 한 번에 처리하는 최대 이벤트 수
+#define NOTICE_ID "*"           // 서버가 보내는 안내 메시지의 보낸 사람 아이디
+#define HISTORY_DEFAULT 20      // /history에 개수를 적지 않았을 때 보내는 메시지 수
+#define ACCEPT_BATCH 64         // fork 모드에서 poll 한 번에 accept하는 최대 연결 수
+
+// 서버 동작 모드
+enum ServerMode {
+    MODE_FORK,   // 클라이언트마다 자식 프로세스를 생성하는 기존 방식
+    MODE_EPOLL,  // 단일 프로세스 epoll 이벤트 루프
+    MODE_THREADS // 코어마다 reactor 스레드를 하나씩 실행하는 멀티코어 모드
+};
+
+// 연결이 사용하는 프로토콜 (로그인 시 첫 바이트로 판별)
+enum Proto {
+    PROTO_UNKNOWN,  // 아직 첫 데이터를 받지 않음
+    PROTO_LEGACY,   // 고정 크기 struct LoginInfo / struct Message
+    PROTO_FRAME     // 가변 길이 프레임
+};
+
+// 송신 대기열이 상한을 넘은 느린 클라이언트 처리 방식
+enum SlowPolicy {
+    SLOW_DROP,      // 대기열이 줄어들 때까지 새 메시지를 버림
+    SLOW_CLOSE      // 연결 종료
+};
+
+// 클라이언트가 허용된 속도보다 빨리 보낼 때 처리 방식
+enum RateAction {
+    RATE_DROP,      // 토큰이 다시 찰 때까지 채팅 메시지를 버림
+    RATE_DELAY,     // 받은 메시지는 처리하고 토큰이 다시 찰 때까지 그 연결을 읽지 않음 (TCP 흐름 제어로 보내는 쪽이 멈춤)
+    RATE_CLOSE      // 연결 종료
+};
+
+// 브로드캐스트 메시지를 소켓에 쓰는 방식
+enum FlushPolicy {
+    FLUSH_LATENCY,  // TCP_NODELAY를 켜고 메시지마다 바로 전송
+    FLUSH_BATCH     // 이벤트 루프 한 바퀴(또는 flush_window_ms) 동안 연결마다 모아서 한 번에 전송
+};
+
+// 이벤트 루프 모드의 입출력 방식
+enum IoBackend {
+    IO_EPOLL,       // epoll + 비차단 recv/sendmsg
+    IO_URING        // io_uring (multishot accept/recv, 송신 요청을 모아서 제출), 지원하지 않는 커널에서는 epoll
+};
+
+// 실행 옵션으로 정하는 서버 설정
+struct ServerConfig {
+    int max_clients;        // 최대 동시 접속 클라이언트 수
+    size_t out_hwm;         // 연결별 송신 대기열 상한(바이트)
+    int slow_policy;        // 상한을 넘었을 때 처리 방식 (enum SlowPolicy)
+    size_t replay_count;    // 로그인한 클라이언트에게 보내는 최근 메시지 수 (0이면 보내지 않음)
+    size_t replay_bytes;    // 방마다 최근 메시지를 보관하는 최대 바이트 수
+    int flush_policy;       // 브로드캐스트 전송 방식 (enum FlushPolicy)
+    int flush_window_ms;    // FLUSH_BATCH에서 모아 두는 최대 시간 (0이면 이벤트 루프 한 바퀴)
+    int io_backend;         // 이벤트 루프 모드의 입출력 방식 (enum IoBackend)
+    int login_timeout_ms;   // 접속한 뒤 로그인을 마쳐야 하는 시간 (지나면 연결을 끊음)
+    uint32_t rate_msgs;     // 연결마다 초당 보낼 수 있는 채팅 메시지 수 (0이면 제한하지 않음)
+    uint32_t rate_bytes;    // 연결마다 초당 보낼 수 있는 바이트 수 (채팅과 파일 조각, 0이면 제한하지 않음)
+    int rate_action;        // 제한을 넘었을 때 처리 방식 (enum RateAction)
+    int port;               // 클라이언트 접속을 받는 포트 (같은 컴퓨터에서 여러 서버를 띄울 때 -p로 바꿈)
+    int relay_port;         // 다른 서버의 중계 연결을 받는 포트 (0이면 받지 않음)
+    uint32_t node_id;       // 중계에 쓰는 이 서버 번호 (0이면 시작할 때 정함)
+    const char *handoff_path;   // 무중단 재시작 소켓 경로 (이벤트 루프 모드, 데몬화 후 열리므로 절대 경로)
+};
+
+extern struct ServerConfig config;
+
+// 수신 버퍼에서 꺼낸 로그인, 채팅 또는 파일 조각 레코드
+struct Record {
+    int type;               // FRAME_LOGIN / FRAME_CHAT / FRAME_FILE_PUT (그 외 프레임은 무시)
+    int flags;              // 프레임 flags (FRAME_FILE_PUT의 FRAME_FLAG_LAST)
+    char id[MAX_ID_LEN];    // 로그인 아이디 (FRAME_LOGIN)
+    const char *name;       // 파일 이름 (FRAME_FILE_PUT, null 종료되지 않음)
+    size_t name_len;
+    const char *text;       // 채팅 메시지 내용 또는 파일 조각 (null 종료되지 않음)
+    size_t len;             // 채팅 메시지 또는 파일 조각 길이
+};
+
+// server.c
+int read_record(struct FrameReader *r, int *proto, int logged_in, struct Record *rec);
+size_t encode_login_reply(char *out, int proto);
+size_t encode_login_fail(char *out, int proto, const char *reason);
+size_t encode_chat(char *out, int proto, const char *id, const char *text, size_t len);
+struct SharedBuf *make_login_reply(int proto);
+struct SharedBuf *make_chat_frame(const char *id, const char *text, size_t len);
+struct SharedBuf *make_legacy_chat(const struct SharedBuf *frame);
+int handle_room_command(struct RoomIndex *idx, void *obj, const char *text, size_t len, char *reply, size_t *reply_len);
+int parse_history_command(const char *text, size_t len);
+size_t queue_replay(struct OutQueue *q, int proto, uint32_t room);
+size_t history_record(const struct StoreRecord *rec, char *id);
+int parse_get_command(const char *text, size_t len);
+struct SpoolSend *open_download(int num, int proto, int busy, char *reply, size_t *reply_len);
+void commit_upload(const char *tmp, const char *name, char *reply, size_t *reply_len, char *announce, size_t *announce_len);
+int rate_check(struct RateLimit *r, const struct Record *rec, const char *id, uint64_t now_us, uint64_t *delay_us);
+int parse_whisper_command(const char *text, size_t len, char *to, const char **body, size_t *body_len);
+void format_whisper(const char *to, int online, const char *body, size_t body_len,
+                    char *text, size_t *text_len, char *reply, size_t *reply_len);
+int set_nonblocking(int fd);
+int bind_listen_socket(int reuseport);
+int open_listen_socket(int backlog, int reuseport);
+
+// reactor.c
+int reactor_init(int ssock, int nshards, struct Handoff *takeover);
+int reactor_run(struct Handoff *takeover);
+
+#endif
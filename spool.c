@@ -0,0 +1,297 @@
+// ---------------------------------------------------------------------------
+// 파일 공유 스풀
+//
+// 올리는 파일은 조각을 받는 대로 스풀 디렉토리의 임시 파일(tmp-<pid>-<순번>)에 이어 쓰고,
+// 마지막 조각을 받으면 번호를 붙여 <번호>.file로 이름을 바꾼다. 파일 목록은 메모리에만
+// 두므로 서버를 다시 시작하면 이전 파일은 지운다. 무중단 재시작(-u)에서는 이전 프로세스의
+// 목록을 넘겨받고 파일을 그대로 둔다.
+//
+// 내려받기는 SPOOL_CHUNK 크기의 FRAME_FILE_DATA 프레임으로 나누어, 헤더만 send()로 쓰고
+// 내용은 sendfile()로 페이지 캐시에서 소켓으로 바로 보낸다. 조각 사이에는 채팅 메시지를
+// 끼워 보낼 수 있으므로 큰 파일을 받는 중에도 같은 연결의 채팅이 밀리지 않는다.
+// ---------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "spool.h"
+#include "log.h"
+#include "metrics.h"
+
+// 스풀에 등록된 파일
+struct SpoolFile {
+    int num;                    // 파일 번호 (0이면 빈 칸)
+    uint64_t size;
+    char name[SPOOL_NAME_MAX];
+};
+
+static struct {
+    pthread_mutex_t lock;       // 파일 목록을 보호 (멀티코어 모드에서는 여러 샤드가 함께 씀)
+    int dirfd;                  // 스풀 디렉토리 (-1이면 파일 공유를 하지 않음)
+    int next;                   // 다음에 붙일 파일 번호
+    struct SpoolFile files[SPOOL_MAX_FILES];    // 번호 % SPOOL_MAX_FILES 칸 (새 파일이 가장 오래된 파일 자리를 씀)
+} spool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .dirfd = -1,
+    .next = 1,
+};
+
+static atomic_uint tmp_seq;     // 임시 파일 이름 순번
+
+// 스풀 디렉토리를 열고 이전 실행에서 남은 파일을 지움 (작업 디렉토리가 바뀌기 전에 호출)
+// keep이면 지우지 않음 (무중단 재시작에서 이전 프로세스의 파일 목록을 spool_import로 이어받을 때)
+int spool_open(const char *dir, int keep) {
+    mkdir(dir, 0755);
+    spool.dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (spool.dirfd < 0) {
+        perror("open(spool)");
+        return -1;
+    }
+    if (keep) return 0;
+
+    DIR *d = fdopendir(dup(spool.dirfd));
+    if (d == NULL) {
+        perror("opendir(spool)");
+        return -1;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t n = strlen(de->d_name);
+        if (strncmp(de->d_name, "tmp-", 4) == 0 || (n > 5 && strcmp(de->d_name + n - 5, ".file") == 0)) {
+            unlinkat(spool.dirfd, de->d_name, 0);
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+int spool_enabled(void) {
+    return spool.dirfd >= 0;
+}
+
+// 파일 목록을 복사해 반환 (무중단 재시작에서 새 프로세스에 넘김, 호출한 쪽이 free)
+size_t spool_export(void **out) {
+    size_t len = sizeof(spool.next) + sizeof(spool.files);
+    char *buf = malloc(len);
+    *out = buf;
+    if (buf == NULL) return 0;
+    pthread_mutex_lock(&spool.lock);
+    memcpy(buf, &spool.next, sizeof(spool.next));
+    memcpy(buf + sizeof(spool.next), spool.files, sizeof(spool.files));
+    pthread_mutex_unlock(&spool.lock);
+    return len;
+}
+
+// 이전 프로세스의 파일 목록을 이어받음 (형식이 다르면 무시하고 빈 목록으로 시작)
+void spool_import(const void *data, size_t len) {
+    if (len != sizeof(spool.next) + sizeof(spool.files)) return;
+    memcpy(&spool.next, data, sizeof(spool.next));
+    memcpy(spool.files, (const char *)data + sizeof(spool.next), sizeof(spool.files));
+}
+
+// 임시 파일을 지우고 실패로 표시
+static void spool_upload_abort(struct SpoolUpload *u) {
+    if (u->fd >= 0) {
+        close(u->fd);
+        unlinkat(spool.dirfd, u->tmp, 0);
+        u->fd = -1;
+    }
+    u->failed = 1;
+}
+
+// 파일 올리기 시작 (메모리가 없을 때만 NULL, 파일 공유가 꺼져 있으면 실패로 표시된 상태를 반환)
+// 이후 조각은 spool_upload_write로 이어 쓰고 마지막 조각 뒤에 spool_upload_end를 호출한다.
+struct SpoolUpload *spool_upload_start(const char *name, size_t name_len) {
+    struct SpoolUpload *u = calloc(1, sizeof(*u));
+    if (u == NULL) return NULL;
+    u->fd = -1;
+
+    if (name_len >= SPOOL_NAME_MAX) name_len = SPOOL_NAME_MAX - 1;
+    for (size_t i = 0; i < name_len; i++) {
+        unsigned char ch = name[i];
+        u->name[i] = (ch == '/' || ch < 0x20 || ch == 0x7F) ? '_' : (char)ch;
+    }
+    if (u->name[0] == '\0' || strcmp(u->name, ".") == 0 || strcmp(u->name, "..") == 0) {
+        strcpy(u->name, "file");
+    }
+
+    if (spool.dirfd < 0) {
+        u->failed = 1;
+        return u;
+    }
+    snprintf(u->tmp, sizeof(u->tmp), "tmp-%d-%u", (int)getpid(), atomic_fetch_add(&tmp_seq, 1));
+    u->fd = openat(spool.dirfd, u->tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (u->fd < 0) {
+        log_msg(LOG_ERR, "스풀 임시 파일을 만들 수 없습니다: %m");
+        u->failed = 1;
+    }
+    return u;
+}
+
+// 받은 조각을 임시 파일에 이어 씀 (크기 제한을 넘거나 쓰기에 실패하면 -1, 이후 조각은 무시됨)
+int spool_upload_write(struct SpoolUpload *u, const void *data, size_t len) {
+    if (u->failed) return -1;
+    if (u->size + len > SPOOL_MAX_SIZE) {
+        spool_upload_abort(u);
+        return -1;
+    }
+    const char *p = data;
+    size_t left = len;
+    while (left > 0) {
+        ssize_t n = write(u->fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            log_msg(LOG_ERR, "스풀 파일 쓰기 실패: %m");
+            spool_upload_abort(u);
+            return -1;
+        }
+        p += n;
+        left -= n;
+    }
+    u->size += len;
+    return 0;
+}
+
+// 마지막 조각까지 받았으면 임시 파일을 닫음 (실패한 올리기면 -1, 임시 파일은 지워져 있음)
+// 임시 파일은 spool_commit으로 등록하거나 spool_commit이 실패하면 지워진다.
+int spool_upload_end(struct SpoolUpload *u) {
+    if (u->failed) {
+        spool_upload_abort(u);
+        return -1;
+    }
+    close(u->fd);
+    u->fd = -1;
+    return 0;
+}
+
+// 올리기 상태 해제 (끝나지 않은 올리기는 임시 파일을 지움)
+void spool_upload_free(struct SpoolUpload *u) {
+    if (u == NULL) return;
+    spool_upload_abort(u);
+    free(u);
+}
+
+// 다 받은 임시 파일에 번호를 붙여 등록하고 번호를 반환 (실패 시 -1, 임시 파일은 지움)
+// 목록이 가득 차면 가장 오래된 파일을 지운다. 그 파일을 받는 중인 연결은 열어 둔 디스크립터로 끝까지 받는다.
+int spool_commit(const char *tmp, const char *name, uint64_t *size) {
+    struct stat st;
+    char path[32];
+
+    if (spool.dirfd < 0) return -1;
+    if (fstatat(spool.dirfd, tmp, &st, 0) < 0) {
+        unlinkat(spool.dirfd, tmp, 0);
+        return -1;
+    }
+
+    pthread_mutex_lock(&spool.lock);
+    int num = spool.next++;
+    struct SpoolFile *f = &spool.files[num % SPOOL_MAX_FILES];
+    if (f->num != 0) {
+        snprintf(path, sizeof(path), "%d.file", f->num);
+        unlinkat(spool.dirfd, path, 0);
+        f->num = 0;
+    }
+    snprintf(path, sizeof(path), "%d.file", num);
+    if (renameat(spool.dirfd, tmp, spool.dirfd, path) < 0) {
+        pthread_mutex_unlock(&spool.lock);
+        unlinkat(spool.dirfd, tmp, 0);
+        return -1;
+    }
+    f->num = num;
+    f->size = (uint64_t)st.st_size;
+    snprintf(f->name, sizeof(f->name), "%s", name);
+    pthread_mutex_unlock(&spool.lock);
+
+    *size = (uint64_t)st.st_size;
+    return num;
+}
+
+// 등록하지 않을 임시 파일을 지움 (다 올린 사람이 등록 전에 접속을 끊은 경우)
+void spool_discard(const char *tmp) {
+    if (spool.dirfd >= 0) unlinkat(spool.dirfd, tmp, 0);
+}
+
+// 번호로 파일을 열어 내려보낼 준비 (없는 번호면 NULL)
+struct SpoolSend *spool_send_open(int num) {
+    char path[32];
+
+    if (spool.dirfd < 0 || num <= 0) return NULL;
+    struct SpoolSend *s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+
+    pthread_mutex_lock(&spool.lock);
+    struct SpoolFile *f = &spool.files[num % SPOOL_MAX_FILES];
+    if (f->num != num) {
+        pthread_mutex_unlock(&spool.lock);
+        free(s);
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%d.file", num);
+    s->fd = openat(spool.dirfd, path, O_RDONLY | O_CLOEXEC);
+    s->size = f->size;
+    memcpy(s->name, f->name, sizeof(s->name));
+    pthread_mutex_unlock(&spool.lock);
+
+    if (s->fd < 0) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// 보내던 조각을 마저 보내고 새 조각을 chunks개까지 보냄 (enum SpoolSendResult, 오류 시 -1)
+// 비차단 소켓이면 송신 버퍼가 가득 찰 때 SPOOL_BLOCKED로 돌아오며, 다시 호출하면 멈춘 곳부터 이어서 보낸다.
+int spool_send(struct SpoolSend *s, int sock, int chunks) {
+    while (1) {
+        if (!spool_send_busy(s)) {
+            if (s->last) return SPOOL_DONE;
+            if (chunks-- <= 0) return SPOOL_YIELD;
+            uint64_t left = s->size - s->offset;
+            s->chunk_left = left < SPOOL_CHUNK ? (size_t)left : SPOOL_CHUNK;
+            s->last = (s->offset + s->chunk_left == s->size);
+            s->hdr_len = frame_encode_header(s->hdr, FRAME_FILE_DATA, s->last ? FRAME_FLAG_LAST : 0,
+                                             s->name, strlen(s->name), s->chunk_left);
+            s->hdr_sent = 0;
+        }
+
+        ssize_t n;
+        if (s->hdr_sent < s->hdr_len) {    // 내용이 이어진다는 것을 알려 헤더가 따로 나가지 않게 함
+            n = send(sock, s->hdr + s->hdr_sent, s->hdr_len - s->hdr_sent,
+                     MSG_NOSIGNAL | (s->chunk_left > 0 ? MSG_MORE : 0));
+        } else {
+            off_t off = (off_t)s->offset;
+            n = sendfile(sock, s->fd, &off, s->chunk_left);
+            if (n == 0) return -1;    // 파일이 그 사이 줄어듦
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SPOOL_BLOCKED;
+            return -1;
+        }
+        metric_add(MC_SEND_CALLS, 1);
+        metric_add(MC_BYTES_OUT, n);
+        if (s->hdr_sent < s->hdr_len) {
+            s->hdr_sent += n;
+        } else {
+            s->offset += n;
+            s->chunk_left -= n;
+            metric_add(MC_FILE_BYTES_OUT, n);
+        }
+    }
+}
+
+void spool_send_close(struct SpoolSend *s) {
+    if (s == NULL) return;
+    close(s->fd);
+    free(s);
+}
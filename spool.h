@@ -0,0 +1,67 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+#define SPOOL_MAX_FILES 256                     // 보관하는 파일 수 (넘으면 가장 오래된 파일부터 지움)
+#define SPOOL_MAX_SIZE (256ULL * 1024 * 1024)   // 올릴 수 있는 파일 하나의 최대 크기
+#define SPOOL_NAME_MAX 128                      // 파일 이름 최대 길이 (null 종료 문자 포함)
+#define SPOOL_CHUNK (32 * 1024)                 // 내려보내는 프레임 하나에 담는 파일 내용 크기
+#define SPOOL_BURST 4                           // 이벤트 루프 한 바퀴에 연결 하나에게 보내는 최대 조각 수
+
+// 올리는 중인 파일 (받은 조각을 스풀 디렉토리의 임시 파일에 이어 씀)
+struct SpoolUpload {
+    int fd;                     // 임시 파일 (-1이면 실패했거나 닫음)
+    int failed;                 // 이름이 잘못되었거나 크기 제한을 넘었거나 쓰기에 실패함
+    uint64_t size;              // 받은 크기
+    char name[SPOOL_NAME_MAX];  // 파일 이름 (경로 구분자와 제어 문자는 '_'로 바꿈)
+    char tmp[32];               // 스풀 디렉토리 안의 임시 파일 이름
+};
+
+// 내려보내는 중인 파일
+// 파일 내용은 FRAME_FILE_DATA 프레임으로 나누어 보내며, 헤더만 send()로 쓰고 내용은 sendfile()로
+// 페이지 캐시에서 소켓으로 바로 보내 사용자 공간으로 복사하지 않는다.
+struct SpoolSend {
+    int fd;                     // 스풀 파일
+    uint64_t offset;            // 다음에 보낼 위치
+    uint64_t size;              // 파일 크기
+    int last;                   // 마지막 조각의 헤더를 만들었는지 여부
+    size_t chunk_left;          // 보내는 중인 조각에서 남은 내용 바이트
+    size_t hdr_len;             // 보내는 중인 조각의 헤더 길이
+    size_t hdr_sent;            // 그중 보낸 바이트
+    char hdr[FRAME_HEADER_LEN + SPOOL_NAME_MAX];
+    char name[SPOOL_NAME_MAX];
+};
+
+// spool_send 결과 (-1은 오류)
+enum SpoolSendResult {
+    SPOOL_BLOCKED,              // 소켓 송신 버퍼가 가득 참 (쓰기 가능해지면 이어서)
+    SPOOL_DONE,                 // 파일을 모두 보냄
+    SPOOL_YIELD                 // 정한 조각 수를 다 보냄 (다음 바퀴에 이어서)
+};
+
+int spool_open(const char *dir, int keep);
+int spool_enabled(void);
+size_t spool_export(void **out);
+void spool_import(const void *data, size_t len);
+
+struct SpoolUpload *spool_upload_start(const char *name, size_t name_len);
+int spool_upload_write(struct SpoolUpload *u, const void *data, size_t len);
+int spool_upload_end(struct SpoolUpload *u);
+void spool_upload_free(struct SpoolUpload *u);
+int spool_commit(const char *tmp, const char *name, uint64_t *size);
+void spool_discard(const char *tmp);
+
+struct SpoolSend *spool_send_open(int num);
+int spool_send(struct SpoolSend *s, int sock, int chunks);
+void spool_send_close(struct SpoolSend *s);
+
+// 조각 하나를 보내는 도중인지 여부 (이때 다른 프레임을 쓰면 스트림이 깨짐)
+static inline int spool_send_busy(const struct SpoolSend *s) {
+    return s->hdr_sent < s->hdr_len || s->chunk_left > 0;
+}
+
+#endif
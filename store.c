@@ -0,0 +1,588 @@
+// ---------------------------------------------------------------------------
+// 메시지 저장소 (append-only 세그먼트 로그)
+//
+// 브로드캐스트한 메시지를 순번과 시각을 붙여 세그먼트 파일 끝에 이어 쓴다.
+// 세그먼트 파일(<첫 순번>.seg)은 미리 STORE_SEGMENT_SIZE로 늘려 mmap해 두고 memcpy로 쓰며,
+// 가득 차면 새 세그먼트를 만든다. 메시지 STORE_INDEX_INTERVAL개마다 (순번, 위치)를
+// 색인 파일(<첫 순번>.idx)에 남겨, 순번 S부터 읽을 때는 세그먼트와 색인을 이진 탐색한 뒤
+// 그 위치부터 순서대로만 읽으면 된다.
+//
+// 추가할 때는 디스크에 쓰지 않고, 백그라운드 스레드가 STORE_SYNC_MS마다 그동안 쓴 범위를
+// 한꺼번에 msync한다. (서버가 비정상 종료되면 마지막 주기의 메시지는 잃을 수 있다.)
+//
+// 메시지마다 같은 방의 이전 메시지 위치를 붙이고 방마다 마지막 메시지 위치를 메모리에 두어,
+// 방의 마지막 메시지 N개는 그 방의 메시지만 N번 따라가 읽는다. 방의 첫 메시지에는 STORE_ENTRY_FIRST를
+// 붙여 거기서 끝나고, 재시작하면 모든 세그먼트를 한 번 읽어 방마다 마지막 위치를 다시 만든다.
+// 이전 메시지 위치를 붙이기 전에 쓴 메시지에 닿았을 때만 STORE_SCAN_MAX개까지 거슬러 훑는다.
+// ---------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "store.h"
+#include "log.h"
+#include "metrics.h"
+
+#define STORE_INDEX_CAP (STORE_SEGMENT_SIZE / (sizeof(struct StoreEntry) * STORE_INDEX_INTERVAL) + 1)
+#define STORE_INDEX_SIZE (STORE_INDEX_CAP * sizeof(struct StoreIndexEntry))
+
+// 방 이름 -> 그 방의 마지막 메시지 위치 (open addressing, 선형 탐사, 지우지 않음)
+// 이름은 따로 두지 않고 가리키는 메시지의 방 이름과 비교한다.
+struct RoomHead {
+    uint64_t hash;          // 0이면 빈 칸
+    uint64_t seq;
+    uint32_t seg;           // store.segs 안의 번호
+    uint32_t offset;
+};
+
+// 세그먼트 하나 (한 번 만들면 닫지 않으므로 주소가 바뀌지 않음)
+struct Segment {
+    uint64_t base;          // 첫 메시지 순번
+    char *map;              // 세그먼트 파일 mmap 영역
+    struct StoreIndexEntry *index;  // 색인 파일 mmap 영역
+    size_t index_count;     // 색인 항목 수
+    size_t end;             // 사용한 크기
+    uint64_t last;          // 마지막 메시지 순번 (비어 있으면 base - 1)
+};
+
+static struct {
+    pthread_mutex_t lock;   // 추가, 새 세그먼트, 읽기 범위 확인을 보호
+    int dirfd;              // 저장소 디렉토리 (-1이면 저장하지 않음)
+    struct Segment *segs[STORE_MAX_SEGMENTS];
+    size_t seg_count;
+    uint64_t next_seq;      // 다음에 붙일 순번
+    struct RoomHead *heads; // 방마다 마지막 메시지 위치
+    size_t head_cap;        // 칸 수 (2의 거듭제곱)
+    size_t head_count;      // 사용 중인 칸 수
+    int heads_complete;     // 모든 방의 마지막 위치가 표에 있는지 (표를 늘리지 못하면 0)
+} store = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .dirfd = -1,
+    .next_seq = 1,
+    .heads_complete = 1,
+};
+
+static size_t entry_size(int flags, size_t room_len, size_t id_len, size_t len) {
+    size_t link = (flags & STORE_ENTRY_PREV) ? sizeof(struct StoreIndexEntry) : 0;
+    return (sizeof(struct StoreEntry) + link + room_len + id_len + len + 7) & ~(size_t)7;
+}
+
+// 헤더 뒤의 방 이름 (같은 방의 이전 메시지 위치가 있으면 그 뒤)
+static const char *entry_room(const struct StoreEntry *e) {
+    return (const char *)(e + 1) + ((e->flags & STORE_ENTRY_PREV) ? sizeof(struct StoreIndexEntry) : 0);
+}
+
+static void entry_record(const struct StoreEntry *e, struct StoreRecord *rec) {
+    rec->seq = e->seq;
+    rec->ts = e->ts;
+    rec->room = entry_room(e);
+    rec->room_len = e->room_len;
+    rec->id = rec->room + e->room_len;
+    rec->id_len = e->id_len;
+    rec->text = rec->id + e->id_len;
+    rec->len = e->len;
+}
+
+// FNV-1a (0은 빈 칸 표시이므로 쓰지 않음)
+static uint64_t room_hash(const char *room, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)room[i]) * 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+// 방의 칸을 찾음 (없으면 그 방이 들어갈 빈 칸, 표가 있을 때만 호출)
+static struct RoomHead *head_slot(const char *room, size_t len, uint64_t hash) {
+    size_t mask = store.head_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        struct RoomHead *h = &store.heads[i];
+        if (h->hash == 0) return h;
+        if (h->hash == hash) {
+            const struct StoreEntry *e = (const void *)(store.segs[h->seg]->map + h->offset);
+            if (e->room_len == len && memcmp(entry_room(e), room, len) == 0) return h;
+        }
+    }
+}
+
+static int head_grow(void) {
+    size_t cap = store.head_cap ? store.head_cap * 2 : 64;
+    struct RoomHead *heads = calloc(cap, sizeof(struct RoomHead));
+    if (heads == NULL) return -1;
+    for (size_t i = 0; i < store.head_cap; i++) {
+        if (store.heads[i].hash == 0) continue;
+        size_t j = store.heads[i].hash & (cap - 1);
+        while (heads[j].hash != 0) j = (j + 1) & (cap - 1);
+        heads[j] = store.heads[i];
+    }
+    free(store.heads);
+    store.heads = heads;
+    store.head_cap = cap;
+    return 0;
+}
+
+// 방의 마지막 메시지 칸 (표를 늘리지 못하면 NULL, lock을 잡은 채로 호출)
+static struct RoomHead *head_get(const char *room, size_t len, uint64_t hash) {
+    if ((store.head_count + 1) * 4 > store.head_cap * 3 && head_grow() < 0) {    // 75% 이상 차면 확장
+        store.heads_complete = 0;    // 이 방은 표에 없으므로 이후로는 표에 없는 방도 훑어서 찾음
+        return NULL;
+    }
+    return head_slot(room, len, hash);
+}
+
+static void head_set(struct RoomHead *h, uint64_t hash, uint64_t seq, size_t seg, size_t offset) {
+    if (h->hash == 0) store.head_count++;
+    h->hash = hash;
+    h->seq = seq;
+    h->seg = (uint32_t)seg;
+    h->offset = (uint32_t)offset;
+}
+
+// 밀리초 단위 현재 시각
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 세그먼트 파일 하나를 크기를 맞춰 열고 mmap (create가 참이면 새로 만듦)
+static void *map_file(const char *name, size_t size, int create) {
+    int fd = openat(store.dirfd, name, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd < 0) {
+        log_msg(LOG_ERR, "저장소 파일 %s 열기 실패: %m", name);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size < size && ftruncate(fd, size) < 0)) {
+        log_msg(LOG_ERR, "저장소 파일 %s 크기 설정 실패: %m", name);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);    // mmap한 뒤에는 디스크립터가 필요 없음
+    if (map == MAP_FAILED) {
+        log_msg(LOG_ERR, "저장소 파일 %s mmap 실패: %m", name);
+        return NULL;
+    }
+    return map;
+}
+
+// 첫 순번이 base인 세그먼트를 열거나 새로 만듦
+static struct Segment *segment_open(uint64_t base, int create) {
+    char name[40];
+    struct Segment *seg = calloc(1, sizeof(struct Segment));
+    if (seg == NULL) return NULL;
+    seg->base = base;
+    seg->last = base - 1;
+
+    snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)base);
+    seg->map = map_file(name, STORE_SEGMENT_SIZE, create);
+    snprintf(name, sizeof(name), "%020llu.idx", (unsigned long long)base);
+    seg->index = seg->map ? map_file(name, STORE_INDEX_SIZE, create) : NULL;
+    if (seg->index == NULL) {
+        if (seg->map) munmap(seg->map, STORE_SEGMENT_SIZE);
+        free(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+// 위치 off에 순번이 seq인 올바른 메시지가 있으면 크기를, 없으면 0을 반환
+static size_t entry_at(const struct Segment *seg, size_t off, uint64_t seq) {
+    if (off + sizeof(struct StoreEntry) > STORE_SEGMENT_SIZE) return 0;
+    const struct StoreEntry *e = (const void *)(seg->map + off);
+    if (e->seq != seq) return 0;
+    size_t size = entry_size(e->flags, e->room_len, e->id_len, e->len);
+    return (off + size <= STORE_SEGMENT_SIZE) ? size : 0;
+}
+
+// 위치 at의 메시지 (세그먼트는 순번으로 찾음, 없으면 NULL)
+static const struct StoreEntry *entry_find(const struct StoreIndexEntry *at, size_t seg_count) {
+    if (seg_count == 0 || at->seq < store.segs[0]->base) return NULL;
+    size_t lo = 0, hi = seg_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (store.segs[mid]->base <= at->seq) lo = mid; else hi = mid;
+    }
+    struct Segment *seg = store.segs[lo];
+    if (entry_at(seg, at->offset, at->seq) == 0) return NULL;
+    return (const void *)(seg->map + at->offset);
+}
+
+// 재시작 시 색인의 마지막 위치부터 훑어 세그먼트의 끝과 색인을 복구
+static void segment_recover(struct Segment *seg) {
+    size_t off = 0;
+    uint64_t seq = seg->base;
+
+    while (seg->index_count < STORE_INDEX_CAP && seg->index[seg->index_count].seq != 0) {
+        seg->index_count++;
+    }
+    // 색인 항목이 가리키는 메시지가 없으면(디스크에 쓰이기 전에 종료) 그 항목부터 버림
+    while (seg->index_count > 0) {
+        struct StoreIndexEntry *ie = &seg->index[seg->index_count - 1];
+        if (entry_at(seg, ie->offset, ie->seq) > 0) {
+            off = ie->offset;
+            seq = ie->seq;
+            break;
+        }
+        memset(ie, 0, sizeof(*ie));
+        seg->index_count--;
+    }
+
+    size_t size;
+    while ((size = entry_at(seg, off, seq)) > 0) {
+        if ((seq - seg->base) % STORE_INDEX_INTERVAL == 0 && seg->index_count < STORE_INDEX_CAP &&
+            (seg->index_count == 0 || seg->index[seg->index_count - 1].seq < seq)) {
+            seg->index[seg->index_count].seq = seq;
+            seg->index[seg->index_count].offset = off;
+            seg->index_count++;
+        }
+        off += size;
+        seq++;
+    }
+    seg->end = off;
+    seg->last = seq - 1;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// 저장소 디렉토리를 열고 기존 세그먼트를 복구 (데몬화로 작업 디렉토리가 바뀌기 전에 호출)
+int store_open(const char *dir) {
+    mkdir(dir, 0755);
+    store.dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (store.dirfd < 0) {
+        perror("open(store)");
+        return -1;
+    }
+
+    // 세그먼트 파일 이름(첫 순번)을 모아 순서대로 정렬
+    DIR *d = fdopendir(dup(store.dirfd));
+    if (d == NULL) {
+        perror("opendir(store)");
+        return -1;
+    }
+    uint64_t bases[STORE_MAX_SEGMENTS];
+    size_t count = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && count < STORE_MAX_SEGMENTS) {
+        size_t n = strlen(de->d_name);
+        if (n > 4 && strcmp(de->d_name + n - 4, ".seg") == 0) {
+            bases[count++] = strtoull(de->d_name, NULL, 10);
+        }
+    }
+    closedir(d);
+    qsort(bases, count, sizeof(uint64_t), compare_u64);
+
+    for (size_t i = 0; i < count; i++) {
+        struct Segment *seg = segment_open(bases[i], 0);
+        if (seg == NULL) {
+            fprintf(stderr, "저장소 세그먼트 %llu를 열 수 없습니다.\n", (unsigned long long)bases[i]);
+            return -1;
+        }
+        segment_recover(seg);
+        store.segs[store.seg_count++] = seg;
+        store.next_seq = seg->last + 1;
+    }
+
+    // 모든 세그먼트를 순서대로 읽어 방마다 마지막 메시지를 찾음
+    // (이후 메시지가 그 뒤로 이어지고, 표에 없는 방은 메시지가 없는 방으로 바로 판단할 수 있도록)
+    for (size_t i = 0; i < store.seg_count; i++) {
+        struct Segment *seg = store.segs[i];
+        size_t off = 0, size;
+        for (uint64_t seq = seg->base; (size = entry_at(seg, off, seq)) > 0; seq++) {
+            const struct StoreEntry *e = (const void *)(seg->map + off);
+            uint64_t hash = room_hash(entry_room(e), e->room_len);
+            struct RoomHead *h = head_get(entry_room(e), e->room_len, hash);
+            if (h != NULL) head_set(h, hash, seq, i, off);
+            off += size;
+        }
+    }
+    return 0;
+}
+
+int store_enabled(void) {
+    return store.dirfd >= 0;
+}
+
+// 메시지를 저장하고 순번을 반환 (저장하지 않으면 0)
+// 메모리에만 쓰고 디스크 동기화는 백그라운드 스레드가 모아서 한다.
+uint64_t store_append(const char *room, const char *id, const char *text, size_t len) {
+    if (store.dirfd < 0) return 0;
+
+    size_t room_len = strlen(room), id_len = strlen(id);
+    uint64_t hash = room_hash(room, room_len);
+    if (entry_size(STORE_ENTRY_PREV, room_len, id_len, len) > STORE_SEGMENT_SIZE) return 0;
+
+    pthread_mutex_lock(&store.lock);
+    struct RoomHead *head = head_get(room, room_len, hash);
+    int flags = 0;    // 표에 넣지 못했으면 표시하지 않아 읽을 때 훑어서 찾음
+    if (head != NULL && head->hash != 0) {
+        flags = STORE_ENTRY_PREV;
+    } else if (head != NULL && store.heads_complete) {
+        flags = STORE_ENTRY_FIRST;    // 표가 빠짐없으므로 표에 없는 방은 처음 쓰는 방
+    }
+    size_t size = entry_size(flags, room_len, id_len, len);
+    struct Segment *seg = store.seg_count ? store.segs[store.seg_count - 1] : NULL;
+    if (seg == NULL || seg->end + size > STORE_SEGMENT_SIZE) {    // 새 세그먼트로 넘어감
+        if (store.seg_count == STORE_MAX_SEGMENTS || (seg = segment_open(store.next_seq, 1)) == NULL) {
+            pthread_mutex_unlock(&store.lock);
+            return 0;
+        }
+        store.segs[store.seg_count++] = seg;
+    }
+
+    uint64_t seq = store.next_seq++;
+    struct StoreEntry *e = (void *)(seg->map + seg->end);
+    e->ts = now_ms();
+    e->room_len = (uint16_t)room_len;
+    e->id_len = (uint8_t)id_len;
+    e->flags = (uint8_t)flags;
+    e->len = (uint32_t)len;
+    char *p = (char *)(e + 1);
+    if (flags & STORE_ENTRY_PREV) {
+        struct StoreIndexEntry prev = { .seq = head->seq, .offset = head->offset };
+        memcpy(p, &prev, sizeof(prev));
+        p += sizeof(prev);
+    }
+    memcpy(p, room, room_len);
+    memcpy(p + room_len, id, id_len);
+    memcpy(p + room_len + id_len, text, len);
+    metric_add(MC_BYTES_COPIED, id_len + len);
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);    // 순번을 마지막에 기록하여 메시지 완성을 표시
+
+    if ((seq - seg->base) % STORE_INDEX_INTERVAL == 0 && seg->index_count < STORE_INDEX_CAP) {
+        seg->index[seg->index_count].offset = seg->end;
+        seg->index[seg->index_count].seq = seq;
+        seg->index_count++;
+    }
+    if (head != NULL) head_set(head, hash, seq, store.seg_count - 1, seg->end);
+    seg->end += size;
+    seg->last = seq;
+    pthread_mutex_unlock(&store.lock);
+    return seq;
+}
+
+// 마지막으로 저장한 메시지 순번 (없으면 0)
+uint64_t store_last_seq(void) {
+    pthread_mutex_lock(&store.lock);
+    uint64_t last = store.next_seq - 1;
+    pthread_mutex_unlock(&store.lock);
+    return last;
+}
+
+// 무중단 재시작: 새 프로세스가 저장소를 여는 동안 이 프로세스가 더 쓰지 않도록 추가를 막음
+// (막은 동안 store_append를 부르는 스레드는 기다리며, 넘기기에 실패하면 store_resume으로 풂)
+void store_pause(void) {
+    if (store.dirfd >= 0) pthread_mutex_lock(&store.lock);
+}
+
+void store_resume(void) {
+    if (store.dirfd >= 0) pthread_mutex_unlock(&store.lock);
+}
+
+// 순번 seq 이상인 메시지를 순서대로 읽어 fn에 넘김 (읽은 메시지 수 반환)
+// 세그먼트 목록과 세그먼트 색인을 이진 탐색해 시작 위치를 찾고, 그 뒤로는 mmap 영역을 순서대로 읽는다.
+int store_read_since(uint64_t seq, store_visit_fn fn, void *arg) {
+    size_t si, off = 0, last_end;
+    uint64_t cur, last;
+
+    pthread_mutex_lock(&store.lock);
+    size_t seg_count = store.seg_count;
+    last = store.next_seq - 1;
+    if (seg_count == 0 || seq > last) {
+        pthread_mutex_unlock(&store.lock);
+        return 0;
+    }
+    if (seq < store.segs[0]->base) seq = store.segs[0]->base;
+
+    // base <= seq인 마지막 세그먼트
+    size_t lo = 0, hi = seg_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (store.segs[mid]->base <= seq) lo = mid; else hi = mid;
+    }
+    si = lo;
+
+    // 세그먼트 안에서 seq <= 찾는 순번인 마지막 색인 항목
+    struct Segment *seg = store.segs[si];
+    cur = seg->base;
+    lo = 0;
+    hi = seg->index_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (seg->index[mid].seq <= seq) lo = mid + 1; else hi = mid;
+    }
+    if (lo > 0) {
+        off = seg->index[lo - 1].offset;
+        cur = seg->index[lo - 1].seq;
+    }
+    last_end = store.segs[seg_count - 1]->end;    // 읽는 도중 추가되는 메시지는 읽지 않음
+    pthread_mutex_unlock(&store.lock);
+
+    int count = 0;
+    while (cur <= last) {
+        size_t end = (si == seg_count - 1) ? last_end : seg->end;
+        size_t size;
+        if (off >= end || (size = entry_at(seg, off, cur)) == 0) {    // 다음 세그먼트로 넘어감
+            if (++si >= seg_count) break;
+            seg = store.segs[si];
+            off = 0;
+            cur = seg->base;
+            continue;
+        }
+        if (cur >= seq) {
+            struct StoreRecord rec;
+            entry_record((const void *)(seg->map + off), &rec);
+            count++;
+            if (fn(&rec, arg) != 0) break;
+        }
+        off += size;
+        cur++;
+    }
+    return count;
+}
+
+// store_read_last()에서 순번 below 앞의 마지막 메시지를 원형 배열에 모으는 데 쓰는 상태
+struct LastCollector {
+    const char *room;
+    size_t room_len;
+    uint64_t below;
+    struct StoreRecord *recs;
+    size_t n, count;
+};
+
+static int collect_last(const struct StoreRecord *rec, void *arg) {
+    struct LastCollector *c = arg;
+    if (rec->seq >= c->below) return 1;
+    if (c->room != NULL && (rec->room_len != c->room_len || memcmp(rec->room, c->room, c->room_len) != 0)) {
+        return 0;
+    }
+    c->recs[c->count++ % c->n] = *rec;
+    return 0;
+}
+
+// 마지막 메시지 n개를 오래된 것부터 fn에 넘김 (room이 NULL이 아니면 그 방의 메시지만, 넘긴 수 반환)
+// 방을 지정하면 그 방의 마지막 메시지부터 이전 메시지 위치를 따라 방의 첫 메시지까지만 읽는다.
+// 이전 메시지 위치를 붙이기 전에 쓴 메시지에 닿았을 때만 그 앞을 STORE_SCAN_MAX개 안에서 훑는다.
+int store_read_last(size_t n, const char *room, store_visit_fn fn, void *arg) {
+    if (n == 0) return 0;
+    if (n > STORE_HISTORY_MAX) n = STORE_HISTORY_MAX;
+
+    struct StoreRecord chain[STORE_HISTORY_MAX], recs[STORE_HISTORY_MAX];
+    struct StoreIndexEntry at = { 0, 0 };
+    size_t linked = 0, room_len = room ? strlen(room) : 0;
+    int scan = (room == NULL);    // 방을 지정하지 않으면 마지막 n개만 순서대로 읽음
+
+    pthread_mutex_lock(&store.lock);
+    uint64_t below = store.next_seq;
+    size_t seg_count = store.seg_count;
+    if (room != NULL && store.head_cap > 0) {
+        struct RoomHead *h = head_slot(room, room_len, room_hash(room, room_len));
+        if (h->hash != 0) {
+            at.seq = h->seq;
+            at.offset = h->offset;
+        }
+    }
+    if (room != NULL && at.seq == 0 && !store.heads_complete) scan = 1;    // 표에 없어도 메시지가 있을 수 있음
+    pthread_mutex_unlock(&store.lock);
+
+    // 새 메시지부터 거꾸로 따라감 (이미 쓴 메시지는 바뀌지 않으므로 잠그지 않고 읽음)
+    while (at.seq != 0 && linked < n) {
+        const struct StoreEntry *e = entry_find(&at, seg_count);
+        if (e == NULL) break;
+        entry_record(e, &chain[linked++]);
+        below = e->seq;
+        if (!(e->flags & STORE_ENTRY_PREV)) {
+            scan = !(e->flags & STORE_ENTRY_FIRST);    // 이전 메시지 위치를 붙이기 전에 쓴 메시지
+            break;
+        }
+        memcpy(&at, e + 1, sizeof(at));
+    }
+
+    // 모자라면 이전 메시지 위치를 붙이기 전에 쓴 메시지 앞을 훑음
+    struct LastCollector c = { .room = room, .room_len = room_len, .below = below, .recs = recs, .n = n - linked };
+    if (scan && linked < n && below > 1) {
+        uint64_t window = (room == NULL) ? n : STORE_SCAN_MAX;
+        store_read_since(below > window ? below - window : 1, collect_last, &c);
+    }
+
+    size_t got = c.count < c.n ? c.count : c.n;
+    for (size_t i = c.count - got; i < c.count; i++) {
+        if (fn(&recs[i % c.n], arg) != 0) return (int)(got + linked);
+    }
+    for (size_t i = linked; i-- > 0;) {
+        if (fn(&chain[i], arg) != 0) break;
+    }
+    return (int)(got + linked);
+}
+
+// 백그라운드 동기화 스레드: 지난번 이후 추가된 범위를 주기적으로 한꺼번에 디스크에 씀
+static void *store_sync_thread(void *arg) {
+    struct timespec period = { .tv_sec = 0, .tv_nsec = STORE_SYNC_MS * 1000000L };
+    size_t synced_seg = 0, synced_off = 0;
+    long page = sysconf(_SC_PAGESIZE);
+    (void)arg;
+
+    while (1) {
+        nanosleep(&period, NULL);
+
+        pthread_mutex_lock(&store.lock);
+        size_t seg_count = store.seg_count;
+        size_t end = seg_count ? store.segs[seg_count - 1]->end : 0;
+        pthread_mutex_unlock(&store.lock);
+        if (seg_count == 0) continue;
+
+        int new_segment = (synced_seg < seg_count - 1);
+        while (synced_seg < seg_count) {
+            struct Segment *seg = store.segs[synced_seg];
+            size_t seg_end = (synced_seg == seg_count - 1) ? end : seg->end;
+            size_t from = synced_off & ~(size_t)(page - 1);
+            if (seg_end > from) {
+                msync(seg->map + from, seg_end - from, MS_SYNC);
+                msync(seg->index, STORE_INDEX_SIZE, MS_SYNC);
+            }
+            if (synced_seg == seg_count - 1) {
+                synced_off = seg_end;
+                break;
+            }
+            synced_seg++;
+            synced_off = 0;
+        }
+        if (new_segment) {
+            fsync(store.dirfd);    // 새로 만든 세그먼트 파일의 디렉토리 항목도 기록
+        }
+    }
+    return NULL;
+}
+
+// 백그라운드 동기화 스레드 시작 (데몬화한 뒤 메시지를 저장할 프로세스에서 호출)
+int store_start(void) {
+    pthread_t thread;
+    if (store.dirfd < 0) return 0;
+
+    // 메인 루프가 signalfd로 받는 SIGCHLD를 이 스레드가 가로채지 않도록 모든 시그널을 막은 채로 만듦
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&thread, NULL, store_sync_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    log_msg(LOG_NOTICE, "메시지 저장소를 열었습니다. 세그먼트 %zu개, 마지막 순번 %llu",
+            store.seg_count, (unsigned long long)(store.next_seq - 1));
+    return 0;
+}
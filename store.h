@@ -0,0 +1,59 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STORE_SEGMENT_SIZE (16 * 1024 * 1024)   // 세그먼트 파일 하나의 크기
+#define STORE_MAX_SEGMENTS 4096     // 열 수 있는 최대 세그먼트 수
+#define STORE_INDEX_INTERVAL 64     // 희소 색인 간격 (메시지 64개마다 위치 하나를 기록)
+#define STORE_SYNC_MS 100           // 백그라운드 스레드가 디스크에 모아서 쓰는 주기
+#define STORE_HISTORY_MAX 200       // /history로 한 번에 받을 수 있는 최대 메시지 수
+#define STORE_SCAN_MAX 65536        // 이전 메시지 위치를 붙이기 전에 쓴 메시지에 닿으면 메시지를 이만큼까지만 거슬러 훑음
+
+#define STORE_ENTRY_PREV 0x01    // 헤더 바로 뒤에 같은 방의 이전 메시지 위치(struct StoreIndexEntry)가 있음
+#define STORE_ENTRY_FIRST 0x02   // 그 방의 첫 메시지 (이전 메시지가 없음)
+
+// 세그먼트 파일에 저장되는 메시지 헤더 (뒤에 방 이름, 아이디, 내용이 이어지고 8바이트 단위로 정렬)
+// seq는 마지막에 기록하므로 0이거나 기대한 순번이 아니면 거기가 로그의 끝이다.
+struct StoreEntry {
+    uint64_t seq;           // 메시지 순번 (1부터 시작, 세그먼트를 넘어 이어짐)
+    int64_t ts;             // 저장 시각 (밀리초 단위 UNIX 시간)
+    uint16_t room_len;      // 방 이름 길이
+    uint8_t id_len;         // 보낸 사람 아이디 길이
+    uint8_t flags;          // STORE_ENTRY_PREV 또는 STORE_ENTRY_FIRST (둘 다 없던 때 쓴 메시지는 0)
+    uint32_t len;           // 메시지 내용 길이
+};
+
+// 세그먼트별 희소 색인 항목 (색인 파일에 순서대로 기록, 같은 방의 이전 메시지 위치로도 씀)
+struct StoreIndexEntry {
+    uint64_t seq;           // 메시지 순번
+    uint64_t offset;        // 세그먼트 파일 안의 위치
+};
+
+// 읽기 함수가 콜백에 넘기는 메시지 (문자열은 세그먼트 mmap 영역을 가리키며 null 종료되지 않음)
+struct StoreRecord {
+    uint64_t seq;
+    int64_t ts;
+    const char *room;
+    size_t room_len;
+    const char *id;
+    size_t id_len;
+    const char *text;
+    size_t len;
+};
+
+// 읽은 메시지마다 호출되는 콜백 (0이 아닌 값을 반환하면 읽기를 멈춤)
+typedef int (*store_visit_fn)(const struct StoreRecord *rec, void *arg);
+
+int store_open(const char *dir);
+int store_start(void);
+int store_enabled(void);
+uint64_t store_append(const char *room, const char *id, const char *text, size_t len);
+uint64_t store_last_seq(void);
+void store_pause(void);
+void store_resume(void);
+int store_read_since(uint64_t seq, store_visit_fn fn, void *arg);
+int store_read_last(size_t n, const char *room, store_visit_fn fn, void *arg);
+
+#endif
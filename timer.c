@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+
+void timer_wheel_init(struct TimerWheel *w, uint64_t now_ms) {
+    memset(w, 0, sizeof(*w));
+    w->tick = now_ms / TIMER_TICK_MS;
+}
+
+void timer_wheel_destroy(struct TimerWheel *w) {
+    for (size_t i = 0; i < TIMER_SLOTS; i++) {
+        free(w->slots[i].entries);
+    }
+    memset(w, 0, sizeof(*w));
+}
+
+// 기한이 속한 칸에 핸들을 넣음 (이미 지난 기한은 다음 칸에서 바로 만료됨)
+int timer_add(struct TimerWheel *w, ConnHandle h, uint64_t deadline_ms) {
+    uint64_t tick = deadline_ms / TIMER_TICK_MS;
+    if (tick <= w->tick) tick = w->tick + 1;
+    struct TimerSlot *s = &w->slots[tick & (TIMER_SLOTS - 1)];
+
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 16;
+        struct TimerEntry *p = realloc(s->entries, cap * sizeof(struct TimerEntry));
+        if (p == NULL) return -1;
+        s->entries = p;
+        s->cap = cap;
+    }
+    s->entries[s->count].handle = h;
+    s->entries[s->count].deadline = deadline_ms;
+    s->count++;
+    w->count++;
+    return 0;
+}
+
+// now_ms까지 지나간 칸을 차례로 훑으며 기한이 된 항목마다 fn 호출
+// 한 바퀴보다 먼 기한은 같은 칸에 남겨 두었다가 다음 바퀴에 처리한다.
+void timer_expire(struct TimerWheel *w, uint64_t now_ms, timer_fn fn, void *arg) {
+    uint64_t target = now_ms / TIMER_TICK_MS;
+    if (target - w->tick > TIMER_SLOTS) {    // 오래 멈춰 있었으면 모든 칸을 한 번씩만 훑음
+        w->tick = target - TIMER_SLOTS;
+    }
+    while (w->tick < target) {
+        w->tick++;
+        struct TimerSlot *s = &w->slots[w->tick & (TIMER_SLOTS - 1)];
+        for (size_t i = s->count; i-- > 0;) {
+            if (s->entries[i].deadline / TIMER_TICK_MS > w->tick) continue;
+            ConnHandle h = s->entries[i].handle;
+            s->entries[i] = s->entries[--s->count];    // 마지막 항목을 빈 자리로 옮김
+            w->count--;
+            fn(h, arg);
+        }
+    }
+}
+
+// 다음 칸을 처리할 때까지 남은 시간 (poll/epoll_wait 타임아웃, 등록된 항목이 없으면 -1)
+int timer_timeout(const struct TimerWheel *w, uint64_t now_ms) {
+    if (w->count == 0) return -1;
+    uint64_t next = (w->tick + 1) * TIMER_TICK_MS;
+    return next > now_ms ? (int)(next - now_ms) : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "conn.h"
+
+#define TIMER_SLOTS 512         // 바퀴 칸 수 (2의 거듭제곱)
+#define TIMER_TICK_MS 100       // 칸 하나가 나타내는 시간 (한 바퀴는 51.2초, 그보다 먼 기한은 다음 바퀴에 처리)
+
+// 기한이 정해진 연결 하나
+struct TimerEntry {
+    ConnHandle handle;
+    uint64_t deadline;      // 만료 시각 (밀리초, CLOCK_MONOTONIC)
+};
+
+struct TimerSlot {
+    struct TimerEntry *entries;
+    size_t count;
+    size_t cap;
+};
+
+// 연결 핸들 기반의 타이머 휠 (스레드 하나가 소유)
+// 기한이 속한 칸에 핸들을 넣어 두고, 시간이 지나간 칸만 훑으므로 등록과 만료 처리가 연결 수와 관계없이 O(1)이다.
+// 취소 함수는 없다. 기한 전에 상태가 바뀐 연결(로그인 완료, 종료)은 만료 콜백에서 걸러낸다.
+struct TimerWheel {
+    struct TimerSlot slots[TIMER_SLOTS];
+    uint64_t tick;          // 마지막으로 처리한 칸의 시각 (밀리초 / TIMER_TICK_MS)
+    size_t count;           // 등록된 전체 항목 수
+};
+
+typedef void (*timer_fn)(ConnHandle h, void *arg);
+
+void timer_wheel_init(struct TimerWheel *w, uint64_t now_ms);
+void timer_wheel_destroy(struct TimerWheel *w);
+int timer_add(struct TimerWheel *w, ConnHandle h, uint64_t deadline_ms);
+void timer_expire(struct TimerWheel *w, uint64_t now_ms, timer_fn fn, void *arg);
+int timer_timeout(const struct TimerWheel *w, uint64_t now_ms);
+
+// 두 타임아웃 중 먼저 끝나는 쪽 (-1은 기다릴 일이 없음)
+static inline int timer_min_timeout(int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return a < b ? a : b;
+}
+
+#endif
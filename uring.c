@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+#include "uring.h"
+
+// multishot recv와 제공 버퍼 링이 모두 들어간 커널(6.0 이상)인지 확인
+// 이 기능들은 IORING_REGISTER_PROBE로 알 수 없으므로 커널 버전으로 판단한다.
+static int uring_kernel_ok(void) {
+    struct utsname u;
+    int major = 0, minor = 0;
+    if (uname(&u) < 0 || sscanf(u.release, "%d.%d", &major, &minor) != 2) return 0;
+    return major >= 6;
+}
+
+// 수신 제공 버퍼 링을 만들어 커널에 등록하고 모든 버퍼를 넣어 둠
+static int uring_setup_bufs(struct Uring *u) {
+    size_t ring_len = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) {
+        u->br = NULL;
+        return -1;
+    }
+    u->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (u->bufs == NULL) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+
+    u->br_tail = 0;
+    for (unsigned i = 0; i < URING_BUF_COUNT; i++) {
+        uring_buf_recycle(u, i);
+    }
+    return 0;
+}
+
+// io_uring 인스턴스를 만들고 제출/완료 큐를 mmap (커널이 지원하지 않으면 -1)
+int uring_init(struct Uring *u) {
+    struct io_uring_params p;
+
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+    if (!uring_kernel_ok()) return -1;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_ENTRIES * 4;    // 브로드캐스트 한 번에 송신 완료가 몰려도 넘치지 않도록
+    u->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (u->fd < 0) return -1;    // 커널에 io_uring이 없거나 꺼져 있음 (ENOSYS, EPERM)
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG) ||
+        !(p.features & IORING_FEAT_NODROP)) {
+        goto fail;
+    }
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (u->cq_map_len > u->sq_map_len) u->sq_map_len = u->cq_map_len;
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) goto fail;
+    u->cq_map = u->sq_map;    // IORING_FEAT_SINGLE_MMAP: 두 큐가 한 영역에 있음
+
+    char *sq = u->sq_map, *cq = u->cq_map;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+    for (unsigned i = 0; i < p.sq_entries; i++) {    // 제출 큐 칸 i는 항상 sqes[i]를 가리킴
+        u->sq_array[i] = i;
+    }
+    u->sqe_head = u->sqe_tail = *u->sq_tail;
+
+    if (uring_setup_bufs(u) < 0) goto fail;    // 제공 버퍼 링이 없는 커널 (5.19 미만)
+    return 0;
+
+fail:
+    if (u->sq_map != NULL && u->sq_map != MAP_FAILED) munmap(u->sq_map, u->sq_map_len);
+    if (u->sqes != NULL && u->sqes != MAP_FAILED) munmap(u->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+    if (u->br != NULL) munmap(u->br, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    free(u->bufs);
+    close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+    return -1;
+}
+
+// 빈 제출 칸을 0으로 채워 반환 (가득 차 있으면 지금까지 채운 것을 먼저 제출)
+struct io_uring_sqe *uring_get_sqe(struct Uring *u) {
+    if (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+        uring_submit_wait(u, 0);
+        if (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) return NULL;
+    }
+    struct io_uring_sqe *sqe = &u->sqes[u->sqe_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqe_tail++;
+    return sqe;
+}
+
+// 채운 제출 항목을 한 번의 io_uring_enter로 모두 제출하고 완료 항목을 기다림
+// timeout_ms가 -1이면 하나 이상 끝날 때까지, 0이면 기다리지 않고 바로 돌아온다.
+int uring_submit_wait(struct Uring *u, int timeout_ms) {
+    unsigned submit = u->sqe_tail - u->sqe_head;
+    if (submit == 0 && timeout_ms == 0) return 0;
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms > 0) arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    unsigned flags = (timeout_ms != 0) ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+    int ret = (int)syscall(__NR_io_uring_enter, u->fd, submit, timeout_ms != 0 ? 1 : 0, flags,
+                           flags ? (void *)&arg : NULL, flags ? sizeof(arg) : 0);
+    if (ret >= 0) {
+        u->sqe_head += (unsigned)ret;
+    } else if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+        ret = 0;    // 시간 초과, 시그널, 완료 큐가 넘쳐 먼저 비워야 하는 경우는 오류가 아님
+    }
+    return ret;
+}
+
+// 다 쓴 수신 버퍼를 제공 버퍼 링에 돌려줌
+void uring_buf_recycle(struct Uring *u, unsigned bid) {
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+    b->addr = (uint64_t)(uintptr_t)uring_buf(u, bid);
+    b->len = URING_BUF_SIZE;
+    b->bid = (unsigned short)bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,59 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 4096      // 제출 큐 칸 수 (완료 큐는 네 배)
+#define URING_BUF_COUNT 1024    // 수신용으로 커널에 제공하는 버퍼 수 (2의 거듭제곱)
+#define URING_BUF_SIZE 4096     // 수신 버퍼 하나의 크기
+#define URING_BUF_GROUP 0       // 제공 버퍼 그룹 번호
+
+// liburing 없이 시스템 콜로 직접 다루는 io_uring 인스턴스 (스레드 하나가 소유)
+// 제출 큐와 완료 큐는 커널과 공유하는 mmap 영역이며, 수신은 커널이 제공 버퍼 링에서
+// 버퍼를 골라 채우는 방식(multishot recv)으로 연결마다 버퍼를 잡아 두지 않는다.
+struct Uring {
+    int fd;
+    // 제출 큐
+    unsigned *sq_head, *sq_tail, *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;      // 채웠지만 아직 커널에 알리지 않은 위치
+    unsigned sqe_head;      // 커널에 알린 위치
+    struct io_uring_sqe *sqes;
+    // 완료 큐
+    unsigned *cq_head, *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    // 수신 제공 버퍼 링
+    struct io_uring_buf_ring *br;
+    char *bufs;             // URING_BUF_COUNT * URING_BUF_SIZE 바이트
+    unsigned short br_tail; // 다음에 돌려줄 버퍼를 쓸 위치
+    // 해제용
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len;
+};
+
+int uring_init(struct Uring *u);
+struct io_uring_sqe *uring_get_sqe(struct Uring *u);
+int uring_submit_wait(struct Uring *u, int timeout_ms);
+void uring_buf_recycle(struct Uring *u, unsigned bid);
+
+// 다음 완료 항목 (없으면 NULL, 처리한 뒤 uring_cqe_seen 호출)
+static inline struct io_uring_cqe *uring_peek_cqe(struct Uring *u) {
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &u->cqes[head & u->cq_mask];
+}
+
+static inline void uring_cqe_seen(struct Uring *u) {
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// 제공 버퍼 번호의 데이터 위치
+static inline char *uring_buf(struct Uring *u, unsigned bid) {
+    return u->bufs + (size_t)bid * URING_BUF_SIZE;
+}
+
+#endif